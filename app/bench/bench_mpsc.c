@@ -0,0 +1,204 @@
+// Measure the cost of pushing control messages from several threads to the
+// controller thread, with the lock-free MPSC queue (and its waiter) compared
+// to the legacy queue (a circular buffer protected by a mutex, with a
+// condition variable signaled when it becomes non-empty).
+//
+// Each producer pushes its messages as fast as possible, like a burst of
+// mouse motion events or a remote script. The push latency includes the
+// retries while the queue is full.
+//
+// usage: bench_mpsc [producers [messages_per_producer]]
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <SDL2/SDL.h>
+
+#include "common.h"
+#include "control_msg.h"
+#include "util/cbuf.h"
+#include "util/histogram.h"
+#include "util/mpsc.h"
+
+#define MAX_PRODUCERS 16
+
+struct mpsc_msg_queue MPSC(struct control_msg, 64);
+struct cbuf_msg_queue CBUF(struct control_msg, 64);
+
+struct bench {
+    int producers;
+    int messages; // per producer
+    bool legacy;
+
+    struct mpsc_msg_queue mpsc;
+    struct mpsc_waiter waiter;
+
+    struct cbuf_msg_queue cbuf;
+    SDL_mutex *mutex;
+    SDL_cond *cond;
+
+    struct histogram push_latency[MAX_PRODUCERS];
+};
+
+struct producer {
+    struct bench *bench;
+    int id;
+};
+
+static bool
+push_legacy(struct bench *bench, const struct control_msg *msg) {
+    SDL_LockMutex(bench->mutex);
+    bool was_empty = cbuf_is_empty(&bench->cbuf);
+    bool ok = cbuf_push(&bench->cbuf, *msg);
+    if (was_empty) {
+        SDL_CondSignal(bench->cond);
+    }
+    SDL_UnlockMutex(bench->mutex);
+    return ok;
+}
+
+static bool
+push_mpsc(struct bench *bench, const struct control_msg *msg) {
+    bool ok = mpsc_push(&bench->mpsc, *msg);
+    if (ok) {
+        mpsc_waiter_notify(&bench->waiter);
+    }
+    return ok;
+}
+
+static int
+run_producer(void *data) {
+    struct producer *producer = data;
+    struct bench *bench = producer->bench;
+    struct histogram *latency = &bench->push_latency[producer->id];
+    uint64_t freq = SDL_GetPerformanceFrequency();
+
+    struct control_msg msg = {
+        .type = CONTROL_MSG_TYPE_INJECT_TOUCH_EVENT,
+    };
+    for (int i = 0; i < bench->messages; ++i) {
+        msg.inject_touch_event.position.point.x = i;
+        uint64_t start = SDL_GetPerformanceCounter();
+        while (bench->legacy ? !push_legacy(bench, &msg)
+                             : !push_mpsc(bench, &msg)) {
+            // full, let the consumer run
+            SDL_Delay(0);
+        }
+        uint64_t ns = (SDL_GetPerformanceCounter() - start) * 1000000000
+                    / freq;
+        histogram_record(latency, ns > UINT32_MAX ? UINT32_MAX : ns);
+    }
+    return 0;
+}
+
+static void
+take_legacy(struct bench *bench, struct control_msg *msg) {
+    SDL_LockMutex(bench->mutex);
+    while (cbuf_is_empty(&bench->cbuf)) {
+        SDL_CondWait(bench->cond, bench->mutex);
+    }
+    bool ok = cbuf_take(&bench->cbuf, msg);
+    assert(ok);
+    (void) ok;
+    SDL_UnlockMutex(bench->mutex);
+}
+
+static void
+take_mpsc(struct bench *bench, struct control_msg *msg) {
+    while (!mpsc_take(&bench->mpsc, msg)) {
+        mpsc_waiter_prepare(&bench->waiter);
+        if (!mpsc_is_empty(&bench->mpsc)) {
+            mpsc_waiter_cancel(&bench->waiter);
+        } else {
+            mpsc_waiter_wait(&bench->waiter);
+        }
+    }
+}
+
+static void
+run(struct bench *bench, bool legacy) {
+    bench->legacy = legacy;
+    mpsc_init(&bench->mpsc);
+    cbuf_init(&bench->cbuf);
+    for (int i = 0; i < bench->producers; ++i) {
+        histogram_init(&bench->push_latency[i]);
+    }
+
+    struct producer producers[MAX_PRODUCERS];
+    SDL_Thread *threads[MAX_PRODUCERS];
+    uint64_t start = SDL_GetPerformanceCounter();
+    for (int i = 0; i < bench->producers; ++i) {
+        producers[i].bench = bench;
+        producers[i].id = i;
+        threads[i] = SDL_CreateThread(run_producer, "producer",
+                                      &producers[i]);
+        assert(threads[i]);
+    }
+
+    int total = bench->producers * bench->messages;
+    for (int i = 0; i < total; ++i) {
+        struct control_msg msg;
+        if (legacy) {
+            take_legacy(bench, &msg);
+        } else {
+            take_mpsc(bench, &msg);
+        }
+    }
+    double sec = (double) (SDL_GetPerformanceCounter() - start)
+               / SDL_GetPerformanceFrequency();
+
+    for (int i = 0; i < bench->producers; ++i) {
+        SDL_WaitThread(threads[i], NULL);
+    }
+
+    // the percentiles of the worst producer
+    uint32_t p50 = 0;
+    uint32_t p99 = 0;
+    uint32_t max = 0;
+    for (int i = 0; i < bench->producers; ++i) {
+        const struct histogram *latency = &bench->push_latency[i];
+        p50 = MAX(p50, histogram_percentile(latency, 50));
+        p99 = MAX(p99, histogram_percentile(latency, 99));
+        max = MAX(max, latency->max);
+    }
+
+    printf("%-6s %d producers: %.2f M msgs/s, push latency (ns, "
+           "p50/p99/max): %u/%u/%u\n", legacy ? "legacy" : "mpsc",
+           bench->producers, total / sec / 1e6, p50, p99, max);
+}
+
+int
+main(int argc, char *argv[]) {
+    struct bench bench = {
+        .producers = 4,
+        .messages = 1000000,
+    };
+    if (argc > 1) {
+        bench.producers = atoi(argv[1]);
+    }
+    if (argc > 2) {
+        bench.messages = atoi(argv[2]);
+    }
+    if (bench.producers <= 0 || bench.producers > MAX_PRODUCERS
+            || bench.messages <= 0) {
+        fprintf(stderr, "Invalid arguments\n");
+        return 1;
+    }
+
+    SDL_SetMainReady();
+
+    bench.mutex = SDL_CreateMutex();
+    bench.cond = SDL_CreateCond();
+    if (!bench.mutex || !bench.cond || !mpsc_waiter_init(&bench.waiter)) {
+        fprintf(stderr, "Could not create synchronization primitives\n");
+        return 1;
+    }
+
+    run(&bench, true);
+    run(&bench, false);
+
+    mpsc_waiter_destroy(&bench.waiter);
+    SDL_DestroyCond(bench.cond);
+    SDL_DestroyMutex(bench.mutex);
+    return 0;
+}
@@ -0,0 +1,150 @@
+// Measure the round-trip time of small control messages over a loopback TCP
+// connection, with and without TCP_NODELAY (and TCP_QUICKACK, where
+// available).
+//
+// Each message is written in two send() calls (the header, then the payload),
+// and the peer replies by a single byte once it has received the whole
+// message, like a device acknowledging an injected event. Without
+// TCP_NODELAY, Nagle's algorithm holds the payload until the header is
+// acknowledged, and the peer delays its ACK.
+//
+// usage: bench_net_latency [messages [port]]
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <SDL2/SDL.h>
+
+#include "util/histogram.h"
+#include "util/net.h"
+
+#define IPV4_LOCALHOST 0x7F000001
+#define HEADER_SIZE 1
+#define PAYLOAD_SIZE 27 // an inject touch event
+
+struct bench {
+    int messages;
+    uint16_t port;
+    socket_t server_socket;
+    const struct net_socket_options *options;
+};
+
+static int
+run_echo(void *data) {
+    struct bench *bench = data;
+    socket_t socket = net_accept(bench->server_socket);
+    if (socket == INVALID_SOCKET) {
+        fprintf(stderr, "Could not accept connection\n");
+        return 1;
+    }
+    net_set_options(socket, bench->options);
+
+    uint8_t msg[HEADER_SIZE + PAYLOAD_SIZE];
+    for (;;) {
+        ssize_t r = net_recv_all(socket, msg, sizeof(msg));
+        if (r < (ssize_t) sizeof(msg)) {
+            break;
+        }
+        uint8_t ack = msg[0];
+        if (net_send_all(socket, &ack, 1) != 1) {
+            break;
+        }
+    }
+    net_close(socket);
+    return 0;
+}
+
+static void
+run(struct bench *bench, const char *name,
+    const struct net_socket_options *options) {
+    bench->options = options;
+    SDL_Thread *echo = SDL_CreateThread(run_echo, "echo", bench);
+    assert(echo);
+
+    socket_t socket = net_connect(IPV4_LOCALHOST, bench->port, 0);
+    assert(socket != INVALID_SOCKET);
+    net_set_options(socket, options);
+
+    struct histogram rtt;
+    histogram_init(&rtt);
+
+    uint8_t payload[PAYLOAD_SIZE];
+    memset(payload, 0, sizeof(payload));
+    uint64_t freq = SDL_GetPerformanceFrequency();
+    uint64_t start = SDL_GetPerformanceCounter();
+    for (int i = 0; i < bench->messages; ++i) {
+        uint8_t header = i & 0xff;
+        uint64_t t = SDL_GetPerformanceCounter();
+        ssize_t w = net_send_all(socket, &header, HEADER_SIZE);
+        assert(w == HEADER_SIZE);
+        w = net_send_all(socket, payload, PAYLOAD_SIZE);
+        assert(w == PAYLOAD_SIZE);
+        (void) w;
+
+        uint8_t ack;
+        ssize_t r = net_recv_all(socket, &ack, 1);
+        assert(r == 1);
+        assert(ack == header);
+        (void) r;
+        uint64_t us = (SDL_GetPerformanceCounter() - t) * 1000000 / freq;
+        histogram_record(&rtt, us > UINT32_MAX ? UINT32_MAX : us);
+    }
+    double sec = (double) (SDL_GetPerformanceCounter() - start) / freq;
+
+    net_shutdown(socket, SHUT_RDWR);
+    net_close(socket);
+    SDL_WaitThread(echo, NULL);
+
+    printf("%-16s %d msgs: %.0f msgs/s, rtt (us, p50/p99/max): %u/%u/%u\n",
+           name, bench->messages, bench->messages / sec,
+           histogram_percentile(&rtt, 50), histogram_percentile(&rtt, 99),
+           rtt.max);
+}
+
+int
+main(int argc, char *argv[]) {
+    struct bench bench = {
+        .messages = 200,
+        .port = 27198,
+    };
+    if (argc > 1) {
+        bench.messages = atoi(argv[1]);
+    }
+    if (argc > 2) {
+        bench.port = atoi(argv[2]);
+    }
+    if (bench.messages <= 0) {
+        fprintf(stderr, "Invalid arguments\n");
+        return 1;
+    }
+
+    SDL_SetMainReady();
+    if (!net_init()) {
+        return 1;
+    }
+
+    bench.server_socket = net_listen(IPV4_LOCALHOST, bench.port, 1, 0);
+    if (bench.server_socket == INVALID_SOCKET) {
+        fprintf(stderr, "Could not listen on port %d\n", bench.port);
+        return 1;
+    }
+
+    // the default number of messages is low, each one may wait for a delayed
+    // ACK (up to 40 ms on Linux, 200 ms elsewhere) without TCP_NODELAY
+    struct net_socket_options nagle = {0};
+    struct net_socket_options nodelay = {
+        .nodelay = true,
+    };
+    struct net_socket_options nodelay_quickack = {
+        .nodelay = true,
+        .quickack = true,
+    };
+    run(&bench, "nagle", &nagle);
+    run(&bench, "nodelay", &nodelay);
+    run(&bench, "nodelay+quickack", &nodelay_quickack);
+
+    net_close(bench.server_socket);
+    net_cleanup();
+    return 0;
+}
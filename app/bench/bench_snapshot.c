@@ -0,0 +1,242 @@
+// Measure the render loop frame time (from the frame being offered by the
+// decoder to the texture being presented), with the legacy per-frame PPM dump
+// and with the asynchronous snapshot service.
+//
+// The rendering uses the SDL software renderer on an offscreen surface, so
+// that it can run without a display.
+//
+// usage: bench_snapshot [frames [width height [snapshot_interval]]]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libswscale/swscale.h>
+#include <SDL2/SDL.h>
+
+#include "fps_counter.h"
+#include "snapshot.h"
+#include "video_buffer.h"
+
+struct bench {
+    int frames;
+    int width;
+    int height;
+    int snapshot_interval;
+
+    SDL_Surface *surface;
+    SDL_Renderer *renderer;
+    SDL_Texture *texture;
+    AVFrame *source;
+    struct fps_counter fps_counter;
+    struct video_buffer vb;
+    struct snapshot snapshot;
+
+    uint64_t *samples; // in performance counter ticks
+};
+
+static int
+compare_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *) a;
+    uint64_t y = *(const uint64_t *) b;
+    return (x > y) - (x < y);
+}
+
+// what screen_saveframe() used to do for every frame
+static void
+legacy_saveframe(const AVFrame *frame) {
+    AVCodec *codec = avcodec_find_decoder(AV_CODEC_ID_H264);
+    AVCodecContext *codec_ctx = avcodec_alloc_context3(codec);
+    codec_ctx->width = frame->width;
+    codec_ctx->height = frame->height;
+    codec_ctx->pix_fmt = AV_PIX_FMT_YUV420P;
+    if (avcodec_open2(codec_ctx, codec, NULL) < 0) {
+        avcodec_free_context(&codec_ctx);
+        return;
+    }
+
+    AVFrame *rgb = av_frame_alloc();
+    rgb->format = AV_PIX_FMT_RGB24;
+    rgb->width = frame->width;
+    rgb->height = frame->height;
+    av_frame_get_buffer(rgb, 1);
+
+    struct SwsContext *sws_ctx =
+        sws_getContext(frame->width, frame->height, frame->format,
+                       frame->width, frame->height, AV_PIX_FMT_RGB24,
+                       SWS_BILINEAR, NULL, NULL, NULL);
+    sws_scale(sws_ctx, (const uint8_t *const *) frame->data, frame->linesize,
+              0, frame->height, rgb->data, rgb->linesize);
+
+    FILE *file = fopen("bench_legacy.ppm", "wb");
+    if (file) {
+        fprintf(file, "P6\n%d %d\n255\n", frame->width, frame->height);
+        for (int y = 0; y < frame->height; ++y) {
+            fwrite(rgb->data[0] + y * rgb->linesize[0], 1, frame->width * 3,
+                   file);
+        }
+        fclose(file);
+    }
+
+    sws_freeContext(sws_ctx);
+    av_frame_free(&rgb);
+    avcodec_free_context(&codec_ctx);
+}
+
+static AVFrame *
+create_source_frame(int width, int height) {
+    AVFrame *frame = av_frame_alloc();
+    if (!frame) {
+        return NULL;
+    }
+    frame->format = AV_PIX_FMT_YUV420P;
+    frame->width = width;
+    frame->height = height;
+    if (av_frame_get_buffer(frame, 32)) {
+        av_frame_free(&frame);
+        return NULL;
+    }
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            frame->data[0][y * frame->linesize[0] + x] = (x + y) & 0xff;
+        }
+    }
+    for (int p = 1; p < 3; ++p) {
+        for (int y = 0; y < height / 2; ++y) {
+            memset(frame->data[p] + y * frame->linesize[p], 64 * p, width / 2);
+        }
+    }
+    return frame;
+}
+
+static void
+render_frame(struct bench *bench, bool legacy) {
+    // what the decoder does
+    av_frame_unref(bench->vb.decoding_frame);
+    av_frame_ref(bench->vb.decoding_frame, bench->source);
+    bool skipped;
+    video_buffer_offer_decoded_frame(&bench->vb, &skipped);
+
+    // what screen_update_frame() does
+    const AVFrame *frame = video_buffer_take_rendering_frame(&bench->vb);
+    SDL_UpdateYUVTexture(bench->texture, NULL,
+                         frame->data[0], frame->linesize[0],
+                         frame->data[1], frame->linesize[1],
+                         frame->data[2], frame->linesize[2]);
+    if (legacy) {
+        legacy_saveframe(frame);
+    }
+    video_buffer_release_rendered_frame(&bench->vb);
+
+    SDL_RenderClear(bench->renderer);
+    SDL_RenderCopy(bench->renderer, bench->texture, NULL, NULL);
+    SDL_RenderPresent(bench->renderer);
+}
+
+static void
+run(struct bench *bench, bool legacy) {
+    uint64_t freq = SDL_GetPerformanceFrequency();
+
+    for (int i = 0; i < bench->frames; ++i) {
+        uint64_t start = SDL_GetPerformanceCounter();
+        render_frame(bench, legacy);
+        if (!legacy && bench->snapshot_interval
+                && i % bench->snapshot_interval == 0) {
+            // the request is issued from the event loop, like the shortcut
+            snapshot_request(&bench->snapshot);
+        }
+        bench->samples[i] = SDL_GetPerformanceCounter() - start;
+    }
+
+    qsort(bench->samples, bench->frames, sizeof(*bench->samples), compare_u64);
+    uint64_t total = 0;
+    for (int i = 0; i < bench->frames; ++i) {
+        total += bench->samples[i];
+    }
+
+#define TO_MS(T) ((double) (T) * 1000 / freq)
+    printf("%-9s %dx%d, %d frames: mean %.3f ms, p50 %.3f ms, "
+           "p99 %.3f ms, max %.3f ms\n",
+           legacy ? "legacy" : "snapshot", bench->width, bench->height,
+           bench->frames, TO_MS(total) / bench->frames,
+           TO_MS(bench->samples[bench->frames / 2]),
+           TO_MS(bench->samples[bench->frames * 99 / 100]),
+           TO_MS(bench->samples[bench->frames - 1]));
+#undef TO_MS
+}
+
+int
+main(int argc, char *argv[]) {
+    struct bench bench = {
+        .frames = 300,
+        .width = 1920,
+        .height = 1080,
+        .snapshot_interval = 60,
+    };
+    if (argc > 1) {
+        bench.frames = atoi(argv[1]);
+    }
+    if (argc > 3) {
+        bench.width = atoi(argv[2]);
+        bench.height = atoi(argv[3]);
+    }
+    if (argc > 4) {
+        bench.snapshot_interval = atoi(argv[4]);
+    }
+    if (bench.frames <= 0 || bench.width <= 0 || bench.height <= 0) {
+        fprintf(stderr, "Invalid arguments\n");
+        return 1;
+    }
+
+    SDL_SetMainReady();
+    if (SDL_Init(0)) {
+        fprintf(stderr, "Could not initialize SDL: %s\n", SDL_GetError());
+        return 1;
+    }
+
+    bench.samples = malloc(bench.frames * sizeof(*bench.samples));
+    bench.surface = SDL_CreateRGBSurfaceWithFormat(0, bench.width,
+                                                   bench.height, 32,
+                                                   SDL_PIXELFORMAT_RGB888);
+    if (!bench.samples || !bench.surface) {
+        fprintf(stderr, "Could not allocate render target\n");
+        return 1;
+    }
+    bench.renderer = SDL_CreateSoftwareRenderer(bench.surface);
+    bench.texture = SDL_CreateTexture(bench.renderer, SDL_PIXELFORMAT_YV12,
+                                      SDL_TEXTUREACCESS_STREAMING,
+                                      bench.width, bench.height);
+    bench.source = create_source_frame(bench.width, bench.height);
+    if (!bench.renderer || !bench.texture || !bench.source) {
+        fprintf(stderr, "Could not initialize rendering\n");
+        return 1;
+    }
+
+    struct snapshot_params snapshot_params = {
+        .path_template = "bench_snapshot.ppm",
+        .format = SNAPSHOT_FORMAT_PPM,
+    };
+    if (!fps_counter_init(&bench.fps_counter, NULL)
+            || !video_buffer_init(&bench.vb, &bench.fps_counter, false, 1)
+            || !snapshot_init(&bench.snapshot, &bench.vb, &snapshot_params)) {
+        fprintf(stderr, "Could not initialize video buffer\n");
+        return 1;
+    }
+
+    run(&bench, true);
+    run(&bench, false);
+
+    snapshot_stop(&bench.snapshot);
+    snapshot_join(&bench.snapshot);
+    snapshot_destroy(&bench.snapshot);
+    video_buffer_destroy(&bench.vb);
+    fps_counter_destroy(&bench.fps_counter);
+    av_frame_free(&bench.source);
+    SDL_DestroyTexture(bench.texture);
+    SDL_DestroyRenderer(bench.renderer);
+    SDL_FreeSurface(bench.surface);
+    free(bench.samples);
+    SDL_Quit();
+    return 0;
+}
@@ -0,0 +1,195 @@
+// Measure the number of recv() calls per frame and the throughput of the
+// video stream framing reader, compared to the legacy reader (two blocking
+// net_recv_all() calls per packet), over a loopback TCP connection.
+//
+// The frames sizes follow a typical screen recording pattern: small P-frames
+// and a large I-frame every 60 frames.
+//
+// usage: bench_stream_reader [frames [port]]
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <libavcodec/avcodec.h>
+#include <SDL2/SDL.h>
+
+#include "packet_pool.h"
+#include "stream_reader.h"
+#include "util/buffer_util.h"
+#include "util/net.h"
+
+#define IPV4_LOCALHOST 0x7F000001
+#define HEADER_SIZE 12
+
+struct bench {
+    int frames;
+    uint16_t port;
+    socket_t server_socket;
+    uint8_t *data; // the whole stream, sent at once
+    size_t data_len;
+};
+
+static uint32_t
+frame_size(int i, uint32_t *seed) {
+    if (i % 60 == 0) {
+        return 150000;
+    }
+    *seed = *seed * 1103515245 + 12345;
+    return 3000 + (*seed >> 16) % 9000;
+}
+
+static bool
+generate_stream(struct bench *bench) {
+    uint32_t seed = 42;
+    size_t len = 0;
+    for (int i = 0; i < bench->frames; ++i) {
+        len += HEADER_SIZE + frame_size(i, &seed);
+    }
+
+    bench->data = malloc(len);
+    if (!bench->data) {
+        return false;
+    }
+
+    seed = 42;
+    uint8_t *p = bench->data;
+    for (int i = 0; i < bench->frames; ++i) {
+        uint32_t size = frame_size(i, &seed);
+        buffer_write64be(p, i * UINT64_C(16666));
+        buffer_write32be(&p[8], size);
+        memset(&p[HEADER_SIZE], i & 0xff, size);
+        p += HEADER_SIZE + size;
+    }
+    bench->data_len = len;
+    return true;
+}
+
+static int
+run_sender(void *data) {
+    struct bench *bench = data;
+    socket_t socket = net_accept(bench->server_socket);
+    if (socket == INVALID_SOCKET) {
+        fprintf(stderr, "Could not accept connection\n");
+        return 1;
+    }
+    net_send_all(socket, bench->data, bench->data_len);
+    net_shutdown(socket, SHUT_RDWR);
+    net_close(socket);
+    return 0;
+}
+
+static bool
+read_legacy(socket_t socket, AVPacket *packet, uint64_t *recv_calls) {
+    uint8_t header[HEADER_SIZE];
+    ++*recv_calls;
+    if (net_recv_all(socket, header, HEADER_SIZE) < HEADER_SIZE) {
+        return false;
+    }
+
+    uint32_t len = buffer_read32be(&header[8]);
+    if (av_new_packet(packet, len)) {
+        return false;
+    }
+
+    ++*recv_calls;
+    ssize_t r = net_recv_all(socket, packet->data, len);
+    if (r < 0 || ((uint32_t) r) < len) {
+        av_packet_unref(packet);
+        return false;
+    }
+    return true;
+}
+
+static void
+run(struct bench *bench, bool legacy) {
+    SDL_Thread *sender = SDL_CreateThread(run_sender, "sender", bench);
+    assert(sender);
+
+    socket_t socket = net_connect(IPV4_LOCALHOST, bench->port, 0);
+    assert(socket != INVALID_SOCKET);
+
+    struct packet_pool pool;
+    struct stream_reader reader;
+    if (!legacy) {
+        bool ok = packet_pool_init(&pool);
+        ok = ok && stream_reader_init(&reader, socket, &pool, NULL);
+        assert(ok);
+        (void) ok;
+    }
+
+    uint64_t recv_calls = 0;
+    int frames = 0;
+    uint64_t start = SDL_GetPerformanceCounter();
+    for (;;) {
+        AVPacket packet;
+        bool ok = legacy ? read_legacy(socket, &packet, &recv_calls)
+                         : stream_reader_read_packet(&reader, &packet);
+        if (!ok) {
+            break;
+        }
+        // sanity check, the payload is filled with the frame index
+        assert(packet.data[0] == (frames & 0xff));
+        assert(packet.data[packet.size - 1] == (frames & 0xff));
+        ++frames;
+        av_packet_unref(&packet);
+    }
+    double sec = (double) (SDL_GetPerformanceCounter() - start)
+               / SDL_GetPerformanceFrequency();
+
+    if (!legacy) {
+        recv_calls = reader.stats.recv_calls;
+        stream_reader_destroy(&reader);
+        packet_pool_destroy(&pool);
+    }
+
+    SDL_WaitThread(sender, NULL);
+    net_close(socket);
+
+    printf("%-7s %d frames: %.2f recv calls per frame, %.1f MB/s, "
+           "%.0f frames/s\n", legacy ? "legacy" : "reader", frames,
+           (double) recv_calls / frames, bench->data_len / sec / 1e6,
+           frames / sec);
+}
+
+int
+main(int argc, char *argv[]) {
+    struct bench bench = {
+        .frames = 20000,
+        .port = 27199,
+    };
+    if (argc > 1) {
+        bench.frames = atoi(argv[1]);
+    }
+    if (argc > 2) {
+        bench.port = atoi(argv[2]);
+    }
+    if (bench.frames <= 0) {
+        fprintf(stderr, "Invalid arguments\n");
+        return 1;
+    }
+
+    SDL_SetMainReady();
+    if (!net_init()) {
+        return 1;
+    }
+
+    if (!generate_stream(&bench)) {
+        fprintf(stderr, "Could not allocate stream\n");
+        return 1;
+    }
+
+    bench.server_socket = net_listen(IPV4_LOCALHOST, bench.port, 1, 0);
+    if (bench.server_socket == INVALID_SOCKET) {
+        fprintf(stderr, "Could not listen on port %d\n", bench.port);
+        return 1;
+    }
+
+    run(&bench, true);
+    run(&bench, false);
+
+    net_close(bench.server_socket);
+    free(bench.data);
+    net_cleanup();
+    return 0;
+}
@@ -0,0 +1,219 @@
+// Measure the time to upload a decoded frame into the screen texture and
+// render it, with the frames allocated by FFmpeg (one buffer per plane,
+// uploaded by SDL_UpdateYUVTexture()) and with the frames allocated in the
+// texture layout (uploaded by a single copy into the locked texture).
+//
+// The rendering uses the SDL software renderer on an offscreen surface, so
+// that it can run without a display (and without a GPU).
+//
+// usage: bench_texture_upload [frames [width height]]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <libavutil/frame.h>
+#include <SDL2/SDL.h>
+
+#include "texture_frame.h"
+
+// what the H.264 decoder requests (see avcodec_align_dimensions2())
+#define DECODER_ALIGN 16
+#define DECODER_LINESIZE_ALIGN 32
+
+#define ALIGN_UP(VALUE, ALIGN) (((VALUE) + (ALIGN) - 1) / (ALIGN) * (ALIGN))
+
+struct bench {
+    int frames;
+    int width;
+    int height;
+
+    SDL_Surface *surface;
+    SDL_Renderer *renderer;
+    struct texture_frame_allocator allocator;
+
+    uint64_t *upload_samples; // in performance counter ticks
+    uint64_t *total_samples;
+};
+
+static int
+compare_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *) a;
+    uint64_t y = *(const uint64_t *) b;
+    return (x > y) - (x < y);
+}
+
+static void
+fill_frame(AVFrame *frame) {
+    for (int y = 0; y < frame->height; ++y) {
+        for (int x = 0; x < frame->width; ++x) {
+            frame->data[0][y * frame->linesize[0] + x] = (x + y) & 0xff;
+        }
+    }
+    for (int p = 1; p < 3; ++p) {
+        for (int y = 0; y < frame->height / 2; ++y) {
+            memset(frame->data[p] + y * frame->linesize[p], 64 * p,
+                   frame->width / 2);
+        }
+    }
+}
+
+static AVFrame *
+create_frame(struct bench *bench, bool texture_layout) {
+    AVFrame *frame = av_frame_alloc();
+    if (!frame) {
+        return NULL;
+    }
+    frame->format = AV_PIX_FMT_YUV420P;
+    frame->width = bench->width;
+    frame->height = bench->height;
+
+    bool ok;
+    if (texture_layout) {
+        ok = texture_frame_allocator_get(&bench->allocator, frame,
+                                         ALIGN_UP(bench->width, DECODER_ALIGN),
+                                         ALIGN_UP(bench->height,
+                                                  DECODER_ALIGN),
+                                         DECODER_LINESIZE_ALIGN);
+    } else {
+        ok = !av_frame_get_buffer(frame, DECODER_LINESIZE_ALIGN);
+    }
+    if (!ok) {
+        av_frame_free(&frame);
+        return NULL;
+    }
+    fill_frame(frame);
+    return frame;
+}
+
+static bool
+run(struct bench *bench, bool texture_layout) {
+    AVFrame *frame = create_frame(bench, texture_layout);
+    if (!frame) {
+        fprintf(stderr, "Could not allocate frame\n");
+        return false;
+    }
+
+    struct size texture_size = {bench->width, bench->height};
+    if (texture_layout) {
+        texture_frame_get_texture_size(frame, &texture_size);
+    }
+    SDL_Texture *texture = SDL_CreateTexture(bench->renderer,
+                                             SDL_PIXELFORMAT_YV12,
+                                             SDL_TEXTUREACCESS_STREAMING,
+                                             texture_size.width,
+                                             texture_size.height);
+    if (!texture) {
+        fprintf(stderr, "Could not create texture: %s\n", SDL_GetError());
+        av_frame_free(&frame);
+        return false;
+    }
+    SDL_Rect frame_rect = {0, 0, bench->width, bench->height};
+
+    for (int i = 0; i < bench->frames; ++i) {
+        uint64_t start = SDL_GetPerformanceCounter();
+        if (texture_layout) {
+            texture_frame_upload(texture, frame);
+        } else {
+            SDL_UpdateYUVTexture(texture, NULL,
+                                 frame->data[0], frame->linesize[0],
+                                 frame->data[1], frame->linesize[1],
+                                 frame->data[2], frame->linesize[2]);
+        }
+        uint64_t uploaded = SDL_GetPerformanceCounter();
+
+        SDL_RenderClear(bench->renderer);
+        SDL_RenderCopy(bench->renderer, texture, &frame_rect, NULL);
+        SDL_RenderPresent(bench->renderer);
+
+        bench->upload_samples[i] = uploaded - start;
+        bench->total_samples[i] = SDL_GetPerformanceCounter() - start;
+    }
+
+    qsort(bench->upload_samples, bench->frames,
+          sizeof(*bench->upload_samples), compare_u64);
+    qsort(bench->total_samples, bench->frames,
+          sizeof(*bench->total_samples), compare_u64);
+    uint64_t upload_total = 0;
+    uint64_t total = 0;
+    for (int i = 0; i < bench->frames; ++i) {
+        upload_total += bench->upload_samples[i];
+        total += bench->total_samples[i];
+    }
+
+    uint64_t freq = SDL_GetPerformanceFrequency();
+#define TO_MS(T) ((double) (T) * 1000 / freq)
+    printf("%-7s %dx%d (texture %ux%u), %d frames: upload mean %.3f ms, "
+           "p99 %.3f ms; upload+render mean %.3f ms, p99 %.3f ms\n",
+           texture_layout ? "locked" : "update", bench->width, bench->height,
+           texture_size.width, texture_size.height, bench->frames,
+           TO_MS(upload_total) / bench->frames,
+           TO_MS(bench->upload_samples[bench->frames * 99 / 100]),
+           TO_MS(total) / bench->frames,
+           TO_MS(bench->total_samples[bench->frames * 99 / 100]));
+#undef TO_MS
+
+    SDL_DestroyTexture(texture);
+    av_frame_free(&frame);
+    return true;
+}
+
+int
+main(int argc, char *argv[]) {
+    struct bench bench = {
+        .frames = 300,
+        .width = 1920,
+        .height = 1080,
+    };
+    if (argc > 1) {
+        bench.frames = atoi(argv[1]);
+    }
+    if (argc > 3) {
+        bench.width = atoi(argv[2]);
+        bench.height = atoi(argv[3]);
+    }
+    if (bench.frames <= 0 || bench.width <= 0 || bench.height <= 0) {
+        fprintf(stderr, "Invalid arguments\n");
+        return 1;
+    }
+
+    SDL_SetMainReady();
+    if (SDL_Init(0)) {
+        fprintf(stderr, "Could not initialize SDL: %s\n", SDL_GetError());
+        return 1;
+    }
+
+    bench.upload_samples = malloc(bench.frames
+                                  * sizeof(*bench.upload_samples));
+    bench.total_samples = malloc(bench.frames * sizeof(*bench.total_samples));
+    bench.surface = SDL_CreateRGBSurfaceWithFormat(0, bench.width,
+                                                   bench.height, 32,
+                                                   SDL_PIXELFORMAT_RGB888);
+    if (!bench.upload_samples || !bench.total_samples || !bench.surface) {
+        fprintf(stderr, "Could not allocate render target\n");
+        return 1;
+    }
+    bench.renderer = SDL_CreateSoftwareRenderer(bench.surface);
+    if (!bench.renderer) {
+        fprintf(stderr, "Could not initialize rendering\n");
+        return 1;
+    }
+    if (SDL_RenderSetLogicalSize(bench.renderer, bench.width, bench.height)) {
+        fprintf(stderr, "Could not set logical size: %s\n", SDL_GetError());
+        return 1;
+    }
+
+    if (!texture_frame_allocator_init(&bench.allocator)) {
+        fprintf(stderr, "Could not initialize frame allocator\n");
+        return 1;
+    }
+
+    bool ok = run(&bench, false) && run(&bench, true);
+
+    texture_frame_allocator_destroy(&bench.allocator);
+    SDL_DestroyRenderer(bench.renderer);
+    SDL_FreeSurface(bench.surface);
+    free(bench.upload_samples);
+    free(bench.total_samples);
+    SDL_Quit();
+    return ok ? 0 : 1;
+}
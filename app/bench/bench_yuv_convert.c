@@ -0,0 +1,174 @@
+// Measure the YUV420P to RGB/gray conversion time of every available
+// yuv_convert implementation, compared to swscale (bilinear, like the frame
+// converter used to do), for the usual device resolutions.
+//
+// usage: bench_yuv_convert [iterations]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <libavutil/frame.h>
+#include <libswscale/swscale.h>
+#include <SDL2/SDL.h>
+
+#include "yuv_convert.h"
+
+static const int resolutions[][2] = {
+    {1280, 720},
+    {1920, 1080},
+    {2560, 1440},
+};
+
+static const struct {
+    enum yuv_convert_format format;
+    enum AVPixelFormat av_format;
+    const char *name;
+} formats[] = {
+    {YUV_CONVERT_FORMAT_RGB24, AV_PIX_FMT_RGB24, "rgb24"},
+    {YUV_CONVERT_FORMAT_BGR24, AV_PIX_FMT_BGR24, "bgr24"},
+    {YUV_CONVERT_FORMAT_RGBA, AV_PIX_FMT_RGBA, "rgba"},
+    {YUV_CONVERT_FORMAT_GRAY8, AV_PIX_FMT_GRAY8, "gray8"},
+};
+
+static AVFrame *
+create_source_frame(int width, int height) {
+    AVFrame *frame = av_frame_alloc();
+    if (!frame) {
+        return NULL;
+    }
+    frame->format = AV_PIX_FMT_YUV420P;
+    frame->width = width;
+    frame->height = height;
+    if (av_frame_get_buffer(frame, 32)) {
+        av_frame_free(&frame);
+        return NULL;
+    }
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            frame->data[0][y * frame->linesize[0] + x] = (x + y) & 0xff;
+        }
+    }
+    for (int p = 1; p < 3; ++p) {
+        for (int y = 0; y < height / 2; ++y) {
+            for (int x = 0; x < width / 2; ++x) {
+                frame->data[p][y * frame->linesize[p] + x] = (x * p + y) & 0xff;
+            }
+        }
+    }
+    return frame;
+}
+
+// return the mean time per frame, in ms
+static double
+run_swscale(const AVFrame *src, enum AVPixelFormat format, int factor,
+            int iterations) {
+    int width = src->width / factor;
+    int height = src->height / factor;
+    AVFrame *dst = av_frame_alloc();
+    if (!dst) {
+        return -1;
+    }
+    dst->format = format;
+    dst->width = width;
+    dst->height = height;
+    struct SwsContext *sws_ctx =
+        sws_getContext(src->width, src->height, src->format, width, height,
+                       format, SWS_BILINEAR, NULL, NULL, NULL);
+    if (!sws_ctx || av_frame_get_buffer(dst, 32)) {
+        sws_freeContext(sws_ctx);
+        av_frame_free(&dst);
+        return -1;
+    }
+
+    uint64_t start = SDL_GetPerformanceCounter();
+    for (int i = 0; i < iterations; ++i) {
+        sws_scale(sws_ctx, (const uint8_t *const *) src->data, src->linesize,
+                  0, src->height, dst->data, dst->linesize);
+    }
+    uint64_t elapsed = SDL_GetPerformanceCounter() - start;
+
+    sws_freeContext(sws_ctx);
+    av_frame_free(&dst);
+    return (double) elapsed * 1000 / SDL_GetPerformanceFrequency()
+         / iterations;
+}
+
+// return the mean time per frame, in ms
+static double
+run_impl(enum yuv_convert_impl impl, const AVFrame *src,
+         enum yuv_convert_format format, int factor, int iterations) {
+    int width = src->width / factor;
+    int height = src->height / factor;
+    int linesize = (width * yuv_convert_bytes_per_pixel(format) + 31) & ~31;
+    uint8_t *dst = malloc((size_t) linesize * height);
+    if (!dst) {
+        return -1;
+    }
+
+    uint64_t start = SDL_GetPerformanceCounter();
+    for (int i = 0; i < iterations; ++i) {
+        yuv_convert_with_impl(impl, src, format, factor, dst, linesize);
+    }
+    uint64_t elapsed = SDL_GetPerformanceCounter() - start;
+
+    free(dst);
+    return (double) elapsed * 1000 / SDL_GetPerformanceFrequency()
+         / iterations;
+}
+
+int
+main(int argc, char *argv[]) {
+    int iterations = 100;
+    if (argc > 1) {
+        iterations = atoi(argv[1]);
+    }
+    if (iterations <= 0) {
+        fprintf(stderr, "Invalid arguments\n");
+        return 1;
+    }
+
+    SDL_SetMainReady();
+    if (SDL_Init(0)) {
+        fprintf(stderr, "Could not initialize SDL: %s\n", SDL_GetError());
+        return 1;
+    }
+
+    printf("%-10s %-6s %-6s %-8s %10s %8s\n", "source", "format", "factor",
+           "impl", "ms/frame", "speedup");
+
+    for (size_t r = 0; r < sizeof(resolutions) / sizeof(resolutions[0]);
+            ++r) {
+        AVFrame *src = create_source_frame(resolutions[r][0],
+                                           resolutions[r][1]);
+        if (!src) {
+            fprintf(stderr, "Could not allocate source frame\n");
+            return 1;
+        }
+        char source[16];
+        snprintf(source, sizeof(source), "%dx%d", src->width, src->height);
+
+        for (size_t f = 0; f < sizeof(formats) / sizeof(formats[0]); ++f) {
+            for (int factor = 1; factor <= 4; factor *= 2) {
+                double reference = run_swscale(src, formats[f].av_format,
+                                               factor, iterations);
+                printf("%-10s %-6s %-6d %-8s %10.3f %8s\n", source,
+                       formats[f].name, factor, "swscale", reference, "1.00");
+
+                for (int impl = 0; impl < YUV_CONVERT_IMPL_COUNT; ++impl) {
+                    if (!yuv_convert_impl_available(impl)) {
+                        continue;
+                    }
+                    double ms = run_impl(impl, src, formats[f].format, factor,
+                                         iterations);
+                    printf("%-10s %-6s %-6d %-8s %10.3f %8.2f\n", source,
+                           formats[f].name, factor,
+                           yuv_convert_impl_name(impl), ms, reference / ms);
+                }
+            }
+        }
+
+        av_frame_free(&src);
+    }
+
+    SDL_Quit();
+    return 0;
+}
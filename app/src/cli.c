@@ -6,6 +6,7 @@
 
 #include "config.h"
 #include "recorder.h"
+#include "snapshot.h"
 #include "util/log.h"
 #include "util/str_util.h"
 
@@ -35,6 +36,59 @@ scrcpy_print_usage(const char *arg0) {
             "        (typically, portrait for a phone, landscape for a tablet).\n"
             "        Any --max-size value is computed on the cropped size.\n"
             "\n"
+            "    --decoder-profile profile\n"
+            "        Select the decoder threading: \"default\" (single-threaded),\n"
+            "        \"low-latency\" (slice threads, without frame delay, only\n"
+            "        effective if the device encodes several slices per frame)\n"
+            "        or \"throughput\" (frame threads, for high resolutions, at\n"
+            "        the cost of one frame of latency per additional thread).\n"
+            "        Default is default.\n"
+            "\n"
+            "    --decoder-queue-depth value\n"
+            "        Set the maximum number of packets waiting to be decoded\n"
+            "        (rounded up to a power of 2).\n"
+            "        Default is %d.\n"
+            "\n"
+            "    --decoder-queue-policy policy\n"
+            "        Set the behavior when the decoder queue is full: \"block\"\n"
+            "        (stop reading the socket until a packet is decoded),\n"
+            "        \"drop-until-keyframe\" (drop the packets until the next\n"
+            "        keyframe) or \"drop-oldest\" (drop the oldest queued\n"
+            "        packets up to the next queued keyframe).\n"
+            "        Default is block.\n"
+            "\n"
+            "    --decoder-threads value\n"
+            "        Set the number of decoding threads for the low-latency and\n"
+            "        throughput decoder profiles.\n"
+            "        Default is 0 (automatic).\n"
+            "\n"
+            "    --dedup-frames\n"
+            "        Neither upload nor present the frames identical to the\n"
+            "        previous one (the device repeats the last frame every\n"
+            "        100 ms even if the screen is static), to reduce the CPU\n"
+            "        and GPU usage for idle devices.\n"
+            "        A frame is compared by a hash of all its chroma rows and\n"
+            "        of every other luma row.\n"
+            "\n"
+            "    --external-server\n"
+            "        Do not push nor start the server on the device: wait for a\n"
+            "        server started by other means (for example the\n"
+            "        replay_server tool) to connect to the local port.\n"
+            "\n"
+            "    --frame-buffer value\n"
+            "        Set the maximum number of decoded frames waiting to be\n"
+            "        rendered, to absorb brief rendering stalls (for example\n"
+            "        while the window is moved) without skipping frames, at the\n"
+            "        cost of latency during the stall.\n"
+            "        Default is 1 (always render the latest frame).\n"
+            "\n"
+            "    --frame-log file\n"
+            "        Write the pts, the content hash and the upload and render\n"
+            "        times of every frame taken for rendering to file (CSV).\n"
+            "        The hashes only depend on the decoded content, so the\n"
+            "        files of two runs fed with the same recorded stream can be\n"
+            "        compared.\n"
+            "\n"
             "    -f, --fullscreen\n"
             "        Start in fullscreen.\n"
             "\n"
@@ -45,6 +99,11 @@ scrcpy_print_usage(const char *arg0) {
             "        Limit the frame rate of screen capture (only supported on\n"
             "        devices with Android >= 10).\n"
             "\n"
+            "    --headless\n"
+            "        Render the frames offscreen with the software renderer,\n"
+            "        without any window (no display server is required). The\n"
+            "        whole decoding and rendering path is still executed.\n"
+            "\n"
             "    -m, --max-size value\n"
             "        Limit both the width and height of the video to value. The\n"
             "        other dimension is computed so that the device aspect-ratio\n"
@@ -58,6 +117,11 @@ scrcpy_print_usage(const char *arg0) {
             "        Do not display device (only when screen recording is\n"
             "        enabled).\n"
             "\n"
+            "    --no-tcp-nodelay\n"
+            "        Keep Nagle's algorithm enabled on the control sockets, so\n"
+            "        that small messages may be coalesced (and delayed) by the\n"
+            "        TCP stack.\n"
+            "\n"
             "    -p, --port port\n"
             "        Set the TCP port the client listens on.\n"
             "        Default is %d.\n"
@@ -79,15 +143,119 @@ scrcpy_print_usage(const char *arg0) {
             "        The format is determined by the --record-format option if\n"
             "        set, or by the file extension (.mp4 or .mkv).\n"
             "\n"
+            "    --record-direct-io\n"
+            "        Bypass the page cache (O_DIRECT) for the recording writes,\n"
+            "        if supported by the platform and the file system. Implies\n"
+            "        --record-write-size if not set.\n"
+            "\n"
             "    --record-format format\n"
             "        Force recording format (either mp4 or mkv).\n"
             "\n"
+            "    --record-events\n"
+            "        Write the injected events in the recordings, as a subtitle\n"
+            "        track synchronized with the video (mkv only, the recordings\n"
+            "        started at runtime into an mp4 --record-path do not\n"
+            "        contain them).\n"
+            "\n"
+            "    --record-fragmented\n"
+            "        Write a fragmented MP4 (a fragment per keyframe), which is\n"
+            "        readable while it is being written, even if the recording\n"
+            "        is interrupted.\n"
+            "\n"
+            "    --record-path template\n"
+            "        Set the path of the recordings started at runtime\n"
+            "        (" CTRL_OR_CMD "+Shift+e or CONTROL_MSG_TYPE_START_RECORDING on\n"
+            "        the remote control port). \"%%t\" is replaced by the local\n"
+            "        time and \"%%n\" by the recording number.\n"
+            "        The format is determined by the file extension (.mp4 or\n"
+            "        .mkv).\n"
+            "        Default is \"%s\".\n"
+            "\n"
+            "    --record-queue-bytes value\n"
+            "        Set the maximum size of the packets waiting to be written\n"
+            "        to the recording, in bytes. Unit suffixes are supported:\n"
+            "        'K' (x1000) and 'M' (x1000000).\n"
+            "        Default is %d.\n"
+            "\n"
+            "    --record-queue-packets value\n"
+            "        Set the maximum number of packets waiting to be written to\n"
+            "        the recording.\n"
+            "        Default is %d.\n"
+            "\n"
+            "    --record-queue-policy policy\n"
+            "        Set the behavior when the recording queue is full (the disk\n"
+            "        is too slow): \"block\" (stop reading the socket until a\n"
+            "        packet is written) or \"drop-gop\" (drop the packets until\n"
+            "        the next keyframe, whole GOPs are missing from the\n"
+            "        recording).\n"
+            "        Default is block.\n"
+            "\n"
+            "    --record-raw file\n"
+            "        Write the raw video stream received from the device\n"
+            "        (including the stream headers) to file, without remuxing.\n"
+            "        The file can be replayed by the replay_server tool.\n"
+            "\n"
+            "    --record-segment-duration seconds\n"
+            "        Split the recording into several files, starting a new one\n"
+            "        on the first keyframe after the given duration. The\n"
+            "        segment number is inserted before the file extension\n"
+            "        (file-000.mp4, file-001.mp4...).\n"
+            "\n"
+            "    --record-segment-size value\n"
+            "        Split the recording into several files, starting a new one\n"
+            "        on the first keyframe once the file reaches the given size,\n"
+            "        in bytes. Unit suffixes are supported: 'K' (x1000) and 'M'\n"
+            "        (x1000000).\n"
+            "\n"
+            "    --record-sync-interval ms\n"
+            "        Flush the recording to the disk (fdatasync) at most once\n"
+            "        per interval, and when the file is closed. Implies\n"
+            "        --record-write-size if not set.\n"
+            "        Default is 0 (never).\n"
+            "\n"
+            "    --record-write-size value\n"
+            "        Buffer the recording in memory and write it to the file by\n"
+            "        blocks of the given size (rounded up to 4K), from a\n"
+            "        separate thread, so that a slow disk does not block the\n"
+            "        recorder. Unit suffixes are supported: 'K' (x1000) and 'M'\n"
+            "        (x1000000).\n"
+            "        Default is 0 (use the default FFmpeg output).\n"
+            "\n"
             "    --render-expired-frames\n"
             "        By default, to minimize latency, scrcpy always renders the\n"
             "        last available decoded frame, and drops any previous ones.\n"
             "        This flag forces to render all frames, at a cost of a\n"
             "        possible increased latency.\n"
             "\n"
+            "    --replay-buffer seconds\n"
+            "        Keep (at least) the last given seconds of the video stream\n"
+            "        in memory, to be saved on request (" CTRL_OR_CMD "+Shift+r or\n"
+            "        CONTROL_MSG_TYPE_SAVE_REPLAY on the remote control port).\n"
+            "        Default is 0 (disabled).\n"
+            "\n"
+            "    --replay-path template\n"
+            "        Set the path of the saved replays. \"%%t\" is replaced by\n"
+            "        the local time and \"%%n\" by the replay number.\n"
+            "        The format is determined by the file extension (.mp4 or\n"
+            "        .mkv).\n"
+            "        Default is \"%s\".\n"
+            "\n"
+            "    --screenshot-compression value\n"
+            "        Set the PNG compression level of the screenshots, from 0\n"
+            "        (fastest) to 9 (smallest).\n"
+            "        Default is %d.\n"
+            "\n"
+            "    --screenshot-path template\n"
+            "        Set the path of the screenshots. \"%%t\" is replaced by the\n"
+            "        local time and \"%%n\" by the screenshot number.\n"
+            "        The format is determined by the file extension (.png, .jpg,\n"
+            "        .jpeg or .ppm).\n"
+            "        Default is \"%s\".\n"
+            "\n"
+            "    --screenshot-quality value\n"
+            "        Set the JPEG quality of the screenshots, from 1 to 100.\n"
+            "        Default is %d.\n"
+            "\n"
             "    -s, --serial serial\n"
             "        The device serial number. Mandatory only if several devices\n"
             "        are connected to adb.\n"
@@ -95,10 +263,32 @@ scrcpy_print_usage(const char *arg0) {
             "    -S, --turn-screen-off\n"
             "        Turn the device screen off immediately.\n"
             "\n"
+            "    --socket-buffer-size value\n"
+            "        Set the receive buffer size (SO_RCVBUF) of the video\n"
+            "        socket, in bytes. Unit suffixes are supported: 'K' (x1000)\n"
+            "        and 'M' (x1000000).\n"
+            "        Default is 0 (keep the system default, which is autotuned\n"
+            "        on most systems).\n"
+            "\n"
             "    -t, --show-touches\n"
             "        Enable \"show touches\" on start, disable on quit.\n"
             "        It only shows physical touches (not clicks from scrcpy).\n"
             "\n"
+            "    --tcp-keepalive\n"
+            "        Enable TCP keepalive on the sockets, to detect a dead\n"
+            "        connection (for example over \"adb connect\") while the\n"
+            "        stream is idle.\n"
+            "\n"
+            "    --tcp-quickack\n"
+            "        Disable the delayed ACKs on the sockets (Linux only).\n"
+            "\n"
+            "    --texture-frames\n"
+            "        Decode the frames directly in the memory layout of the\n"
+            "        display texture, so that each frame is uploaded by a\n"
+            "        single copy into the locked texture.\n"
+            "        This is mostly useful with the software renderer\n"
+            "        (SDL_RENDER_DRIVER=software).\n"
+            "\n"
             "    -v, --version\n"
             "        Print the version of scrcpy.\n"
             "\n"
@@ -177,6 +367,12 @@ scrcpy_print_usage(const char *arg0) {
             "    " CTRL_OR_CMD "+r\n"
             "        rotate device screen\n"
             "\n"
+            "    " CTRL_OR_CMD "+Shift+e\n"
+            "        start/stop recording the video (see --record-path)\n"
+            "\n"
+            "    " CTRL_OR_CMD "+Shift+r\n"
+            "        save the last seconds of the video (see --replay-buffer)\n"
+            "\n"
             "    " CTRL_OR_CMD "+n\n"
             "       expand notification panel\n"
             "\n"
@@ -193,15 +389,27 @@ scrcpy_print_usage(const char *arg0) {
             "        copy computer clipboard to device\n"
             "\n"
             "    " CTRL_OR_CMD "+i\n"
-            "        enable/disable FPS counter (print frames/second in logs)\n"
+            "        enable/disable FPS counter (print frames/second and frame\n"
+            "        latencies in logs)\n"
+            "\n"
+            "    " CTRL_OR_CMD "+k\n"
+            "        take a screenshot (see --screenshot-path)\n"
             "\n"
             "    Drag & drop APK file\n"
             "        install APK from computer\n"
             "\n",
             arg0,
             DEFAULT_BIT_RATE,
+            DEFAULT_DECODER_QUEUE_DEPTH,
             DEFAULT_MAX_SIZE, DEFAULT_MAX_SIZE ? "" : " (unlimited)",
-            DEFAULT_LOCAL_PORT);
+            DEFAULT_LOCAL_PORT,
+            DEFAULT_RECORD_PATH,
+            DEFAULT_RECORD_QUEUE_BYTES,
+            DEFAULT_RECORD_QUEUE_PACKETS,
+            DEFAULT_REPLAY_PATH,
+            DEFAULT_SNAPSHOT_COMPRESSION,
+            DEFAULT_SNAPSHOT_PATH,
+            DEFAULT_SNAPSHOT_QUALITY);
 }
 
 static bool
@@ -267,6 +475,82 @@ parse_max_fps(const char *s, uint16_t *max_fps) {
     return true;
 }
 
+static bool
+parse_decoder_profile(const char *s, enum decoder_profile *profile) {
+    if (!strcmp(s, "default")) {
+        *profile = DECODER_PROFILE_DEFAULT;
+        return true;
+    }
+    if (!strcmp(s, "low-latency")) {
+        *profile = DECODER_PROFILE_LOW_LATENCY;
+        return true;
+    }
+    if (!strcmp(s, "throughput")) {
+        *profile = DECODER_PROFILE_THROUGHPUT;
+        return true;
+    }
+    LOGE("Unsupported decoder profile: %s (expected default, low-latency or "
+         "throughput)", s);
+    return false;
+}
+
+static bool
+parse_decoder_threads(const char *s, uint16_t *threads) {
+    long value;
+    bool ok = parse_integer_arg(s, &value, false, 0, 64, "decoder threads");
+    if (!ok) {
+        return false;
+    }
+
+    *threads = (uint16_t) value;
+    return true;
+}
+
+static bool
+parse_frame_buffer(const char *s, uint16_t *frame_buffer) {
+    long value;
+    bool ok = parse_integer_arg(s, &value, false, 1, 16, "frame buffer");
+    if (!ok) {
+        return false;
+    }
+
+    *frame_buffer = (uint16_t) value;
+    return true;
+}
+
+static bool
+parse_decoder_queue_depth(const char *s, uint16_t *depth) {
+    long value;
+    bool ok = parse_integer_arg(s, &value, false, 1, 1024,
+                                "decoder queue depth");
+    if (!ok) {
+        return false;
+    }
+
+    *depth = (uint16_t) value;
+    return true;
+}
+
+static bool
+parse_decoder_queue_policy(const char *s,
+                           enum packet_queue_policy *policy) {
+    if (!strcmp(s, "block")) {
+        *policy = PACKET_QUEUE_POLICY_BLOCK;
+        return true;
+    }
+    if (!strcmp(s, "drop-until-keyframe")) {
+        *policy = PACKET_QUEUE_POLICY_DROP_UNTIL_KEYFRAME;
+        return true;
+    }
+    if (!strcmp(s, "drop-oldest")) {
+        *policy = PACKET_QUEUE_POLICY_DROP_OLDEST;
+        return true;
+    }
+    LOGE("Unsupported decoder queue policy: %s (expected block, "
+         "drop-until-keyframe or drop-oldest)", s);
+    return false;
+}
+
 static bool
 parse_window_position(const char *s, int16_t *position) {
     long value;
@@ -319,6 +603,126 @@ parse_record_format(const char *optarg, enum recorder_format *format) {
     return false;
 }
 
+static bool
+parse_record_queue_bytes(const char *s, uint32_t *bytes) {
+    long value;
+    bool ok = parse_integer_arg(s, &value, true, 1, 0x7FFFFFFF,
+                                "record queue bytes");
+    if (!ok) {
+        return false;
+    }
+
+    *bytes = (uint32_t) value;
+    return true;
+}
+
+static bool
+parse_record_queue_packets(const char *s, uint16_t *packets) {
+    long value;
+    bool ok = parse_integer_arg(s, &value, false, 1, 0xFFFF,
+                                "record queue packets");
+    if (!ok) {
+        return false;
+    }
+
+    *packets = (uint16_t) value;
+    return true;
+}
+
+static bool
+parse_record_queue_policy(const char *s, enum recorder_queue_policy *policy) {
+    if (!strcmp(s, "block")) {
+        *policy = RECORDER_QUEUE_POLICY_BLOCK;
+        return true;
+    }
+    if (!strcmp(s, "drop-gop")) {
+        *policy = RECORDER_QUEUE_POLICY_DROP_GOP;
+        return true;
+    }
+    LOGE("Unsupported record queue policy: %s (expected block or drop-gop)",
+         s);
+    return false;
+}
+
+static bool
+parse_record_segment_duration(const char *s, uint32_t *duration) {
+    long value;
+    bool ok = parse_integer_arg(s, &value, false, 1, 0x7FFFFFFF,
+                                "record segment duration");
+    if (!ok) {
+        return false;
+    }
+
+    *duration = (uint32_t) value;
+    return true;
+}
+
+static bool
+parse_record_segment_size(const char *s, uint32_t *size) {
+    long value;
+    bool ok = parse_integer_arg(s, &value, true, 1, 0x7FFFFFFF,
+                                "record segment size");
+    if (!ok) {
+        return false;
+    }
+
+    *size = (uint32_t) value;
+    return true;
+}
+
+static bool
+parse_record_write_size(const char *s, uint32_t *size) {
+    long value;
+    bool ok = parse_integer_arg(s, &value, true, 0, 0x40000000,
+                                "record write size");
+    if (!ok) {
+        return false;
+    }
+
+    *size = (uint32_t) value;
+    return true;
+}
+
+static bool
+parse_record_sync_interval(const char *s, uint32_t *interval) {
+    long value;
+    bool ok = parse_integer_arg(s, &value, false, 0, 0x7FFFFFFF,
+                                "record sync interval");
+    if (!ok) {
+        return false;
+    }
+
+    *interval = (uint32_t) value;
+    return true;
+}
+
+static bool
+parse_socket_buffer_size(const char *s, uint32_t *size) {
+    long value;
+    // SO_RCVBUF takes an int
+    bool ok = parse_integer_arg(s, &value, true, 0, 0x7FFFFFFF,
+                                "socket buffer size");
+    if (!ok) {
+        return false;
+    }
+
+    *size = (uint32_t) value;
+    return true;
+}
+
+static bool
+parse_replay_duration(const char *s, uint32_t *duration) {
+    long value;
+    bool ok = parse_integer_arg(s, &value, false, 0, 0x7FFFFFFF,
+                                "replay buffer duration");
+    if (!ok) {
+        return false;
+    }
+
+    *duration = (uint32_t) value;
+    return true;
+}
+
 static enum recorder_format
 guess_record_format(const char *filename) {
     size_t len = strlen(filename);
@@ -335,6 +739,50 @@ guess_record_format(const char *filename) {
     return 0;
 }
 
+static bool
+parse_screenshot_quality(const char *s, uint8_t *quality) {
+    long value;
+    bool ok = parse_integer_arg(s, &value, false, 1, 100,
+                                "screenshot quality");
+    if (!ok) {
+        return false;
+    }
+
+    *quality = (uint8_t) value;
+    return true;
+}
+
+static bool
+parse_screenshot_compression(const char *s, uint8_t *compression) {
+    long value;
+    bool ok = parse_integer_arg(s, &value, false, 0, 9,
+                                "screenshot compression");
+    if (!ok) {
+        return false;
+    }
+
+    *compression = (uint8_t) value;
+    return true;
+}
+
+static enum snapshot_format
+guess_screenshot_format(const char *path) {
+    const char *ext = strrchr(path, '.');
+    if (!ext) {
+        return 0;
+    }
+    if (!strcmp(ext, ".png")) {
+        return SNAPSHOT_FORMAT_PNG;
+    }
+    if (!strcmp(ext, ".jpg") || !strcmp(ext, ".jpeg")) {
+        return SNAPSHOT_FORMAT_JPEG;
+    }
+    if (!strcmp(ext, ".ppm")) {
+        return SNAPSHOT_FORMAT_PPM;
+    }
+    return 0;
+}
+
 #define OPT_RENDER_EXPIRED_FRAMES 1000
 #define OPT_WINDOW_TITLE          1001
 #define OPT_PUSH_TARGET           1002
@@ -350,6 +798,37 @@ guess_record_format(const char *filename) {
 #define OPT_MAX_FPS               1012
 #define OPT_SCREEN_WIDTH          1013
 #define OPT_SCREEN_HEIGHT         1014
+#define OPT_EXTERNAL_SERVER       1015
+#define OPT_RECORD_RAW            1016
+#define OPT_DECODER_QUEUE_DEPTH   1017
+#define OPT_DECODER_QUEUE_POLICY  1018
+#define OPT_DECODER_PROFILE       1019
+#define OPT_DECODER_THREADS       1020
+#define OPT_FRAME_BUFFER          1021
+#define OPT_TEXTURE_FRAMES        1022
+#define OPT_DEDUP_FRAMES          1023
+#define OPT_SCREENSHOT_PATH       1024
+#define OPT_SCREENSHOT_QUALITY    1025
+#define OPT_SCREENSHOT_COMPRESSION 1026
+#define OPT_HEADLESS              1027
+#define OPT_FRAME_LOG             1028
+#define OPT_RECORD_QUEUE_BYTES    1029
+#define OPT_RECORD_QUEUE_PACKETS  1030
+#define OPT_RECORD_QUEUE_POLICY   1031
+#define OPT_RECORD_SEGMENT_DURATION 1032
+#define OPT_RECORD_SEGMENT_SIZE   1033
+#define OPT_RECORD_FRAGMENTED     1034
+#define OPT_REPLAY_BUFFER         1035
+#define OPT_REPLAY_PATH           1036
+#define OPT_RECORD_PATH           1037
+#define OPT_RECORD_EVENTS         1038
+#define OPT_RECORD_WRITE_SIZE     1039
+#define OPT_RECORD_SYNC_INTERVAL  1040
+#define OPT_RECORD_DIRECT_IO      1041
+#define OPT_NO_TCP_NODELAY        1042
+#define OPT_TCP_QUICKACK          1043
+#define OPT_TCP_KEEPALIVE         1044
+#define OPT_SOCKET_BUFFER_SIZE    1045
 
 bool
 scrcpy_parse_args(struct scrcpy_cli_args *args, int argc, char *argv[]) {
@@ -357,20 +836,77 @@ scrcpy_parse_args(struct scrcpy_cli_args *args, int argc, char *argv[]) {
             {"always-on-top",         no_argument,       NULL, OPT_ALWAYS_ON_TOP},
             {"bit-rate",              required_argument, NULL, 'b'},
             {"crop",                  required_argument, NULL, OPT_CROP},
+            {"decoder-profile",       required_argument, NULL,
+                                                  OPT_DECODER_PROFILE},
+            {"decoder-queue-depth",   required_argument, NULL,
+                                                  OPT_DECODER_QUEUE_DEPTH},
+            {"decoder-queue-policy",  required_argument, NULL,
+                                                  OPT_DECODER_QUEUE_POLICY},
+            {"decoder-threads",       required_argument, NULL,
+                                                  OPT_DECODER_THREADS},
+            {"dedup-frames",          no_argument,       NULL,
+                                                  OPT_DEDUP_FRAMES},
+            {"external-server",       no_argument,       NULL,
+                                                  OPT_EXTERNAL_SERVER},
+            {"frame-buffer",          required_argument, NULL,
+                                                  OPT_FRAME_BUFFER},
+            {"frame-log",             required_argument, NULL, OPT_FRAME_LOG},
             {"fullscreen",            no_argument,       NULL, 'f'},
+            {"headless",              no_argument,       NULL, OPT_HEADLESS},
             {"help",                  no_argument,       NULL, 'h'},
             {"max-fps",               required_argument, NULL, OPT_MAX_FPS},
             {"max-size",              required_argument, NULL, 'm'},
             {"no-control",            no_argument,       NULL, 'n'},
             {"no-display",            no_argument,       NULL, 'N'},
+            {"no-tcp-nodelay",        no_argument,       NULL,
+                                                  OPT_NO_TCP_NODELAY},
             {"port",                  required_argument, NULL, 'p'},
             {"push-target",           required_argument, NULL, OPT_PUSH_TARGET},
             {"record",                required_argument, NULL, 'r'},
+            {"record-direct-io",      no_argument,       NULL,
+                                                  OPT_RECORD_DIRECT_IO},
+            {"record-events",         no_argument,       NULL,
+                                                  OPT_RECORD_EVENTS},
             {"record-format",         required_argument, NULL, OPT_RECORD_FORMAT},
+            {"record-fragmented",     no_argument,       NULL,
+                                                  OPT_RECORD_FRAGMENTED},
+            {"record-path",           required_argument, NULL, OPT_RECORD_PATH},
+            {"record-queue-bytes",    required_argument, NULL,
+                                                  OPT_RECORD_QUEUE_BYTES},
+            {"record-queue-packets",  required_argument, NULL,
+                                                  OPT_RECORD_QUEUE_PACKETS},
+            {"record-queue-policy",   required_argument, NULL,
+                                                  OPT_RECORD_QUEUE_POLICY},
+            {"record-segment-duration", required_argument, NULL,
+                                                  OPT_RECORD_SEGMENT_DURATION},
+            {"record-segment-size",   required_argument, NULL,
+                                                  OPT_RECORD_SEGMENT_SIZE},
+            {"record-raw",            required_argument, NULL, OPT_RECORD_RAW},
+            {"record-sync-interval",  required_argument, NULL,
+                                                  OPT_RECORD_SYNC_INTERVAL},
+            {"record-write-size",     required_argument, NULL,
+                                                  OPT_RECORD_WRITE_SIZE},
             {"render-expired-frames", no_argument,       NULL,
                                                                OPT_RENDER_EXPIRED_FRAMES},
+            {"replay-buffer",         required_argument, NULL,
+                                                  OPT_REPLAY_BUFFER},
+            {"replay-path",           required_argument, NULL, OPT_REPLAY_PATH},
+            {"screenshot-compression", required_argument, NULL,
+                                                  OPT_SCREENSHOT_COMPRESSION},
+            {"screenshot-path",       required_argument, NULL,
+                                                  OPT_SCREENSHOT_PATH},
+            {"screenshot-quality",    required_argument, NULL,
+                                                  OPT_SCREENSHOT_QUALITY},
             {"serial",                required_argument, NULL, 's'},
             {"show-touches",          no_argument,       NULL, 't'},
+            {"socket-buffer-size",    required_argument, NULL,
+                                                  OPT_SOCKET_BUFFER_SIZE},
+            {"tcp-keepalive",         no_argument,       NULL,
+                                                  OPT_TCP_KEEPALIVE},
+            {"tcp-quickack",          no_argument,       NULL,
+                                                  OPT_TCP_QUICKACK},
+            {"texture-frames",        no_argument,       NULL,
+                                                  OPT_TEXTURE_FRAMES},
             {"turn-screen-off",       no_argument,       NULL, 'S'},
             {"prefer-text",           no_argument,       NULL, OPT_PREFER_TEXT},
             {"version",               no_argument,       NULL, 'v'},
@@ -506,14 +1042,153 @@ scrcpy_parse_args(struct scrcpy_cli_args *args, int argc, char *argv[]) {
             case OPT_PREFER_TEXT:
                 opts->prefer_text = true;
                 break;
+            case OPT_EXTERNAL_SERVER:
+                opts->external_server = true;
+                break;
+            case OPT_RECORD_RAW:
+                opts->record_raw_filename = optarg;
+                break;
+            case OPT_DECODER_QUEUE_DEPTH:
+                if (!parse_decoder_queue_depth(optarg,
+                                               &opts->decoder_queue_depth)) {
+                    return false;
+                }
+                break;
+            case OPT_DECODER_QUEUE_POLICY:
+                if (!parse_decoder_queue_policy(optarg,
+                                                &opts->decoder_queue_policy)) {
+                    return false;
+                }
+                break;
+            case OPT_DECODER_PROFILE:
+                if (!parse_decoder_profile(optarg, &opts->decoder_profile)) {
+                    return false;
+                }
+                break;
+            case OPT_DECODER_THREADS:
+                if (!parse_decoder_threads(optarg, &opts->decoder_threads)) {
+                    return false;
+                }
+                break;
+            case OPT_FRAME_BUFFER:
+                if (!parse_frame_buffer(optarg, &opts->frame_buffer)) {
+                    return false;
+                }
+                break;
+            case OPT_TEXTURE_FRAMES:
+                opts->texture_frames = true;
+                break;
+            case OPT_DEDUP_FRAMES:
+                opts->dedup_frames = true;
+                break;
+            case OPT_RECORD_QUEUE_BYTES:
+                if (!parse_record_queue_bytes(optarg,
+                                              &opts->record_queue_bytes)) {
+                    return false;
+                }
+                break;
+            case OPT_RECORD_QUEUE_PACKETS:
+                if (!parse_record_queue_packets(optarg,
+                                                &opts->record_queue_packets)) {
+                    return false;
+                }
+                break;
+            case OPT_RECORD_QUEUE_POLICY:
+                if (!parse_record_queue_policy(optarg,
+                                               &opts->record_queue_policy)) {
+                    return false;
+                }
+                break;
+            case OPT_RECORD_SEGMENT_DURATION:
+                if (!parse_record_segment_duration(
+                            optarg, &opts->record_segment_duration)) {
+                    return false;
+                }
+                break;
+            case OPT_RECORD_SEGMENT_SIZE:
+                if (!parse_record_segment_size(optarg,
+                                               &opts->record_segment_size)) {
+                    return false;
+                }
+                break;
+            case OPT_RECORD_FRAGMENTED:
+                opts->record_fragmented = true;
+                break;
+            case OPT_RECORD_EVENTS:
+                opts->record_events = true;
+                break;
+            case OPT_RECORD_WRITE_SIZE:
+                if (!parse_record_write_size(optarg,
+                                             &opts->record_write_size)) {
+                    return false;
+                }
+                break;
+            case OPT_RECORD_SYNC_INTERVAL:
+                if (!parse_record_sync_interval(optarg,
+                                                &opts->record_sync_interval)) {
+                    return false;
+                }
+                break;
+            case OPT_RECORD_DIRECT_IO:
+                opts->record_direct_io = true;
+                break;
+            case OPT_NO_TCP_NODELAY:
+                opts->tcp_nodelay = false;
+                break;
+            case OPT_TCP_QUICKACK:
+                opts->tcp_quickack = true;
+                break;
+            case OPT_TCP_KEEPALIVE:
+                opts->tcp_keepalive = true;
+                break;
+            case OPT_SOCKET_BUFFER_SIZE:
+                if (!parse_socket_buffer_size(optarg,
+                                              &opts->socket_buffer_size)) {
+                    return false;
+                }
+                break;
+            case OPT_REPLAY_BUFFER:
+                if (!parse_replay_duration(optarg, &opts->replay_duration)) {
+                    return false;
+                }
+                break;
+            case OPT_RECORD_PATH:
+                opts->record_path = optarg;
+                break;
+            case OPT_REPLAY_PATH:
+                opts->replay_path = optarg;
+                break;
+            case OPT_HEADLESS:
+                opts->headless = true;
+                break;
+            case OPT_FRAME_LOG:
+                opts->frame_log_filename = optarg;
+                break;
+            case OPT_SCREENSHOT_PATH:
+                opts->screenshot_path = optarg;
+                break;
+            case OPT_SCREENSHOT_QUALITY:
+                if (!parse_screenshot_quality(optarg,
+                                              &opts->screenshot_quality)) {
+                    return false;
+                }
+                break;
+            case OPT_SCREENSHOT_COMPRESSION:
+                if (!parse_screenshot_compression(
+                            optarg, &opts->screenshot_compression)) {
+                    return false;
+                }
+                break;
             default:
                 // getopt prints the error message on stderr
                 return false;
         }
     }
 
-    if (!opts->display && !opts->record_filename) {
-        LOGE("-N/--no-display requires screen recording (-r/--record)");
+    if (!opts->display && !opts->record_filename
+            && !opts->record_raw_filename) {
+        LOGE("-N/--no-display requires screen recording (-r/--record or "
+             "--record-raw)");
         return false;
     }
 
@@ -522,6 +1197,17 @@ scrcpy_parse_args(struct scrcpy_cli_args *args, int argc, char *argv[]) {
         return false;
     }
 
+    if (!opts->display && (opts->headless || opts->frame_log_filename)) {
+        LOGE("--headless and --frame-log require the frames to be rendered "
+             "(incompatible with -N/--no-display)");
+        return false;
+    }
+
+    if (opts->headless && opts->fullscreen) {
+        LOGE("-f/--fullscreen is incompatible with --headless");
+        return false;
+    }
+
     int index = optind;
     if (index < argc) {
         LOGE("Unexpected additional argument: %s", argv[index]);
@@ -542,10 +1228,71 @@ scrcpy_parse_args(struct scrcpy_cli_args *args, int argc, char *argv[]) {
         }
     }
 
+    if (opts->replay_duration) {
+        opts->replay_format = guess_record_format(opts->replay_path);
+        if (!opts->replay_format) {
+            LOGE("Unsupported replay format for \"%s\" (expected .mp4 or "
+                 ".mkv)", opts->replay_path);
+            return false;
+        }
+    }
+
+    opts->screenshot_format = guess_screenshot_format(opts->screenshot_path);
+    if (!opts->screenshot_format) {
+        LOGE("Unsupported screenshot format for \"%s\" (expected .png, .jpg, "
+             ".jpeg or .ppm)", opts->screenshot_path);
+        return false;
+    }
+
+    opts->record_path_format = guess_record_format(opts->record_path);
+    if (!opts->record_path_format) {
+        LOGE("Unsupported record format for \"%s\" (expected .mp4 or .mkv)",
+             opts->record_path);
+        return false;
+    }
+
+    // the recordings started at runtime use the same output options
+    if (opts->record_fragmented
+            && ((opts->record_filename
+                    && opts->record_format != RECORDER_FORMAT_MP4)
+                || opts->record_path_format != RECORDER_FORMAT_MP4)) {
+        LOGE("Fragmented recording is only supported in mp4");
+        return false;
+    }
+
+    // the recordings started at runtime into an mp4 path are written without
+    // the event track (with a warning)
+    if (opts->record_events && opts->record_filename
+            && opts->record_format != RECORDER_FORMAT_MKV) {
+        LOGE("Recording the events is only supported in mkv");
+        return false;
+    }
+
+    if ((opts->record_sync_interval || opts->record_direct_io)
+            && !opts->record_write_size) {
+        opts->record_write_size = RECORD_IO_DEFAULT_BUFFER_SIZE;
+    }
+
+    if (opts->record_events && !opts->control) {
+        LOGE("Could not record the events if control is disabled");
+        return false;
+    }
+
     if (!opts->control && opts->turn_screen_off) {
         LOGE("Could not request to turn screen off if control is disabled");
         return false;
     }
 
+    if (opts->decoder_threads
+            && opts->decoder_profile == DECODER_PROFILE_DEFAULT) {
+        LOGE("Decoder threads specified without a threaded decoder profile");
+        return false;
+    }
+
+    if (opts->external_server && opts->show_touches) {
+        LOGE("Could not enable \"show touches\" with an external server");
+        return false;
+    }
+
     return true;
 }
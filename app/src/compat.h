@@ -1,7 +1,9 @@
 #ifndef COMPAT_H
 #define COMPAT_H
 
+#include <libavcodec/version.h>
 #include <libavformat/version.h>
+#include <libavutil/version.h>
 #include <SDL2/SDL_version.h>
 
 // In ffmpeg/doc/APIchanges:
@@ -34,6 +36,36 @@
 # define SCRCPY_LAVF_HAS_NEW_ENCODING_DECODING_API
 #endif
 
+// In ffmpeg/doc/APIchanges:
+// 2021-04-27 - lavu 57.0.100 - buffer.h
+//   Buffer sizes are size_t instead of int (FF_API_BUFFER_SIZE_T removed),
+//   including the size passed to the av_buffer_pool_init2() alloc callback.
+#if LIBAVUTIL_VERSION_MAJOR >= 57
+# define SCRCPY_LAVU_HAS_SIZE_T_BUFFER_API
+#endif
+
+// In ffmpeg/doc/APIchanges:
+// 2021-03-10 - lavc 58.134.100 - avcodec.h
+//   Deprecate AVCodecContext.thread_safe_callbacks. Starting with
+//   LIBAVCODEC_VERSION_MAJOR=60, user callbacks must always be thread-safe.
+#if LIBAVCODEC_VERSION_INT < AV_VERSION_INT(58, 134, 100)
+# define SCRCPY_LAVC_HAS_THREAD_SAFE_CALLBACKS
+#endif
+
+// In ffmpeg/doc/APIchanges:
+// 2017-09-01 - a5e1a6c2a4 - lavf 57.81.100 - avio.h
+//   Add avio_context_free(). From now on it must be used for freeing
+//   AVIOContext.
+#if LIBAVFORMAT_VERSION_INT >= AV_VERSION_INT(57, 81, 100)
+# define SCRCPY_LAVF_HAS_AVIO_CONTEXT_FREE
+#endif
+
+// The write_packet callback of avio_alloc_context() takes a const buffer
+// since lavf 61 (FF_API_AVIO_WRITE_NONCONST removed).
+#if LIBAVFORMAT_VERSION_MAJOR >= 61
+# define SCRCPY_LAVF_HAS_AVIO_CONST_WRITE_PACKET
+#endif
+
 #if SDL_VERSION_ATLEAST(2, 0, 5)
 // <https://wiki.libsdl.org/SDL_HINT_MOUSE_FOCUS_CLICKTHROUGH>
 # define SCRCPY_SDL_HAS_HINT_MOUSE_FOCUS_CLICKTHROUGH
@@ -31,6 +31,7 @@ enum control_msg_type {
     CONTROL_MSG_TYPE_ROTATE_DEVICE,
     CONTROL_MSG_TYPE_START_RECORDING,
     CONTROL_MSG_TYPE_END_RECORDING,
+    CONTROL_MSG_TYPE_SAVE_REPLAY,
 };
 
 enum screen_power_mode {
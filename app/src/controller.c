@@ -1,22 +1,27 @@
 #include "controller.h"
 
 #include <assert.h>
+#include <inttypes.h>
+#include <string.h>
 
 #include "config.h"
 #include "util/lock.h"
 #include "util/log.h"
 #include "control_msg.h"
+#include "stream.h"
 
 bool
 controller_init(struct controller *controller, socket_t control_socket, socket_t remote_control_socket,
-                socket_t remote_client_socket) {
-    cbuf_init(&controller->queue);
+                socket_t remote_client_socket,
+                const struct net_socket_options *remote_socket_options) {
+    mpsc_init(&controller->queue);
 
     if (!receiver_init(&controller->receiver, control_socket)) {
         return false;
     }
 
-    if (!remote_init(&controller->remote, remote_control_socket, remote_client_socket, controller)) {
+    if (!remote_init(&controller->remote, remote_control_socket, remote_client_socket, controller,
+                     remote_socket_options)) {
         return false;
     }
 
@@ -26,7 +31,7 @@ controller_init(struct controller *controller, socket_t control_socket, socket_t
         return false;
     }
 
-    if (!(controller->msg_cond = SDL_CreateCond())) {
+    if (!mpsc_waiter_init(&controller->waiter)) {
         receiver_destroy(&controller->receiver);
         remote_destroy(&controller->remote);
         SDL_DestroyMutex(controller->mutex);
@@ -34,19 +39,23 @@ controller_init(struct controller *controller, socket_t control_socket, socket_t
     }
 
     controller->control_socket = control_socket;
-    controller->stopped = false;
+    SDL_AtomicSet(&controller->stopped, 0);
+    SDL_AtomicSet(&controller->event_log_enabled, 0);
     controller->fp_events = NULL;
+    controller->stream = NULL;
+    memset(&controller->stats, 0, sizeof(controller->stats));
+    histogram_init(&controller->stats.batch_size);
 
     return true;
 }
 
 void
 controller_destroy(struct controller *controller) {
-    SDL_DestroyCond(controller->msg_cond);
+    mpsc_waiter_destroy(&controller->waiter);
     SDL_DestroyMutex(controller->mutex);
 
     struct control_msg msg;
-    while (cbuf_take(&controller->queue, &msg)) {
+    while (mpsc_take(&controller->queue, &msg)) {
         control_msg_destroy(&msg);
     }
 
@@ -56,12 +65,9 @@ controller_destroy(struct controller *controller) {
 }
 
 
-bool
-controller_push_msg(struct controller *controller,
-                    const struct control_msg *msg) {
+static void
+log_event(struct controller *controller, const char *json) {
     mutex_lock(controller->mutex);
-    bool was_empty = cbuf_is_empty(&controller->queue);
-    bool res = cbuf_push(&controller->queue, *msg);
     FILE *fp = controller->fp_events;
     if (fp != NULL) {
         bool need_recording = 1;
@@ -81,30 +87,100 @@ controller_push_msg(struct controller *controller,
 //                break;
 //        }
         if (need_recording) {
-            char *json = control_msg_to_json(msg);
-            if (json != NULL) {
-                fprintf(fp, "%s", json);
-                SDL_free(json);
-            }
+            fprintf(fp, "%s", json);
         }
     }
-    if (was_empty) {
-        cond_signal(controller->msg_cond);
-    }
     mutex_unlock(controller->mutex);
+}
+
+bool
+controller_push_msg(struct controller *controller,
+                    const struct control_msg *msg) {
+    // once pushed, msg belongs to the controller thread, which may destroy
+    // it (and free its text) at any time: serialize it before
+    char *event = NULL;
+    bool log = SDL_AtomicGet(&controller->event_log_enabled);
+    if (log || controller->stream) {
+        event = control_msg_to_json(msg);
+    }
+
+    bool res = mpsc_push(&controller->queue, *msg);
+    if (res) {
+        mpsc_waiter_notify(&controller->waiter);
+    }
+
+    if (log && event) {
+        log_event(controller, event);
+    }
+
+    if (res && event && controller->stream) {
+        stream_push_event(controller->stream, event);
+    }
+    SDL_free(event);
     return res;
 }
 
+
+// wait for the next msg
+// return false if the controller is stopped
 static bool
-process_msg(struct controller *controller,
-            const struct control_msg *msg) {
-    unsigned char serialized_msg[CONTROL_MSG_SERIALIZED_MAX_SIZE];
-    int length = control_msg_serialize(msg, serialized_msg);
-    if (!length) {
-        return false;
+take_msg(struct controller *controller, struct control_msg *msg) {
+    for (;;) {
+        if (SDL_AtomicGet(&controller->stopped)) {
+            // stop immediately, do not process further msgs
+            return false;
+        }
+        if (mpsc_take(&controller->queue, msg)) {
+            return true;
+        }
+
+        mpsc_waiter_prepare(&controller->waiter);
+        // check again, a producer may have pushed before it could see the
+        // flag
+        if (!mpsc_is_empty(&controller->queue)
+                || SDL_AtomicGet(&controller->stopped)) {
+            mpsc_waiter_cancel(&controller->waiter);
+        } else {
+            mpsc_waiter_wait(&controller->waiter);
+        }
     }
-    int w = net_send_all(controller->control_socket, serialized_msg, length);
-    return w == length;
+}
+
+// serialize msg, then all the msgs already queued (as long as they fit),
+// and send them with a single write
+static bool
+process_batch(struct controller *controller, struct control_msg *msg) {
+    size_t len = 0;
+    unsigned count = 0;
+    for (;;) {
+        int length = control_msg_serialize(msg, &controller->batch[len]);
+        control_msg_destroy(msg);
+        if (!length) {
+            return false;
+        }
+        len += length;
+        ++count;
+
+        if (CONTROLLER_BATCH_BUFFER_SIZE - len
+                < CONTROL_MSG_SERIALIZED_MAX_SIZE) {
+            // the remaining msgs will be sent in the next batch
+            break;
+        }
+        if (!mpsc_take(&controller->queue, msg)) {
+            break;
+        }
+    }
+
+    ssize_t w = net_send_all(controller->control_socket, controller->batch,
+                             len);
+
+    struct controller_stats *stats = &controller->stats;
+    stats->msgs += count;
+    ++stats->batches;
+    stats->bytes += len;
+    histogram_record(&stats->batch_size, count);
+
+    return w == (ssize_t) len;
 }
 
 static int
@@ -112,24 +188,12 @@ run_controller(void *data) {
     struct controller *controller = data;
 
     for (;;) {
-        mutex_lock(controller->mutex);
-        while (!controller->stopped && cbuf_is_empty(&controller->queue)) {
-            cond_wait(controller->msg_cond, controller->mutex);
-        }
-        if (controller->stopped) {
-            // stop immediately, do not process further msgs
-            mutex_unlock(controller->mutex);
+        struct control_msg msg;
+        if (!take_msg(controller, &msg)) {
             break;
         }
-        struct control_msg msg;
-        bool non_empty = cbuf_take(&controller->queue, &msg);
-        assert(non_empty);
-        (void) non_empty;
-        mutex_unlock(controller->mutex);
 
-        bool ok = process_msg(controller, &msg);
-        control_msg_destroy(&msg);
-        if (!ok) {
+        if (!process_batch(controller, &msg)) {
             LOGD("Could not write msg to socket");
             break;
         }
@@ -137,6 +201,21 @@ run_controller(void *data) {
     return 0;
 }
 
+static void
+controller_log_stats(const struct controller_stats *stats) {
+    if (!stats->batches) {
+        return;
+    }
+    const struct histogram *batch_size = &stats->batch_size;
+    LOGI("Controller: %" PRIu64 " msgs (%" PRIu64 " bytes) in %" PRIu64
+         " writes, msgs per write (avg/p50/p99/max): %.2f/%u/%u/%u",
+         stats->msgs, stats->bytes, stats->batches,
+         (double) stats->msgs / stats->batches,
+         histogram_percentile(batch_size, 50),
+         histogram_percentile(batch_size, 99),
+         batch_size->max);
+}
+
 bool
 controller_start(struct controller *controller) {
     LOGD("Starting controller thread");
@@ -165,15 +244,15 @@ controller_start(struct controller *controller) {
 
 void
 controller_stop(struct controller *controller) {
-    mutex_lock(controller->mutex);
-    controller->stopped = true;
-    cond_signal(controller->msg_cond);
-    mutex_unlock(controller->mutex);
+    SDL_AtomicSet(&controller->stopped, 1);
+    mpsc_waiter_notify(&controller->waiter);
 }
 
 void
 controller_join(struct controller *controller) {
     SDL_WaitThread(controller->thread, NULL);
+    // the controller thread is joined, no need to lock
+    controller_log_stats(&controller->stats);
     receiver_join(&controller->receiver);
     remote_join(&controller->remote);
 }
@@ -181,7 +260,7 @@ controller_join(struct controller *controller) {
 
 void
 controller_start_recording(struct controller *controller) {
-
+    mutex_lock(controller->mutex);
     FILE *fp = controller->fp_events;
     if (fp != NULL) {
         fclose(fp);
@@ -189,15 +268,21 @@ controller_start_recording(struct controller *controller) {
     }
     LOGI("Start recording...");
     controller->fp_events = fopen("saved_event.json", "w");
+    SDL_AtomicSet(&controller->event_log_enabled,
+                  controller->fp_events != NULL);
+    mutex_unlock(controller->mutex);
 }
 
 void
 controller_stop_recording(struct controller *controller) {
+    mutex_lock(controller->mutex);
     FILE *fp = controller->fp_events;
     if (fp != NULL) {
         LOGI("Stop recording");
         fflush(fp);
         fclose(fp);
         controller->fp_events = NULL;
+        SDL_AtomicSet(&controller->event_log_enabled, 0);
     }
+    mutex_unlock(controller->mutex);
 }
\ No newline at end of file
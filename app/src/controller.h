@@ -2,6 +2,7 @@
 #define CONTROLLER_H
 
 #include <stdbool.h>
+#include <SDL2/SDL_atomic.h>
 #include <SDL2/SDL_mutex.h>
 #include <SDL2/SDL_thread.h>
 
@@ -9,26 +10,49 @@
 #include "control_msg.h"
 #include "receiver.h"
 #include "remote.h"
-#include "util/cbuf.h"
+#include "util/histogram.h"
+#include "util/mpsc.h"
 #include "util/net.h"
 
-struct control_msg_queue CBUF(struct control_msg, 64);
+struct control_msg_queue MPSC(struct control_msg, 64);
+
+// the queued msgs are serialized back-to-back into a single buffer, and sent
+// at once
+#define CONTROLLER_BATCH_BUFFER_SIZE 0x10000
+
+struct controller_stats {
+    uint64_t msgs;
+    uint64_t batches; // number of writes to the socket
+    uint64_t bytes;
+    struct histogram batch_size; // msgs per batch
+};
+
+struct stream;
 
 struct controller {
     socket_t control_socket;
     SDL_Thread *thread;
-    SDL_mutex *mutex;
-    SDL_cond *msg_cond;
-    bool stopped;
-    FILE *fp_events;
+    // the messages are pushed from several threads (the input events and the
+    // remote) without any lock
+    struct mpsc_waiter waiter;
+    SDL_atomic_t stopped;
+    SDL_mutex *mutex; // only used for the event log
+    SDL_atomic_t event_log_enabled; // fp_events is not NULL
+    FILE *fp_events; // protected by the mutex
+    // if set, the pushed messages are also written in the current recording
+    struct stream *stream;
     struct control_msg_queue queue;
+    // only accessed from the controller thread
+    unsigned char batch[CONTROLLER_BATCH_BUFFER_SIZE];
+    struct controller_stats stats;
     struct receiver receiver;
     struct remote remote;
 };
 
 bool
 controller_init(struct controller *controller, socket_t control_socket,
-        socket_t remote_control_socket,socket_t remote_client_socket);
+        socket_t remote_control_socket,socket_t remote_client_socket,
+        const struct net_socket_options *remote_socket_options);
 
 void
 controller_destroy(struct controller *controller);
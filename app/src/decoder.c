@@ -1,5 +1,6 @@
 #include "decoder.h"
 
+#include <inttypes.h>
 #include <libavformat/avformat.h>
 #include <libavutil/time.h>
 #include <SDL2/SDL_events.h>
@@ -10,30 +11,86 @@
 #include "config.h"
 #include "compat.h"
 #include "events.h"
+#include "frame_latency.h"
 #include "recorder.h"
 #include "video_buffer.h"
 #include "util/buffer_util.h"
 #include "util/log.h"
 
 // set the decoded frame as ready for rendering, and notify
-static void
+// return the time spent, in microseconds (it may block until the previous
+// frame is rendered if the frames must not be skipped)
+static int64_t
 push_frame(struct decoder *decoder) {
+    int64_t start = av_gettime_relative();
+    if (decoder->latency) {
+        frame_latency_mark(decoder->latency,
+                           decoder->video_buffer->decoding_frame->pts,
+                           FRAME_LATENCY_DECODED);
+    }
+
     bool previous_frame_skipped;
     video_buffer_offer_decoded_frame(decoder->video_buffer,
                                      &previous_frame_skipped);
-    if (previous_frame_skipped) {
-        // the previous EVENT_NEW_FRAME will consume this frame
-        return;
+    if (!previous_frame_skipped) {
+        // else the previous EVENT_NEW_FRAME will consume this frame
+        static SDL_Event new_frame_event = {
+            .type = EVENT_NEW_FRAME,
+        };
+        SDL_PushEvent(&new_frame_event);
     }
-    static SDL_Event new_frame_event = {
-        .type = EVENT_NEW_FRAME,
-    };
-    SDL_PushEvent(&new_frame_event);
+    return av_gettime_relative() - start;
 }
 
 void
-decoder_init(struct decoder *decoder, struct video_buffer *vb) {
+decoder_init(struct decoder *decoder, struct video_buffer *vb,
+             struct frame_latency *latency,
+             const struct decoder_params *params) {
     decoder->video_buffer = vb;
+    decoder->latency = latency;
+    decoder->params = *params;
+}
+
+static const char *
+profile_name(enum decoder_profile profile) {
+    switch (profile) {
+        case DECODER_PROFILE_LOW_LATENCY:
+            return "low-latency";
+        case DECODER_PROFILE_THROUGHPUT:
+            return "throughput";
+        default:
+            return "default";
+    }
+}
+
+static const char *
+thread_type_name(int thread_type) {
+    switch (thread_type) {
+        case FF_THREAD_SLICE:
+            return "slice threads";
+        case FF_THREAD_FRAME:
+            return "frame threads";
+        default:
+            return "no threading";
+    }
+}
+
+static void
+apply_profile(AVCodecContext *codec_ctx, const struct decoder_params *params) {
+    switch (params->profile) {
+        case DECODER_PROFILE_LOW_LATENCY:
+            codec_ctx->thread_type = FF_THREAD_SLICE;
+            codec_ctx->thread_count = params->threads;
+            codec_ctx->flags |= AV_CODEC_FLAG_LOW_DELAY;
+            break;
+        case DECODER_PROFILE_THROUGHPUT:
+            codec_ctx->thread_type = FF_THREAD_FRAME;
+            codec_ctx->thread_count = params->threads;
+            break;
+        default:
+            // keep the FFmpeg defaults
+            break;
+    }
 }
 
 bool
@@ -44,23 +101,76 @@ decoder_open(struct decoder *decoder, const AVCodec *codec) {
         return false;
     }
 
+    apply_profile(decoder->codec_ctx, &decoder->params);
+
+    if (decoder->params.texture_frames) {
+        if (!texture_frame_allocator_init(&decoder->frame_allocator)) {
+            avcodec_free_context(&decoder->codec_ctx);
+            return false;
+        }
+        texture_frame_allocator_install(&decoder->frame_allocator,
+                                        decoder->codec_ctx);
+    }
+
     if (avcodec_open2(decoder->codec_ctx, codec, NULL) < 0) {
         LOGE("Could not open codec");
-        avcodec_free_context(&decoder->codec_ctx);
-        return false;
+        goto error_free_codec_ctx;
+    }
+
+    if (!packet_queue_init(&decoder->queue, decoder->params.queue_depth,
+                           decoder->params.queue_policy)) {
+        avcodec_close(decoder->codec_ctx);
+        goto error_free_codec_ctx;
     }
 
+    histogram_init(&decoder->decode_time);
+
+    // the thread count is resolved by avcodec_open2() if it was automatic
+    LOGI("Decoder profile: %s (%s, %d threads)",
+         profile_name(decoder->params.profile),
+         thread_type_name(decoder->codec_ctx->active_thread_type),
+         decoder->codec_ctx->thread_count);
     return true;
+
+error_free_codec_ctx:
+    avcodec_free_context(&decoder->codec_ctx);
+    if (decoder->params.texture_frames) {
+        texture_frame_allocator_destroy(&decoder->frame_allocator);
+    }
+    return false;
+}
+
+static void
+log_decode_time(const struct histogram *decode_time) {
+    if (!decode_time->count) {
+        return;
+    }
+    LOGI("Decode time (ms, p50/p95/p99/max, %" PRIu64 " packets): "
+         "%.1f/%.1f/%.1f/%.1f", decode_time->count,
+         histogram_percentile(decode_time, 50) / 1000.0,
+         histogram_percentile(decode_time, 95) / 1000.0,
+         histogram_percentile(decode_time, 99) / 1000.0,
+         decode_time->max / 1000.0);
 }
 
 void
 decoder_close(struct decoder *decoder) {
+    log_decode_time(&decoder->decode_time);
+    packet_queue_log_stats(&decoder->queue, "Decoder");
+    packet_queue_destroy(&decoder->queue);
     avcodec_close(decoder->codec_ctx);
     avcodec_free_context(&decoder->codec_ctx);
+    if (decoder->params.texture_frames) {
+        // the frames still referenced by the video buffer remain valid
+        texture_frame_allocator_destroy(&decoder->frame_allocator);
+    }
 }
 
-bool
-decoder_push(struct decoder *decoder, const AVPacket *packet) {
+// decode the packet, or drain the decoder if packet is NULL
+// the time spent in push_frame() is added to push_time
+static bool
+decode_packet(struct decoder *decoder, const AVPacket *packet,
+              int64_t *push_time) {
 // the new decoding/encoding API has been introduced by:
 // <http://git.videolan.org/?p=ffmpeg.git;a=commitdiff;h=7fc329e2dd6226dfecaa4a1d7adf353bf2773726>
 #ifdef SCRCPY_LAVF_HAS_NEW_ENCODING_DECODING_API
@@ -69,32 +179,120 @@ decoder_push(struct decoder *decoder, const AVPacket *packet) {
         LOGE("Could not send video packet: %d", ret);
         return false;
     }
-    ret = avcodec_receive_frame(decoder->codec_ctx,
-                                decoder->video_buffer->decoding_frame);
-    if (!ret) {
+    // with frame threading, a packet may output zero or several frames
+    for (;;) {
+        ret = avcodec_receive_frame(decoder->codec_ctx,
+                                    decoder->video_buffer->decoding_frame);
+        if (ret) {
+            break;
+        }
         // a frame was received
-        push_frame(decoder);
-    } else if (ret != AVERROR(EAGAIN)) {
+        *push_time += push_frame(decoder);
+    }
+    // once drained, the decoder returns AVERROR_EOF instead of EAGAIN
+    if (ret != AVERROR(EAGAIN) && (packet || ret != AVERROR_EOF)) {
         LOGE("Could not receive video frame: %d", ret);
         return false;
     }
 #else
+    AVPacket empty;
+    if (!packet) {
+        // the old API is drained by empty packets, one frame per call
+        av_init_packet(&empty);
+        empty.data = NULL;
+        empty.size = 0;
+        packet = &empty;
+    }
     int got_picture;
-    int len = avcodec_decode_video2(decoder->codec_ctx,
-                                    decoder->video_buffer->decoding_frame,
-                                    &got_picture,
-                                    packet);
-    if (len < 0) {
-        LOGE("Could not decode video packet: %d", len);
-        return false;
+    do {
+        int len = avcodec_decode_video2(decoder->codec_ctx,
+                                        decoder->video_buffer->decoding_frame,
+                                        &got_picture,
+                                        packet);
+        if (len < 0) {
+            LOGE("Could not decode video packet: %d", len);
+            return false;
+        }
+        if (got_picture) {
+            *push_time += push_frame(decoder);
+        }
+    } while (packet == &empty && got_picture);
+#endif
+    return true;
+}
+
+static int
+run_decoder(void *data) {
+    struct decoder *decoder = data;
+
+    AVPacket packet;
+    while (packet_queue_take(&decoder->queue, &packet)) {
+        // an empty packet marks the end of stream (see decoder_drain())
+        bool eos = !packet.size;
+        int64_t start = av_gettime_relative();
+        int64_t push_time = 0;
+        bool ok = decode_packet(decoder, eos ? NULL : &packet, &push_time);
+        if (!eos) {
+            // push_frame() is excluded, it may block until the previous frame
+            // is rendered (--render-expired-frames)
+            histogram_record(&decoder->decode_time,
+                             av_gettime_relative() - start - push_time);
+        }
+        av_packet_unref(&packet);
+        if (!ok) {
+            // make decoder_push() fail, so that the stream stops
+            packet_queue_stop(&decoder->queue);
+            break;
+        }
+        if (eos) {
+            LOGD("Decoder drained");
+            break;
+        }
     }
-    if (got_picture) {
-        push_frame(decoder);
+
+    LOGD("Decoder thread ended");
+    return 0;
+}
+
+bool
+decoder_start(struct decoder *decoder) {
+    LOGD("Starting decoder thread");
+
+    decoder->thread = SDL_CreateThread(run_decoder, "decoder", decoder);
+    if (!decoder->thread) {
+        LOGC("Could not start decoder thread");
+        return false;
     }
-#endif
     return true;
 }
 
+void
+decoder_stop(struct decoder *decoder) {
+    packet_queue_stop(&decoder->queue);
+}
+
+void
+decoder_join(struct decoder *decoder) {
+    SDL_WaitThread(decoder->thread, NULL);
+}
+
+bool
+decoder_push(struct decoder *decoder, const AVPacket *packet) {
+    return packet_queue_push(&decoder->queue, packet);
+}
+
+bool
+decoder_drain(struct decoder *decoder) {
+    AVPacket eos;
+    av_init_packet(&eos);
+    eos.data = NULL;
+    eos.size = 0;
+    // without pts, like a config packet, so that it is never dropped
+    eos.pts = AV_NOPTS_VALUE;
+    eos.dts = AV_NOPTS_VALUE;
+    return packet_queue_push(&decoder->queue, &eos);
+}
+
 void
 decoder_interrupt(struct decoder *decoder) {
     video_buffer_interrupt(decoder->video_buffer);
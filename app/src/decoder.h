@@ -3,18 +3,55 @@
 
 #include <stdbool.h>
 #include <libavformat/avformat.h>
+#include <SDL2/SDL_thread.h>
 
 #include "config.h"
+#include "packet_queue.h"
+#include "texture_frame.h"
+#include "util/histogram.h"
 
+struct frame_latency;
 struct video_buffer;
 
+enum decoder_profile {
+    // FFmpeg defaults (single-threaded)
+    DECODER_PROFILE_DEFAULT,
+    // slice threading (only effective if the encoder produces several slices
+    // per frame), without any frame delay
+    DECODER_PROFILE_LOW_LATENCY,
+    // frame threading: a higher throughput (for large resolutions), at the
+    // cost of one frame of delay per additional thread
+    DECODER_PROFILE_THROUGHPUT,
+};
+
+struct decoder_params {
+    unsigned queue_depth;
+    enum packet_queue_policy queue_policy;
+    enum decoder_profile profile;
+    unsigned threads; // 0 for automatic (ignored by the default profile)
+    // allocate the frames in the layout of the screen texture
+    bool texture_frames;
+};
+
+// the packets are decoded on a separate thread, so that a slow decoding does
+// not delay the socket reads
 struct decoder {
     struct video_buffer *video_buffer;
+    struct frame_latency *latency; // may be NULL
+    struct decoder_params params;
     AVCodecContext *codec_ctx;
+    struct texture_frame_allocator frame_allocator; // if texture_frames
+    SDL_Thread *thread;
+    struct packet_queue queue;
+    // time spent in the decoder for each packet, in microseconds
+    // only accessed by the decoder thread (then by decoder_close())
+    struct histogram decode_time;
 };
 
 void
-decoder_init(struct decoder *decoder, struct video_buffer *vb);
+decoder_init(struct decoder *decoder, struct video_buffer *vb,
+             struct frame_latency *latency,
+             const struct decoder_params *params);
 
 bool
 decoder_open(struct decoder *decoder, const AVCodec *codec);
@@ -22,9 +59,27 @@ decoder_open(struct decoder *decoder, const AVCodec *codec);
 void
 decoder_close(struct decoder *decoder);
 
+bool
+decoder_start(struct decoder *decoder);
+
+void
+decoder_stop(struct decoder *decoder);
+
+void
+decoder_join(struct decoder *decoder);
+
+// queue the packet for decoding
+// return false if the decoder has stopped (on error)
 bool
 decoder_push(struct decoder *decoder, const AVPacket *packet);
 
+// on end of stream, decode the packets still queued and output the frames
+// delayed by the decoder (with frame threading), then terminate the decoder
+// thread (decoder_stop() must not be called, it would discard them)
+// return false if the decoder has stopped (on error)
+bool
+decoder_drain(struct decoder *decoder);
+
 void
 decoder_interrupt(struct decoder *decoder);
 
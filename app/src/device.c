@@ -1,16 +1,22 @@
 #include "device.h"
 
+#include <string.h>
+
 #include "config.h"
 #include "util/log.h"
 
 bool
-device_read_info(socket_t device_socket, char *device_name, struct size *size) {
-    unsigned char buf[DEVICE_NAME_FIELD_LENGTH + 4];
+device_read_info(socket_t device_socket, char *device_name, struct size *size,
+                 uint8_t *raw) {
+    unsigned char buf[DEVICE_INFO_SIZE];
     int r = net_recv_all(device_socket, buf, sizeof(buf));
-    if (r < DEVICE_NAME_FIELD_LENGTH + 4) {
+    if (r < DEVICE_INFO_SIZE) {
         LOGE("Could not retrieve device information");
         return false;
     }
+    if (raw) {
+        memcpy(raw, buf, DEVICE_INFO_SIZE);
+    }
     // in case the client sends garbage
     buf[DEVICE_NAME_FIELD_LENGTH - 1] = '\0';
     // strcpy is safe here, since name contains at least
@@ -8,9 +8,12 @@
 #include "util/net.h"
 
 #define DEVICE_NAME_FIELD_LENGTH 64
+#define DEVICE_INFO_SIZE (DEVICE_NAME_FIELD_LENGTH + 4)
 
 // name must be at least DEVICE_NAME_FIELD_LENGTH bytes
+// if raw is not NULL, the DEVICE_INFO_SIZE bytes received are copied to it
 bool
-device_read_info(socket_t device_socket, char *device_name, struct size *size);
+device_read_info(socket_t device_socket, char *device_name, struct size *size,
+                 uint8_t *raw);
 
 #endif
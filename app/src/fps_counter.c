@@ -1,6 +1,7 @@
 #include "fps_counter.h"
 
 #include <assert.h>
+#include <stdio.h>
 #include <SDL2/SDL_timer.h>
 
 #include "config.h"
@@ -10,7 +11,7 @@
 #define FPS_COUNTER_INTERVAL_MS 1000
 
 bool
-fps_counter_init(struct fps_counter *counter) {
+fps_counter_init(struct fps_counter *counter, struct frame_latency *latency) {
     counter->mutex = SDL_CreateMutex();
     if (!counter->mutex) {
         return false;
@@ -22,6 +23,7 @@ fps_counter_init(struct fps_counter *counter) {
         return false;
     }
 
+    counter->latency = latency;
     counter->thread = NULL;
     SDL_AtomicSet(&counter->started, 0);
     // no need to initialize the other fields, they are unused until started
@@ -40,12 +42,19 @@ static void
 display_fps(struct fps_counter *counter) {
     unsigned rendered_per_second =
         counter->nr_rendered * 1000 / FPS_COUNTER_INTERVAL_MS;
-    if (counter->nr_skipped) {
-        LOGI("%u fps (+%u frames skipped)", rendered_per_second,
-                                            counter->nr_skipped);
-    } else {
-        LOGI("%u fps", rendered_per_second);
+    char details[64] = "";
+    if (counter->nr_skipped && counter->nr_deduplicated) {
+        snprintf(details, sizeof(details),
+                 " (+%u frames skipped, %u frames deduplicated)",
+                 counter->nr_skipped, counter->nr_deduplicated);
+    } else if (counter->nr_skipped) {
+        snprintf(details, sizeof(details), " (+%u frames skipped)",
+                 counter->nr_skipped);
+    } else if (counter->nr_deduplicated) {
+        snprintf(details, sizeof(details), " (%u frames deduplicated)",
+                 counter->nr_deduplicated);
     }
+    LOGI("%u fps%s", rendered_per_second, details);
 }
 
 // must be called with mutex locked
@@ -56,8 +65,12 @@ check_interval_expired(struct fps_counter *counter, uint32_t now) {
     }
 
     display_fps(counter);
+    if (counter->latency) {
+        frame_latency_log_interval(counter->latency);
+    }
     counter->nr_rendered = 0;
     counter->nr_skipped = 0;
+    counter->nr_deduplicated = 0;
     // add a multiple of the interval
     uint32_t elapsed_slices =
         (now - counter->next_timestamp) / FPS_COUNTER_INTERVAL_MS + 1;
@@ -94,8 +107,14 @@ fps_counter_start(struct fps_counter *counter) {
     counter->next_timestamp = SDL_GetTicks() + FPS_COUNTER_INTERVAL_MS;
     counter->nr_rendered = 0;
     counter->nr_skipped = 0;
+    counter->nr_deduplicated = 0;
     mutex_unlock(counter->mutex);
 
+    if (counter->latency) {
+        // do not report the frames presented while the counter was stopped
+        frame_latency_reset_interval(counter->latency);
+    }
+
     SDL_AtomicSet(&counter->started, 1);
     cond_signal(counter->state_cond);
 
@@ -168,3 +187,16 @@ fps_counter_add_skipped_frame(struct fps_counter *counter) {
     ++counter->nr_skipped;
     mutex_unlock(counter->mutex);
 }
+
+void
+fps_counter_add_deduplicated_frame(struct fps_counter *counter) {
+    if (!SDL_AtomicGet(&counter->started)) {
+        return;
+    }
+
+    mutex_lock(counter->mutex);
+    uint32_t now = SDL_GetTicks();
+    check_interval_expired(counter, now);
+    ++counter->nr_deduplicated;
+    mutex_unlock(counter->mutex);
+}
@@ -8,11 +8,14 @@
 #include <SDL2/SDL_thread.h>
 
 #include "config.h"
+#include "frame_latency.h"
 
 struct fps_counter {
     SDL_Thread *thread;
     SDL_mutex *mutex;
     SDL_cond *state_cond;
+    // if not NULL, the frame latencies are logged along with the FPS
+    struct frame_latency *latency;
 
     // atomic so that we can check without locking the mutex
     // if the FPS counter is disabled, we don't want to lock unnecessarily
@@ -22,11 +25,12 @@ struct fps_counter {
     bool interrupted;
     unsigned nr_rendered;
     unsigned nr_skipped;
+    unsigned nr_deduplicated;
     uint32_t next_timestamp;
 };
 
 bool
-fps_counter_init(struct fps_counter *counter);
+fps_counter_init(struct fps_counter *counter, struct frame_latency *latency);
 
 void
 fps_counter_destroy(struct fps_counter *counter);
@@ -54,4 +58,9 @@ fps_counter_add_rendered_frame(struct fps_counter *counter);
 void
 fps_counter_add_skipped_frame(struct fps_counter *counter);
 
+// a rendered frame was identical to the previous one (it is also counted as
+// rendered)
+void
+fps_counter_add_deduplicated_frame(struct fps_counter *counter);
+
 #endif
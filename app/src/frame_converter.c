@@ -0,0 +1,211 @@
+#include "frame_converter.h"
+
+#include <assert.h>
+#include <string.h>
+#include <libavutil/imgutils.h>
+#include <libswscale/swscale.h>
+
+#include "config.h"
+#include "util/log.h"
+
+void
+frame_converter_init(struct frame_converter *fc) {
+    memset(fc, 0, sizeof(*fc));
+}
+
+static void
+release_entry(struct frame_converter_entry *entry) {
+    sws_freeContext(entry->sws_ctx);
+    // the buffers still referenced are released when their last reference is
+    // dropped
+    av_buffer_pool_uninit(&entry->pool);
+    memset(entry, 0, sizeof(*entry));
+}
+
+void
+frame_converter_destroy(struct frame_converter *fc) {
+    for (int i = 0; i < FRAME_CONVERTER_CACHE_SIZE; ++i) {
+        release_entry(&fc->entries[i]);
+    }
+}
+
+static bool
+entry_matches(const struct frame_converter_entry *entry, const AVFrame *src,
+              enum AVPixelFormat format, int width, int height) {
+    return entry->pool
+        && entry->src_width == src->width
+        && entry->src_height == src->height
+        && entry->src_format == src->format
+        && entry->dst_width == width
+        && entry->dst_height == height
+        && entry->dst_format == format;
+}
+
+// return the downscaling factor if the conversion is supported by the
+// yuv_convert kernels, or 0
+static int
+get_yuv_factor(const AVFrame *src, enum AVPixelFormat format, int width,
+               int height, enum yuv_convert_format *yuv_format) {
+    if (src->format != AV_PIX_FMT_YUV420P
+            || src->color_range == AVCOL_RANGE_JPEG) {
+        return 0;
+    }
+
+    switch (format) {
+        case AV_PIX_FMT_RGB24:
+            *yuv_format = YUV_CONVERT_FORMAT_RGB24;
+            break;
+        case AV_PIX_FMT_BGR24:
+            *yuv_format = YUV_CONVERT_FORMAT_BGR24;
+            break;
+        case AV_PIX_FMT_RGBA:
+            *yuv_format = YUV_CONVERT_FORMAT_RGBA;
+            break;
+        case AV_PIX_FMT_GRAY8:
+            *yuv_format = YUV_CONVERT_FORMAT_GRAY8;
+            break;
+        default:
+            return 0;
+    }
+
+    for (int factor = 1; factor <= 4; factor *= 2) {
+        if (width == src->width / factor && height == src->height / factor) {
+            return factor;
+        }
+    }
+    return 0;
+}
+
+// return the entry for the conversion, replacing the least recently used one
+// if it is not cached
+static struct frame_converter_entry *
+get_entry(struct frame_converter *fc, const AVFrame *src,
+          enum AVPixelFormat format, int width, int height) {
+    struct frame_converter_entry *lru = &fc->entries[0];
+    for (int i = 0; i < FRAME_CONVERTER_CACHE_SIZE; ++i) {
+        struct frame_converter_entry *entry = &fc->entries[i];
+        if (entry_matches(entry, src, format, width, height)) {
+            return entry;
+        }
+        if (entry->last_used < lru->last_used) {
+            lru = entry;
+        }
+    }
+
+    ++fc->stats.cache_misses;
+
+    lru->yuv_factor = get_yuv_factor(src, format, width, height,
+                                     &lru->yuv_format);
+    if (lru->yuv_factor) {
+        sws_freeContext(lru->sws_ctx);
+        lru->sws_ctx = NULL;
+    } else {
+        // the previous context of the entry is reused if possible
+        lru->sws_ctx = sws_getCachedContext(lru->sws_ctx, src->width,
+                                            src->height, src->format,
+                                            width, height, format,
+                                            SWS_BILINEAR, NULL, NULL, NULL);
+        if (!lru->sws_ctx) {
+            LOGE("Could not initialize conversion context");
+            release_entry(lru);
+            return NULL;
+        }
+    }
+
+    int size = av_image_get_buffer_size(format, width, height,
+                                        FRAME_CONVERTER_ALIGN);
+    if (size < 0) {
+        LOGE("Could not compute conversion buffer size");
+        release_entry(lru);
+        return NULL;
+    }
+
+    if (!lru->pool || size != lru->buffer_size) {
+        av_buffer_pool_uninit(&lru->pool);
+        lru->pool = av_buffer_pool_init(size, NULL);
+        if (!lru->pool) {
+            LOGC("Could not create conversion buffer pool");
+            release_entry(lru);
+            return NULL;
+        }
+        lru->buffer_size = size;
+    }
+
+    lru->src_width = src->width;
+    lru->src_height = src->height;
+    lru->src_format = src->format;
+    lru->dst_width = width;
+    lru->dst_height = height;
+    lru->dst_format = format;
+    return lru;
+}
+
+bool
+frame_converter_convert(struct frame_converter *fc, const AVFrame *src,
+                        enum AVPixelFormat format, int width, int height,
+                        AVFrame *dst) {
+    assert(!dst->buf[0]);
+    if (!width) {
+        width = src->width;
+    }
+    if (!height) {
+        height = src->height;
+    }
+
+    struct frame_converter_entry *entry =
+        get_entry(fc, src, format, width, height);
+    if (!entry) {
+        return false;
+    }
+    entry->last_used = ++fc->use_counter;
+
+    dst->buf[0] = av_buffer_pool_get(entry->pool);
+    if (!dst->buf[0]) {
+        LOGC("Could not allocate conversion buffer");
+        return false;
+    }
+
+    av_image_fill_arrays(dst->data, dst->linesize, dst->buf[0]->data, format,
+                         width, height, FRAME_CONVERTER_ALIGN);
+    dst->format = format;
+    dst->width = width;
+    dst->height = height;
+    if (av_frame_copy_props(dst, src)) {
+        LOGW("Could not copy frame properties");
+    }
+
+    if (entry->yuv_factor) {
+        if (!yuv_convert(src, entry->yuv_format, entry->yuv_factor,
+                         dst->data[0], dst->linesize[0])) {
+            av_frame_unref(dst);
+            return false;
+        }
+    } else {
+        sws_scale(entry->sws_ctx, (const uint8_t *const *) src->data,
+                  src->linesize, 0, src->height, dst->data, dst->linesize);
+    }
+
+    ++fc->stats.conversions;
+    return true;
+}
+
+void
+frame_converter_fit_size(int width, int height, int max_size,
+                         int *out_width, int *out_height) {
+    if (!max_size || (width <= max_size && height <= max_size)) {
+        *out_width = width;
+        *out_height = height;
+        return;
+    }
+
+    if (width > height) {
+        *out_width = max_size;
+        *out_height = (int) ((int64_t) height * max_size / width);
+    } else {
+        *out_width = (int) ((int64_t) width * max_size / height);
+        *out_height = max_size;
+    }
+    // round down to even dimensions (but never to 0)
+    *out_width = *out_width > 1 ? *out_width & ~1 : 1;
+    *out_height = *out_height > 1 ? *out_height & ~1 : 1;
+}
@@ -0,0 +1,84 @@
+#ifndef FRAME_CONVERTER_H
+#define FRAME_CONVERTER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <libavutil/frame.h>
+#include <libavutil/pixfmt.h>
+
+#include "config.h"
+#include "yuv_convert.h"
+
+// number of distinct conversions (source size and format, destination size
+// and format) kept ready at the same time
+#define FRAME_CONVERTER_CACHE_SIZE 4
+
+// alignment of the destination lines (padding may follow each line, always
+// use the linesize of the output frame)
+#define FRAME_CONVERTER_ALIGN 32
+
+struct frame_converter_entry {
+    int src_width;
+    int src_height;
+    enum AVPixelFormat src_format;
+    int dst_width;
+    int dst_height;
+    enum AVPixelFormat dst_format;
+
+    // the conversion is done either by the yuv_convert kernels, downscaled
+    // by yuv_factor, or by swscale if yuv_factor is 0
+    int yuv_factor;
+    enum yuv_convert_format yuv_format;
+    struct SwsContext *sws_ctx;
+    AVBufferPool *pool; // destination buffers
+    int buffer_size;
+    uint64_t last_used;
+};
+
+struct frame_converter_stats {
+    uint64_t conversions;
+    uint64_t cache_misses; // a conversion had to be (re)initialized
+};
+
+// convert decoded frames to other pixel formats (RGB24, BGR24 for OpenCV,
+// GRAY8...) and/or sizes
+//
+// the conversions from YUV420P to RGB24, BGR24, RGBA and GRAY8 (optionally
+// downscaled by 2 or 4) use the yuv_convert SIMD kernels, the other ones use
+// swscale
+//
+// the conversion contexts are cached, and the destination buffers are taken
+// from a pool, so that converting frames with the same properties does not
+// allocate in steady state
+//
+// a converter must only be used from one thread, but the output frames may
+// be referenced and released from any thread (even after the converter is
+// destroyed)
+struct frame_converter {
+    struct frame_converter_entry entries[FRAME_CONVERTER_CACHE_SIZE];
+    uint64_t use_counter;
+    struct frame_converter_stats stats;
+};
+
+void
+frame_converter_init(struct frame_converter *fc);
+
+void
+frame_converter_destroy(struct frame_converter *fc);
+
+// convert src to format, scaled to width x height (0 to keep the source
+// dimension), into dst (which must be unreferenced)
+// the caller must unreference dst to return its buffer to the pool
+bool
+frame_converter_convert(struct frame_converter *fc, const AVFrame *src,
+                        enum AVPixelFormat format, int width, int height,
+                        AVFrame *dst);
+
+// compute the size fitting in max_size x max_size which preserves the aspect
+// ratio, without upscaling (the dimensions are kept even for chroma
+// subsampled formats)
+void
+frame_converter_fit_size(int width, int height, int max_size,
+                         int *out_width, int *out_height);
+
+#endif
@@ -0,0 +1,103 @@
+#include "frame_dedup.h"
+
+#include <stddef.h>
+#include <string.h>
+
+#include "config.h"
+
+// FNV-1a parameters, applied on 64-bit words rather than on bytes
+#define HASH_OFFSET 0xcbf29ce484222325ULL
+#define HASH_PRIME 0x100000001b3ULL
+
+void
+frame_dedup_init(struct frame_dedup *dedup) {
+    frame_dedup_reset(dedup);
+    dedup->deduplicated = 0;
+}
+
+void
+frame_dedup_reset(struct frame_dedup *dedup) {
+    dedup->has_previous = false;
+}
+
+static inline uint64_t
+hash_word(uint64_t hash, uint64_t word) {
+    hash ^= word;
+    hash *= HASH_PRIME;
+    // mix the high bits into the low bits, which only depend on the low bits
+    // of the words after the multiplication
+    return hash ^ (hash >> 29);
+}
+
+static uint64_t
+hash_row(uint64_t hash, const uint8_t *row, int len) {
+    int i = 0;
+    for (; i + 8 <= len; i += 8) {
+        uint64_t word;
+        memcpy(&word, row + i, sizeof(word));
+        hash = hash_word(hash, word);
+    }
+    if (i < len) {
+        uint64_t word = 0;
+        memcpy(&word, row + i, len - i);
+        hash = hash_word(hash, word);
+    }
+    return hash;
+}
+
+static uint64_t
+hash_plane(uint64_t hash, const uint8_t *data, int linesize, int width,
+           int height, int row_step) {
+    for (int y = 0; y < height; y += row_step) {
+        hash = hash_row(hash, data + (ptrdiff_t) y * linesize, width);
+    }
+    return hash;
+}
+
+static uint64_t
+hash_frame(const AVFrame *frame, int luma_row_step) {
+    int chroma_width = (frame->width + 1) / 2;
+    int chroma_height = (frame->height + 1) / 2;
+
+    uint64_t hash = HASH_OFFSET;
+    hash = hash_plane(hash, frame->data[0], frame->linesize[0], frame->width,
+                      frame->height, luma_row_step);
+    hash = hash_plane(hash, frame->data[1], frame->linesize[1], chroma_width,
+                      chroma_height, 1);
+    hash = hash_plane(hash, frame->data[2], frame->linesize[2], chroma_width,
+                      chroma_height, 1);
+    return hash;
+}
+
+uint64_t
+frame_dedup_hash(const AVFrame *frame) {
+    return hash_frame(frame, FRAME_DEDUP_LUMA_ROW_STEP);
+}
+
+uint64_t
+frame_dedup_hash_full(const AVFrame *frame) {
+    return hash_frame(frame, 1);
+}
+
+bool
+frame_dedup_check(struct frame_dedup *dedup, const AVFrame *frame) {
+    if (frame->format != AV_PIX_FMT_YUV420P) {
+        frame_dedup_reset(dedup);
+        return false;
+    }
+
+    uint64_t hash = frame_dedup_hash(frame);
+    bool duplicate = dedup->has_previous
+                  && dedup->width == frame->width
+                  && dedup->height == frame->height
+                  && dedup->hash == hash;
+    if (duplicate) {
+        ++dedup->deduplicated;
+    } else {
+        dedup->has_previous = true;
+        dedup->hash = hash;
+        dedup->width = frame->width;
+        dedup->height = frame->height;
+    }
+    return duplicate;
+}
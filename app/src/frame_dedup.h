@@ -0,0 +1,47 @@
+#ifndef FRAME_DEDUP_H
+#define FRAME_DEDUP_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <libavutil/frame.h>
+
+#include "config.h"
+
+// only one luma row out of FRAME_DEDUP_LUMA_ROW_STEP is hashed (every chroma
+// row is hashed, and covers 2 luma rows)
+#define FRAME_DEDUP_LUMA_ROW_STEP 2
+
+// detect the frames identical to the previous one
+//
+// the device encoder repeats the last frame every 100 ms when the screen is
+// static, so an idle device still produces frames, which do not need to be
+// uploaded nor presented
+struct frame_dedup {
+    bool has_previous;
+    uint64_t hash;
+    int width;
+    int height;
+    uint64_t deduplicated; // number of frames detected as duplicates
+};
+
+void
+frame_dedup_init(struct frame_dedup *dedup);
+
+// forget the previous frame (the next one is never a duplicate)
+void
+frame_dedup_reset(struct frame_dedup *dedup);
+
+// return true if the frame has the same size and (sampled) content as the
+// previous frame passed to this function
+bool
+frame_dedup_check(struct frame_dedup *dedup, const AVFrame *frame);
+
+// hash the visible content of a YUV420P frame (the padding is ignored)
+uint64_t
+frame_dedup_hash(const AVFrame *frame);
+
+// same as frame_dedup_hash(), but hash every luma row
+uint64_t
+frame_dedup_hash_full(const AVFrame *frame);
+
+#endif
@@ -0,0 +1,221 @@
+#include "frame_latency.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <libavutil/time.h>
+
+#include "config.h"
+#include "util/lock.h"
+#include "util/log.h"
+
+static const char *const stage_names[FRAME_LATENCY_STAGE_COUNT - 1] = {
+    "parse", "decode", "upload", "present",
+};
+
+static void
+histograms_init(struct frame_latency_histograms *histograms) {
+    for (int i = 0; i < FRAME_LATENCY_STAGE_COUNT - 1; ++i) {
+        histogram_init(&histograms->stages[i]);
+    }
+    histogram_init(&histograms->total);
+}
+
+bool
+frame_latency_init(struct frame_latency *latency, unsigned pipeline_depth) {
+    // the skipped frames are evicted first, since they are the oldest ones, so
+    // one more slot than the pipeline depth is sufficient
+    unsigned slot_count = pipeline_depth + 1;
+    if (slot_count < FRAME_LATENCY_MIN_SLOTS) {
+        slot_count = FRAME_LATENCY_MIN_SLOTS;
+    }
+
+    latency->slots = SDL_calloc(slot_count, sizeof(*latency->slots));
+    if (!latency->slots) {
+        LOGC("Could not allocate frame latency slots");
+        return false;
+    }
+
+    latency->mutex = SDL_CreateMutex();
+    if (!latency->mutex) {
+        LOGC("Could not create mutex");
+        SDL_free(latency->slots);
+        return false;
+    }
+
+    latency->slot_count = slot_count;
+    latency->next_slot = 0;
+    latency->evicted = 0;
+    latency->evicted_undecoded = 0;
+    latency->has_uploaded = false;
+    histograms_init(&latency->interval);
+    histograms_init(&latency->session);
+
+    return true;
+}
+
+void
+frame_latency_destroy(struct frame_latency *latency) {
+    SDL_DestroyMutex(latency->mutex);
+    SDL_free(latency->slots);
+}
+
+// must be called with the mutex locked
+static struct frame_latency_slot *
+find_slot(struct frame_latency *latency, int64_t pts) {
+    for (unsigned i = 0; i < latency->slot_count; ++i) {
+        struct frame_latency_slot *slot = &latency->slots[i];
+        if (slot->used && slot->pts == pts) {
+            return slot;
+        }
+    }
+    return NULL;
+}
+
+static void
+record(struct histogram *histogram, int64_t duration) {
+    if (duration < 0) {
+        duration = 0;
+    } else if (duration > UINT32_MAX) {
+        duration = UINT32_MAX;
+    }
+    histogram_record(histogram, duration);
+}
+
+// must be called with the mutex locked
+static void
+record_slot(struct frame_latency *latency,
+            const struct frame_latency_slot *slot) {
+    for (int i = 0; i < FRAME_LATENCY_STAGE_COUNT - 1; ++i) {
+        int64_t begin = slot->times[i];
+        int64_t end = slot->times[i + 1];
+        if (begin && end) {
+            record(&latency->interval.stages[i], end - begin);
+            record(&latency->session.stages[i], end - begin);
+        }
+    }
+
+    int64_t begin = slot->times[FRAME_LATENCY_RECEIVED];
+    int64_t end = slot->times[FRAME_LATENCY_PRESENTED];
+    if (begin && end) {
+        record(&latency->interval.total, end - begin);
+        record(&latency->session.total, end - begin);
+    }
+}
+
+void
+frame_latency_mark(struct frame_latency *latency, int64_t pts,
+                   enum frame_latency_stage stage) {
+    int64_t now = av_gettime_relative();
+
+    mutex_lock(latency->mutex);
+    struct frame_latency_slot *slot;
+    if (stage == FRAME_LATENCY_RECEIVED) {
+        // evict the oldest frame
+        slot = &latency->slots[latency->next_slot];
+        latency->next_slot = (latency->next_slot + 1) % latency->slot_count;
+        if (slot->used) {
+            ++latency->evicted;
+            if (!slot->times[FRAME_LATENCY_DECODED]) {
+                ++latency->evicted_undecoded;
+            }
+        }
+        memset(slot, 0, sizeof(*slot));
+        slot->pts = pts;
+        slot->used = true;
+    } else {
+        slot = find_slot(latency, pts);
+    }
+
+    if (slot) {
+        slot->times[stage] = now;
+        if (stage == FRAME_LATENCY_UPLOADED) {
+            latency->uploaded_pts = pts;
+            latency->has_uploaded = true;
+        } else if (stage == FRAME_LATENCY_PRESENTED) {
+            record_slot(latency, slot);
+            slot->used = false;
+        }
+    }
+    mutex_unlock(latency->mutex);
+}
+
+void
+frame_latency_mark_presented(struct frame_latency *latency) {
+    mutex_lock(latency->mutex);
+    bool has_uploaded = latency->has_uploaded;
+    int64_t pts = latency->uploaded_pts;
+    // a frame is presented only once, the next renderings (e.g. on window
+    // resize) are not measured
+    latency->has_uploaded = false;
+    mutex_unlock(latency->mutex);
+
+    if (has_uploaded) {
+        frame_latency_mark(latency, pts, FRAME_LATENCY_PRESENTED);
+    }
+}
+
+// must be called with the mutex locked
+static void
+log_histograms(const struct frame_latency_histograms *histograms,
+               const char *prefix) {
+    if (!histograms->total.count) {
+        return;
+    }
+
+    char buf[256];
+    size_t len = 0;
+    for (int i = 0; i < FRAME_LATENCY_STAGE_COUNT; ++i) {
+        const struct histogram *histogram;
+        const char *name;
+        if (i < FRAME_LATENCY_STAGE_COUNT - 1) {
+            histogram = &histograms->stages[i];
+            name = stage_names[i];
+        } else {
+            histogram = &histograms->total;
+            name = "total";
+        }
+        int r = snprintf(buf + len, sizeof(buf) - len,
+                         "%s%s %.1f/%.1f/%.1f/%.1f", i ? ", " : "", name,
+                         histogram_percentile(histogram, 50) / 1000.0,
+                         histogram_percentile(histogram, 95) / 1000.0,
+                         histogram_percentile(histogram, 99) / 1000.0,
+                         histogram->max / 1000.0);
+        if (r < 0 || (size_t) r >= sizeof(buf) - len) {
+            break;
+        }
+        len += r;
+    }
+
+    LOGI("%s latency (ms, p50/p95/p99/max, %" PRIu64 " frames): %s", prefix,
+         histograms->total.count, buf);
+}
+
+void
+frame_latency_reset_interval(struct frame_latency *latency) {
+    mutex_lock(latency->mutex);
+    histograms_init(&latency->interval);
+    mutex_unlock(latency->mutex);
+}
+
+void
+frame_latency_log_interval(struct frame_latency *latency) {
+    mutex_lock(latency->mutex);
+    log_histograms(&latency->interval, "Frame");
+    histograms_init(&latency->interval);
+    mutex_unlock(latency->mutex);
+}
+
+void
+frame_latency_log_session(struct frame_latency *latency) {
+    mutex_lock(latency->mutex);
+    log_histograms(&latency->session, "Session");
+    if (latency->evicted) {
+        LOGI("Frame latency: %" PRIu64 " frames not measured (%" PRIu64
+             " skipped after decoding, %" PRIu64 " dropped before decoding or "
+             "evicted from the %u slots)", latency->evicted,
+             latency->evicted - latency->evicted_undecoded,
+             latency->evicted_undecoded, latency->slot_count);
+    }
+    mutex_unlock(latency->mutex);
+}
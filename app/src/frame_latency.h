@@ -0,0 +1,94 @@
+#ifndef FRAME_LATENCY_H
+#define FRAME_LATENCY_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <SDL2/SDL_mutex.h>
+
+#include "config.h"
+#include "util/histogram.h"
+
+// minimal number of frames tracked simultaneously
+#define FRAME_LATENCY_MIN_SLOTS 32
+
+enum frame_latency_stage {
+    FRAME_LATENCY_RECEIVED, // packet received from the socket
+    FRAME_LATENCY_PARSED, // packet parsed
+    FRAME_LATENCY_DECODED, // frame decoded
+    FRAME_LATENCY_UPLOADED, // frame uploaded to the texture
+    FRAME_LATENCY_PRESENTED, // frame presented on screen
+    FRAME_LATENCY_STAGE_COUNT,
+};
+
+struct frame_latency_slot {
+    int64_t pts;
+    bool used;
+    int64_t times[FRAME_LATENCY_STAGE_COUNT]; // 0 if not reached
+};
+
+struct frame_latency_histograms {
+    // stages[i] is the time from the stage i to the stage i+1
+    struct histogram stages[FRAME_LATENCY_STAGE_COUNT - 1];
+    // from RECEIVED to PRESENTED
+    struct histogram total;
+};
+
+// measure, for each frame (identified by its pts), the time spent between
+// the pipeline stages, from the socket to the screen
+//
+// the stages are marked from the stream thread (received, parsed, decoded)
+// and from the main thread (uploaded, presented)
+struct frame_latency {
+    SDL_mutex *mutex;
+    // the oldest frame is evicted when a new one is received, so a frame is
+    // measured only if less than slot_count frames are received before it is
+    // presented
+    struct frame_latency_slot *slots;
+    unsigned slot_count;
+    unsigned next_slot;
+    // frames evicted before being presented: skipped or dropped frames, or
+    // frames still in the pipeline if the slots are too few
+    uint64_t evicted;
+    // evicted before being decoded (dropped frames, or too few slots)
+    uint64_t evicted_undecoded;
+    // pts of the frame in the texture, not presented yet
+    int64_t uploaded_pts;
+    bool has_uploaded;
+
+    // reset after each frame_latency_log_interval()
+    struct frame_latency_histograms interval;
+    // for the whole session
+    struct frame_latency_histograms session;
+};
+
+// pipeline_depth is the maximum number of frames received but not presented
+// yet (the slot count is larger)
+bool
+frame_latency_init(struct frame_latency *latency, unsigned pipeline_depth);
+
+void
+frame_latency_destroy(struct frame_latency *latency);
+
+// record the current time for the frame identified by pts
+// a new frame is tracked on FRAME_LATENCY_RECEIVED
+void
+frame_latency_mark(struct frame_latency *latency, int64_t pts,
+                   enum frame_latency_stage stage);
+
+// mark the last uploaded frame (if any) as presented
+void
+frame_latency_mark_presented(struct frame_latency *latency);
+
+void
+frame_latency_reset_interval(struct frame_latency *latency);
+
+// log the latencies of the frames presented since the last call (or reset)
+void
+frame_latency_log_interval(struct frame_latency *latency);
+
+// log the latencies of all the frames presented, and the number of frames
+// which could not be measured
+void
+frame_latency_log_session(struct frame_latency *latency);
+
+#endif
@@ -0,0 +1,37 @@
+#include "frame_log.h"
+
+#include <inttypes.h>
+
+#include "config.h"
+#include "util/log.h"
+
+bool
+frame_log_init(struct frame_log *log, const char *filename) {
+    log->file = fopen(filename, "w");
+    if (!log->file) {
+        LOGE("Could not open frame log file: %s", filename);
+        return false;
+    }
+
+    fputs("frame,pts,width,height,hash,upload_us,render_us\n", log->file);
+    log->count = 0;
+    return true;
+}
+
+void
+frame_log_destroy(struct frame_log *log) {
+    if (fclose(log->file)) {
+        LOGE("Could not write frame log");
+    }
+    LOGI("Frames logged: %" PRIu64, log->count);
+}
+
+void
+frame_log_write(struct frame_log *log, int64_t pts, int width, int height,
+                uint64_t hash, int64_t upload_us, int64_t render_us) {
+    // the lines are buffered by stdio, they are not flushed on every frame
+    fprintf(log->file, "%" PRIu64 ",%" PRId64 ",%d,%d,%016" PRIx64 ",%" PRId64
+                       ",%" PRId64 "\n",
+            log->count, pts, width, height, hash, upload_us, render_us);
+    ++log->count;
+}
@@ -0,0 +1,33 @@
+#ifndef FRAME_LOG_H
+#define FRAME_LOG_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "config.h"
+
+// write one CSV line per frame taken for rendering: its pts, size, content
+// hash and the time spent to upload and render it
+//
+// the hashes only depend on the decoded frames, so that two runs fed with the
+// same stream (for example by the replay_server tool) can be compared to
+// detect decoder regressions, while the timings measure the render path
+struct frame_log {
+    FILE *file;
+    uint64_t count;
+};
+
+bool
+frame_log_init(struct frame_log *log, const char *filename);
+
+void
+frame_log_destroy(struct frame_log *log);
+
+// upload_us and render_us are -1 if the frame has not been uploaded (a
+// duplicate frame or an error)
+void
+frame_log_write(struct frame_log *log, int64_t pts, int width, int height,
+                uint64_t hash, int64_t upload_us, int64_t render_us);
+
+#endif
@@ -1,6 +1,7 @@
 #include "input_manager.h"
 
 #include <assert.h>
+#include <inttypes.h>
 
 #include "config.h"
 #include "event_converter.h"
@@ -34,6 +35,38 @@ get_mouse_point(struct screen *screen) {
     };
 }
 
+void
+input_manager_init_stats(struct input_manager *im) {
+    histogram_init(&im->injection_latency);
+}
+
+void
+input_manager_log_stats(const struct input_manager *im) {
+    const struct histogram *latency = &im->injection_latency;
+    if (!latency->count) {
+        return;
+    }
+    LOGI("Input injection latency (ms, p50/p95/p99/max, %" PRIu64 " events): "
+         "%.1f/%.1f/%.1f/%.1f", latency->count,
+         histogram_percentile(latency, 50) / 1000.0,
+         histogram_percentile(latency, 95) / 1000.0,
+         histogram_percentile(latency, 99) / 1000.0,
+         latency->max / 1000.0);
+}
+
+// push the injection of an input event received at timestamp (in SDL ticks)
+static bool
+push_injection(struct input_manager *im, const struct control_msg *msg,
+               uint32_t timestamp) {
+    if (!controller_push_msg(im->controller, msg)) {
+        return false;
+    }
+    // unsigned arithmetic handles the ticks wrapping
+    uint32_t elapsed_ms = SDL_GetTicks() - timestamp;
+    histogram_record(&im->injection_latency, elapsed_ms * 1000);
+    return true;
+}
+
 static const int ACTION_DOWN = 1;
 static const int ACTION_UP = 1 << 1;
 
@@ -221,6 +254,26 @@ rotate_device(struct controller *controller) {
     }
 }
 
+static void
+switch_recording_state(struct stream *stream) {
+    if (stream_is_recording(stream)) {
+        // the remaining packets are written asynchronously
+        stream_stop_recording(stream);
+    } else {
+        stream_start_recording(stream, NULL, RECORDER_FORMAT_AUTO);
+    }
+}
+
+static void
+save_replay(struct replay_buffer *replay) {
+    if (!replay) {
+        LOGW("Replay buffer disabled (see --replay-buffer)");
+        return;
+    }
+    // the last seconds are written asynchronously
+    replay_buffer_save(replay);
+}
+
 void
 input_manager_process_text_input(struct input_manager *im,
                                  const SDL_TextInputEvent *event) {
@@ -240,7 +293,7 @@ input_manager_process_text_input(struct input_manager *im,
         LOGW("Could not strdup input text");
         return;
     }
-    if (!controller_push_msg(im->controller, &msg)) {
+    if (!push_injection(im, &msg, event->timestamp)) {
         SDL_free(msg.inject_text.text);
         LOGW("Could not request 'inject text'");
     }
@@ -399,19 +452,27 @@ input_manager_process_key(struct input_manager *im,
                 }
                 return;
             case SDLK_r:
-                if (control && cmd && !shift && !repeat && down) {
-                    rotate_device(controller);
+                if (cmd && !repeat && down) {
+                    if (shift) {
+                        save_replay(im->replay);
+                    } else if (control) {
+                        rotate_device(controller);
+                    }
                 }
                 return;
 
             case SDLK_k:
-                if (control && cmd && !shift && !repeat && down) {
-                    screen_capture(im->screen);
+                if (cmd && !shift && !repeat && down) {
+                    // encode and write the latest frame asynchronously
+                    snapshot_request(im->snapshot);
                 }
 
                 return;
             case SDLK_e:
-                if (control && cmd && !shift && !repeat && down) {
+                if (cmd && shift && !repeat && down) {
+                    // the video recording does not require control
+                    switch_recording_state(im->stream);
+                } else if (control && cmd && !repeat && down) {
                     if(controller->fp_events==NULL){
                         controller_start_recording(controller);
                     }else{
@@ -431,7 +492,7 @@ input_manager_process_key(struct input_manager *im,
 
     struct control_msg msg;
     if (convert_input_key(event, &msg, im->prefer_text)) {
-        if (!controller_push_msg(controller, &msg)) {
+        if (!push_injection(im, &msg, event->timestamp)) {
             LOGW("Could not request 'inject keycode'");
         }
     }
@@ -465,7 +526,7 @@ input_manager_process_mouse_motion(struct input_manager *im,
     }
     struct control_msg msg;
     if (convert_mouse_motion(event, im->screen, &msg)) {
-        if (!controller_push_msg(im->controller, &msg)) {
+        if (!push_injection(im, &msg, event->timestamp)) {
             LOGW("Could not request 'inject mouse motion event'");
         }
     }
@@ -497,7 +558,7 @@ input_manager_process_touch(struct input_manager *im,
                             const SDL_TouchFingerEvent *event) {
     struct control_msg msg;
     if (convert_touch(event, im->screen, &msg)) {
-        if (!controller_push_msg(im->controller, &msg)) {
+        if (!push_injection(im, &msg, event->timestamp)) {
             LOGW("Could not request 'inject touch event'");
         }
     }
@@ -565,7 +626,7 @@ input_manager_process_mouse_button(struct input_manager *im,
 
     struct control_msg msg;
     if (convert_mouse_button(event, im->screen, &msg)) {
-        if (!controller_push_msg(im->controller, &msg)) {
+        if (!push_injection(im, &msg, event->timestamp)) {
             LOGW("Could not request 'inject mouse button event'");
         }
     }
@@ -593,7 +654,7 @@ input_manager_process_mouse_wheel(struct input_manager *im,
                                   const SDL_MouseWheelEvent *event) {
     struct control_msg msg;
     if (convert_mouse_wheel(event, im->screen, &msg)) {
-        if (!controller_push_msg(im->controller, &msg)) {
+        if (!push_injection(im, &msg, event->timestamp)) {
             LOGW("Could not request 'inject mouse wheel event'");
         }
     }
@@ -8,15 +8,32 @@
 #include "controller.h"
 #include "fps_counter.h"
 #include "video_buffer.h"
+#include "replay_buffer.h"
 #include "screen.h"
+#include "snapshot.h"
+#include "stream.h"
+#include "util/histogram.h"
 
 struct input_manager {
     struct controller *controller;
     struct video_buffer *video_buffer;
     struct screen *screen;
+    struct snapshot *snapshot;
+    struct replay_buffer *replay; // NULL if the replay buffer is disabled
+    struct stream *stream;
     bool prefer_text;
+    // delay between the SDL input events and the push of the resulting
+    // injection messages to the controller, in microseconds (with the
+    // millisecond resolution of the SDL timestamps)
+    struct histogram injection_latency;
 };
 
+void
+input_manager_init_stats(struct input_manager *im);
+
+void
+input_manager_log_stats(const struct input_manager *im);
+
 void
 input_manager_process_text_input(struct input_manager *im,
                                  const SDL_TextInputEvent *event);
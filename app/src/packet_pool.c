@@ -0,0 +1,107 @@
+#include "packet_pool.h"
+
+#include <assert.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <string.h>
+
+#include "config.h"
+#include "compat.h"
+#include "util/log.h"
+
+#define CLASS_SIZE(INDEX) \
+    ((size_t) 1 << (PACKET_POOL_MIN_SIZE_SHIFT + (INDEX)))
+
+#ifdef SCRCPY_LAVU_HAS_SIZE_T_BUFFER_API
+typedef size_t buffer_size_t;
+#else
+typedef int buffer_size_t;
+#endif
+
+// called by av_buffer_pool_get() when no buffer is available in the pool,
+// so from the thread calling packet_pool_get()
+static AVBufferRef *
+alloc_buffer(void *opaque, buffer_size_t size) {
+    struct packet_pool *pool = opaque;
+    AVBufferRef *buf = av_buffer_alloc(size);
+    if (buf) {
+        ++pool->stats.misses;
+        ++pool->stats.buffers;
+        pool->stats.bytes += size;
+    }
+    return buf;
+}
+
+bool
+packet_pool_init(struct packet_pool *pool) {
+    for (int i = 0; i < PACKET_POOL_CLASS_COUNT; ++i) {
+        size_t size = CLASS_SIZE(i) + AV_INPUT_BUFFER_PADDING_SIZE;
+        pool->pools[i] = av_buffer_pool_init2(size, pool, alloc_buffer, NULL);
+        if (!pool->pools[i]) {
+            LOGC("Could not create packet buffer pool");
+            while (i--) {
+                av_buffer_pool_uninit(&pool->pools[i]);
+            }
+            return false;
+        }
+    }
+
+    memset(&pool->stats, 0, sizeof(pool->stats));
+    return true;
+}
+
+void
+packet_pool_destroy(struct packet_pool *pool) {
+    for (int i = 0; i < PACKET_POOL_CLASS_COUNT; ++i) {
+        av_buffer_pool_uninit(&pool->pools[i]);
+    }
+}
+
+static int
+get_size_class(size_t size) {
+    for (int i = 0; i < PACKET_POOL_CLASS_COUNT; ++i) {
+        if (size <= CLASS_SIZE(i)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+bool
+packet_pool_get(struct packet_pool *pool, AVPacket *packet, size_t size) {
+    assert(size <= INT_MAX - AV_INPUT_BUFFER_PADDING_SIZE);
+    ++pool->stats.requests;
+
+    int index = get_size_class(size);
+    if (index == -1) {
+        ++pool->stats.misses;
+        ++pool->stats.oversized;
+        return !av_new_packet(packet, size);
+    }
+
+    uint64_t misses = pool->stats.misses;
+    AVBufferRef *buf = av_buffer_pool_get(pool->pools[index]);
+    if (!buf) {
+        return false;
+    }
+    if (pool->stats.misses == misses) {
+        // alloc_buffer() has not been called
+        ++pool->stats.hits;
+    }
+
+    av_init_packet(packet);
+    packet->buf = buf;
+    packet->data = buf->data;
+    packet->size = size;
+    memset(packet->data + size, 0, AV_INPUT_BUFFER_PADDING_SIZE);
+    return true;
+}
+
+void
+packet_pool_log_stats(const struct packet_pool *pool) {
+    const struct packet_pool_stats *stats = &pool->stats;
+    LOGD("Packet pool: %" PRIu64 " requests, %" PRIu64 " hits, %" PRIu64
+         " misses (%" PRIu64 " oversized), high-water mark: %u buffers "
+         "(%zu KiB)", stats->requests, stats->hits, stats->misses,
+         stats->oversized, stats->buffers, stats->bytes / 1024);
+}
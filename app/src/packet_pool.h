@@ -0,0 +1,54 @@
+#ifndef PACKET_POOL_H
+#define PACKET_POOL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <libavcodec/avcodec.h>
+
+#include "config.h"
+
+// packet payloads are allocated from power-of-two size classes, from 4 KiB
+// to 8 MiB; larger packets are allocated individually
+#define PACKET_POOL_MIN_SIZE_SHIFT 12
+#define PACKET_POOL_CLASS_COUNT 12
+
+struct packet_pool_stats {
+    uint64_t requests;
+    uint64_t hits; // served by a buffer returned to the pool
+    uint64_t misses; // required a new allocation
+    uint64_t oversized; // too large for any size class (counted as misses)
+    // buffers are never released to the allocator before the pool is
+    // destroyed, so the number of allocated buffers is their high-water mark
+    unsigned buffers;
+    size_t bytes;
+};
+
+// recycle packet buffers, so that receiving a packet does not allocate in
+// steady state
+//
+// buffers are reference-counted: packets obtained from the pool may be
+// referenced (av_packet_ref()) and released from any thread, but
+// packet_pool_get() must always be called from the same thread
+struct packet_pool {
+    AVBufferPool *pools[PACKET_POOL_CLASS_COUNT];
+    struct packet_pool_stats stats;
+};
+
+bool
+packet_pool_init(struct packet_pool *pool);
+
+// the buffers still referenced are released when their last reference is
+// dropped
+void
+packet_pool_destroy(struct packet_pool *pool);
+
+// initialize packet with an uninitialized payload of size bytes (followed by
+// zeroed padding)
+bool
+packet_pool_get(struct packet_pool *pool, AVPacket *packet, size_t size);
+
+void
+packet_pool_log_stats(const struct packet_pool *pool);
+
+#endif
@@ -0,0 +1,332 @@
+#include "packet_queue.h"
+
+#include <assert.h>
+#include <inttypes.h>
+#include <string.h>
+
+#include "config.h"
+#include "util/log.h"
+
+// positions are stored as int into SDL_atomic_t, but always compared as
+// unsigned values, so that they can wrap around
+static inline unsigned
+atomic_get_position(SDL_atomic_t *atomic) {
+    return (unsigned) SDL_AtomicGet(atomic);
+}
+
+static inline void
+atomic_set_position(SDL_atomic_t *atomic, unsigned position) {
+    SDL_AtomicSet(atomic, (int) position);
+}
+
+bool
+packet_queue_init(struct packet_queue *queue, unsigned depth,
+                  enum packet_queue_policy policy) {
+    assert(depth);
+    // the sequence numbers would be ambiguous with a single slot
+    unsigned capacity = 2;
+    while (capacity < depth) {
+        capacity <<= 1;
+    }
+
+    queue->slots = SDL_calloc(capacity, sizeof(*queue->slots));
+    if (!queue->slots) {
+        LOGC("Could not allocate packet queue");
+        return false;
+    }
+
+    queue->not_empty_sem = SDL_CreateSemaphore(0);
+    if (!queue->not_empty_sem) {
+        LOGC("Could not create semaphore");
+        SDL_free(queue->slots);
+        return false;
+    }
+
+    queue->not_full_sem = SDL_CreateSemaphore(0);
+    if (!queue->not_full_sem) {
+        LOGC("Could not create semaphore");
+        SDL_DestroySemaphore(queue->not_empty_sem);
+        SDL_free(queue->slots);
+        return false;
+    }
+
+    for (unsigned i = 0; i < capacity; ++i) {
+        atomic_set_position(&queue->slots[i].sequence, i);
+        av_init_packet(&queue->slots[i].packet);
+        queue->slots[i].packet.data = NULL;
+        queue->slots[i].packet.size = 0;
+    }
+
+    queue->capacity = capacity;
+    queue->policy = policy;
+    atomic_set_position(&queue->head, 0);
+    SDL_AtomicSet(&queue->stopped, 0);
+    SDL_AtomicSet(&queue->consumer_waiting, 0);
+    SDL_AtomicSet(&queue->producer_waiting, 0);
+    queue->tail = 0;
+    queue->dropping = false;
+    memset(&queue->stats, 0, sizeof(queue->stats));
+
+    return true;
+}
+
+void
+packet_queue_destroy(struct packet_queue *queue) {
+    // the slots not containing a packet have been reset by
+    // av_packet_move_ref(), unreferencing them is a no-op
+    for (unsigned i = 0; i < queue->capacity; ++i) {
+        av_packet_unref(&queue->slots[i].packet);
+    }
+    SDL_DestroySemaphore(queue->not_full_sem);
+    SDL_DestroySemaphore(queue->not_empty_sem);
+    SDL_free(queue->slots);
+}
+
+static inline struct packet_queue_slot *
+get_slot(struct packet_queue *queue, unsigned position) {
+    return &queue->slots[position & (queue->capacity - 1)];
+}
+
+// must be called from the producer
+static bool
+can_push(struct packet_queue *queue) {
+    struct packet_queue_slot *slot = get_slot(queue, queue->tail);
+    return atomic_get_position(&slot->sequence) == queue->tail;
+}
+
+static bool
+can_take(struct packet_queue *queue) {
+    unsigned head = atomic_get_position(&queue->head);
+    struct packet_queue_slot *slot = get_slot(queue, head);
+    return atomic_get_position(&slot->sequence) == head + 1;
+}
+
+static inline bool
+is_config_packet(const AVPacket *packet) {
+    return packet->pts == AV_NOPTS_VALUE;
+}
+
+static inline bool
+is_sync_point(const AVPacket *packet) {
+    return (packet->flags & AV_PKT_FLAG_KEY) || is_config_packet(packet);
+}
+
+// move the packet into the queue if it is not full
+// must be called from the producer
+static bool
+try_push(struct packet_queue *queue, AVPacket *packet) {
+    if (!can_push(queue)) {
+        return false;
+    }
+
+    struct packet_queue_slot *slot = get_slot(queue, queue->tail);
+    slot->sync_point = is_sync_point(packet);
+    slot->config = is_config_packet(packet);
+    av_packet_move_ref(&slot->packet, packet);
+    // publish the packet to the consumer
+    atomic_set_position(&slot->sequence, queue->tail + 1);
+    ++queue->tail;
+    return true;
+}
+
+static bool
+try_take(struct packet_queue *queue, AVPacket *packet) {
+    unsigned head = atomic_get_position(&queue->head);
+    for (;;) {
+        struct packet_queue_slot *slot = get_slot(queue, head);
+        unsigned sequence = atomic_get_position(&slot->sequence);
+        int diff = (int) (sequence - (head + 1));
+        if (diff < 0) {
+            // empty
+            return false;
+        }
+        if (!diff && SDL_AtomicCAS(&queue->head, (int) head,
+                                    (int) (head + 1))) {
+            av_packet_move_ref(packet, &slot->packet);
+            // make the slot available for the push one lap later
+            atomic_set_position(&slot->sequence, head + queue->capacity);
+            return true;
+        }
+        // the other side took the packet in the meantime
+        head = atomic_get_position(&queue->head);
+    }
+}
+
+// take the packet at position only if it is still the oldest one
+static bool
+try_take_at(struct packet_queue *queue, unsigned position, AVPacket *packet) {
+    struct packet_queue_slot *slot = get_slot(queue, position);
+    if (atomic_get_position(&slot->sequence) != position + 1
+            || !SDL_AtomicCAS(&queue->head, (int) position,
+                              (int) (position + 1))) {
+        // not pushed yet, or already taken
+        return false;
+    }
+    av_packet_move_ref(packet, &slot->packet);
+    atomic_set_position(&slot->sequence, position + queue->capacity);
+    return true;
+}
+
+// drop the oldest queued packets up to (excluding) the next sync point, so
+// that the decoder resumes from it (the new packet is the next sync point if
+// sync_point is set and none is queued)
+// return false if there is no such sync point, or if the oldest packet is a
+// config packet (which must never be dropped)
+// must be called from the producer
+static bool
+drop_oldest(struct packet_queue *queue, bool sync_point) {
+    unsigned head = atomic_get_position(&queue->head);
+    if (head == queue->tail) {
+        // the consumer emptied the queue in the meantime
+        return true;
+    }
+    struct packet_queue_slot *slot = get_slot(queue, head);
+    if (slot->config) {
+        return false;
+    }
+
+    unsigned end = head + 1;
+    while (end != queue->tail && !get_slot(queue, end)->sync_point) {
+        ++end;
+    }
+    if (end == queue->tail && !sync_point) {
+        return false;
+    }
+
+    for (unsigned position = head; position != end; ++position) {
+        AVPacket packet;
+        if (try_take_at(queue, position, &packet)) {
+            av_packet_unref(&packet);
+            ++queue->stats.dropped;
+        }
+        // else the consumer took it in the meantime
+    }
+    return true;
+}
+
+// wake up the other side if it is waiting
+static void
+notify(SDL_atomic_t *waiting, SDL_sem *sem) {
+    if (SDL_AtomicCAS(waiting, 1, 0)) {
+        SDL_SemPost(sem);
+    }
+}
+
+// wait until ready() or stopped
+static void
+wait_for(struct packet_queue *queue, SDL_atomic_t *waiting, SDL_sem *sem,
+         bool (*ready)(struct packet_queue *)) {
+    SDL_AtomicSet(waiting, 1);
+    // check again, the other side may have changed the state before it could
+    // see the flag
+    if (ready(queue) || SDL_AtomicGet(&queue->stopped)) {
+        if (!SDL_AtomicCAS(waiting, 1, 0)) {
+            // the other side has already reset the flag, consume its post
+            SDL_SemWait(sem);
+        }
+        return;
+    }
+    SDL_SemWait(sem);
+}
+
+bool
+packet_queue_push(struct packet_queue *queue, const AVPacket *packet) {
+    if (SDL_AtomicGet(&queue->stopped)) {
+        return false;
+    }
+
+    // config packets are never dropped, but they do not end the dropping
+    bool keyframe = packet->flags & AV_PKT_FLAG_KEY;
+    bool droppable = !keyframe && !is_config_packet(packet);
+    if (queue->dropping) {
+        if (droppable) {
+            ++queue->stats.dropped;
+            return true;
+        }
+        if (keyframe) {
+            queue->dropping = false;
+        }
+    }
+
+    AVPacket ref;
+    if (av_packet_ref(&ref, packet)) {
+        LOGE("Could not reference packet");
+        return false;
+    }
+
+    while (!try_push(queue, &ref)) {
+        if (SDL_AtomicGet(&queue->stopped)) {
+            av_packet_unref(&ref);
+            return false;
+        }
+
+        if (queue->policy == PACKET_QUEUE_POLICY_DROP_OLDEST
+                && drop_oldest(queue, !droppable)) {
+            continue;
+        }
+
+        // without a queued sync point, dropping a queued packet would corrupt
+        // the following ones: drop the new packets instead
+        if (queue->policy != PACKET_QUEUE_POLICY_BLOCK && droppable) {
+            queue->dropping = true;
+            ++queue->stats.dropped;
+            av_packet_unref(&ref);
+            return true;
+        }
+
+        wait_for(queue, &queue->producer_waiting, queue->not_full_sem,
+                 can_push);
+    }
+
+    notify(&queue->consumer_waiting, queue->not_empty_sem);
+
+    unsigned depth = packet_queue_depth(queue);
+    ++queue->stats.pushed;
+    queue->stats.depth_sum += depth;
+    if (depth > queue->stats.max_depth) {
+        queue->stats.max_depth = depth;
+    }
+    return true;
+}
+
+bool
+packet_queue_take(struct packet_queue *queue, AVPacket *packet) {
+    for (;;) {
+        if (SDL_AtomicGet(&queue->stopped)) {
+            return false;
+        }
+        if (try_take(queue, packet)) {
+            notify(&queue->producer_waiting, queue->not_full_sem);
+            return true;
+        }
+        wait_for(queue, &queue->consumer_waiting, queue->not_empty_sem,
+                 can_take);
+    }
+}
+
+void
+packet_queue_stop(struct packet_queue *queue) {
+    SDL_AtomicSet(&queue->stopped, 1);
+    notify(&queue->consumer_waiting, queue->not_empty_sem);
+    notify(&queue->producer_waiting, queue->not_full_sem);
+}
+
+unsigned
+packet_queue_depth(struct packet_queue *queue) {
+    unsigned head = atomic_get_position(&queue->head);
+    return queue->tail - head;
+}
+
+void
+packet_queue_log_stats(const struct packet_queue *queue, const char *name) {
+    const struct packet_queue_stats *stats = &queue->stats;
+    if (!stats->pushed && !stats->dropped) {
+        return;
+    }
+    double avg_depth = stats->pushed
+                     ? (double) stats->depth_sum / stats->pushed
+                     : 0;
+    LOGD("%s queue: %" PRIu64 " packets, %" PRIu64 " dropped, depth "
+         "avg %.2f max %u (capacity %u)", name, stats->pushed, stats->dropped,
+         avg_depth, stats->max_depth, queue->capacity);
+}
@@ -0,0 +1,104 @@
+#ifndef PACKET_QUEUE_H
+#define PACKET_QUEUE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <libavcodec/avcodec.h>
+#include <SDL2/SDL_atomic.h>
+#include <SDL2/SDL_mutex.h>
+
+#include "config.h"
+
+// behavior of packet_queue_push() when the queue is full
+enum packet_queue_policy {
+    // wait until the consumer takes a packet
+    PACKET_QUEUE_POLICY_BLOCK,
+    // drop the new packets until the next keyframe (the keyframe itself
+    // waits for space), so that the decoder never receives a packet
+    // referencing a dropped one
+    PACKET_QUEUE_POLICY_DROP_UNTIL_KEYFRAME,
+    // drop the oldest queued packets up to the next queued keyframe (or
+    // config packet); if there is none, behave like DROP_UNTIL_KEYFRAME
+    PACKET_QUEUE_POLICY_DROP_OLDEST,
+};
+
+struct packet_queue_slot {
+    // position for which the slot is ready to be pushed (== position) or
+    // taken (== position + 1), as in Dmitry Vyukov's bounded queue
+    SDL_atomic_t sequence;
+    AVPacket packet;
+    // only accessed by the producer (the packet itself may be moved by the
+    // consumer concurrently)
+    bool sync_point; // keyframe or config packet, the decoder may resume
+                     // from it
+    bool config;
+};
+
+struct packet_queue_stats {
+    uint64_t pushed;
+    uint64_t dropped;
+    unsigned max_depth;
+    uint64_t depth_sum; // sum of the depths after each push
+};
+
+// bounded lock-free queue of packets, from a single producer to a single
+// consumer
+//
+// the producer and the consumer only wait on a semaphore (and the other side
+// only posts it) when the queue is full or empty respectively
+//
+// the producer may also take packets itself (to drop the oldest ones), so the
+// consumer side uses a CAS on the head
+struct packet_queue {
+    struct packet_queue_slot *slots;
+    unsigned capacity; // power of 2
+    enum packet_queue_policy policy;
+
+    SDL_atomic_t head; // next position to take
+    SDL_atomic_t stopped;
+    // set by a side which is about to wait on its semaphore, reset by the
+    // side which posts it
+    SDL_atomic_t consumer_waiting;
+    SDL_atomic_t producer_waiting;
+    SDL_sem *not_empty_sem;
+    SDL_sem *not_full_sem;
+
+    // only accessed by the producer
+    unsigned tail; // next position to push
+    bool dropping; // drop until the next keyframe
+    struct packet_queue_stats stats;
+};
+
+// the capacity is depth rounded up to a power of 2 (at least 2)
+bool
+packet_queue_init(struct packet_queue *queue, unsigned depth,
+                  enum packet_queue_policy policy);
+
+// unreference the packets still queued
+void
+packet_queue_destroy(struct packet_queue *queue);
+
+// reference the packet into the queue, applying the policy if it is full
+// return false if the queue is stopped or on error
+bool
+packet_queue_push(struct packet_queue *queue, const AVPacket *packet);
+
+// move the oldest packet to packet, waiting until one is available
+// return false if the queue is stopped
+bool
+packet_queue_take(struct packet_queue *queue, AVPacket *packet);
+
+// wake up and make both sides fail
+void
+packet_queue_stop(struct packet_queue *queue);
+
+// number of packets queued (approximate if not called from the producer)
+unsigned
+packet_queue_depth(struct packet_queue *queue);
+
+// must be called from the producer thread (or once the queue is not used
+// anymore)
+void
+packet_queue_log_stats(const struct packet_queue *queue, const char *name);
+
+#endif
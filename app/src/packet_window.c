@@ -0,0 +1,177 @@
+#include "packet_window.h"
+
+#include <assert.h>
+#include <SDL2/SDL_stdinc.h>
+
+#include "config.h"
+#include "util/log.h"
+
+void
+packet_window_init(struct packet_window *window, int64_t duration) {
+    window->duration = duration;
+    queue_init(&window->queue);
+    queue_init(&window->free_queue);
+    window->count = 0;
+    window->bytes = 0;
+    window->has_config_packet = false;
+}
+
+// drop the oldest packet of the window
+static void
+drop_first(struct packet_window *window) {
+    struct window_packet *wp;
+    queue_take(&window->queue, next, &wp);
+    --window->count;
+    window->bytes -= wp->packet.size;
+    av_packet_unref(&wp->packet);
+    queue_push(&window->free_queue, next, wp);
+}
+
+static void
+clear(struct packet_window *window) {
+    while (!queue_is_empty(&window->queue)) {
+        drop_first(window);
+    }
+}
+
+void
+packet_window_destroy(struct packet_window *window) {
+    clear(window);
+    while (!queue_is_empty(&window->free_queue)) {
+        struct window_packet *wp;
+        queue_take(&window->free_queue, next, &wp);
+        SDL_free(wp);
+    }
+    if (window->has_config_packet) {
+        av_packet_unref(&window->config_packet);
+    }
+}
+
+// the first packet of the window is a keyframe: drop the whole GOPs as long as
+// the remaining window still covers the duration
+static void
+trim(struct packet_window *window, int64_t last_pts) {
+    for (;;) {
+        assert(!queue_is_empty(&window->queue));
+        struct window_packet *next_gop = window->queue.first->next;
+        while (next_gop && !(next_gop->packet.flags & AV_PKT_FLAG_KEY)) {
+            next_gop = next_gop->next;
+        }
+        if (!next_gop || last_pts - next_gop->packet.pts < window->duration) {
+            break;
+        }
+        while (window->queue.first != next_gop) {
+            drop_first(window);
+        }
+    }
+}
+
+static struct window_packet *
+get_free_packet(struct packet_window *window) {
+    if (!queue_is_empty(&window->free_queue)) {
+        struct window_packet *wp;
+        queue_take(&window->free_queue, next, &wp);
+        return wp;
+    }
+    // the window grows until it covers the duration, then the packets are
+    // recycled
+    return SDL_malloc(sizeof(struct window_packet));
+}
+
+static bool
+push_config_packet(struct packet_window *window, const AVPacket *packet) {
+    if (window->has_config_packet) {
+        av_packet_unref(&window->config_packet);
+    }
+    clear(window);
+
+    // av_packet_ref() does not initialize all fields in old FFmpeg versions
+    av_init_packet(&window->config_packet);
+    window->has_config_packet = !av_packet_ref(&window->config_packet, packet);
+    if (!window->has_config_packet) {
+        LOGC("Could not reference config packet");
+        return false;
+    }
+    return true;
+}
+
+static bool
+push_data_packet(struct packet_window *window, const AVPacket *packet) {
+    bool key = packet->flags & AV_PKT_FLAG_KEY;
+    if (queue_is_empty(&window->queue) && !key) {
+        // the window must start with a keyframe
+        return true;
+    }
+
+    struct window_packet *wp = get_free_packet(window);
+    if (!wp) {
+        LOGC("Could not allocate window packet");
+        return false;
+    }
+
+    av_init_packet(&wp->packet);
+    if (av_packet_ref(&wp->packet, packet)) {
+        LOGC("Could not reference window packet");
+        queue_push(&window->free_queue, next, wp);
+        return false;
+    }
+
+    queue_push(&window->queue, next, wp);
+    ++window->count;
+    window->bytes += packet->size;
+
+    if (key) {
+        trim(window, packet->pts);
+    }
+    return true;
+}
+
+bool
+packet_window_push(struct packet_window *window, const AVPacket *packet) {
+    if (packet->pts == AV_NOPTS_VALUE) {
+        return push_config_packet(window, packet);
+    }
+    return push_data_packet(window, packet);
+}
+
+bool
+packet_window_ref_packets(const struct packet_window *window,
+                          AVPacket **packets, unsigned *count) {
+    assert(!packet_window_is_empty(window));
+
+    unsigned n = window->count + 1;
+    AVPacket *array = SDL_malloc(n * sizeof(*array));
+    if (!array) {
+        LOGC("Could not allocate window packets");
+        return false;
+    }
+
+    unsigned i = 0;
+    const AVPacket *src = &window->config_packet;
+    const struct window_packet *wp = window->queue.first;
+    while (src) {
+        av_init_packet(&array[i]);
+        if (av_packet_ref(&array[i], src)) {
+            LOGC("Could not reference window packet");
+            packet_window_release_packets(array, i);
+            return false;
+        }
+        ++i;
+
+        src = wp ? &wp->packet : NULL;
+        wp = wp ? wp->next : NULL;
+    }
+    assert(i == n);
+
+    *packets = array;
+    *count = n;
+    return true;
+}
+
+void
+packet_window_release_packets(AVPacket *packets, unsigned count) {
+    for (unsigned i = 0; i < count; ++i) {
+        av_packet_unref(&packets[i]);
+    }
+    SDL_free(packets);
+}
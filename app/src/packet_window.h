@@ -0,0 +1,67 @@
+#ifndef PACKET_WINDOW_H
+#define PACKET_WINDOW_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <libavcodec/avcodec.h>
+
+#include "config.h"
+#include "util/queue.h"
+
+struct window_packet {
+    struct window_packet *next;
+    AVPacket packet;
+};
+
+struct window_packet_queue QUEUE(struct window_packet);
+
+// keep the latest packets of the video stream (at least the given duration,
+// trimmed at GOP boundaries) along with the latest config packet, so that
+// they can be written to a new file decodable from its first frame
+//
+// the packets are only referenced, their payload is not copied
+//
+// it is not thread-safe
+struct packet_window {
+    int64_t duration; // in microseconds, 0 to keep only the current GOP
+    // the window always starts with a keyframe
+    struct window_packet_queue queue;
+    struct window_packet_queue free_queue; // to be reused
+    unsigned count;
+    size_t bytes;
+    bool has_config_packet;
+    AVPacket config_packet;
+};
+
+void
+packet_window_init(struct packet_window *window, int64_t duration);
+
+void
+packet_window_destroy(struct packet_window *window);
+
+// reference the packet in the window, and drop the oldest GOPs which are not
+// needed anymore to cover the duration
+//
+// a new config packet clears the window, since the previous packets may not
+// be decoded with it
+bool
+packet_window_push(struct packet_window *window, const AVPacket *packet);
+
+static inline bool
+packet_window_is_empty(const struct packet_window *window) {
+    return !window->has_config_packet || queue_is_empty(&window->queue);
+}
+
+// reference the config packet followed by the packets of the window into a
+// new array of *count packets, to be released by
+// packet_window_release_packets()
+// the window must not be empty
+bool
+packet_window_ref_packets(const struct packet_window *window,
+                          AVPacket **packets, unsigned *count);
+
+void
+packet_window_release_packets(AVPacket *packets, unsigned count);
+
+#endif
@@ -0,0 +1,474 @@
+// modern glibc will complain without this
+#define _DEFAULT_SOURCE
+#define _GNU_SOURCE // for O_DIRECT
+
+#include "record_io.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <string.h>
+#include <unistd.h>
+#include <libavutil/mem.h>
+#include <libavutil/time.h>
+#include <SDL2/SDL_stdinc.h>
+#ifdef _WIN32
+# include <io.h>
+#endif
+
+#include "config.h"
+#include "common.h"
+#include "compat.h"
+#include "util/lock.h"
+#include "util/log.h"
+
+// size of the AVIOContext internal buffer, copied to the blocks when full
+#define AVIO_BUFFER_SIZE 0x10000
+
+#define ALIGN_UP(x, a) (((x) + (a) - 1) / (a) * (a))
+
+void
+record_io_stats_init(struct record_io_stats *stats) {
+    stats->bytes = 0;
+    stats->writes = 0;
+    stats->syncs = 0;
+    stats->stalls = 0;
+    histogram_init(&stats->write_latency);
+    histogram_init(&stats->sync_latency);
+}
+
+static void
+log_latency(const char *name, const struct histogram *latency) {
+    if (latency->count) {
+        LOGI("Recorder %s latency (ms, p50/p95/p99/max): %.1f/%.1f/%.1f/%.1f",
+             name,
+             histogram_percentile(latency, 50) / 1000.0,
+             histogram_percentile(latency, 95) / 1000.0,
+             histogram_percentile(latency, 99) / 1000.0,
+             latency->max / 1000.0);
+    }
+}
+
+void
+record_io_log_stats(const struct record_io_stats *stats) {
+    LOGI("Recorder disk: %" PRIu64 " bytes in %" PRIu64 " writes, %" PRIu64
+         " syncs, %" PRIu64 " stalls", stats->bytes, stats->writes,
+         stats->syncs, stats->stalls);
+    log_latency("disk write", &stats->write_latency);
+    log_latency("disk sync", &stats->sync_latency);
+}
+
+static bool
+seek_fd(int fd, int64_t offset) {
+#ifdef _WIN32
+    return _lseeki64(fd, offset, SEEK_SET) == offset;
+#else
+    return lseek(fd, (off_t) offset, SEEK_SET) == (off_t) offset;
+#endif
+}
+
+static bool
+write_fd(int fd, const uint8_t *data, size_t len) {
+    while (len) {
+        ssize_t w = write(fd, data, len);
+        if (w < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += w;
+        len -= w;
+    }
+    return true;
+}
+
+static int
+sync_fd(int fd) {
+#ifdef _WIN32
+    return _commit(fd);
+#elif defined(__linux__)
+    // the metadata (mtime) do not need to be flushed
+    return fdatasync(fd);
+#else
+    return fsync(fd);
+#endif
+}
+
+// called from the writer thread
+static bool
+write_block(struct record_io *io, const struct record_io_block *block) {
+    // direct I/O requires the offset and the size to be aligned (the data
+    // are always aligned); the unaligned blocks (typically the last one, or
+    // a header rewritten by the muxer) use the buffered file descriptor
+    bool aligned = !(block->offset % RECORD_IO_ALIGNMENT)
+                && !(block->size % RECORD_IO_ALIGNMENT);
+    int fd = io->direct_fd != -1 && aligned ? io->direct_fd : io->fd;
+
+    int64_t start = av_gettime_relative();
+    bool ok = seek_fd(fd, block->offset)
+           && write_fd(fd, block->data, block->size);
+    uint32_t latency = av_gettime_relative() - start;
+
+    mutex_lock(io->mutex);
+    struct record_io_stats *stats = io->stats;
+    ++stats->writes;
+    stats->bytes += block->size;
+    histogram_record(&stats->write_latency, latency);
+    mutex_unlock(io->mutex);
+
+    if (!ok) {
+        LOGE("Could not write recording: %s", strerror(errno));
+    }
+    return ok;
+}
+
+// called from the writer thread
+static bool
+sync_file(struct record_io *io) {
+    int64_t start = av_gettime_relative();
+    bool ok = !sync_fd(io->fd);
+    int64_t now = av_gettime_relative();
+    io->last_sync_time = now;
+
+    mutex_lock(io->mutex);
+    ++io->stats->syncs;
+    histogram_record(&io->stats->sync_latency, now - start);
+    mutex_unlock(io->mutex);
+
+    if (!ok) {
+        LOGE("Could not sync recording: %s", strerror(errno));
+    }
+    return ok;
+}
+
+static bool
+must_sync(struct record_io *io) {
+    uint32_t interval = io->params.sync_interval;
+    return interval && av_gettime_relative() - io->last_sync_time
+                           >= (int64_t) interval * 1000;
+}
+
+static int
+run_record_io(void *data) {
+    struct record_io *io = data;
+
+    io->last_sync_time = av_gettime_relative();
+
+    for (;;) {
+        mutex_lock(io->mutex);
+        while (!io->stopped && queue_is_empty(&io->pending)) {
+            cond_wait(io->pending_cond, io->mutex);
+        }
+        if (queue_is_empty(&io->pending)) {
+            // stopped, and all the pending blocks are written
+            mutex_unlock(io->mutex);
+            break;
+        }
+        struct record_io_block *block;
+        queue_take(&io->pending, next, &block);
+        bool failed = io->failed;
+        mutex_unlock(io->mutex);
+
+        // once a write failed, the remaining blocks are discarded
+        bool ok = !failed && write_block(io, block)
+               && (!must_sync(io) || sync_file(io));
+
+        mutex_lock(io->mutex);
+        if (!ok) {
+            io->failed = true;
+        }
+        queue_push(&io->free_queue, next, block);
+        cond_signal(io->free_cond);
+        mutex_unlock(io->mutex);
+    }
+
+    if (io->params.sync_interval && !io->failed) {
+        // the thread is stopped, no need to lock
+        if (!sync_file(io)) {
+            io->failed = true;
+        }
+    }
+
+    return 0;
+}
+
+// take a free block to be filled from the current position
+static bool
+record_io_acquire_block(struct record_io *io) {
+    assert(!io->current);
+
+    mutex_lock(io->mutex);
+    if (queue_is_empty(&io->free_queue)) {
+        ++io->stats->stalls;
+        do {
+            cond_wait(io->free_cond, io->mutex);
+        } while (!io->failed && queue_is_empty(&io->free_queue));
+    }
+    bool ok = !io->failed;
+    if (ok) {
+        queue_take(&io->free_queue, next, &io->current);
+    }
+    mutex_unlock(io->mutex);
+
+    if (ok) {
+        io->current->offset = io->pos;
+        io->current->size = 0;
+    }
+    return ok;
+}
+
+// send the current block, if any, to the writer thread
+static void
+record_io_submit_block(struct record_io *io) {
+    struct record_io_block *block = io->current;
+    if (!block) {
+        return;
+    }
+    io->current = NULL;
+
+    mutex_lock(io->mutex);
+    if (block->size) {
+        queue_push(&io->pending, next, block);
+        cond_signal(io->pending_cond);
+    } else {
+        queue_push(&io->free_queue, next, block);
+    }
+    mutex_unlock(io->mutex);
+}
+
+bool
+record_io_write(struct record_io *io, const uint8_t *data, size_t len) {
+    size_t capacity = io->params.buffer_size;
+    while (len) {
+        if (!io->current && !record_io_acquire_block(io)) {
+            return false;
+        }
+
+        struct record_io_block *block = io->current;
+        size_t n = MIN(len, capacity - block->size);
+        memcpy(block->data + block->size, data, n);
+        block->size += n;
+        data += n;
+        len -= n;
+        io->pos += n;
+        io->size = MAX(io->size, io->pos);
+
+        if (block->size == capacity) {
+            record_io_submit_block(io);
+        }
+    }
+    return true;
+}
+
+int64_t
+record_io_seek(struct record_io *io, int64_t offset, int whence) {
+    int64_t pos;
+    switch (whence) {
+        case AVSEEK_SIZE:
+            return io->size;
+        case SEEK_SET:
+            pos = offset;
+            break;
+        case SEEK_CUR:
+            pos = io->pos + offset;
+            break;
+        case SEEK_END:
+            pos = io->size + offset;
+            break;
+        default:
+            return -1;
+    }
+    if (pos < 0) {
+        return -1;
+    }
+
+    if (pos != io->pos) {
+        // the blocks are contiguous, a seek starts a new block
+        record_io_submit_block(io);
+        io->pos = pos;
+    }
+    return pos;
+}
+
+static int
+avio_write_packet(void *opaque,
+#ifdef SCRCPY_LAVF_HAS_AVIO_CONST_WRITE_PACKET
+                  const
+#endif
+                  uint8_t *buf, int buf_size) {
+    struct record_io *io = opaque;
+    if (!record_io_write(io, buf, buf_size)) {
+        return AVERROR(EIO);
+    }
+    return buf_size;
+}
+
+static int64_t
+avio_seek(void *opaque, int64_t offset, int whence) {
+    struct record_io *io = opaque;
+    int64_t ret = record_io_seek(io, offset, whence);
+    return ret < 0 ? AVERROR(EINVAL) : ret;
+}
+
+static void
+free_avio(AVIOContext **avio) {
+    av_freep(&(*avio)->buffer);
+#ifdef SCRCPY_LAVF_HAS_AVIO_CONTEXT_FREE
+    avio_context_free(avio);
+#else
+    av_freep(avio);
+#endif
+}
+
+static bool
+open_files(struct record_io *io, const char *filename) {
+    int flags = O_WRONLY | O_CREAT | O_TRUNC;
+#ifdef _WIN32
+    flags |= O_BINARY;
+#endif
+    io->fd = open(filename, flags, 0644);
+    if (io->fd == -1) {
+        LOGE("Could not open output file: %s", filename);
+        return false;
+    }
+
+    io->direct_fd = -1;
+    if (io->params.direct) {
+#ifdef O_DIRECT
+        // the same file is also opened with O_DIRECT for the aligned blocks
+        io->direct_fd = open(filename, O_WRONLY | O_DIRECT);
+        if (io->direct_fd == -1) {
+            LOGW("Direct I/O not supported for %s, using buffered writes",
+                 filename);
+        }
+#else
+        LOGW("Direct I/O not supported on this platform");
+#endif
+    }
+    return true;
+}
+
+static void
+close_files(struct record_io *io) {
+    if (io->direct_fd != -1) {
+        close(io->direct_fd);
+    }
+    if (close(io->fd)) {
+        LOGE("Could not close recording: %s", strerror(errno));
+        io->failed = true;
+    }
+}
+
+bool
+record_io_open(struct record_io *io, const char *filename,
+               const struct record_io_params *params,
+               struct record_io_stats *stats) {
+    assert(params->buffer_size);
+
+    io->params = *params;
+    io->params.buffer_size =
+        ALIGN_UP(params->buffer_size, RECORD_IO_ALIGNMENT);
+    size_t buffer_size = io->params.buffer_size;
+
+    io->memory = SDL_malloc(RECORD_IO_BUFFER_COUNT * buffer_size
+                          + RECORD_IO_ALIGNMENT - 1);
+    if (!io->memory) {
+        LOGC("Could not allocate recording buffers");
+        return false;
+    }
+
+    uintptr_t aligned = ALIGN_UP((uintptr_t) io->memory, RECORD_IO_ALIGNMENT);
+    queue_init(&io->free_queue);
+    queue_init(&io->pending);
+    for (unsigned i = 0; i < RECORD_IO_BUFFER_COUNT; ++i) {
+        struct record_io_block *block = &io->blocks[i];
+        block->data = (uint8_t *) aligned + i * buffer_size;
+        queue_push(&io->free_queue, next, block);
+    }
+
+    if (!(io->mutex = SDL_CreateMutex())) {
+        goto error_free_memory;
+    }
+
+    if (!(io->pending_cond = SDL_CreateCond())) {
+        goto error_destroy_mutex;
+    }
+
+    if (!(io->free_cond = SDL_CreateCond())) {
+        goto error_destroy_pending_cond;
+    }
+
+    uint8_t *avio_buffer = av_malloc(AVIO_BUFFER_SIZE);
+    if (!avio_buffer) {
+        LOGC("Could not allocate I/O buffer");
+        goto error_destroy_free_cond;
+    }
+
+    io->avio = avio_alloc_context(avio_buffer, AVIO_BUFFER_SIZE, 1, io, NULL,
+                                  avio_write_packet, avio_seek);
+    if (!io->avio) {
+        LOGC("Could not allocate I/O context");
+        av_free(avio_buffer);
+        goto error_destroy_free_cond;
+    }
+
+    if (!open_files(io, filename)) {
+        goto error_free_avio;
+    }
+
+    io->current = NULL;
+    io->pos = 0;
+    io->size = 0;
+    io->stopped = false;
+    io->failed = false;
+    io->stats = stats;
+
+    io->thread = SDL_CreateThread(run_record_io, "record_io", io);
+    if (!io->thread) {
+        LOGC("Could not start record I/O thread");
+        goto error_close_files;
+    }
+
+    return true;
+
+error_close_files:
+    close_files(io);
+error_free_avio:
+    free_avio(&io->avio);
+error_destroy_free_cond:
+    SDL_DestroyCond(io->free_cond);
+error_destroy_pending_cond:
+    SDL_DestroyCond(io->pending_cond);
+error_destroy_mutex:
+    SDL_DestroyMutex(io->mutex);
+error_free_memory:
+    SDL_free(io->memory);
+    return false;
+}
+
+bool
+record_io_close(struct record_io *io) {
+    avio_flush(io->avio);
+    bool ok = !io->avio->error;
+    record_io_submit_block(io);
+
+    mutex_lock(io->mutex);
+    io->stopped = true;
+    cond_signal(io->pending_cond);
+    mutex_unlock(io->mutex);
+
+    SDL_WaitThread(io->thread, NULL);
+
+    // the writer thread is joined, no need to lock
+    close_files(io);
+    ok = ok && !io->failed;
+
+    free_avio(&io->avio);
+    SDL_DestroyCond(io->free_cond);
+    SDL_DestroyCond(io->pending_cond);
+    SDL_DestroyMutex(io->mutex);
+    SDL_free(io->memory);
+    return ok;
+}
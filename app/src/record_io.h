@@ -0,0 +1,110 @@
+#ifndef RECORD_IO_H
+#define RECORD_IO_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <libavformat/avio.h>
+#include <SDL2/SDL_mutex.h>
+#include <SDL2/SDL_thread.h>
+
+#include "config.h"
+#include "util/histogram.h"
+#include "util/queue.h"
+
+// the buffers (and, for direct I/O, the file offsets and the write sizes) are
+// aligned on this value
+#define RECORD_IO_ALIGNMENT 4096
+#define RECORD_IO_BUFFER_COUNT 4
+#define RECORD_IO_DEFAULT_BUFFER_SIZE (1 << 20)
+
+struct record_io_params {
+    // size of the writes issued to the file (rounded up to a multiple of
+    // RECORD_IO_ALIGNMENT), 0 to use the default FFmpeg I/O (avio_open())
+    size_t buffer_size;
+    // if not 0, flush the data written to the disk (fdatasync()) at most once
+    // per interval, in milliseconds, and on close
+    uint32_t sync_interval;
+    // bypass the page cache (O_DIRECT) for the aligned writes, if supported
+    bool direct;
+};
+
+struct record_io_stats {
+    uint64_t bytes;
+    uint64_t writes;
+    uint64_t syncs;
+    // number of times the muxer had to wait for a buffer to be written
+    uint64_t stalls;
+    // duration of each write() and fdatasync(), in microseconds
+    struct histogram write_latency;
+    struct histogram sync_latency;
+};
+
+struct record_io_block {
+    uint8_t *data; // aligned on RECORD_IO_ALIGNMENT
+    size_t size;
+    int64_t offset; // position of the data in the file
+    struct record_io_block *next;
+};
+
+struct record_io_block_queue QUEUE(struct record_io_block);
+
+// buffered output for the recorder
+//
+// the muxer (through the AVIOContext) fills large aligned blocks, which are
+// written to the file by a separate thread, so that the recorder thread is
+// not blocked by the disk latency until all the blocks are pending
+struct record_io {
+    AVIOContext *avio;
+    struct record_io_params params;
+    int fd;
+    int direct_fd; // -1 if direct I/O is disabled
+
+    uint8_t *memory; // unaligned allocation of all the blocks
+    struct record_io_block blocks[RECORD_IO_BUFFER_COUNT];
+
+    // only accessed from the muxer thread
+    struct record_io_block *current; // the block being filled, if any
+    int64_t pos; // current position in the file
+    int64_t size; // current file size
+
+    SDL_Thread *thread;
+    SDL_mutex *mutex;
+    SDL_cond *pending_cond;
+    SDL_cond *free_cond;
+    bool stopped;
+    bool failed;
+    struct record_io_block_queue pending; // protected by the mutex
+    struct record_io_block_queue free_queue; // protected by the mutex
+    int64_t last_sync_time; // only accessed from the writer thread
+    struct record_io_stats *stats; // protected by the mutex
+};
+
+void
+record_io_stats_init(struct record_io_stats *stats);
+
+void
+record_io_log_stats(const struct record_io_stats *stats);
+
+// create (or truncate) the file and start the writer thread
+// the stats are accumulated into stats, which must outlive the record_io
+bool
+record_io_open(struct record_io *io, const char *filename,
+               const struct record_io_params *params,
+               struct record_io_stats *stats);
+
+// write the remaining data, then close the file
+// return false if any write failed
+bool
+record_io_close(struct record_io *io);
+
+// the AVIOContext callbacks, to be called from the muxer thread only
+bool
+record_io_write(struct record_io *io, const uint8_t *data, size_t len);
+
+// whence is SEEK_SET, SEEK_CUR, SEEK_END or AVSEEK_SIZE
+// return the new position (or the file size for AVSEEK_SIZE), or -1 on error
+int64_t
+record_io_seek(struct record_io *io, int64_t offset, int whence);
+
+#endif
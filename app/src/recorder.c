@@ -1,6 +1,8 @@
 #include "recorder.h"
 
 #include <assert.h>
+#include <inttypes.h>
+#include <string.h>
 #include <libavutil/time.h>
 
 #include "config.h"
@@ -27,53 +29,76 @@ find_muxer(const char *name) {
     return oformat;
 }
 
+// besides the queued packets, the recorder thread holds the previous packet
+// (waiting for the next one to know its duration), the packet being written
+// and the pending events
+#define RECORD_PACKETS_OUTSIDE_QUEUE (2 + RECORDER_MAX_PENDING_EVENTS)
+
+// must be called with the mutex locked
 static struct record_packet *
-record_packet_new(const AVPacket *packet) {
-    struct record_packet *rec = SDL_malloc(sizeof(*rec));
-    if (!rec) {
-        return NULL;
-    }
+record_packet_new(struct recorder *recorder, const AVPacket *packet) {
+    // the queue bound guarantees that a preallocated packet is available
+    assert(!queue_is_empty(&recorder->free_queue));
+    struct record_packet *rec;
+    queue_take(&recorder->free_queue, next, &rec);
 
     // av_packet_ref() does not initialize all fields in old FFmpeg versions
     // See <https://github.com/Genymobile/scrcpy/issues/707>
     av_init_packet(&rec->packet);
 
     if (av_packet_ref(&rec->packet, packet)) {
-        SDL_free(rec);
+        queue_push(&recorder->free_queue, next, rec);
         return NULL;
     }
     return rec;
 }
 
+// must be called with the mutex locked (or once the recorder thread is
+// stopped)
 static void
-record_packet_delete(struct record_packet *rec) {
+record_packet_release(struct recorder *recorder, struct record_packet *rec) {
     av_packet_unref(&rec->packet);
-    SDL_free(rec);
+    queue_push(&recorder->free_queue, next, rec);
 }
 
+// must be called with the mutex locked
 static void
-recorder_queue_clear(struct recorder_queue *queue) {
-    while (!queue_is_empty(queue)) {
+recorder_queue_clear(struct recorder *recorder) {
+    while (!queue_is_empty(&recorder->queue)) {
         struct record_packet *rec;
-        queue_take(queue, next, &rec);
-        record_packet_delete(rec);
+        queue_take(&recorder->queue, next, &rec);
+        record_packet_release(recorder, rec);
     }
+    recorder->stats.depth = 0;
+    recorder->stats.bytes = 0;
 }
 
 bool
 recorder_init(struct recorder *recorder,
               const char *filename,
               enum recorder_format format,
-              struct size declared_frame_size) {
+              struct size declared_frame_size,
+              const struct recorder_queue_params *queue_params,
+              const struct recorder_output_params *output_params) {
+    assert(queue_params->max_packets);
     recorder->filename = SDL_strdup(filename);
     if (!recorder->filename) {
         LOGE("Could not strdup filename");
         return false;
     }
 
+    unsigned count = queue_params->max_packets + RECORD_PACKETS_OUTSIDE_QUEUE;
+    recorder->packets = SDL_malloc(count * sizeof(*recorder->packets));
+    if (!recorder->packets) {
+        LOGC("Could not allocate record packets");
+        SDL_free(recorder->filename);
+        return false;
+    }
+
     recorder->mutex = SDL_CreateMutex();
     if (!recorder->mutex) {
         LOGC("Could not create mutex");
+        SDL_free(recorder->packets);
         SDL_free(recorder->filename);
         return false;
     }
@@ -82,25 +107,65 @@ recorder_init(struct recorder *recorder,
     if (!recorder->queue_cond) {
         LOGC("Could not create cond");
         SDL_DestroyMutex(recorder->mutex);
+        SDL_free(recorder->packets);
+        SDL_free(recorder->filename);
+        return false;
+    }
+
+    recorder->space_cond = SDL_CreateCond();
+    if (!recorder->space_cond) {
+        LOGC("Could not create cond");
+        SDL_DestroyCond(recorder->queue_cond);
+        SDL_DestroyMutex(recorder->mutex);
+        SDL_free(recorder->packets);
         SDL_free(recorder->filename);
         return false;
     }
 
     queue_init(&recorder->queue);
+    queue_init(&recorder->free_queue);
+    for (unsigned i = 0; i < count; ++i) {
+        queue_push(&recorder->free_queue, next, &recorder->packets[i]);
+    }
+    recorder->queue_params = *queue_params;
+    recorder->dropping = false;
+    recorder->last_event_pts = AV_NOPTS_VALUE;
+    memset(&recorder->stats, 0, sizeof(recorder->stats));
+    histogram_init(&recorder->stats.write_latency);
+    record_io_stats_init(&recorder->io_stats);
     recorder->stopped = false;
     recorder->failed = false;
     recorder->format = format;
     recorder->declared_frame_size = declared_frame_size;
     recorder->header_written = false;
     recorder->previous = NULL;
+    queue_init(&recorder->pending_events);
+    recorder->pending_event_count = 0;
+    recorder->ctx = NULL;
+    recorder->output_params = *output_params;
+    recorder->codec = NULL;
+    recorder->has_config_packet = false;
+    recorder->segment_filename = NULL;
+    recorder->segment_index = 0;
+    recorder->segment_start_pts = AV_NOPTS_VALUE;
+    recorder->pts_offset = 0;
 
     return true;
 }
 
 void
 recorder_destroy(struct recorder *recorder) {
+    // the recorder thread, if any, is joined
+    recorder_queue_clear(recorder);
+    SDL_DestroyCond(recorder->space_cond);
     SDL_DestroyCond(recorder->queue_cond);
     SDL_DestroyMutex(recorder->mutex);
+    if (recorder->has_config_packet) {
+        av_packet_unref(&recorder->config_packet);
+    }
+    SDL_free(recorder->packets);
+    // set if the recorder has been opened but not closed
+    SDL_free(recorder->segment_filename);
     SDL_free(recorder->filename);
 }
 
@@ -113,8 +178,54 @@ recorder_get_format_name(enum recorder_format format) {
     }
 }
 
-bool
-recorder_open(struct recorder *recorder, const AVCodec *input_codec) {
+static bool
+is_segmented(const struct recorder *recorder) {
+    return recorder->output_params.segment_duration
+        || recorder->output_params.segment_size;
+}
+
+static bool
+has_record_io(const struct recorder *recorder) {
+    return recorder->output_params.io.buffer_size;
+}
+
+static bool
+has_event_track(const struct recorder *recorder) {
+    return recorder->output_params.events
+        && recorder->format == RECORDER_FORMAT_MKV;
+}
+
+char *
+recorder_get_segment_filename(const char *filename, unsigned index) {
+    size_t len = strlen(filename);
+    const char *ext = strrchr(filename, '.');
+    const char *sep = strrchr(filename, '/');
+#ifdef _WIN32
+    const char *win_sep = strrchr(filename, '\\');
+    if (win_sep && (!sep || win_sep > sep)) {
+        sep = win_sep;
+    }
+#endif
+    if (!ext || ext == filename || (sep && ext <= sep + 1)) {
+        // no extension (a leading dot is not an extension separator)
+        ext = filename + len;
+    }
+
+    // "-" and at least 3 digits
+    size_t size = len + 16;
+    char *segment_filename = SDL_malloc(size);
+    if (!segment_filename) {
+        LOGC("Could not allocate segment filename");
+        return NULL;
+    }
+    snprintf(segment_filename, size, "%.*s-%03u%s", (int) (ext - filename),
+             filename, index, ext);
+    return segment_filename;
+}
+
+// open the file for the current segment, without writing the header
+static bool
+recorder_open_output(struct recorder *recorder) {
     const char *format_name = recorder_get_format_name(recorder->format);
     assert(format_name);
     const AVOutputFormat *format = find_muxer(format_name);
@@ -123,8 +234,21 @@ recorder_open(struct recorder *recorder, const AVCodec *input_codec) {
         return false;
     }
 
-    recorder->ctx = avformat_alloc_context();
-    if (!recorder->ctx) {
+    SDL_free(recorder->segment_filename);
+    if (is_segmented(recorder)) {
+        recorder->segment_filename =
+            recorder_get_segment_filename(recorder->filename,
+                                          recorder->segment_index);
+    } else {
+        recorder->segment_filename = SDL_strdup(recorder->filename);
+    }
+    if (!recorder->segment_filename) {
+        LOGE("Could not create recording filename");
+        return false;
+    }
+
+    AVFormatContext *ctx = avformat_alloc_context();
+    if (!ctx) {
         LOGE("Could not allocate output context");
         return false;
     }
@@ -133,14 +257,15 @@ recorder_open(struct recorder *recorder, const AVCodec *input_codec) {
     // returns (on purpose) a pointer-to-const, but AVFormatContext.oformat
     // still expects a pointer-to-non-const (it has not be updated accordingly)
     // <https://github.com/FFmpeg/FFmpeg/commit/0694d8702421e7aff1340038559c438b61bb30dd>
-    recorder->ctx->oformat = (AVOutputFormat *) format;
+    ctx->oformat = (AVOutputFormat *) format;
 
-    av_dict_set(&recorder->ctx->metadata, "comment",
+    av_dict_set(&ctx->metadata, "comment",
                 "Recorded by scrcpy " SCRCPY_VERSION, 0);
 
-    AVStream *ostream = avformat_new_stream(recorder->ctx, input_codec);
+    const AVCodec *input_codec = recorder->codec;
+    AVStream *ostream = avformat_new_stream(ctx, input_codec);
     if (!ostream) {
-        avformat_free_context(recorder->ctx);
+        avformat_free_context(ctx);
         return false;
     }
 
@@ -158,67 +283,174 @@ recorder_open(struct recorder *recorder, const AVCodec *input_codec) {
     ostream->codec->height = recorder->declared_frame_size.height;
 #endif
 
-    int ret = avio_open(&recorder->ctx->pb, recorder->filename,
-                        AVIO_FLAG_WRITE);
-    if (ret < 0) {
-        LOGE("Failed to open output file: %s", recorder->filename);
-        // ostream will be cleaned up during context cleaning
-        avformat_free_context(recorder->ctx);
-        return false;
+    if (has_event_track(recorder)) {
+        AVStream *estream = avformat_new_stream(ctx, NULL);
+        if (!estream) {
+            avformat_free_context(ctx);
+            return false;
+        }
+
+        // plain UTF-8 text (S_TEXT/UTF8 in matroska)
+#ifdef SCRCPY_LAVF_HAS_NEW_CODEC_PARAMS_API
+        estream->codecpar->codec_type = AVMEDIA_TYPE_SUBTITLE;
+        estream->codecpar->codec_id = AV_CODEC_ID_TEXT;
+#else
+        estream->codec->codec_type = AVMEDIA_TYPE_SUBTITLE;
+        estream->codec->codec_id = AV_CODEC_ID_TEXT;
+#endif
+        av_dict_set(&estream->metadata, "title", "scrcpy events", 0);
+    }
+
+    if (has_record_io(recorder)) {
+        if (!record_io_open(&recorder->io, recorder->segment_filename,
+                            &recorder->output_params.io,
+                            &recorder->io_stats)) {
+            avformat_free_context(ctx);
+            return false;
+        }
+        ctx->pb = recorder->io.avio;
+    } else {
+        int ret = avio_open(&ctx->pb, recorder->segment_filename,
+                            AVIO_FLAG_WRITE);
+        if (ret < 0) {
+            LOGE("Failed to open output file: %s",
+                 recorder->segment_filename);
+            // ostream will be cleaned up during context cleaning
+            avformat_free_context(ctx);
+            return false;
+        }
     }
 
-    LOGI("Recording started to %s file: %s", format_name, recorder->filename);
+    recorder->ctx = ctx;
+
+    LOGI("Recording started to %s file: %s", format_name,
+         recorder->segment_filename);
 
     return true;
 }
 
-void
-recorder_close(struct recorder *recorder) {
-    if (recorder->header_written) {
+// write the trailer (if the header has been written) and close the file of
+// the current segment
+static bool
+recorder_close_output(struct recorder *recorder) {
+    if (!recorder->ctx) {
+        // the output could not be opened
+        return false;
+    }
+
+    bool ok = recorder->header_written;
+    if (ok) {
         int ret = av_write_trailer(recorder->ctx);
         if (ret < 0) {
-            LOGE("Failed to write trailer to %s", recorder->filename);
-            recorder->failed = true;
+            LOGE("Failed to write trailer to %s", recorder->segment_filename);
+            ok = false;
+        }
+    }
+    // else the recorded file is empty
+
+    if (has_record_io(recorder)) {
+        if (!record_io_close(&recorder->io)) {
+            LOGE("Failed to write %s", recorder->segment_filename);
+            ok = false;
         }
     } else {
-        // the recorded file is empty
-        recorder->failed = true;
+        avio_close(recorder->ctx->pb);
     }
-    avio_close(recorder->ctx->pb);
     avformat_free_context(recorder->ctx);
+    recorder->ctx = NULL;
+    recorder->header_written = false;
+    return ok;
+}
+
+bool
+recorder_open(struct recorder *recorder, const AVCodec *input_codec) {
+    if (recorder->output_params.events && !has_event_track(recorder)) {
+        // typically a recording started at runtime into an mp4 path
+        LOGW("The events are only recorded in mkv, not in %s",
+             recorder->filename);
+    }
+    recorder->codec = input_codec;
+    recorder->segment_index = 0;
+    return recorder_open_output(recorder);
+}
+
+static void
+recorder_log_stats(const struct recorder_stats *stats) {
+    LOGI("Recorder queue: %" PRIu64 " packets, %" PRIu64 " dropped, %" PRIu64
+         " blocked pushes, max depth %u, max %" PRIu64 " bytes buffered",
+         stats->pushed, stats->dropped, stats->blocked, stats->max_depth,
+         (uint64_t) stats->max_bytes);
+
+    const struct histogram *latency = &stats->write_latency;
+    if (latency->count) {
+        LOGI("Recorder write latency (ms, p50/p95/p99/max): "
+             "%.1f/%.1f/%.1f/%.1f",
+             histogram_percentile(latency, 50) / 1000.0,
+             histogram_percentile(latency, 95) / 1000.0,
+             histogram_percentile(latency, 99) / 1000.0,
+             latency->max / 1000.0);
+    }
+}
+
+void
+recorder_close(struct recorder *recorder) {
+    if (!recorder_close_output(recorder)) {
+        recorder->failed = true;
+    }
 
     if (recorder->failed) {
-        LOGE("Recording failed to %s", recorder->filename);
+        LOGE("Recording failed to %s", recorder->segment_filename);
     } else {
         const char *format_name = recorder_get_format_name(recorder->format);
-        LOGI("Recording complete to %s file: %s", format_name, recorder->filename);
+        LOGI("Recording complete to %s file: %s", format_name,
+             recorder->segment_filename);
+    }
+    SDL_free(recorder->segment_filename);
+    recorder->segment_filename = NULL;
+
+    // the recorder thread is joined, no need to lock
+    recorder_log_stats(&recorder->stats);
+    if (has_record_io(recorder)) {
+        record_io_log_stats(&recorder->io_stats);
     }
 }
 
 static bool
-recorder_write_header(struct recorder *recorder, const AVPacket *packet) {
+recorder_write_header(struct recorder *recorder) {
+    assert(recorder->has_config_packet);
+    const AVPacket *config = &recorder->config_packet;
     AVStream *ostream = recorder->ctx->streams[0];
 
-    uint8_t *extradata = av_malloc(packet->size * sizeof(uint8_t));
+    uint8_t *extradata = av_malloc(config->size * sizeof(uint8_t));
     if (!extradata) {
         LOGC("Could not allocate extradata");
         return false;
     }
 
-    // copy the first packet to the extra data
-    memcpy(extradata, packet->data, packet->size);
+    // copy the config packet to the extra data
+    memcpy(extradata, config->data, config->size);
 
 #ifdef SCRCPY_LAVF_HAS_NEW_CODEC_PARAMS_API
     ostream->codecpar->extradata = extradata;
-    ostream->codecpar->extradata_size = packet->size;
+    ostream->codecpar->extradata_size = config->size;
 #else
     ostream->codec->extradata = extradata;
-    ostream->codec->extradata_size = packet->size;
+    ostream->codec->extradata_size = config->size;
 #endif
 
-    int ret = avformat_write_header(recorder->ctx, NULL);
+    AVDictionary *options = NULL;
+    if (recorder->output_params.fragmented) {
+        assert(recorder->format == RECORDER_FORMAT_MP4);
+        // start a fragment on each keyframe, and write an empty moov, so that
+        // the index does not grow with the recording duration
+        av_dict_set(&options, "movflags",
+                    "frag_keyframe+empty_moov+default_base_moof", 0);
+    }
+
+    int ret = avformat_write_header(recorder->ctx, &options);
+    av_dict_free(&options);
     if (ret < 0) {
-        LOGE("Failed to write header to %s", recorder->filename);
+        LOGE("Failed to write header to %s", recorder->segment_filename);
         return false;
     }
 
@@ -227,41 +459,185 @@ recorder_write_header(struct recorder *recorder, const AVPacket *packet) {
 
 static void
 recorder_rescale_packet(struct recorder *recorder, AVPacket *packet) {
-    AVStream *ostream = recorder->ctx->streams[0];
+    AVStream *ostream = recorder->ctx->streams[packet->stream_index];
     av_packet_rescale_ts(packet, SCRCPY_TIME_BASE, ostream->time_base);
 }
 
+// must be called on a keyframe
+static bool
+recorder_must_start_segment(struct recorder *recorder,
+                            const AVPacket *packet) {
+    const struct recorder_output_params *params = &recorder->output_params;
+    if (params->segment_duration
+            && packet->pts - recorder->segment_start_pts
+                >= (int64_t) params->segment_duration) {
+        return true;
+    }
+    return params->segment_size
+        && (uint64_t) avio_tell(recorder->ctx->pb) >= params->segment_size;
+}
+
+// finish the current segment and start a new one at the keyframe pts
+static bool
+recorder_start_segment(struct recorder *recorder, int64_t pts) {
+    if (!recorder_close_output(recorder)) {
+        LOGE("Could not finish recording segment: %s",
+             recorder->segment_filename);
+        return false;
+    }
+    LOGI("Recording segment complete: %s", recorder->segment_filename);
+
+    ++recorder->segment_index;
+    if (!recorder_open_output(recorder)) {
+        return false;
+    }
+    if (!recorder_write_header(recorder)) {
+        return false;
+    }
+    recorder->header_written = true;
+    recorder->segment_start_pts = pts;
+    recorder->pts_offset = pts;
+    return true;
+}
+
+// rebase and write a packet to the current segment
+static bool
+recorder_write_packet(struct recorder *recorder, AVPacket *packet) {
+    // each segment starts at 0
+    packet->pts -= recorder->pts_offset;
+    if (packet->dts != AV_NOPTS_VALUE) {
+        packet->dts -= recorder->pts_offset;
+    }
+    recorder_rescale_packet(recorder, packet);
+    return av_write_frame(recorder->ctx, packet) >= 0;
+}
+
+static bool
+recorder_write_event(struct recorder *recorder, AVPacket *packet) {
+    if (recorder->segment_start_pts == AV_NOPTS_VALUE
+            || packet->pts < recorder->pts_offset) {
+        // the event occurred before the first frame of the recording (or of
+        // the current segment)
+        return true;
+    }
+    return recorder_write_packet(recorder, packet);
+}
+
 bool
 recorder_write(struct recorder *recorder, AVPacket *packet) {
-    if (!recorder->header_written) {
-        if (packet->pts != AV_NOPTS_VALUE) {
-            LOGE("The first packet is not a config packet");
-            return false;
+    if (packet->stream_index == RECORDER_EVENT_STREAM_INDEX) {
+        return recorder_write_event(recorder, packet);
+    }
+
+    if (packet->pts == AV_NOPTS_VALUE) {
+        // keep the latest config packet for the next segments
+        if (recorder->has_config_packet) {
+            av_packet_unref(&recorder->config_packet);
         }
-        bool ok = recorder_write_header(recorder, packet);
-        if (!ok) {
+        // av_packet_ref() does not initialize all fields in old FFmpeg
+        // versions
+        av_init_packet(&recorder->config_packet);
+        recorder->has_config_packet =
+            !av_packet_ref(&recorder->config_packet, packet);
+        if (!recorder->has_config_packet) {
+            LOGC("Could not reference config packet");
             return false;
         }
-        recorder->header_written = true;
+
+        if (!recorder->header_written) {
+            bool ok = recorder_write_header(recorder);
+            if (!ok) {
+                return false;
+            }
+            recorder->header_written = true;
+        }
+        // the config packets are not written as frames
         return true;
     }
 
-    if (packet->pts == AV_NOPTS_VALUE) {
-        // ignore config packets
-        return true;
+    if (!recorder->header_written) {
+        LOGE("The first packet is not a config packet");
+        return false;
     }
 
-    recorder_rescale_packet(recorder, packet);
-    return av_write_frame(recorder->ctx, packet) >= 0;
+    if (recorder->segment_start_pts == AV_NOPTS_VALUE) {
+        recorder->segment_start_pts = packet->pts;
+        // the recording starts at 0, even if it is started while the stream
+        // is running
+        recorder->pts_offset = packet->pts;
+    } else if (is_segmented(recorder) && (packet->flags & AV_PKT_FLAG_KEY)
+            && recorder_must_start_segment(recorder, packet)) {
+        if (!recorder_start_segment(recorder, packet->pts)) {
+            return false;
+        }
+    }
+
+    return recorder_write_packet(recorder, packet);
+}
+
+// write the oldest pending event, and keep it to be recycled
+static bool
+recorder_write_pending_event(struct recorder *recorder,
+                             struct recorder_queue *written) {
+    struct record_packet *rec;
+    queue_take(&recorder->pending_events, next, &rec);
+    --recorder->pending_event_count;
+    bool ok = recorder_write(recorder, &rec->packet);
+    av_packet_unref(&rec->packet);
+    queue_push(written, next, rec);
+    return ok;
+}
+
+// write the pending events which occurred before pts (all of them if pts is
+// AV_NOPTS_VALUE), so that the packets are interleaved in the file
+static bool
+recorder_write_pending_events(struct recorder *recorder,
+                              struct recorder_queue *written, int64_t pts) {
+    while (!queue_is_empty(&recorder->pending_events)) {
+        if (pts != AV_NOPTS_VALUE
+                && recorder->pending_events.first->packet.pts >= pts) {
+            break;
+        }
+        if (!recorder_write_pending_event(recorder, written)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// must be called with the mutex locked
+static void
+recorder_recycle_written(struct recorder *recorder,
+                         struct recorder_queue *written) {
+    while (!queue_is_empty(written)) {
+        struct record_packet *rec;
+        queue_take(written, next, &rec);
+        // already unreferenced
+        queue_push(&recorder->free_queue, next, rec);
+    }
 }
 
 static int
 run_recorder(void *data) {
     struct recorder *recorder = data;
 
+    // the packets written during the previous iteration, to be recycled once
+    // the mutex is locked
+    struct recorder_queue written;
+    queue_init(&written);
+    // the duration of the video packet write, if any
+    bool has_write_latency = false;
+    uint32_t write_latency = 0;
+
     for (;;) {
         mutex_lock(recorder->mutex);
 
+        recorder_recycle_written(recorder, &written);
+        if (has_write_latency) {
+            histogram_record(&recorder->stats.write_latency, write_latency);
+            has_write_latency = false;
+        }
+
         while (!recorder->stopped && queue_is_empty(&recorder->queue)) {
             cond_wait(recorder->queue_cond, recorder->mutex);
         }
@@ -275,53 +651,106 @@ run_recorder(void *data) {
             if (last) {
                 // assign an arbitrary duration to the last packet
                 last->packet.duration = 100000;
-                bool ok = recorder_write(recorder, &last->packet);
+                bool ok = recorder_write_pending_events(recorder, &written,
+                                                        last->packet.pts)
+                       && recorder_write(recorder, &last->packet);
                 if (!ok) {
                     // failing to write the last frame is not very serious, no
                     // future frame may depend on it, so the resulting file
                     // will still be valid
                     LOGW("Could not record last packet");
                 }
-                record_packet_delete(last);
+            }
+            if (!recorder_write_pending_events(recorder, &written,
+                                               AV_NOPTS_VALUE)) {
+                LOGW("Could not record last events");
             }
             break;
         }
 
         struct record_packet *rec;
         queue_take(&recorder->queue, next, &rec);
+        --recorder->stats.depth;
+        recorder->stats.bytes -= rec->packet.size;
+        // only the stream thread may wait for space
+        cond_signal(recorder->space_cond);
 
         mutex_unlock(recorder->mutex);
 
-        // recorder->previous is only written from this thread, no need to lock
-        struct record_packet *previous = recorder->previous;
-        recorder->previous = rec;
+        bool ok;
+        if (rec->packet.stream_index == RECORDER_EVENT_STREAM_INDEX) {
+            // the events are written just before the video packet which
+            // follows them, but the video may be stalled for a long time (the
+            // device sends no frame while the screen is static)
+            ok = true;
+            if (recorder->pending_event_count == RECORDER_MAX_PENDING_EVENTS) {
+                ok = recorder_write_pending_event(recorder, &written);
+            }
+            queue_push(&recorder->pending_events, next, rec);
+            ++recorder->pending_event_count;
+        } else {
+            // recorder->previous is only written from this thread, no need
+            // to lock
+            struct record_packet *previous = recorder->previous;
+            recorder->previous = rec;
+
+            if (!previous) {
+                // we just received the first packet
+                continue;
+            }
 
-        if (!previous) {
-            // we just received the first packet
-            continue;
-        }
+            // config packets have no PTS, we must ignore them
+            if (rec->packet.pts != AV_NOPTS_VALUE
+                && previous->packet.pts != AV_NOPTS_VALUE) {
+                // we now know the duration of the previous packet
+                previous->packet.duration =
+                    rec->packet.pts - previous->packet.pts;
+            }
 
-        // config packets have no PTS, we must ignore them
-        if (rec->packet.pts != AV_NOPTS_VALUE
-            && previous->packet.pts != AV_NOPTS_VALUE) {
-            // we now know the duration of the previous packet
-            previous->packet.duration = rec->packet.pts - previous->packet.pts;
+            if (previous->packet.pts != AV_NOPTS_VALUE) {
+                ok = recorder_write_pending_events(recorder, &written,
+                                                   previous->packet.pts);
+            } else {
+                ok = true;
+            }
+
+            if (ok) {
+                int64_t start = av_gettime_relative();
+                ok = recorder_write(recorder, &previous->packet);
+                write_latency = av_gettime_relative() - start;
+                has_write_latency = true;
+            }
+            av_packet_unref(&previous->packet);
+            queue_push(&written, next, previous);
         }
 
-        bool ok = recorder_write(recorder, &previous->packet);
-        record_packet_delete(previous);
         if (!ok) {
             LOGE("Could not record packet");
 
             mutex_lock(recorder->mutex);
             recorder->failed = true;
             // discard pending packets
-            recorder_queue_clear(&recorder->queue);
+            recorder_queue_clear(recorder);
+            recorder_recycle_written(recorder, &written);
+            // wake up the stream if it waits for space, to make it fail
+            cond_signal(recorder->space_cond);
             mutex_unlock(recorder->mutex);
             break;
         }
+    }
 
+    // the recorder thread is stopped, no need to lock
+    if (recorder->previous) {
+        record_packet_release(recorder, recorder->previous);
+        recorder->previous = NULL;
+    }
+    while (!queue_is_empty(&recorder->pending_events)) {
+        struct record_packet *event;
+        queue_take(&recorder->pending_events, next, &event);
+        record_packet_release(recorder, event);
     }
+    recorder->pending_event_count = 0;
+    recorder_recycle_written(recorder, &written);
 
     LOGD("Recorder thread ended");
 
@@ -354,6 +783,39 @@ recorder_join(struct recorder *recorder) {
     SDL_WaitThread(recorder->thread, NULL);
 }
 
+// must be called with the mutex locked
+static bool
+recorder_queue_is_full(const struct recorder *recorder, size_t size) {
+    const struct recorder_stats *stats = &recorder->stats;
+    if (!stats->depth) {
+        // always accept a packet in an empty queue, even if it is larger than
+        // max_bytes
+        return false;
+    }
+    return stats->depth >= recorder->queue_params.max_packets
+        || stats->bytes + size > recorder->queue_params.max_bytes;
+}
+
+// must be called with the mutex locked, the queue must not be full
+static bool
+recorder_enqueue(struct recorder *recorder, const AVPacket *packet) {
+    struct record_packet *rec = record_packet_new(recorder, packet);
+    if (!rec) {
+        LOGC("Could not allocate record packet");
+        return false;
+    }
+
+    queue_push(&recorder->queue, next, rec);
+    struct recorder_stats *stats = &recorder->stats;
+    ++stats->pushed;
+    ++stats->depth;
+    stats->bytes += packet->size;
+    stats->max_depth = MAX(stats->max_depth, stats->depth);
+    stats->max_bytes = MAX(stats->max_bytes, stats->bytes);
+    cond_signal(recorder->queue_cond);
+    return true;
+}
+
 bool
 recorder_push(struct recorder *recorder, const AVPacket *packet) {
     mutex_lock(recorder->mutex);
@@ -361,18 +823,99 @@ recorder_push(struct recorder *recorder, const AVPacket *packet) {
 
     if (recorder->failed) {
         // reject any new packet (this will stop the stream)
+        mutex_unlock(recorder->mutex);
         return false;
     }
 
-    struct record_packet *rec = record_packet_new(packet);
-    if (!rec) {
-        LOGC("Could not allocate record packet");
+    size_t size = packet->size;
+    bool is_config = packet->pts == AV_NOPTS_VALUE;
+    if (recorder->queue_params.policy == RECORDER_QUEUE_POLICY_DROP_GOP
+            && !is_config) {
+        bool full = recorder_queue_is_full(recorder, size);
+        if (recorder->dropping && (packet->flags & AV_PKT_FLAG_KEY) && !full) {
+            recorder->dropping = false;
+            LOGW("Recorder queue available, resume recording");
+        } else if (full && !recorder->dropping) {
+            recorder->dropping = true;
+            LOGW("Recorder queue full, drop packets until the next keyframe");
+        }
+        if (recorder->dropping) {
+            ++recorder->stats.dropped;
+            mutex_unlock(recorder->mutex);
+            return true;
+        }
+    }
+
+    if (recorder_queue_is_full(recorder, size)) {
+        ++recorder->stats.blocked;
+        do {
+            cond_wait(recorder->space_cond, recorder->mutex);
+        } while (!recorder->failed && recorder_queue_is_full(recorder, size));
+
+        if (recorder->failed) {
+            mutex_unlock(recorder->mutex);
+            return false;
+        }
+    }
+
+    bool ok = recorder_enqueue(recorder, packet);
+    mutex_unlock(recorder->mutex);
+    return ok;
+}
+
+bool
+recorder_push_event(struct recorder *recorder, int64_t pts, const char *text) {
+    if (!has_event_track(recorder)) {
+        return true;
+    }
+
+    size_t len = strlen(text);
+    AVPacket packet;
+    if (av_new_packet(&packet, len)) {
+        LOGC("Could not allocate event packet");
         return false;
     }
+    memcpy(packet.data, text, len);
+    packet.pts = pts;
+    packet.dts = pts;
+    packet.duration = RECORDER_EVENT_DURATION;
+    packet.flags = AV_PKT_FLAG_KEY;
+    packet.stream_index = RECORDER_EVENT_STREAM_INDEX;
 
-    queue_push(&recorder->queue, next, rec);
-    cond_signal(recorder->queue_cond);
+    mutex_lock(recorder->mutex);
+    assert(!recorder->stopped);
 
+    bool ok;
+    if (recorder->failed) {
+        ok = false;
+    } else if (recorder_queue_is_full(recorder, len)) {
+        // do not block the caller (the input events)
+        ++recorder->stats.dropped;
+        ok = true;
+    } else {
+        // the event pts is estimated from the client clock, which is
+        // resynchronized on each video packet, so it may go backwards (e.g.
+        // after a network stall), but the muxer rejects decreasing timestamps
+        // in a track
+        if (recorder->last_event_pts != AV_NOPTS_VALUE
+                && packet.pts < recorder->last_event_pts) {
+            packet.pts = recorder->last_event_pts;
+            packet.dts = recorder->last_event_pts;
+        }
+        ok = recorder_enqueue(recorder, &packet);
+        if (ok) {
+            recorder->last_event_pts = packet.pts;
+        }
+    }
+    mutex_unlock(recorder->mutex);
+
+    av_packet_unref(&packet);
+    return ok;
+}
+
+void
+recorder_get_stats(struct recorder *recorder, struct recorder_stats *stats) {
+    mutex_lock(recorder->mutex);
+    *stats = recorder->stats;
     mutex_unlock(recorder->mutex);
-    return true;
 }
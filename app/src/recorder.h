@@ -8,6 +8,8 @@
 
 #include "config.h"
 #include "common.h"
+#include "record_io.h"
+#include "util/histogram.h"
 #include "util/queue.h"
 
 enum recorder_format {
@@ -16,6 +18,48 @@ enum recorder_format {
     RECORDER_FORMAT_MKV,
 };
 
+// behavior of recorder_push() when the queue is full (typically because the
+// disk is stalled)
+enum recorder_queue_policy {
+    // wait until the recorder thread writes a packet (the stream stops
+    // reading the socket meanwhile)
+    RECORDER_QUEUE_POLICY_BLOCK,
+    // drop the packets until the next keyframe which fits in the queue, so
+    // that whole GOPs are missing from the recording, but no recorded packet
+    // references a dropped one (config packets are never dropped)
+    RECORDER_QUEUE_POLICY_DROP_GOP,
+};
+
+struct recorder_queue_params {
+    unsigned max_packets;
+    size_t max_bytes; // a single packet larger than this is still accepted
+    enum recorder_queue_policy policy;
+};
+
+struct recorder_output_params {
+    // if not 0, start a new file (a segment) on the first keyframe once the
+    // current segment reaches this duration (in microseconds) or this size
+    // (in bytes)
+    uint64_t segment_duration;
+    uint64_t segment_size;
+    // write a fragmented MP4 (a fragment per keyframe, without a global
+    // index), so that the file is readable while it is written or if the
+    // recording is interrupted
+    bool fragmented;
+    // write the events pushed by recorder_push_event() as a subtitle track
+    // (only supported in mkv)
+    bool events;
+    struct record_io_params io;
+};
+
+// the video is always the first stream
+#define RECORDER_EVENT_STREAM_INDEX 1
+// how long each event is displayed as a subtitle, in microseconds
+#define RECORDER_EVENT_DURATION 100000
+// the events held by the recorder thread until the next video packet is
+// written (beyond, they are written immediately)
+#define RECORDER_MAX_PENDING_EVENTS 256
+
 struct record_packet {
     AVPacket packet;
     struct record_packet *next;
@@ -23,6 +67,18 @@ struct record_packet {
 
 struct recorder_queue QUEUE(struct record_packet);
 
+struct recorder_stats {
+    uint64_t pushed;
+    uint64_t dropped;
+    uint64_t blocked; // number of pushes which had to wait for space
+    unsigned depth; // packets currently queued
+    unsigned max_depth;
+    size_t bytes; // payload bytes currently queued
+    size_t max_bytes;
+    // duration of each video packet write, in microseconds
+    struct histogram write_latency;
+};
+
 struct recorder {
     char *filename;
     enum recorder_format format;
@@ -30,23 +86,56 @@ struct recorder {
     struct size declared_frame_size;
     bool header_written;
 
+    struct recorder_output_params output_params;
+    const AVCodec *codec;
+    // the latest config packet, used as extradata for every segment
+    AVPacket config_packet;
+    bool has_config_packet;
+    // the name of the current file (the filename itself if segments are
+    // disabled)
+    char *segment_filename;
+    unsigned segment_index;
+    // device pts of the first packet of the current segment
+    int64_t segment_start_pts;
+    // subtracted from the packets pts, so that each segment starts at 0
+    int64_t pts_offset;
+    // only used if output_params.io.buffer_size is not 0
+    struct record_io io;
+    struct record_io_stats io_stats; // accumulated over the segments
+
     SDL_Thread *thread;
     SDL_mutex *mutex;
     SDL_cond *queue_cond;
     bool stopped; // set on recorder_stop() by the stream reader
     bool failed; // set on packet write failure
     struct recorder_queue queue;
+    struct recorder_queue_params queue_params;
+    // preallocated packets, so that pushing a packet never allocates
+    struct record_packet *packets;
+    // unreferenced packets from the preallocated array
+    struct recorder_queue free_queue;
+    SDL_cond *space_cond; // signaled when a packet is taken from the queue
+    bool dropping; // drop until the next keyframe (only for DROP_GOP)
+    // pts of the last event queued, protected by the mutex
+    int64_t last_event_pts;
+    struct recorder_stats stats; // protected by the mutex
 
     // we can write a packet only once we received the next one so that we can
     // set its duration (next_pts - current_pts)
     // "previous" is only accessed from the recorder thread, so it does not
     // need to be protected by the mutex
     struct record_packet *previous;
+    // the events to be written before the next video packet, only accessed
+    // from the recorder thread
+    struct recorder_queue pending_events;
+    unsigned pending_event_count;
 };
 
 bool
 recorder_init(struct recorder *recorder, const char *filename,
-              enum recorder_format format, struct size declared_frame_size);
+              enum recorder_format format, struct size declared_frame_size,
+              const struct recorder_queue_params *queue_params,
+              const struct recorder_output_params *output_params);
 
 void
 recorder_destroy(struct recorder *recorder);
@@ -66,7 +155,27 @@ recorder_stop(struct recorder *recorder);
 void
 recorder_join(struct recorder *recorder);
 
+// reference the packet into the queue, applying the queue policy if it is
+// full
+// return false if the recording failed
 bool
 recorder_push(struct recorder *recorder, const AVPacket *packet);
 
+// write a timed text (typically an injected control message) in the event
+// track, at the given device pts
+// never blocks: the event is dropped if the queue is full or if the event
+// track is disabled
+// return false if the recording failed
+bool
+recorder_push_event(struct recorder *recorder, int64_t pts, const char *text);
+
+// return the name of the segment file, by inserting its index before the
+// extension of filename (to be released by SDL_free())
+char *
+recorder_get_segment_filename(const char *filename, unsigned index);
+
+// copy the current queue and write statistics (may be called from any thread)
+void
+recorder_get_stats(struct recorder *recorder, struct recorder_stats *stats);
+
 #endif
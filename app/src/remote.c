@@ -1,12 +1,14 @@
 #include "remote.h"
 
 #include <assert.h>
+#include <SDL2/SDL_events.h>
 
 
 #include "config.h"
 #include "remote_control_msg.h"
 #include "control_msg.h"
 #include "controller.h"
+#include "events.h"
 #include "util/lock.h"
 #include "util/log.h"
 #include "util/net.h"
@@ -15,7 +17,7 @@
 //#define IPV4_LOCALHOST 0x7F000001
 //static socket_t
 //listen_on_port(uint16_t port) {
-//    return net_listen(IPV4_LOCALHOST, port, 1);
+//    return net_listen(IPV4_LOCALHOST, port, 1, 0);
 //}
 static void
 close_socket(socket_t *socket) {
@@ -30,13 +32,15 @@ close_socket(socket_t *socket) {
 
 
 bool
-remote_init(struct remote *remote, socket_t control_socket, socket_t client_socket, struct controller *controller) {
+remote_init(struct remote *remote, socket_t control_socket, socket_t client_socket, struct controller *controller,
+            const struct net_socket_options *socket_options) {
     if (!(remote->mutex = SDL_CreateMutex())) {
         return false;
     }
     remote->control_socket = control_socket;
     remote->remote_client_socket = client_socket;
     remote->controller = controller;
+    remote->socket_options = *socket_options;
     return true;
 }
 
@@ -49,6 +53,7 @@ bool remote_reboot_client_socket(struct remote *remote) {
     if (remote->remote_client_socket == INVALID_SOCKET) {
         return 0;
     }
+    net_set_options(remote->remote_client_socket, &remote->socket_options);
     return 1;
 }
 
@@ -59,16 +64,31 @@ remote_destroy(struct remote *remote) {
 
 }
 
+static void
+push_event(uint32_t type) {
+    SDL_Event event;
+    event.type = type;
+    SDL_PushEvent(&event);
+}
+
 static void
 process_msg(struct remote *remote, struct control_msg *msg) {
 
     switch (msg->type) {
         case CONTROL_MSG_TYPE_START_RECORDING: {
             controller_start_recording(remote->controller);
+            // the video recording is managed by the main thread
+            push_event(EVENT_START_RECORDING);
         }
             break;
         case CONTROL_MSG_TYPE_END_RECORDING: {
             controller_stop_recording(remote->controller);
+            push_event(EVENT_STOP_RECORDING);
+        }
+            break;
+        case CONTROL_MSG_TYPE_SAVE_REPLAY: {
+            // the replay buffer is owned by the main thread
+            push_event(EVENT_SAVE_REPLAY);
         }
             break;
         default:
@@ -113,6 +133,7 @@ run_remote(void *data) {
 
         return 0;
     }
+    net_set_options(remote->remote_client_socket, &remote->socket_options);
 
     for (;;) {
         assert(head < CONTROL_MSG_SERIALIZED_MAX_SIZE);
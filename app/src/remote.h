@@ -16,12 +16,14 @@ struct remote {
     SDL_Thread *thread;
     SDL_mutex *mutex;
     struct controller *controller;
-
+    // applied to each accepted client
+    struct net_socket_options socket_options;
 };
 
 bool
 remote_init(struct remote *remote, socket_t control_socket, socket_t client_socket,
-        struct controller *controller);
+        struct controller *controller,
+        const struct net_socket_options *socket_options);
 
 void
 remote_destroy(struct remote *remote);
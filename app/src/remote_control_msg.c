@@ -80,6 +80,8 @@ remote_control_msg_deserialize(const unsigned char *buf, size_t len,
             msg->type = CONTROL_MSG_TYPE_START_RECORDING;
         }else if (strcmp(msg_type, "CONTROL_MSG_TYPE_END_RECORDING") == 0) {
             msg->type = CONTROL_MSG_TYPE_END_RECORDING;
+        } else if (strcmp(msg_type, "CONTROL_MSG_TYPE_SAVE_REPLAY") == 0) {
+            msg->type = CONTROL_MSG_TYPE_SAVE_REPLAY;
         }else /* default: */
         {
             msg->type = 9999;
@@ -182,6 +184,9 @@ remote_control_msg_deserialize(const unsigned char *buf, size_t len,
             case CONTROL_MSG_TYPE_END_RECORDING:
                 LOGD("CONTROL_MSG_TYPE_END_RECORDING: %d", (int) msg->type);
                 break;
+            case CONTROL_MSG_TYPE_SAVE_REPLAY:
+                LOGD("CONTROL_MSG_TYPE_SAVE_REPLAY: %d", (int) msg->type);
+                break;
             default:
                 LOGW("Unknown remote control message type: %d", (int) msg->type);
                 ret = 0; // error, we cannot recover
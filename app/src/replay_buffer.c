@@ -0,0 +1,231 @@
+#include "replay_buffer.h"
+
+#include <assert.h>
+
+#include "config.h"
+#include "compat.h"
+#include "snapshot.h"
+#include "util/lock.h"
+#include "util/log.h"
+
+#define REPLAY_PATH_MAX 1024
+
+bool
+replay_buffer_init(struct replay_buffer *rb, struct size declared_frame_size,
+                   const struct replay_params *params) {
+    assert(params->duration);
+
+    const char *path_template = params->path_template
+                              ? params->path_template
+                              : DEFAULT_REPLAY_PATH;
+    rb->path_template = SDL_strdup(path_template);
+    if (!rb->path_template) {
+        LOGE("Could not strdup replay path template");
+        return false;
+    }
+
+    if (!(rb->mutex = SDL_CreateMutex())) {
+        goto error_free_path_template;
+    }
+
+    if (!(rb->request_cond = SDL_CreateCond())) {
+        goto error_destroy_mutex;
+    }
+
+    rb->params = *params;
+    rb->params.path_template = rb->path_template;
+    rb->declared_frame_size = declared_frame_size;
+    packet_window_init(&rb->window, (int64_t) params->duration * 1000000);
+    rb->thread = NULL;
+    rb->stopped = false;
+    // lazy initialization
+    rb->initialized = false;
+    rb->has_request = false;
+    rb->next_number = 1;
+
+    return true;
+
+error_destroy_mutex:
+    SDL_DestroyMutex(rb->mutex);
+error_free_path_template:
+    SDL_free(rb->path_template);
+    return false;
+}
+
+static void
+release_request(struct replay_request *req) {
+    packet_window_release_packets(req->packets, req->count);
+}
+
+void
+replay_buffer_destroy(struct replay_buffer *rb) {
+    // the replay thread, if any, is joined
+    if (rb->has_request) {
+        release_request(&rb->request);
+    }
+    packet_window_destroy(&rb->window);
+    SDL_DestroyCond(rb->request_cond);
+    SDL_DestroyMutex(rb->mutex);
+    SDL_free(rb->path_template);
+}
+
+static bool
+write_replay(struct replay_buffer *rb, struct replay_request *req) {
+    char path[REPLAY_PATH_MAX];
+    if (!snapshot_format_path(rb->path_template, req->number, req->time,
+                              path, sizeof(path))) {
+        LOGE("Replay path too long");
+        return false;
+    }
+
+    const AVCodec *codec = avcodec_find_decoder(AV_CODEC_ID_H264);
+    if (!codec) {
+        LOGE("H.264 decoder not found");
+        return false;
+    }
+
+    // the queue is large enough to never block nor drop
+    struct recorder_queue_params queue_params = {
+        .max_packets = req->count,
+        .max_bytes = req->bytes,
+        .policy = RECORDER_QUEUE_POLICY_BLOCK,
+    };
+    struct recorder_output_params output_params = {0};
+    struct recorder recorder;
+    if (!recorder_init(&recorder, path, rb->params.format,
+                       rb->declared_frame_size, &queue_params,
+                       &output_params)) {
+        return false;
+    }
+
+    if (!recorder_open(&recorder, codec)) {
+        recorder_destroy(&recorder);
+        return false;
+    }
+
+    if (!recorder_start(&recorder)) {
+        recorder_close(&recorder);
+        recorder_destroy(&recorder);
+        return false;
+    }
+
+    for (unsigned i = 0; i < req->count; ++i) {
+        if (!recorder_push(&recorder, &req->packets[i])) {
+            LOGE("Could not send packet to replay recorder");
+            break;
+        }
+    }
+
+    recorder_stop(&recorder);
+    recorder_join(&recorder);
+    recorder_close(&recorder);
+    bool ok = !recorder.failed;
+    recorder_destroy(&recorder);
+
+    if (ok) {
+        LOGI("Replay written to %s (%u packets)", path, req->count - 1);
+    }
+    return ok;
+}
+
+static int
+run_replay(void *data) {
+    struct replay_buffer *rb = data;
+
+    for (;;) {
+        mutex_lock(rb->mutex);
+        while (!rb->stopped && !rb->has_request) {
+            cond_wait(rb->request_cond, rb->mutex);
+        }
+        if (!rb->has_request) {
+            // stopped, and the pending replay (if any) has been written
+            mutex_unlock(rb->mutex);
+            break;
+        }
+        struct replay_request req = rb->request;
+        mutex_unlock(rb->mutex);
+
+        write_replay(rb, &req);
+        release_request(&req);
+
+        mutex_lock(rb->mutex);
+        rb->has_request = false;
+        mutex_unlock(rb->mutex);
+    }
+
+    return 0;
+}
+
+bool
+replay_buffer_start(struct replay_buffer *rb) {
+    LOGD("Starting replay thread");
+
+    rb->thread = SDL_CreateThread(run_replay, "replay", rb);
+    if (!rb->thread) {
+        LOGC("Could not start replay thread");
+        return false;
+    }
+
+    return true;
+}
+
+void
+replay_buffer_stop(struct replay_buffer *rb) {
+    mutex_lock(rb->mutex);
+    rb->stopped = true;
+    cond_signal(rb->request_cond);
+    mutex_unlock(rb->mutex);
+}
+
+void
+replay_buffer_join(struct replay_buffer *rb) {
+    if (rb->thread) {
+        SDL_WaitThread(rb->thread, NULL);
+    }
+}
+
+bool
+replay_buffer_push(struct replay_buffer *rb, const AVPacket *packet) {
+    mutex_lock(rb->mutex);
+    bool ok = packet_window_push(&rb->window, packet);
+    mutex_unlock(rb->mutex);
+    return ok;
+}
+
+bool
+replay_buffer_save(struct replay_buffer *rb) {
+    // start the replay thread if it's used for the first time
+    if (!rb->initialized) {
+        if (!replay_buffer_start(rb)) {
+            return false;
+        }
+        rb->initialized = true;
+    }
+
+    mutex_lock(rb->mutex);
+    if (rb->has_request) {
+        mutex_unlock(rb->mutex);
+        LOGW("The previous replay is still being written, request dropped");
+        return false;
+    }
+
+    if (packet_window_is_empty(&rb->window)) {
+        mutex_unlock(rb->mutex);
+        LOGW("No packets available for replay");
+        return false;
+    }
+
+    struct replay_request *req = &rb->request;
+    bool ok = packet_window_ref_packets(&rb->window, &req->packets,
+                                        &req->count);
+    if (ok) {
+        req->bytes = rb->window.config_packet.size + rb->window.bytes;
+        req->number = rb->next_number++;
+        req->time = time(NULL);
+        rb->has_request = true;
+        cond_signal(rb->request_cond);
+    }
+    mutex_unlock(rb->mutex);
+
+    return ok;
+}
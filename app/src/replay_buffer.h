@@ -0,0 +1,82 @@
+#ifndef REPLAY_BUFFER_H
+#define REPLAY_BUFFER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+#include <libavcodec/avcodec.h>
+#include <SDL2/SDL_mutex.h>
+#include <SDL2/SDL_thread.h>
+
+#include "config.h"
+#include "common.h"
+#include "packet_window.h"
+#include "recorder.h"
+
+// %t is replaced by the local time, %n by the replay number
+#define DEFAULT_REPLAY_PATH "replay-%t-%n.mp4"
+
+struct replay_params {
+    uint32_t duration; // in seconds
+    const char *path_template;
+    enum recorder_format format;
+};
+
+// the packets referenced from the window at the time of a save request
+struct replay_request {
+    AVPacket *packets; // the config packet, then the data packets
+    unsigned count;
+    size_t bytes;
+    unsigned number;
+    time_t time;
+};
+
+// keep the last seconds of the video stream in memory, so that they may be
+// written to a file on request
+struct replay_buffer {
+    char *path_template;
+    struct replay_params params;
+    struct size declared_frame_size;
+
+    SDL_mutex *mutex;
+    struct packet_window window; // protected by the mutex
+
+    // the save requests are written by a separate thread, one at a time
+    SDL_Thread *thread;
+    SDL_cond *request_cond;
+    bool stopped;
+    bool initialized;
+    bool has_request; // protected by the mutex
+    struct replay_request request;
+    unsigned next_number;
+};
+
+bool
+replay_buffer_init(struct replay_buffer *rb, struct size declared_frame_size,
+                   const struct replay_params *params);
+
+void
+replay_buffer_destroy(struct replay_buffer *rb);
+
+bool
+replay_buffer_start(struct replay_buffer *rb);
+
+// finish writing the pending replay, if any, then stop
+void
+replay_buffer_stop(struct replay_buffer *rb);
+
+void
+replay_buffer_join(struct replay_buffer *rb);
+
+// reference the packet in the window (see packet_window_push())
+bool
+replay_buffer_push(struct replay_buffer *rb, const AVPacket *packet);
+
+// write the current window to a new file asynchronously
+// the request is rejected (and false is returned) if the window is empty or
+// if the previous replay is still being written
+bool
+replay_buffer_save(struct replay_buffer *rb);
+
+#endif
@@ -1,5 +1,6 @@
 #include "scrcpy.h"
 
+#include <inttypes.h>
 #include <stdio.h>
 #include <string.h>
 #include <unistd.h>
@@ -17,10 +18,14 @@
 #include "events.h"
 #include "file_handler.h"
 #include "fps_counter.h"
+#include "frame_latency.h"
+#include "frame_log.h"
 #include "input_manager.h"
 #include "recorder.h"
 #include "screen.h"
 #include "server.h"
+#include "session_capture.h"
+#include "snapshot.h"
 #include "stream.h"
 #include "tiny_xpm.h"
 #include "video_buffer.h"
@@ -31,21 +36,27 @@
 static struct server server = SERVER_INITIALIZER;
 static struct screen screen = SCREEN_INITIALIZER;
 static struct fps_counter fps_counter;
+static struct frame_latency frame_latency;
+static struct frame_log frame_log;
 static struct video_buffer video_buffer;
 static struct stream stream;
 static struct decoder decoder;
-static struct recorder recorder;
+static struct session_capture session_capture;
 static struct controller controller;
 static struct file_handler file_handler;
+static struct snapshot snapshot;
+static struct replay_buffer replay_buffer;
 
 static struct input_manager input_manager = {
     .controller = &controller,
     .video_buffer = &video_buffer,
     .screen = &screen,
+    .snapshot = &snapshot,
     .prefer_text = false, // initialized later
 };
 
 // init SDL and set appropriate hints
+// the video subsystem is not initialized if there is no window to display
 static bool
 sdl_init_and_configure(bool display) {
     uint32_t flags = display ? SDL_INIT_VIDEO : SDL_INIT_EVENTS;
@@ -134,14 +145,21 @@ handle_event(SDL_Event *event, bool control) {
         case SDL_QUIT:
             LOGD("User requested to quit");
             return EVENT_RESULT_STOPPED_BY_USER;
-        case EVENT_NEW_FRAME:
-            if (!screen.has_frame) {
-                screen.has_frame = true;
-                // this is the very first frame, show the window
-                screen_show_window(&screen);
+        case EVENT_START_RECORDING:
+            // requested from the remote control socket
+            if (!stream_is_recording(&stream)) {
+                stream_start_recording(&stream, NULL, RECORDER_FORMAT_AUTO);
             }
-            if (!screen_update_frame(&screen, &video_buffer)) {
-                return EVENT_RESULT_CONTINUE;
+            break;
+        case EVENT_STOP_RECORDING:
+            stream_stop_recording(&stream);
+            break;
+        case EVENT_SAVE_REPLAY:
+            // requested from the remote control socket
+            if (input_manager.replay) {
+                replay_buffer_save(input_manager.replay);
+            } else {
+                LOGW("Replay buffer disabled (see --replay-buffer)");
             }
             break;
         case SDL_WINDOWEVENT:
@@ -200,6 +218,25 @@ handle_event(SDL_Event *event, bool control) {
     return EVENT_RESULT_CONTINUE;
 }
 
+static void
+render_new_frame(void) {
+    if (!screen.has_frame) {
+        screen.has_frame = true;
+        // this is the very first frame, show the window
+        screen_show_window(&screen);
+    }
+    screen_update_frame(&screen, &video_buffer);
+}
+
+// maximum number of events handled in a row while a frame is waiting to be
+// rendered, so that a flood of events (typically mouse motion) does not
+// freeze the video
+#define MAX_EVENTS_BEFORE_RENDERING 32
+
+// the rendering (especially the present, which may wait for vsync) is slow,
+// so all the pending events (for example the input events received during
+// the previous present) are handled before rendering the next frame, so that
+// their injection is not delayed by the rendering
 static bool
 event_loop(bool display, bool control) {
     (void) display;
@@ -208,8 +245,40 @@ event_loop(bool display, bool control) {
         SDL_AddEventWatch(event_watcher, NULL);
     }
 #endif
-    SDL_Event event;
-    while (SDL_WaitEvent(&event)) {
+    // number of EVENT_NEW_FRAME received but not rendered yet (one frame is
+    // taken from the video buffer for each event)
+    unsigned pending_frames = 0;
+    unsigned events_in_a_row = 0;
+    for (;;) {
+        SDL_Event event;
+        bool has_event;
+        if (!pending_frames) {
+            events_in_a_row = 0;
+            if (!SDL_WaitEvent(&event)) {
+                LOGE("Could not wait for event: %s", SDL_GetError());
+                return false;
+            }
+            has_event = true;
+        } else if (events_in_a_row < MAX_EVENTS_BEFORE_RENDERING) {
+            has_event = SDL_PollEvent(&event);
+        } else {
+            has_event = false;
+        }
+
+        if (!has_event) {
+            // no more events to handle (or too many in a row), render
+            --pending_frames;
+            events_in_a_row = 0;
+            render_new_frame();
+            continue;
+        }
+
+        ++events_in_a_row;
+        if (event.type == EVENT_NEW_FRAME) {
+            ++pending_frames;
+            continue;
+        }
+
         enum event_result result = handle_event(&event, control);
         switch (result) {
             case EVENT_RESULT_STOPPED_BY_USER:
@@ -221,7 +290,6 @@ event_loop(bool display, bool control) {
                 break;
         }
     }
-    return false;
 }
 
 static process_t
@@ -275,9 +343,44 @@ av_log_callback(void *avcl, int level, const char *fmt, va_list vl) {
     SDL_free(local_fmt);
 }
 
+// FFmpeg limits the automatic thread count to the number of CPUs + 1, and to
+// 16 threads
+#define DECODER_MAX_AUTO_THREADS 16
+
+// maximum number of frames received from the socket but not presented yet
+static unsigned
+get_pipeline_depth(const struct scrcpy_options *options) {
+    // the queue capacity is the depth rounded up to a power of 2
+    unsigned depth = 2 * options->decoder_queue_depth;
+    if (options->decoder_profile == DECODER_PROFILE_THROUGHPUT) {
+        // frame threading delays one frame per additional thread
+        unsigned threads = options->decoder_threads;
+        if (!threads) {
+            threads = SDL_GetCPUCount() + 1;
+            if (threads > DECODER_MAX_AUTO_THREADS) {
+                threads = DECODER_MAX_AUTO_THREADS;
+            }
+        }
+        depth += threads;
+    }
+    // the frame buffer, and one frame in the parser, in the decoder and in
+    // the texture
+    return depth + options->frame_buffer + 3;
+}
+
 bool
 scrcpy(const struct scrcpy_options *options) {
-    bool record = !!options->record_filename;
+    struct net_socket_options video_socket_options = {
+        .quickack = options->tcp_quickack,
+        .keepalive = options->tcp_keepalive,
+    };
+    // the control messages are small and must not wait for an ACK
+    struct net_socket_options control_socket_options = {
+        .nodelay = options->tcp_nodelay,
+        .quickack = options->tcp_quickack,
+        .keepalive = options->tcp_keepalive,
+    };
+
     struct server_params params = {
         .crop = options->crop,
         .local_port = options->port,
@@ -285,6 +388,12 @@ scrcpy(const struct scrcpy_options *options) {
         .bit_rate = options->bit_rate,
         .max_fps = options->max_fps,
         .control = options->control,
+        .video_socket_options = video_socket_options,
+        .control_socket_options = control_socket_options,
+        // the client only receives on the video socket, so only its receive
+        // buffer may be changed
+        .video_socket_rcvbuf = (int) options->socket_buffer_size,
+        .external = options->external_server,
     };
     if (!server_start(&server, options->serial, &params)) {
         return false;
@@ -300,15 +409,23 @@ scrcpy(const struct scrcpy_options *options) {
 
     bool ret = false;
 
+    bool frame_latency_initialized = false;
+    bool frame_log_initialized = false;
     bool fps_counter_initialized = false;
     bool video_buffer_initialized = false;
     bool file_handler_initialized = false;
-    bool recorder_initialized = false;
+    bool snapshot_initialized = false;
+    bool stream_initialized = false;
+    bool replay_buffer_initialized = false;
+    bool session_capture_initialized = false;
+    bool session_capture_started = false;
     bool stream_started = false;
     bool controller_initialized = false;
     bool controller_started = false;
 
-    if (!sdl_init_and_configure(options->display)) {
+    // in headless mode, the frames are rendered offscreen by the software
+    // renderer, which does not require the video subsystem
+    if (!sdl_init_and_configure(options->display && !options->headless)) {
         goto end;
     }
 
@@ -316,29 +433,81 @@ scrcpy(const struct scrcpy_options *options) {
         goto end;
     }
 
+    struct session_capture *capture = NULL;
+    if (options->record_raw_filename) {
+        if (!session_capture_init(&session_capture,
+                                  options->record_raw_filename)) {
+            goto end;
+        }
+        session_capture_initialized = true;
+
+        if (!session_capture_start(&session_capture)) {
+            goto end;
+        }
+        session_capture_started = true;
+        capture = &session_capture;
+    }
+
     char device_name[DEVICE_NAME_FIELD_LENGTH];
     struct size frame_size;
+    uint8_t device_info[DEVICE_INFO_SIZE];
 
     // screenrecord does not send frames when the screen content does not
     // change therefore, we transmit the screen size before the video stream,
     // to be able to init the window immediately
-    if (!device_read_info(server.video_socket, device_name, &frame_size)) {
+    if (!device_read_info(server.video_socket, device_name, &frame_size,
+                          capture ? device_info : NULL)) {
         goto end;
     }
 
+    if (capture) {
+        // the capture contains the whole video socket content
+        session_capture_push(capture, device_info, sizeof(device_info));
+    }
+
     struct decoder *dec = NULL;
     if (options->display) {
-        if (!fps_counter_init(&fps_counter)) {
+        if (!frame_latency_init(&frame_latency,
+                                get_pipeline_depth(options))) {
+            goto end;
+        }
+        frame_latency_initialized = true;
+        screen.latency = &frame_latency;
+        screen.dedup_frames = options->dedup_frames;
+        frame_dedup_init(&screen.dedup);
+        screen.headless = options->headless;
+
+        if (options->frame_log_filename) {
+            if (!frame_log_init(&frame_log, options->frame_log_filename)) {
+                goto end;
+            }
+            frame_log_initialized = true;
+            screen.frame_log = &frame_log;
+        }
+
+        if (!fps_counter_init(&fps_counter, &frame_latency)) {
             goto end;
         }
         fps_counter_initialized = true;
 
         if (!video_buffer_init(&video_buffer, &fps_counter,
-                               options->render_expired_frames)) {
+                               options->render_expired_frames,
+                               options->frame_buffer)) {
             goto end;
         }
         video_buffer_initialized = true;
 
+        struct snapshot_params snapshot_params = {
+            .path_template = options->screenshot_path,
+            .format = options->screenshot_format,
+            .quality = options->screenshot_quality,
+            .compression = options->screenshot_compression,
+        };
+        if (!snapshot_init(&snapshot, &video_buffer, &snapshot_params)) {
+            goto end;
+        }
+        snapshot_initialized = true;
+
         if (options->control) {
             if (!file_handler_init(&file_handler, server.serial,
                                    options->push_target)) {
@@ -347,25 +516,70 @@ scrcpy(const struct scrcpy_options *options) {
             file_handler_initialized = true;
         }
 
-        decoder_init(&decoder, &video_buffer);
+        struct decoder_params decoder_params = {
+            .queue_depth = options->decoder_queue_depth,
+            .queue_policy = options->decoder_queue_policy,
+            .profile = options->decoder_profile,
+            .threads = options->decoder_threads,
+            .texture_frames = options->texture_frames,
+        };
+        decoder_init(&decoder, &video_buffer, &frame_latency, &decoder_params);
         dec = &decoder;
     }
 
-    struct recorder *rec = NULL;
-    if (record) {
-        if (!recorder_init(&recorder,
-                           options->record_filename,
-                           options->record_format,
-                           frame_size)) {
+    struct replay_buffer *replay = NULL;
+    if (options->replay_duration) {
+        struct replay_params replay_params = {
+            .duration = options->replay_duration,
+            .path_template = options->replay_path,
+            .format = options->replay_format,
+        };
+        if (!replay_buffer_init(&replay_buffer, frame_size, &replay_params)) {
             goto end;
         }
-        rec = &recorder;
-        recorder_initialized = true;
+        replay_buffer_initialized = true;
+        replay = &replay_buffer;
+        input_manager.replay = replay;
     }
 
     av_log_set_callback(av_log_callback);
 
-    stream_init(&stream, server.video_socket, dec, rec);
+    struct stream_record_params record_params = {
+        .path_template = options->record_path,
+        .path_format = options->record_path_format,
+        .declared_frame_size = frame_size,
+        .queue = {
+            .max_packets = options->record_queue_packets,
+            .max_bytes = options->record_queue_bytes,
+            .policy = options->record_queue_policy,
+        },
+        .output = {
+            .segment_duration =
+                (uint64_t) options->record_segment_duration * 1000000,
+            .segment_size = options->record_segment_size,
+            .fragmented = options->record_fragmented,
+            .events = options->record_events,
+            .io = {
+                .buffer_size = options->record_write_size,
+                .sync_interval = options->record_sync_interval,
+                .direct = options->record_direct_io,
+            },
+        },
+    };
+    if (!stream_init(&stream, server.video_socket, dec, replay, capture,
+                     frame_latency_initialized ? &frame_latency : NULL,
+                     &record_params)) {
+        goto end;
+    }
+    stream_initialized = true;
+    input_manager.stream = &stream;
+
+    if (options->record_filename) {
+        if (!stream_start_recording(&stream, options->record_filename,
+                                    options->record_format)) {
+            goto end;
+        }
+    }
 
     // now we consumed the header values, the socket receives the video stream
     // start the stream
@@ -378,10 +592,14 @@ scrcpy(const struct scrcpy_options *options) {
     if (options->display) {
         if (options->control) {
             if (!controller_init(&controller, server.control_socket,
-                    server.remote_server_socket,server.remote_client_socket)) {
+                    server.remote_server_socket,server.remote_client_socket,
+                    &control_socket_options)) {
                 goto end;
             }
             controller_initialized = true;
+            if (options->record_events) {
+                controller.stream = &stream;
+            }
 
             if (!controller_start(&controller)) {
                 goto end;
@@ -391,7 +609,6 @@ scrcpy(const struct scrcpy_options *options) {
 
         const char *window_title =
             options->window_title ? options->window_title : device_name;
-        screen.stream=stream;
 
         if (!screen_init_rendering(&screen, window_title, frame_size,
                                    options->always_on_top, options->window_x,
@@ -423,9 +640,15 @@ scrcpy(const struct scrcpy_options *options) {
     }
 
     input_manager.prefer_text = options->prefer_text;
+    input_manager_init_stats(&input_manager);
 
-    ret = event_loop(options->display, options->control);
+    ret = event_loop(options->display && !options->headless,
+                     options->control);
     LOGD("quit...");
+    input_manager_log_stats(&input_manager);
+    if (options->dedup_frames) {
+        LOGI("Frames deduplicated: %" PRIu64, screen.dedup.deduplicated);
+    }
 
     screen_destroy(&screen);
 
@@ -441,6 +664,9 @@ end:
     if (file_handler_initialized) {
         file_handler_stop(&file_handler);
     }
+    if (snapshot_initialized) {
+        snapshot_stop(&snapshot);
+    }
     if (fps_counter_initialized) {
         fps_counter_interrupt(&fps_counter);
     }
@@ -453,6 +679,14 @@ end:
     if (stream_started) {
         stream_join(&stream);
     }
+    if (session_capture_started) {
+        // the stream is joined, nothing will be pushed anymore
+        session_capture_stop(&session_capture);
+        session_capture_join(&session_capture);
+    }
+    if (session_capture_initialized) {
+        session_capture_destroy(&session_capture);
+    }
     if (controller_started) {
         controller_join(&controller);
     }
@@ -460,8 +694,20 @@ end:
         controller_destroy(&controller);
     }
 
-    if (recorder_initialized) {
-        recorder_destroy(&recorder);
+    if (stream_initialized) {
+        // the stream is joined, finish the current recording, if any, and
+        // wait for the files to be complete
+        stream_stop_recording(&stream);
+        stream_join_recordings(&stream);
+        stream_destroy(&stream);
+    }
+
+    if (replay_buffer_initialized) {
+        // the stream is joined, the window does not change anymore; the
+        // replay being written, if any, is finished
+        replay_buffer_stop(&replay_buffer);
+        replay_buffer_join(&replay_buffer);
+        replay_buffer_destroy(&replay_buffer);
     }
 
     if (file_handler_initialized) {
@@ -469,6 +715,11 @@ end:
         file_handler_destroy(&file_handler);
     }
 
+    if (snapshot_initialized) {
+        snapshot_join(&snapshot);
+        snapshot_destroy(&snapshot);
+    }
+
     if (video_buffer_initialized) {
         video_buffer_destroy(&video_buffer);
     }
@@ -478,6 +729,15 @@ end:
         fps_counter_destroy(&fps_counter);
     }
 
+    if (frame_log_initialized) {
+        frame_log_destroy(&frame_log);
+    }
+
+    if (frame_latency_initialized) {
+        frame_latency_log_session(&frame_latency);
+        frame_latency_destroy(&frame_latency);
+    }
+
     if (options->show_touches) {
         if (!show_touches_waited) {
             // wait the process which enabled "show touches"
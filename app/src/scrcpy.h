@@ -5,20 +5,49 @@
 #include <stdint.h>
 
 #include "config.h"
+#include "decoder.h"
 #include "input_manager.h"
+#include "packet_queue.h"
 #include "recorder.h"
+#include "replay_buffer.h"
+#include "snapshot.h"
+#include "stream.h"
 
 struct scrcpy_options {
     const char *serial;
     const char *crop;
     const char *record_filename;
+    const char *record_raw_filename;
+    const char *record_path;
+    const char *frame_log_filename;
     const char *window_title;
     const char *push_target;
+    const char *screenshot_path;
+    const char *replay_path;
     enum recorder_format record_format;
+    enum recorder_format record_path_format;
+    enum recorder_queue_policy record_queue_policy;
+    uint16_t record_queue_packets;
+    uint32_t record_queue_bytes;
+    uint32_t record_segment_duration; // in seconds
+    uint32_t record_segment_size;
+    uint32_t record_write_size; // 0 to use the default FFmpeg output
+    uint32_t record_sync_interval; // in milliseconds, 0 to disable
+    uint32_t replay_duration; // in seconds, 0 to disable the replay buffer
+    enum recorder_format replay_format;
+    enum snapshot_format screenshot_format;
+    uint8_t screenshot_quality;
+    uint8_t screenshot_compression;
     uint16_t port;
     uint16_t max_size;
     uint32_t bit_rate;
     uint16_t max_fps;
+    uint32_t socket_buffer_size; // 0 for the system default (autotuning)
+    uint16_t decoder_queue_depth;
+    enum packet_queue_policy decoder_queue_policy;
+    enum decoder_profile decoder_profile;
+    uint16_t decoder_threads;
+    uint16_t frame_buffer;
     int16_t window_x;
     int16_t window_y;
     uint16_t window_width;
@@ -32,6 +61,16 @@ struct scrcpy_options {
     bool render_expired_frames;
     bool prefer_text;
     bool window_borderless;
+    bool external_server;
+    bool texture_frames;
+    bool dedup_frames;
+    bool headless;
+    bool record_fragmented;
+    bool record_events;
+    bool record_direct_io;
+    bool tcp_nodelay;
+    bool tcp_quickack;
+    bool tcp_keepalive;
     uint16_t screen_width;
     uint16_t screen_height;
 };
@@ -40,13 +79,37 @@ struct scrcpy_options {
     .serial = NULL, \
     .crop = NULL, \
     .record_filename = NULL, \
+    .record_raw_filename = NULL, \
+    .record_path = DEFAULT_RECORD_PATH, \
+    .frame_log_filename = NULL, \
     .window_title = NULL, \
     .push_target = NULL, \
+    .screenshot_path = DEFAULT_SNAPSHOT_PATH, \
+    .replay_path = DEFAULT_REPLAY_PATH, \
     .record_format = RECORDER_FORMAT_AUTO, \
+    .record_path_format = RECORDER_FORMAT_AUTO, \
+    .record_queue_policy = RECORDER_QUEUE_POLICY_BLOCK, \
+    .record_queue_packets = DEFAULT_RECORD_QUEUE_PACKETS, \
+    .record_queue_bytes = DEFAULT_RECORD_QUEUE_BYTES, \
+    .record_segment_duration = 0, \
+    .record_segment_size = 0, \
+    .record_write_size = 0, \
+    .record_sync_interval = 0, \
+    .replay_duration = 0, \
+    .replay_format = RECORDER_FORMAT_AUTO, \
+    .screenshot_format = SNAPSHOT_FORMAT_AUTO, \
+    .screenshot_quality = DEFAULT_SNAPSHOT_QUALITY, \
+    .screenshot_compression = DEFAULT_SNAPSHOT_COMPRESSION, \
     .port = DEFAULT_LOCAL_PORT, \
     .max_size = DEFAULT_MAX_SIZE, \
     .bit_rate = DEFAULT_BIT_RATE, \
     .max_fps = 0, \
+    .socket_buffer_size = 0, \
+    .decoder_queue_depth = DEFAULT_DECODER_QUEUE_DEPTH, \
+    .decoder_queue_policy = PACKET_QUEUE_POLICY_BLOCK, \
+    .decoder_profile = DECODER_PROFILE_DEFAULT, \
+    .decoder_threads = 0, \
+    .frame_buffer = 1, \
     .window_x = -1, \
     .window_y = -1, \
     .window_width = 0, \
@@ -60,6 +123,16 @@ struct scrcpy_options {
     .render_expired_frames = false, \
     .prefer_text = false, \
     .window_borderless = false, \
+    .external_server = false, \
+    .texture_frames = false, \
+    .dedup_frames = false, \
+    .headless = false, \
+    .record_fragmented = false, \
+    .record_events = false, \
+    .record_direct_io = false, \
+    .tcp_nodelay = true, \
+    .tcp_quickack = false, \
+    .tcp_keepalive = false, \
 }
 
 bool
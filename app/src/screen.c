@@ -4,15 +4,15 @@
 #include <string.h>
 #include <SDL2/SDL.h>
 #include <libavformat/avformat.h>
-#include <libswscale/swscale.h>
+#include <libavutil/time.h>
 
 #include "config.h"
 #include "common.h"
 #include "compat.h"
 #include "icon.xpm"
+#include "texture_frame.h"
 #include "tiny_xpm.h"
 #include "video_buffer.h"
-#include "util/lock.h"
 #include "util/log.h"
 
 
@@ -155,6 +155,7 @@ get_initial_optimal_size(struct size frame_size, uint16_t req_width,
 void
 screen_init(struct screen *screen) {
     *screen = (struct screen) SCREEN_INITIALIZER;
+    frame_dedup_init(&screen->dedup);
 }
 
 static inline SDL_Texture *
@@ -164,6 +165,43 @@ create_texture(SDL_Renderer *renderer, struct size frame_size) {
                              frame_size.width, frame_size.height);
 }
 
+static bool
+init_headless_rendering(struct screen *screen, struct size frame_size) {
+    // the surface is never read, the frames are scaled to its size
+    screen->surface = SDL_CreateRGBSurface(0, frame_size.width,
+                                           frame_size.height, 32, 0, 0, 0, 0);
+    if (!screen->surface) {
+        LOGC("Could not create offscreen surface: %s", SDL_GetError());
+        return false;
+    }
+
+    screen->renderer = SDL_CreateSoftwareRenderer(screen->surface);
+    if (!screen->renderer) {
+        LOGC("Could not create software renderer: %s", SDL_GetError());
+        screen_destroy(screen);
+        return false;
+    }
+
+    if (SDL_RenderSetLogicalSize(screen->renderer, frame_size.width,
+                                 frame_size.height)) {
+        LOGE("Could not set renderer logical size: %s", SDL_GetError());
+        screen_destroy(screen);
+        return false;
+    }
+
+    LOGI("Headless texture: %" PRIu16 "x%" PRIu16, frame_size.width,
+         frame_size.height);
+    screen->texture = create_texture(screen->renderer, frame_size);
+    if (!screen->texture) {
+        LOGC("Could not create texture: %s", SDL_GetError());
+        screen_destroy(screen);
+        return false;
+    }
+    screen->texture_size = frame_size;
+
+    return true;
+}
+
 bool
 screen_init_rendering(struct screen *screen, const char *window_title,
                       struct size frame_size, bool always_on_top,
@@ -179,6 +217,10 @@ screen_init_rendering(struct screen *screen, const char *window_title,
         screen->device_screen_size = frame_size;
     }
 
+    if (screen->headless) {
+        return init_headless_rendering(screen, frame_size);
+    }
+
     struct size window_size =
             get_initial_optimal_size(frame_size, window_width, window_height);
     uint32_t window_flags = SDL_WINDOW_HIDDEN | SDL_WINDOW_RESIZABLE;
@@ -241,6 +283,7 @@ screen_init_rendering(struct screen *screen, const char *window_title,
         screen_destroy(screen);
         return false;
     }
+    screen->texture_size = frame_size;
 
     screen->windowed_window_size = window_size;
 
@@ -249,6 +292,9 @@ screen_init_rendering(struct screen *screen, const char *window_title,
 
 void
 screen_show_window(struct screen *screen) {
+    if (screen->headless) {
+        return;
+    }
     SDL_ShowWindow(screen->window);
 }
 
@@ -263,9 +309,33 @@ screen_destroy(struct screen *screen) {
     if (screen->window) {
         SDL_DestroyWindow(screen->window);
     }
+    if (screen->surface) {
+        SDL_FreeSurface(screen->surface);
+    }
 }
 
-// recreate the texture and resize the window if the frame size has changed
+// recreate the texture if its size has changed
+static bool
+prepare_texture(struct screen *screen, struct size texture_size) {
+    if (screen->texture_size.width == texture_size.width
+            && screen->texture_size.height == texture_size.height) {
+        return true;
+    }
+
+    SDL_DestroyTexture(screen->texture);
+    screen->texture_size = texture_size;
+
+    LOGI("New texture: %" PRIu16 "x%" PRIu16, texture_size.width,
+         texture_size.height);
+    screen->texture = create_texture(screen->renderer, texture_size);
+    if (!screen->texture) {
+        LOGC("Could not create texture: %s", SDL_GetError());
+        return false;
+    }
+    return true;
+}
+
+// resize the window if the frame size has changed
 static bool
 prepare_for_frame(struct screen *screen, struct size new_frame_size) {
     if (screen->frame_size.width != new_frame_size.width
@@ -276,8 +346,11 @@ prepare_for_frame(struct screen *screen, struct size new_frame_size) {
             return false;
         }
 
-        // frame dimension changed, destroy texture
-        SDL_DestroyTexture(screen->texture);
+        if (screen->headless) {
+            // no window to resize
+            screen->frame_size = new_frame_size;
+            return true;
+        }
 
         struct size windowed_size = get_windowed_window_size(screen);
         struct size target_size = {
@@ -290,100 +363,104 @@ prepare_for_frame(struct screen *screen, struct size new_frame_size) {
         set_window_size(screen, target_size);
 
         screen->frame_size = new_frame_size;
-
-        LOGI("New texture: %"
-                     PRIu16
-                     "x%"
-                     PRIu16,
-             screen->frame_size.width, screen->frame_size.height);
-        screen->texture = create_texture(screen->renderer, new_frame_size);
-        if (!screen->texture) {
-            LOGC("Could not create texture: %s", SDL_GetError());
-            return false;
-        }
     }
 
     return true;
 }
 
 // write the frame into the texture
-static void
+static bool
 update_texture(struct screen *screen, const AVFrame *frame) {
+    struct size texture_size;
+    if (texture_frame_get_texture_size(frame, &texture_size)) {
+        // the frame has been allocated in the texture layout
+        return prepare_texture(screen, texture_size)
+            && texture_frame_upload(screen->texture, frame);
+    }
+
+    texture_size = screen->frame_size;
+    if (!prepare_texture(screen, texture_size)) {
+        return false;
+    }
     SDL_UpdateYUVTexture(screen->texture, NULL,
                          frame->data[0], frame->linesize[0],
                          frame->data[1], frame->linesize[1],
                          frame->data[2], frame->linesize[2]);
-
-    screen_saveframe(screen,frame);
-
-    AVCodecContext    *pCodecCtxOrig = screen->stream.codec_ctx;
-
-
-
-//    write_frame_to_file(frame,screen->stream.codec_ctx);
-
+    return true;
 }
 
 bool
 screen_update_frame(struct screen *screen, struct video_buffer *vb) {
-    mutex_lock(vb->mutex);
-    const AVFrame *frame = video_buffer_consume_rendered_frame(vb);
+    const AVFrame *frame = video_buffer_take_rendering_frame(vb);
+    if (!frame) {
+        // the frame has been skipped in the meantime
+        return true;
+    }
+    int64_t pts = frame->pts;
     struct size new_frame_size = {frame->width, frame->height};
-    if (!prepare_for_frame(screen, new_frame_size)) {
-        mutex_unlock(vb->mutex);
+    uint64_t hash = 0;
+    if (screen->frame_log) {
+        hash = frame_dedup_hash_full(frame);
+    }
+    if (screen->dedup_frames && frame_dedup_check(&screen->dedup, frame)) {
+        // the texture already contains this frame
+        video_buffer_release_rendered_frame(vb);
+        fps_counter_add_deduplicated_frame(vb->fps_counter);
+        if (screen->frame_log) {
+            frame_log_write(screen->frame_log, pts, new_frame_size.width,
+                            new_frame_size.height, hash, -1, -1);
+        }
+        return true;
+    }
+    int64_t start = av_gettime_relative();
+    if (!prepare_for_frame(screen, new_frame_size)
+            || !update_texture(screen, frame)) {
+        // the texture content is unknown
+        frame_dedup_reset(&screen->dedup);
+        video_buffer_release_rendered_frame(vb);
+        if (screen->frame_log) {
+            frame_log_write(screen->frame_log, pts, new_frame_size.width,
+                            new_frame_size.height, hash, -1, -1);
+        }
         return false;
     }
-    update_texture(screen, frame);
-    mutex_unlock(vb->mutex);
+    video_buffer_release_rendered_frame(vb);
+    int64_t uploaded = av_gettime_relative();
+
+    if (screen->latency) {
+        frame_latency_mark(screen->latency, pts, FRAME_LATENCY_UPLOADED);
+    }
 
     screen_render(screen);
+    if (screen->frame_log) {
+        int64_t rendered = av_gettime_relative();
+        frame_log_write(screen->frame_log, pts, new_frame_size.width,
+                        new_frame_size.height, hash, uploaded - start,
+                        rendered - uploaded);
+    }
     return true;
 }
 
 
-
-void save_texture(struct screen *screen,SDL_Renderer *renderer, SDL_Texture *texture, const char *file_name) {
-    SDL_Texture *target = SDL_GetRenderTarget(renderer);
-    SDL_SetRenderTarget(renderer, texture);
-    int width, height,format;
-    SDL_QueryTexture(texture, &format, NULL, &width, &height);
-    bool is_portrait = height>width;
-    uint16_t screen_width=screen->device_screen_size.width;
-    uint16_t screen_height=screen->device_screen_size.height;
-    if (!is_portrait){
-        screen_width=screen->device_screen_size.height;
-        screen_height=screen->device_screen_size.width;
-    }
-    LOGI("Capture screen size: %"
-                 PRIu16
-                 "x%"
-                 PRIu16, screen_width,
-         screen_height);
-    SDL_Surface *surface = SDL_CreateRGBSurface(0, screen_width,
-                                                screen_height, 32, 0, 0, 0, 0);
-    SDL_RenderReadPixels(renderer, NULL, surface->format->format, surface->pixels, surface->pitch);
-
-    SDL_SaveBMP(surface, file_name);
-    SDL_FreeSurface(surface);
-
-    SDL_SetRenderTarget(renderer, target);
-}
-
 void
 screen_render(struct screen *screen) {
 
+    // the texture may be larger than the frame
+    SDL_Rect frame_rect = {
+        .x = 0,
+        .y = 0,
+        .w = screen->frame_size.width,
+        .h = screen->frame_size.height,
+    };
     SDL_RenderClear(screen->renderer);
-    SDL_RenderCopy(screen->renderer, screen->texture, NULL, NULL);
+    SDL_RenderCopy(screen->renderer, screen->texture, &frame_rect, NULL);
     SDL_RenderPresent(screen->renderer);
+    if (screen->latency) {
+        frame_latency_mark_presented(screen->latency);
+    }
 
-
-}
-
-void screen_capture(struct screen *screen) {
-    save_texture(screen,screen->renderer, screen->texture, "capture.bmp");
 }
 
-
 void
 screen_switch_fullscreen(struct screen *screen) {
     uint32_t new_mode = screen->fullscreen ? 0 : SDL_WINDOW_FULLSCREEN_DESKTOP;
@@ -474,114 +551,3 @@ screen_handle_window_event(struct screen *screen,
     }
 }
 
-
-void SaveFrame(AVFrame *pFrame, int width, int height, int iFrame) {
-    FILE *pFile;
-    char szFilename[32];
-    int  y;
-
-    // Open file
-    sprintf(szFilename, "frame%d.ppm", iFrame);
-    pFile=fopen(szFilename, "wb");
-    if(pFile==NULL)
-        return;
-
-    // Write header
-    fprintf(pFile, "P6\n%d %d\n255\n", width, height);
-
-    // Write pixel data
-    for(y=0; y<height; y++)
-        fwrite(pFrame->data[0]+y*pFrame->linesize[0], 1, width*3, pFile);
-
-    // Close file
-    fclose(pFile);
-}
-
-void screen_saveframe(struct screen *screen,AVFrame *pFrame){
-    AVCodecContext    *pCodecCtxOrig = NULL;
-    AVCodecContext    *pCodecCtx = NULL;
-    AVCodec           *pCodec = NULL;
-
-    SDL_Texture *texture;
-
-    AVFrame           *pFrameRGB = NULL;
-    struct SwsContext *sws_ctx = NULL;
-
-    int               numBytes;
-    uint8_t           *buffer = NULL;
-
-    pCodecCtxOrig = screen->stream.codec_ctx;
-    pCodec=screen->stream.codec;
-    texture = screen->texture;
-    int width, height,format;
-    SDL_QueryTexture(texture, &format, NULL, &width, &height);
-
-    if(pCodec==NULL) {
-        fprintf(stderr, "Unsupported codec!\n");
-        return ;
-    }
-
-    // Copy context
-    pCodecCtx = avcodec_alloc_context3(pCodec);
-    if(avcodec_copy_context(pCodecCtx, pCodecCtxOrig) != 0) {
-        fprintf(stderr, "Couldn't copy codec context");
-        return ; // Error copying codec context
-    }
-
-    pCodecCtx->height=height;
-    pCodecCtx->width=width;
-    pCodecCtx->pix_fmt=AV_PIX_FMT_YUV420P;
-    pCodecCtx->coded_height=height;
-    pCodecCtx->coded_width=width;
-
-    // Open codec
-    if(avcodec_open2(pCodecCtx, pCodec, NULL)<0)
-        return ; // Could not open codec
-
-    pFrameRGB=av_frame_alloc();
-    if(pFrameRGB==NULL)
-        return;
-
-    // Determine required buffer size and allocate buffer
-    numBytes=avpicture_get_size(AV_PIX_FMT_RGB24, pCodecCtx->width,
-                                pCodecCtx->height);
-    buffer=(uint8_t *)av_malloc(numBytes*sizeof(uint8_t));
-
-    // Assign appropriate parts of buffer to image planes in pFrameRGB
-    // Note that pFrameRGB is an AVFrame, but AVFrame is a superset
-    // of AVPicture
-    avpicture_fill((AVPicture *)pFrameRGB, buffer, AV_PIX_FMT_RGB24,
-                   pCodecCtx->width, pCodecCtx->height);
-
-    // initialize SWS context for software scaling
-    sws_ctx = sws_getContext(pCodecCtx->width,
-                             pCodecCtx->height,
-                             pCodecCtx->pix_fmt,
-                             pCodecCtx->width,
-                             pCodecCtx->height,
-                             AV_PIX_FMT_RGB24,
-                             SWS_BILINEAR,
-                             NULL,
-                             NULL,
-                             NULL
-    );
-
-    if (sws_ctx==NULL) return;
-    sws_scale(sws_ctx, (uint8_t const * const *)pFrame->data,
-              pFrame->linesize, 0, pCodecCtx->height,
-              pFrameRGB->data, pFrameRGB->linesize);
-
-
-    SaveFrame(pFrameRGB, pCodecCtx->width, pCodecCtx->height,
-              0);
-
-    av_free(buffer);
-
-    av_frame_free(&pFrameRGB);
-
-
-
-    // Close the codecs
-    avcodec_close(pCodecCtx);
-}
-
@@ -4,17 +4,22 @@
 #include <stdbool.h>
 #include <SDL2/SDL.h>
 #include <libavformat/avformat.h>
-#include <libavutil/imgutils.h>
-#include <libswscale/swscale.h>
 #include "config.h"
 #include "common.h"
-#include "stream.h"
+#include "frame_dedup.h"
+#include "frame_latency.h"
+#include "frame_log.h"
 struct video_buffer;
 
 struct screen {
     SDL_Window *window;
+    // if headless, the software renderer draws into this surface
+    SDL_Surface *surface;
     SDL_Renderer *renderer;
     SDL_Texture *texture;
+    // may be larger than the frame if the frames are allocated in the
+    // texture layout (only the frame area is rendered)
+    struct size texture_size;
     struct size frame_size;
     // The window size the last time it was not maximized or fullscreen.
     struct size windowed_window_size;
@@ -25,15 +30,29 @@ struct screen {
     bool fullscreen;
     bool maximized;
     bool no_window;
-    struct stream stream;
 
     struct size device_screen_size;
+    // if not NULL, the upload and present times are measured
+    struct frame_latency *latency;
+    // if enabled, the frames identical to the one in the texture are neither
+    // uploaded nor presented
+    bool dedup_frames;
+    struct frame_dedup dedup;
+    // if enabled, render offscreen (no window, no display server required)
+    bool headless;
+    // if not NULL, the hash and timings of every frame are logged
+    struct frame_log *frame_log;
 };
 
 #define SCREEN_INITIALIZER { \
     .window = NULL, \
+    .surface = NULL, \
     .renderer = NULL, \
     .texture = NULL, \
+    .texture_size = { \
+        .width = 0, \
+        .height = 0, \
+    }, \
     .frame_size = { \
         .width = 0,  \
         .height = 0, \
@@ -50,6 +69,10 @@ struct screen {
     .fullscreen = false, \
     .maximized = false, \
     .no_window = false, \
+    .latency = NULL, \
+    .dedup_frames = false, \
+    .headless = false, \
+    .frame_log = NULL, \
 }
 
 // initialize default values
@@ -57,6 +80,7 @@ void
 screen_init(struct screen *screen);
 
 // initialize screen, create window, renderer and texture (window is hidden)
+// if headless, the window parameters are ignored
 bool
 screen_init_rendering(struct screen *screen, const char *window_title,
                       struct size frame_size, bool always_on_top,
@@ -96,8 +120,4 @@ screen_resize_to_pixel_perfect(struct screen *screen);
 void
 screen_handle_window_event(struct screen *screen, const SDL_WindowEvent *event);
 
-void
-screen_capture(struct screen *screen);
-
-void screen_saveframe(struct screen *screen,AVFrame *pFrame);
 #endif
@@ -164,13 +164,13 @@ execute_server(struct server *server, const struct server_params *params) {
 #define IPV4_LOCALHOST 0x7F000001
 
 static socket_t
-listen_on_port(uint16_t port) {
-    return net_listen(IPV4_LOCALHOST, port, 1);
+listen_on_port(uint16_t port, int rcvbuf) {
+    return net_listen(IPV4_LOCALHOST, port, 1, rcvbuf);
 }
 
 static socket_t
-connect_and_read_byte(uint16_t port) {
-    socket_t socket = net_connect(IPV4_LOCALHOST, port);
+connect_and_read_byte(uint16_t port, int rcvbuf) {
+    socket_t socket = net_connect(IPV4_LOCALHOST, port, rcvbuf);
     if (socket == INVALID_SOCKET) {
         return INVALID_SOCKET;
     }
@@ -187,10 +187,11 @@ connect_and_read_byte(uint16_t port) {
 }
 
 static socket_t
-connect_to_server(uint16_t port, uint32_t attempts, uint32_t delay) {
+connect_to_server(uint16_t port, int rcvbuf, uint32_t attempts,
+                  uint32_t delay) {
     do {
         LOGD("Remaining connection attempts: %d", (int) attempts);
-        socket_t socket = connect_and_read_byte(port);
+        socket_t socket = connect_and_read_byte(port, rcvbuf);
         if (socket != INVALID_SOCKET) {
             // it worked!
             return socket;
@@ -218,10 +219,42 @@ server_init(struct server *server) {
     *server = (struct server) SERVER_INITIALIZER;
 }
 
+// listen for a server which is not managed by the client (for example
+// the replay_server tool), in "adb reverse" mode
+static bool
+start_external(struct server *server, const struct server_params *params) {
+    server->external = true;
+
+    server->server_socket = listen_on_port(params->local_port,
+                                           params->video_socket_rcvbuf);
+    if (server->server_socket == INVALID_SOCKET) {
+        LOGE("Could not listen on port %" PRIu16, params->local_port);
+        SDL_free(server->serial);
+        return false;
+    }
+
+    server->remote_server_socket = listen_on_port(params->local_port + 1, 0);
+    if (server->remote_server_socket == INVALID_SOCKET) {
+        LOGE("Could not listen on remote control port %" PRIu16,
+             params->local_port + 1);
+        close_socket(&server->server_socket);
+        SDL_free(server->serial);
+        return false;
+    }
+    server->remote_client_socket = INVALID_SOCKET;
+
+    LOGI("Waiting for an external server on port %" PRIu16 "...",
+         params->local_port);
+    return true;
+}
+
 bool
 server_start(struct server *server, const char *serial,
              const struct server_params *params) {
     server->local_port = params->local_port;
+    server->video_socket_options = params->video_socket_options;
+    server->control_socket_options = params->control_socket_options;
+    server->video_socket_rcvbuf = params->video_socket_rcvbuf;
 
     if (serial) {
         server->serial = SDL_strdup(serial);
@@ -230,6 +263,10 @@ server_start(struct server *server, const char *serial,
         }
     }
 
+    if (params->external) {
+        return start_external(server, params);
+    }
+
     if (!push_server(serial)) {
         SDL_free(server->serial);
         return false;
@@ -250,7 +287,10 @@ server_start(struct server *server, const char *serial,
         // need to try to connect until the server socket is listening on the
         // device.
 
-        server->server_socket = listen_on_port(params->local_port);
+        // the video socket is accepted from it, and inherits its receive
+        // buffer size
+        server->server_socket = listen_on_port(params->local_port,
+                                               params->video_socket_rcvbuf);
         if (server->server_socket == INVALID_SOCKET) {
             LOGE("Could not listen on port %" PRIu16, params->local_port);
             disable_tunnel(server);
@@ -259,7 +299,7 @@ server_start(struct server *server, const char *serial,
         }
     }
 
-    server->remote_server_socket = listen_on_port(params->local_port+1);
+    server->remote_server_socket = listen_on_port(params->local_port+1, 0);
     if (server->remote_server_socket == INVALID_SOCKET) {
         LOGE("Could not listen on remote control port %" PRIu16, params->local_port+1);
         disable_tunnel(server);
@@ -306,22 +346,28 @@ server_connect_to(struct server *server) {
         uint32_t attempts = 100;
         uint32_t delay = 100; // ms
         server->video_socket =
-            connect_to_server(server->local_port, attempts, delay);
+            connect_to_server(server->local_port, server->video_socket_rcvbuf,
+                              attempts, delay);
         if (server->video_socket == INVALID_SOCKET) {
             return false;
         }
 
         // we know that the device is listening, we don't need several attempts
         server->control_socket =
-            net_connect(IPV4_LOCALHOST, server->local_port);
+            net_connect(IPV4_LOCALHOST, server->local_port, 0);
         if (server->control_socket == INVALID_SOCKET) {
             return false;
         }
     }
 
-    // we don't need the adb tunnel anymore
-    disable_tunnel(server); // ignore failure
-    server->tunnel_enabled = false;
+    net_set_options(server->video_socket, &server->video_socket_options);
+    net_set_options(server->control_socket, &server->control_socket_options);
+
+    if (server->tunnel_enabled) {
+        // we don't need the adb tunnel anymore
+        disable_tunnel(server); // ignore failure
+        server->tunnel_enabled = false;
+    }
 
     return true;
 }
@@ -344,6 +390,11 @@ server_stop(struct server *server) {
         close_socket(&server->remote_client_socket);
     }
 
+    if (server->external) {
+        // the server is not managed by the client
+        return;
+    }
+
     assert(server->process != PROCESS_NONE);
 
     if (!cmd_terminate(server->process)) {
@@ -19,6 +19,10 @@ struct server {
     uint16_t local_port;
     bool tunnel_enabled;
     bool tunnel_forward; // use "adb forward" instead of "adb reverse"
+    bool external; // the server is not started by the client
+    struct net_socket_options video_socket_options;
+    struct net_socket_options control_socket_options;
+    int video_socket_rcvbuf;
 };
 
 #define SERVER_INITIALIZER {          \
@@ -30,6 +34,7 @@ struct server {
     .local_port = 0,                  \
     .tunnel_enabled = false,          \
     .tunnel_forward = false,          \
+    .external = false,                \
 }
 
 struct server_params {
@@ -39,6 +44,15 @@ struct server_params {
     uint32_t bit_rate;
     uint16_t max_fps;
     bool control;
+    // applied once connected
+    struct net_socket_options video_socket_options;
+    struct net_socket_options control_socket_options;
+    // receive buffer size of the video socket, applied before the connection
+    // (to the listening socket in "adb reverse" mode), 0 for the system default
+    int video_socket_rcvbuf;
+    // do not push nor execute the server (and do not enable any tunnel),
+    // just wait for a server started by other means to connect
+    bool external;
 };
 
 // init default values
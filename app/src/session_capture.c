@@ -0,0 +1,222 @@
+#include "session_capture.h"
+
+#include <inttypes.h>
+#include <string.h>
+
+#include "config.h"
+#include "util/lock.h"
+#include "util/log.h"
+
+static void
+block_queue_clear(struct capture_block_queue *queue) {
+    while (!queue_is_empty(queue)) {
+        struct capture_block *block;
+        queue_take(queue, next, &block);
+        SDL_free(block);
+    }
+}
+
+bool
+session_capture_init(struct session_capture *capture, const char *filename) {
+    capture->filename = SDL_strdup(filename);
+    if (!capture->filename) {
+        LOGE("Could not strdup filename");
+        return false;
+    }
+
+    capture->mutex = SDL_CreateMutex();
+    if (!capture->mutex) {
+        LOGC("Could not create mutex");
+        SDL_free(capture->filename);
+        return false;
+    }
+
+    capture->queue_cond = SDL_CreateCond();
+    if (!capture->queue_cond) {
+        LOGC("Could not create cond");
+        SDL_DestroyMutex(capture->mutex);
+        SDL_free(capture->filename);
+        return false;
+    }
+
+    capture->file = NULL;
+    capture->thread = NULL;
+    capture->stopped = false;
+    capture->failed = false;
+    queue_init(&capture->queue);
+    queue_init(&capture->free_queue);
+    capture->pending = 0;
+    capture->current = NULL;
+    capture->bytes = 0;
+
+    return true;
+}
+
+void
+session_capture_destroy(struct session_capture *capture) {
+    SDL_free(capture->current);
+    block_queue_clear(&capture->queue);
+    block_queue_clear(&capture->free_queue);
+    SDL_DestroyCond(capture->queue_cond);
+    SDL_DestroyMutex(capture->mutex);
+    SDL_free(capture->filename);
+}
+
+static int
+run_session_capture(void *data) {
+    struct session_capture *capture = data;
+
+    for (;;) {
+        mutex_lock(capture->mutex);
+        while (!capture->stopped && queue_is_empty(&capture->queue)) {
+            cond_wait(capture->queue_cond, capture->mutex);
+        }
+        if (queue_is_empty(&capture->queue)) {
+            // stopped and everything has been written
+            mutex_unlock(capture->mutex);
+            break;
+        }
+        struct capture_block *block;
+        queue_take(&capture->queue, next, &block);
+        --capture->pending;
+        mutex_unlock(capture->mutex);
+
+        bool ok = fwrite(block->data, 1, block->len, capture->file)
+               == block->len;
+
+        mutex_lock(capture->mutex);
+        queue_push(&capture->free_queue, next, block);
+        if (!ok) {
+            LOGE("Could not write to %s", capture->filename);
+            capture->failed = true;
+            // discard pending blocks
+            block_queue_clear(&capture->queue);
+            capture->pending = 0;
+            mutex_unlock(capture->mutex);
+            break;
+        }
+        mutex_unlock(capture->mutex);
+    }
+
+    LOGD("Session capture thread ended");
+    return 0;
+}
+
+bool
+session_capture_start(struct session_capture *capture) {
+    capture->file = fopen(capture->filename, "wb");
+    if (!capture->file) {
+        LOGE("Could not open session capture file: %s", capture->filename);
+        return false;
+    }
+    // the blocks are large enough, do not copy them to the stdio buffer
+    setvbuf(capture->file, NULL, _IONBF, 0);
+
+    LOGD("Starting session capture thread");
+    capture->thread = SDL_CreateThread(run_session_capture, "capture",
+                                       capture);
+    if (!capture->thread) {
+        LOGC("Could not start session capture thread");
+        fclose(capture->file);
+        return false;
+    }
+
+    LOGI("Session capture started to %s", capture->filename);
+    return true;
+}
+
+// must be called with the mutex locked
+static void
+submit_current_block(struct session_capture *capture) {
+    if (capture->current && capture->current->len) {
+        queue_push(&capture->queue, next, capture->current);
+        ++capture->pending;
+        capture->current = NULL;
+        cond_signal(capture->queue_cond);
+    }
+}
+
+void
+session_capture_stop(struct session_capture *capture) {
+    mutex_lock(capture->mutex);
+    submit_current_block(capture);
+    capture->stopped = true;
+    cond_signal(capture->queue_cond);
+    mutex_unlock(capture->mutex);
+}
+
+void
+session_capture_join(struct session_capture *capture) {
+    SDL_WaitThread(capture->thread, NULL);
+
+    if (fclose(capture->file)) {
+        capture->failed = true;
+    }
+    if (capture->failed) {
+        LOGE("Session capture failed to %s", capture->filename);
+    } else {
+        LOGI("Session capture complete to %s (%" PRIu64 " bytes)",
+             capture->filename, capture->bytes);
+    }
+}
+
+// submit the current block (if any) and make a new one current
+// return false if the capture has failed
+static bool
+next_block(struct session_capture *capture) {
+    mutex_lock(capture->mutex);
+    if (capture->failed) {
+        mutex_unlock(capture->mutex);
+        return false;
+    }
+
+    submit_current_block(capture);
+
+    if (capture->pending >= SESSION_CAPTURE_MAX_PENDING_BLOCKS) {
+        LOGE("Session capture too slow, stopping capture to %s",
+             capture->filename);
+        capture->failed = true;
+        mutex_unlock(capture->mutex);
+        return false;
+    }
+
+    struct capture_block *block;
+    if (!queue_is_empty(&capture->free_queue)) {
+        queue_take(&capture->free_queue, next, &block);
+    } else {
+        block = SDL_malloc(sizeof(*block));
+        if (!block) {
+            LOGC("Could not allocate capture block");
+            capture->failed = true;
+            mutex_unlock(capture->mutex);
+            return false;
+        }
+    }
+    mutex_unlock(capture->mutex);
+
+    block->len = 0;
+    capture->current = block;
+    return true;
+}
+
+void
+session_capture_push(struct session_capture *capture, const uint8_t *data,
+                     size_t len) {
+    while (len) {
+        struct capture_block *block = capture->current;
+        if (!block || block->len == SESSION_CAPTURE_BLOCK_SIZE) {
+            if (!next_block(capture)) {
+                return;
+            }
+            block = capture->current;
+        }
+
+        size_t available = SESSION_CAPTURE_BLOCK_SIZE - block->len;
+        size_t n = len < available ? len : available;
+        memcpy(block->data + block->len, data, n);
+        block->len += n;
+        capture->bytes += n;
+        data += n;
+        len -= n;
+    }
+}
@@ -0,0 +1,72 @@
+#ifndef SESSION_CAPTURE_H
+#define SESSION_CAPTURE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <SDL2/SDL_mutex.h>
+#include <SDL2/SDL_thread.h>
+
+#include "config.h"
+#include "util/queue.h"
+
+#define SESSION_CAPTURE_BLOCK_SIZE (1 << 20)
+// if the disk is too slow, stop capturing rather than consuming unbounded
+// memory (a truncated capture is reported as failed)
+#define SESSION_CAPTURE_MAX_PENDING_BLOCKS 64
+
+struct capture_block {
+    struct capture_block *next;
+    size_t len;
+    uint8_t data[SESSION_CAPTURE_BLOCK_SIZE];
+};
+
+struct capture_block_queue QUEUE(struct capture_block);
+
+// write the bytes received on the video socket verbatim (device info, meta
+// headers and payloads), so that a session can be replayed exactly
+//
+// the data are accumulated into large blocks, written by a separate thread
+struct session_capture {
+    char *filename;
+    FILE *file;
+
+    SDL_Thread *thread;
+    SDL_mutex *mutex;
+    SDL_cond *queue_cond;
+    bool stopped;
+    bool failed;
+    struct capture_block_queue queue; // full blocks, to be written
+    struct capture_block_queue free_queue; // written blocks, to be reused
+    unsigned pending; // number of blocks in queue
+
+    // only accessed by the producer (the stream thread)
+    struct capture_block *current;
+    uint64_t bytes;
+};
+
+bool
+session_capture_init(struct session_capture *capture, const char *filename);
+
+void
+session_capture_destroy(struct session_capture *capture);
+
+// open the file and start the writer thread
+bool
+session_capture_start(struct session_capture *capture);
+
+// write the remaining data then stop
+void
+session_capture_stop(struct session_capture *capture);
+
+void
+session_capture_join(struct session_capture *capture);
+
+// append data to the capture, never blocks on I/O
+// must always be called from the same thread
+void
+session_capture_push(struct session_capture *capture, const uint8_t *data,
+                     size_t len);
+
+#endif
@@ -0,0 +1,411 @@
+#include "snapshot.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "config.h"
+#include "compat.h"
+#include "video_buffer.h"
+#include "util/lock.h"
+#include "util/log.h"
+
+#define SNAPSHOT_PATH_MAX 1024
+
+bool
+snapshot_init(struct snapshot *snapshot, struct video_buffer *vb,
+              const struct snapshot_params *params) {
+    assert(params->format != SNAPSHOT_FORMAT_AUTO);
+
+    const char *path_template = params->path_template
+                              ? params->path_template
+                              : DEFAULT_SNAPSHOT_PATH;
+    snapshot->path_template = SDL_strdup(path_template);
+    if (!snapshot->path_template) {
+        LOGE("Could not strdup snapshot path template");
+        return false;
+    }
+
+    if (!(snapshot->packet = av_packet_alloc())) {
+        goto error_free_path_template;
+    }
+
+    if (!(snapshot->converted_frame = av_frame_alloc())) {
+        goto error_free_packet;
+    }
+
+    if (!(snapshot->mutex = SDL_CreateMutex())) {
+        goto error_free_converted_frame;
+    }
+
+    if (!(snapshot->request_cond = SDL_CreateCond())) {
+        goto error_destroy_mutex;
+    }
+
+    snapshot->params = *params;
+    snapshot->params.path_template = snapshot->path_template;
+    snapshot->video_buffer = vb;
+    snapshot->thread = NULL;
+    snapshot->stopped = false;
+    snapshot->next_number = 1;
+    snapshot->codec_ctx = NULL;
+    // lazy initialization
+    snapshot->initialized = false;
+    cbuf_init(&snapshot->queue);
+    frame_converter_init(&snapshot->converter);
+
+    return true;
+
+error_destroy_mutex:
+    SDL_DestroyMutex(snapshot->mutex);
+error_free_converted_frame:
+    av_frame_free(&snapshot->converted_frame);
+error_free_packet:
+    av_packet_free(&snapshot->packet);
+error_free_path_template:
+    SDL_free(snapshot->path_template);
+    return false;
+}
+
+static void
+drop_requests(struct snapshot *snapshot) {
+    struct snapshot_request req;
+    while (cbuf_take(&snapshot->queue, &req)) {
+        av_frame_free(&req.frame);
+    }
+}
+
+void
+snapshot_destroy(struct snapshot *snapshot) {
+    drop_requests(snapshot);
+    if (snapshot->codec_ctx) {
+        avcodec_free_context(&snapshot->codec_ctx);
+    }
+    frame_converter_destroy(&snapshot->converter);
+    SDL_DestroyCond(snapshot->request_cond);
+    SDL_DestroyMutex(snapshot->mutex);
+    av_frame_free(&snapshot->converted_frame);
+    av_packet_free(&snapshot->packet);
+    SDL_free(snapshot->path_template);
+}
+
+static bool
+append(char **out, size_t *remaining, const char *s, size_t len) {
+    if (len >= *remaining) {
+        return false;
+    }
+    memcpy(*out, s, len);
+    *out += len;
+    *remaining -= len;
+    return true;
+}
+
+bool
+snapshot_format_path(const char *path_template, unsigned number, time_t time,
+                     char *out, size_t len) {
+    assert(len);
+    char buf[32];
+    const char *p = path_template;
+    while (*p) {
+        const char *s = p;
+        size_t n = 1;
+        if (*p == '%') {
+            if (p[1] == 't') {
+#ifdef _WIN32
+                // the Windows localtime() uses thread-local storage
+                struct tm tm = *localtime(&time);
+#else
+                struct tm tm;
+                localtime_r(&time, &tm);
+#endif
+                n = strftime(buf, sizeof(buf), "%Y%m%d-%H%M%S", &tm);
+                s = buf;
+                ++p;
+            } else if (p[1] == 'n') {
+                n = (size_t) snprintf(buf, sizeof(buf), "%03u", number);
+                s = buf;
+                ++p;
+            } else if (p[1] == '%') {
+                ++p;
+            }
+        }
+        if (!append(&out, &len, s, n)) {
+            return false;
+        }
+        ++p;
+    }
+    *out = '\0';
+    return true;
+}
+
+// JPEG quality (1 to 100) to MJPEG quantizer scale (31 to 2)
+static int
+quality_to_qscale(int quality) {
+    return 2 + (100 - quality) * 29 / 99;
+}
+
+static enum AVPixelFormat
+get_encoder_format(enum snapshot_format format) {
+    // the JPEG encoder accepts the decoded frames as is
+    return format == SNAPSHOT_FORMAT_JPEG ? AV_PIX_FMT_YUV420P
+                                          : AV_PIX_FMT_RGB24;
+}
+
+static enum AVCodecID
+get_encoder_id(enum snapshot_format format) {
+    switch (format) {
+        case SNAPSHOT_FORMAT_PNG:
+            return AV_CODEC_ID_PNG;
+        case SNAPSHOT_FORMAT_JPEG:
+            return AV_CODEC_ID_MJPEG;
+        case SNAPSHOT_FORMAT_PPM:
+            return AV_CODEC_ID_PPM;
+        default:
+            assert(!"unexpected snapshot format");
+            return AV_CODEC_ID_NONE;
+    }
+}
+
+static const char *
+get_format_name(enum snapshot_format format) {
+    switch (format) {
+        case SNAPSHOT_FORMAT_PNG:
+            return "PNG";
+        case SNAPSHOT_FORMAT_JPEG:
+            return "JPEG";
+        case SNAPSHOT_FORMAT_PPM:
+            return "PPM";
+        default:
+            return NULL;
+    }
+}
+
+// (re)open the encoder if the frame size has changed
+static bool
+prepare_encoder(struct snapshot *snapshot, int width, int height) {
+    AVCodecContext *ctx = snapshot->codec_ctx;
+    if (ctx && ctx->width == width && ctx->height == height) {
+        return true;
+    }
+
+    if (ctx) {
+        avcodec_free_context(&snapshot->codec_ctx);
+    }
+
+    enum snapshot_format format = snapshot->params.format;
+    const char *name = get_format_name(format);
+    const AVCodec *codec = avcodec_find_encoder(get_encoder_id(format));
+    if (!codec) {
+        LOGE("%s encoder not found", name);
+        return false;
+    }
+
+    ctx = avcodec_alloc_context3(codec);
+    if (!ctx) {
+        LOGC("Could not allocate encoder context");
+        return false;
+    }
+
+    ctx->width = width;
+    ctx->height = height;
+    ctx->pix_fmt = get_encoder_format(format);
+    ctx->time_base = (AVRational) {1, 1};
+    if (format == SNAPSHOT_FORMAT_PNG) {
+        ctx->compression_level = snapshot->params.compression;
+    } else if (format == SNAPSHOT_FORMAT_JPEG) {
+        // the decoded frames are in limited range
+        ctx->color_range = AVCOL_RANGE_MPEG;
+        ctx->strict_std_compliance = FF_COMPLIANCE_UNOFFICIAL;
+        ctx->flags |= AV_CODEC_FLAG_QSCALE;
+        ctx->global_quality =
+            quality_to_qscale(snapshot->params.quality) * FF_QP2LAMBDA;
+    }
+
+    if (avcodec_open2(ctx, codec, NULL) < 0) {
+        LOGE("Could not open %s encoder", name);
+        avcodec_free_context(&ctx);
+        return false;
+    }
+
+    snapshot->codec_ctx = ctx;
+    return true;
+}
+
+// encode the frame into snapshot->packet
+static bool
+encode(struct snapshot *snapshot, AVFrame *frame) {
+    AVCodecContext *ctx = snapshot->codec_ctx;
+    frame->pts = 0;
+    frame->quality = ctx->global_quality;
+#ifdef SCRCPY_LAVF_HAS_NEW_ENCODING_DECODING_API
+    int ret;
+    if ((ret = avcodec_send_frame(ctx, frame)) < 0) {
+        LOGE("Could not send frame to encoder: %d", ret);
+        return false;
+    }
+    if ((ret = avcodec_receive_packet(ctx, snapshot->packet)) < 0) {
+        LOGE("Could not receive encoded snapshot: %d", ret);
+        return false;
+    }
+#else
+    int got_packet;
+    int ret = avcodec_encode_video2(ctx, snapshot->packet, frame,
+                                    &got_packet);
+    if (ret < 0 || !got_packet) {
+        LOGE("Could not encode snapshot: %d", ret);
+        return false;
+    }
+#endif
+    return true;
+}
+
+static bool
+write_file(const char *path, const AVPacket *packet) {
+    FILE *file = fopen(path, "wb");
+    if (!file) {
+        LOGE("Could not open snapshot file: %s", path);
+        return false;
+    }
+
+    size_t len = packet->size;
+    bool ok = fwrite(packet->data, 1, len, file) == len;
+    if (fclose(file)) {
+        ok = false;
+    }
+    if (!ok) {
+        LOGE("Could not write snapshot file: %s", path);
+    }
+    return ok;
+}
+
+static bool
+process_request(struct snapshot *snapshot,
+                const struct snapshot_request *req) {
+    char path[SNAPSHOT_PATH_MAX];
+    if (!snapshot_format_path(snapshot->path_template, req->number,
+                              req->time, path, sizeof(path))) {
+        LOGE("Snapshot path too long");
+        return false;
+    }
+
+    AVFrame *frame = req->frame;
+    enum AVPixelFormat format =
+        get_encoder_format(snapshot->params.format);
+    if (frame->format != format) {
+        if (!frame_converter_convert(&snapshot->converter, frame, format,
+                                     0, 0, snapshot->converted_frame)) {
+            return false;
+        }
+        frame = snapshot->converted_frame;
+    }
+
+    bool ok = prepare_encoder(snapshot, frame->width, frame->height)
+           && encode(snapshot, frame)
+           && write_file(path, snapshot->packet);
+    av_packet_unref(snapshot->packet);
+    av_frame_unref(snapshot->converted_frame);
+
+    if (ok) {
+        LOGI("Snapshot written to %s", path);
+    }
+    return ok;
+}
+
+static int
+run_snapshot(void *data) {
+    struct snapshot *snapshot = data;
+
+    for (;;) {
+        mutex_lock(snapshot->mutex);
+        while (!snapshot->stopped && cbuf_is_empty(&snapshot->queue)) {
+            cond_wait(snapshot->request_cond, snapshot->mutex);
+        }
+        if (snapshot->stopped) {
+            // stop immediately, do not process further requests
+            mutex_unlock(snapshot->mutex);
+            break;
+        }
+        struct snapshot_request req;
+        bool non_empty = cbuf_take(&snapshot->queue, &req);
+        assert(non_empty);
+        (void) non_empty;
+        mutex_unlock(snapshot->mutex);
+
+        process_request(snapshot, &req);
+        av_frame_free(&req.frame);
+    }
+
+    return 0;
+}
+
+bool
+snapshot_start(struct snapshot *snapshot) {
+    LOGD("Starting snapshot thread");
+
+    snapshot->thread = SDL_CreateThread(run_snapshot, "snapshot", snapshot);
+    if (!snapshot->thread) {
+        LOGC("Could not start snapshot thread");
+        return false;
+    }
+
+    return true;
+}
+
+void
+snapshot_stop(struct snapshot *snapshot) {
+    mutex_lock(snapshot->mutex);
+    snapshot->stopped = true;
+    cond_signal(snapshot->request_cond);
+    mutex_unlock(snapshot->mutex);
+}
+
+void
+snapshot_join(struct snapshot *snapshot) {
+    if (snapshot->thread) {
+        SDL_WaitThread(snapshot->thread, NULL);
+    }
+}
+
+bool
+snapshot_request(struct snapshot *snapshot) {
+    // start the snapshot thread if it's used for the first time
+    if (!snapshot->initialized) {
+        if (!snapshot_start(snapshot)) {
+            return false;
+        }
+        snapshot->initialized = true;
+    }
+
+    struct snapshot_request req = {
+        .frame = av_frame_alloc(),
+        .number = snapshot->next_number,
+        .time = time(NULL),
+    };
+    if (!req.frame) {
+        LOGC("Could not allocate snapshot frame");
+        return false;
+    }
+
+    if (!video_buffer_ref_latest_frame(snapshot->video_buffer, req.frame)) {
+        LOGW("No frame available for snapshot");
+        av_frame_free(&req.frame);
+        return false;
+    }
+
+    mutex_lock(snapshot->mutex);
+    bool was_empty = cbuf_is_empty(&snapshot->queue);
+    bool ok = cbuf_push(&snapshot->queue, req);
+    if (was_empty) {
+        cond_signal(snapshot->request_cond);
+    }
+    mutex_unlock(snapshot->mutex);
+
+    if (!ok) {
+        LOGW("Too many snapshots pending, request dropped");
+        av_frame_free(&req.frame);
+        return false;
+    }
+
+    ++snapshot->next_number;
+    return true;
+}
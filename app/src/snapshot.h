@@ -0,0 +1,107 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <time.h>
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <SDL2/SDL_mutex.h>
+#include <SDL2/SDL_thread.h>
+
+#include "config.h"
+#include "frame_converter.h"
+#include "util/cbuf.h"
+
+// %t is replaced by the local time, %n by the snapshot number
+#define DEFAULT_SNAPSHOT_PATH "screenshot-%t-%n.png"
+#define DEFAULT_SNAPSHOT_QUALITY 90
+#define DEFAULT_SNAPSHOT_COMPRESSION 6
+
+// maximum number of snapshots waiting to be encoded
+#define SNAPSHOT_QUEUE_SIZE 8
+
+struct video_buffer;
+
+enum snapshot_format {
+    SNAPSHOT_FORMAT_AUTO = 0,
+    SNAPSHOT_FORMAT_PNG,
+    SNAPSHOT_FORMAT_JPEG,
+    SNAPSHOT_FORMAT_PPM,
+};
+
+struct snapshot_params {
+    const char *path_template;
+    enum snapshot_format format;
+    int quality; // JPEG, 1 (worst) to 100 (best)
+    int compression; // PNG, 0 (fastest) to 9 (smallest)
+};
+
+struct snapshot_request {
+    AVFrame *frame;
+    unsigned number;
+    time_t time;
+};
+
+struct snapshot_request_queue CBUF(struct snapshot_request,
+                                   SNAPSHOT_QUEUE_SIZE);
+
+// encode the decoded frames to PNG, JPEG or PPM files on request, from a
+// separate thread, so that the rendering path never pays for the conversion
+//
+// a request only references the latest decoded frame, so that taking
+// snapshots never stalls the renderer nor blocks the event loop
+struct snapshot {
+    char *path_template;
+    struct snapshot_params params;
+    struct video_buffer *video_buffer;
+
+    SDL_Thread *thread;
+    SDL_mutex *mutex;
+    SDL_cond *request_cond;
+    bool stopped;
+    bool initialized;
+    unsigned next_number;
+    struct snapshot_request_queue queue; // protected by the mutex
+
+    // the following fields are only accessed by the snapshot thread, they are
+    // kept across snapshots as long as the frame size does not change
+    AVCodecContext *codec_ctx;
+    AVPacket *packet;
+    AVFrame *converted_frame;
+    struct frame_converter converter;
+};
+
+bool
+snapshot_init(struct snapshot *snapshot, struct video_buffer *vb,
+              const struct snapshot_params *params);
+
+void
+snapshot_destroy(struct snapshot *snapshot);
+
+bool
+snapshot_start(struct snapshot *snapshot);
+
+void
+snapshot_stop(struct snapshot *snapshot);
+
+void
+snapshot_join(struct snapshot *snapshot);
+
+// take a reference to the latest decoded frame, to be encoded and written
+// asynchronously
+// the video buffer is locked only for the time needed to reference the frame
+// the request is dropped (and false is returned) if too many snapshots are
+// already waiting to be encoded
+bool
+snapshot_request(struct snapshot *snapshot);
+
+// expand the path template for the given snapshot number and time
+// "%t" is replaced by the local time (YYYYmmdd-HHMMSS), "%n" by the number
+// (formatted on 3 digits at least) and "%%" by '%'
+// return false if the result does not fit in len bytes
+bool
+snapshot_format_path(const char *path_template, unsigned number, time_t time,
+                     char *out, size_t len);
+
+#endif
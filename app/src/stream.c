@@ -12,53 +12,28 @@
 #include "compat.h"
 #include "decoder.h"
 #include "events.h"
+#include "frame_latency.h"
+#include "packet_pool.h"
 #include "recorder.h"
-#include "util/buffer_util.h"
+#include "replay_buffer.h"
+#include "snapshot.h"
+#include "stream_reader.h"
+#include "util/lock.h"
 #include "util/log.h"
 
 #define BUFSIZE 0x10000
-
-#define HEADER_SIZE 12
-#define NO_PTS UINT64_C(-1)
+#define RECORD_PATH_MAX 1024
 
 static bool
 stream_recv_packet(struct stream *stream, AVPacket *packet) {
-    // The video stream contains raw packets, without time information. When we
-    // record, we retrieve the timestamps separately, from a "meta" header
-    // added by the server before each raw packet.
-    //
-    // The "meta" header length is 12 bytes:
-    // [. . . . . . . .|. . . .]. . . . . . . . . . . . . . . ...
-    //  <-------------> <-----> <-----------------------------...
-    //        PTS        packet        raw packet
-    //                    size
-    //
-    // It is followed by <packet_size> bytes containing the packet/frame.
-
-    uint8_t header[HEADER_SIZE];
-    ssize_t r = net_recv_all(stream->socket, header, HEADER_SIZE);
-    if (r < HEADER_SIZE) {
+    if (!stream_reader_read_packet(&stream->reader, packet)) {
         return false;
     }
 
-    uint64_t pts = buffer_read64be(header);
-    uint32_t len = buffer_read32be(&header[8]);
-    assert(pts == NO_PTS || (pts & 0x8000000000000000) == 0);
-    assert(len);
-
-    if (av_new_packet(packet, len)) {
-        LOGE("Could not allocate packet");
-        return false;
+    if (stream->latency && packet->pts != AV_NOPTS_VALUE) {
+        frame_latency_mark(stream->latency, packet->pts,
+                           FRAME_LATENCY_RECEIVED);
     }
-
-    r = net_recv_all(stream->socket, packet->data, len);
-    if (r < 0 || ((uint32_t) r) < len) {
-        av_packet_unref(packet);
-        return false;
-    }
-
-    packet->pts = pts != NO_PTS ? (int64_t) pts : AV_NOPTS_VALUE;
-
     return true;
 }
 
@@ -69,10 +44,108 @@ notify_stopped(void) {
     SDL_PushEvent(&stop_event);
 }
 
+// the recording must not be accessed concurrently (the mutex is locked, or
+// the recording is detached)
+static bool
+push_recording_gop(struct stream_recording *recording) {
+    bool ok = true;
+    for (unsigned i = 0; ok && i < recording->gop_count; ++i) {
+        ok = recorder_push(&recording->recorder, &recording->gop[i]);
+    }
+    if (recording->gop) {
+        packet_window_release_packets(recording->gop, recording->gop_count);
+        recording->gop = NULL;
+        recording->gop_count = 0;
+    }
+    if (!ok) {
+        LOGE("Could not send the current GOP to recorder");
+    }
+    return ok;
+}
+
+static void
+close_recorder(struct recorder *recorder) {
+    recorder_stop(recorder);
+    recorder_join(recorder);
+    recorder_close(recorder);
+    recorder_destroy(recorder);
+}
+
+static int
+run_finisher(void *data) {
+    struct stream_recording *recording = data;
+
+    // the stream thread did not receive any packet since the recording
+    // started (or it is not running)
+    push_recording_gop(recording);
+    close_recorder(&recording->recorder);
+
+    SDL_AtomicSet(&recording->finished, 1);
+    return 0;
+}
+
+// must be called with the mutex locked
+static struct stream_recording *
+detach_recording(struct stream *stream) {
+    struct stream_recording *recording = stream->recording;
+    mutex_lock(stream->event_mutex);
+    stream->recording = NULL;
+    mutex_unlock(stream->event_mutex);
+    return recording;
+}
+
+// finish the detached recording from a separate thread
+// must be called with the mutex locked
+static void
+finish_recording(struct stream *stream, struct stream_recording *recording) {
+    LOGI("Finishing recording...");
+    recording->finisher = SDL_CreateThread(run_finisher, "finisher",
+                                           recording);
+    if (!recording->finisher) {
+        LOGW("Could not start finisher thread, finishing synchronously");
+        run_finisher(recording);
+        SDL_free(recording);
+        return;
+    }
+    queue_push(&stream->finishing, next, recording);
+}
+
+// keep the packet for the future recordings, and send it to the current
+// recording, if any
+static bool
+record_packet(struct stream *stream, const AVPacket *packet) {
+    if (packet->pts != AV_NOPTS_VALUE) {
+        mutex_lock(stream->event_mutex);
+        stream->last_pts = packet->pts;
+        stream->last_pts_time = av_gettime_relative();
+        mutex_unlock(stream->event_mutex);
+    }
+
+    mutex_lock(stream->mutex);
+    bool ok = packet_window_push(&stream->gop, packet);
+    struct stream_recording *recording = stream->recording;
+    if (ok && recording) {
+        if (!push_recording_gop(recording)
+                || !recorder_push(&recording->recorder, packet)) {
+            // the recording failed (typically the disk is full), but the
+            // mirroring continues
+            LOGE("Could not send packet to recorder, recording stopped");
+            detach_recording(stream);
+            finish_recording(stream, recording);
+        }
+    }
+    mutex_unlock(stream->mutex);
+    return ok;
+}
+
 static bool
 process_config_packet(struct stream *stream, AVPacket *packet) {
-    if (stream->recorder && !recorder_push(stream->recorder, packet)) {
-        LOGE("Could not send config packet to recorder");
+    if (!record_packet(stream, packet)) {
+        return false;
+    }
+
+    if (stream->replay && !replay_buffer_push(stream->replay, packet)) {
+        LOGE("Could not send config packet to replay buffer");
         return false;
     }
     return true;
@@ -84,13 +157,15 @@ process_frame(struct stream *stream, AVPacket *packet) {
         return false;
     }
 
-    if (stream->recorder) {
-        packet->dts = packet->pts;
+    packet->dts = packet->pts;
 
-        if (!recorder_push(stream->recorder, packet)) {
-            LOGE("Could not send packet to recorder");
-            return false;
-        }
+    if (!record_packet(stream, packet)) {
+        return false;
+    }
+
+    if (stream->replay && !replay_buffer_push(stream->replay, packet)) {
+        LOGE("Could not send packet to replay buffer");
+        return false;
     }
 
     return true;
@@ -115,6 +190,10 @@ stream_parse(struct stream *stream, AVPacket *packet) {
         packet->flags |= AV_PKT_FLAG_KEY;
     }
 
+    if (stream->latency) {
+        frame_latency_mark(stream->latency, packet->pts, FRAME_LATENCY_PARSED);
+    }
+
     bool ok = process_frame(stream, packet);
     if (!ok) {
         LOGE("Could not process frame");
@@ -184,6 +263,7 @@ stream_push_packet(struct stream *stream, AVPacket *packet) {
 static int
 run_stream(void *data) {
     struct stream *stream = data;
+    bool decoder_draining = false;
 
     AVCodec *codec = avcodec_find_decoder(AV_CODEC_ID_H264);
     if (!codec) {
@@ -197,33 +277,37 @@ run_stream(void *data) {
         goto end;
     }
 
-    if (stream->decoder && !decoder_open(stream->decoder, codec)) {
-        LOGE("Could not open decoder");
-        goto finally_free_codec_ctx;
-    }
-
-    if (stream->recorder) {
-        if (!recorder_open(stream->recorder, codec)) {
-            LOGE("Could not open recorder");
-            goto finally_close_decoder;
+    if (stream->decoder) {
+        if (!decoder_open(stream->decoder, codec)) {
+            LOGE("Could not open decoder");
+            goto finally_free_codec_ctx;
         }
 
-        if (!recorder_start(stream->recorder)) {
-            LOGE("Could not start recorder");
-            goto finally_close_recorder;
+        if (!decoder_start(stream->decoder)) {
+            LOGE("Could not start decoder");
+            goto finally_close_decoder;
         }
     }
 
     stream->parser = av_parser_init(AV_CODEC_ID_H264);
     if (!stream->parser) {
         LOGE("Could not initialize parser");
-        goto finally_stop_and_join_recorder;
+        goto finally_stop_and_join_decoder;
     }
 
     // We must only pass complete frames to av_parser_parse2()!
     // It's more complicated, but this allows to reduce the latency by 1 frame!
     stream->parser->flags |= PARSER_FLAG_COMPLETE_FRAMES;
 
+    if (!packet_pool_init(&stream->packet_pool)) {
+        goto finally_close_parser;
+    }
+
+    if (!stream_reader_init(&stream->reader, stream->socket,
+                            &stream->packet_pool, stream->capture)) {
+        goto finally_destroy_packet_pool;
+    }
+
     for (;;) {
         AVPacket packet;
         bool ok = stream_recv_packet(stream, &packet);
@@ -242,20 +326,30 @@ run_stream(void *data) {
 
     LOGD("End of frames");
 
+    if (stream->decoder) {
+        decoder_draining = decoder_drain(stream->decoder);
+    }
+
     if (stream->has_pending) {
         av_packet_unref(&stream->pending);
     }
 
+    stream_reader_log_stats(&stream->reader);
+    stream_reader_destroy(&stream->reader);
+    packet_pool_log_stats(&stream->packet_pool);
+finally_destroy_packet_pool:
+    // the buffers still referenced by the decoder or the recorder are released
+    // once they are unreferenced
+    packet_pool_destroy(&stream->packet_pool);
+finally_close_parser:
     av_parser_close(stream->parser);
-finally_stop_and_join_recorder:
-    if (stream->recorder) {
-        recorder_stop(stream->recorder);
-        LOGI("Finishing recording...");
-        recorder_join(stream->recorder);
-    }
-finally_close_recorder:
-    if (stream->recorder) {
-        recorder_close(stream->recorder);
+    // the current recording, if any, is finished by stream_stop_recording()
+finally_stop_and_join_decoder:
+    if (stream->decoder) {
+        if (!decoder_draining) {
+            decoder_stop(stream->decoder);
+        }
+        decoder_join(stream->decoder);
     }
 finally_close_decoder:
     if (stream->decoder) {
@@ -268,13 +362,44 @@ end:
     return 0;
 }
 
-void
+bool
 stream_init(struct stream *stream, socket_t socket,
-            struct decoder *decoder, struct recorder *recorder) {
+            struct decoder *decoder, struct replay_buffer *replay,
+            struct session_capture *capture, struct frame_latency *latency,
+            const struct stream_record_params *record_params) {
+    if (!(stream->mutex = SDL_CreateMutex())) {
+        return false;
+    }
+
+    if (!(stream->event_mutex = SDL_CreateMutex())) {
+        SDL_DestroyMutex(stream->mutex);
+        return false;
+    }
+
     stream->socket = socket;
     stream->decoder = decoder,
-    stream->recorder = recorder;
+    stream->replay = replay;
+    stream->capture = capture;
+    stream->latency = latency;
     stream->has_pending = false;
+    stream->record_params = *record_params;
+    stream->next_record_number = 1;
+    stream->recording = NULL;
+    queue_init(&stream->finishing);
+    stream->last_pts = AV_NOPTS_VALUE;
+    stream->last_pts_time = 0;
+    // only keep the current GOP
+    packet_window_init(&stream->gop, 0);
+    return true;
+}
+
+void
+stream_destroy(struct stream *stream) {
+    assert(!stream->recording);
+    assert(queue_is_empty(&stream->finishing));
+    packet_window_destroy(&stream->gop);
+    SDL_DestroyMutex(stream->event_mutex);
+    SDL_DestroyMutex(stream->mutex);
 }
 
 bool
@@ -300,3 +425,171 @@ void
 stream_join(struct stream *stream) {
     SDL_WaitThread(stream->thread, NULL);
 }
+
+// the recorder must be initialized
+static bool
+open_recorder(struct recorder *recorder) {
+    const AVCodec *codec = avcodec_find_decoder(AV_CODEC_ID_H264);
+    if (!codec) {
+        LOGE("H.264 decoder not found");
+        return false;
+    }
+
+    if (!recorder_open(recorder, codec)) {
+        LOGE("Could not open recorder");
+        return false;
+    }
+
+    if (!recorder_start(recorder)) {
+        LOGE("Could not start recorder");
+        recorder_close(recorder);
+        return false;
+    }
+
+    return true;
+}
+
+// join the finisher threads which are done (or all of them if wait is set)
+static void
+join_finished_recordings(struct stream *stream, bool wait) {
+    struct stream_recording_queue finished;
+    queue_init(&finished);
+
+    mutex_lock(stream->mutex);
+    struct stream_recording_queue finishing = stream->finishing;
+    queue_init(&stream->finishing);
+    while (!queue_is_empty(&finishing)) {
+        struct stream_recording *recording;
+        queue_take(&finishing, next, &recording);
+        if (wait || SDL_AtomicGet(&recording->finished)) {
+            queue_push(&finished, next, recording);
+        } else {
+            queue_push(&stream->finishing, next, recording);
+        }
+    }
+    mutex_unlock(stream->mutex);
+
+    while (!queue_is_empty(&finished)) {
+        struct stream_recording *recording;
+        queue_take(&finished, next, &recording);
+        SDL_WaitThread(recording->finisher, NULL);
+        SDL_free(recording);
+    }
+}
+
+bool
+stream_start_recording(struct stream *stream, const char *filename,
+                       enum recorder_format format) {
+    const struct stream_record_params *params = &stream->record_params;
+
+    join_finished_recordings(stream, false);
+
+    if (stream_is_recording(stream)) {
+        LOGW("Already recording");
+        return false;
+    }
+
+    char path[RECORD_PATH_MAX];
+    if (!filename) {
+        if (!snapshot_format_path(params->path_template,
+                                  stream->next_record_number, time(NULL),
+                                  path, sizeof(path))) {
+            LOGE("Record path too long");
+            return false;
+        }
+        ++stream->next_record_number;
+        filename = path;
+        format = params->path_format;
+    }
+
+    struct stream_recording *recording = SDL_malloc(sizeof(*recording));
+    if (!recording) {
+        LOGC("Could not allocate recording");
+        return false;
+    }
+    recording->gop = NULL;
+    recording->gop_count = 0;
+    SDL_AtomicSet(&recording->finished, 0);
+
+    // the file is created without the mutex, so that the stream thread is
+    // not blocked meanwhile
+    struct recorder *recorder = &recording->recorder;
+    if (!recorder_init(recorder, filename, format,
+                       params->declared_frame_size, &params->queue,
+                       &params->output)) {
+        SDL_free(recording);
+        return false;
+    }
+
+    if (!open_recorder(recorder)) {
+        recorder_destroy(recorder);
+        SDL_free(recording);
+        return false;
+    }
+
+    // the current GOP is referenced and the recording is published at once,
+    // so that no packet is missed nor pushed twice
+    mutex_lock(stream->mutex);
+    if (!packet_window_is_empty(&stream->gop)
+            && !packet_window_ref_packets(&stream->gop, &recording->gop,
+                                          &recording->gop_count)) {
+        mutex_unlock(stream->mutex);
+        LOGE("Could not reference the current GOP");
+        // nothing has been written yet
+        close_recorder(recorder);
+        SDL_free(recording);
+        return false;
+    }
+
+    mutex_lock(stream->event_mutex);
+    stream->recording = recording;
+    mutex_unlock(stream->event_mutex);
+    mutex_unlock(stream->mutex);
+
+    return true;
+}
+
+void
+stream_stop_recording(struct stream *stream) {
+    mutex_lock(stream->mutex);
+    struct stream_recording *recording = detach_recording(stream);
+    if (recording) {
+        finish_recording(stream, recording);
+    }
+    mutex_unlock(stream->mutex);
+
+    join_finished_recordings(stream, false);
+}
+
+void
+stream_join_recordings(struct stream *stream) {
+    join_finished_recordings(stream, true);
+}
+
+bool
+stream_is_recording(struct stream *stream) {
+    // the event mutex is never held for long
+    mutex_lock(stream->event_mutex);
+    bool recording = stream->recording;
+    mutex_unlock(stream->event_mutex);
+    return recording;
+}
+
+void
+stream_push_event(struct stream *stream, const char *text) {
+    // recorder_push_event() never blocks
+    mutex_lock(stream->event_mutex);
+    if (!stream->recording || stream->last_pts == AV_NOPTS_VALUE) {
+        mutex_unlock(stream->event_mutex);
+        return;
+    }
+
+    // the device pts and the client time are both in microseconds
+    int64_t pts = stream->last_pts
+                + av_gettime_relative() - stream->last_pts_time;
+
+    if (!recorder_push_event(&stream->recording->recorder, pts, text)) {
+        LOGW("Could not send event to recorder");
+    }
+    mutex_unlock(stream->event_mutex);
+}
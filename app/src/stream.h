@@ -5,31 +5,99 @@
 #include <stdint.h>
 #include <libavformat/avformat.h>
 #include <SDL2/SDL_atomic.h>
+#include <SDL2/SDL_mutex.h>
 #include <SDL2/SDL_thread.h>
 
 #include "config.h"
+#include "common.h"
+#include "packet_pool.h"
+#include "packet_window.h"
+#include "recorder.h"
+#include "stream_reader.h"
 #include "util/net.h"
 
+// %t is replaced by the local time, %n by the recording number
+#define DEFAULT_RECORD_PATH "record-%t-%n.mp4"
+
 struct video_buffer;
 
+// a recording, allocated when it starts and released once its file is
+// finished
+struct stream_recording {
+    struct recorder recorder;
+    // the GOP referenced when the recording was started, to be pushed to the
+    // recorder by the stream thread before the next packet (so that starting
+    // a recording never waits for the recorder queue)
+    AVPacket *gop;
+    unsigned gop_count;
+    // once stopped, the recorder thread is joined and the file is finished
+    // by a separate thread, so that stopping a recording never blocks the
+    // caller (typically the UI)
+    SDL_Thread *finisher;
+    SDL_atomic_t finished;
+    struct stream_recording *next;
+};
+
+struct stream_recording_queue QUEUE(struct stream_recording);
+
+struct stream_record_params {
+    // for the recordings started without an explicit filename
+    const char *path_template;
+    enum recorder_format path_format;
+    struct size declared_frame_size;
+    struct recorder_queue_params queue;
+    struct recorder_output_params output;
+};
+
 struct stream {
     socket_t socket;
     struct video_buffer *video_buffer;
     SDL_Thread *thread;
     struct decoder *decoder;
-    struct recorder *recorder;
+    struct replay_buffer *replay;
+    struct session_capture *capture;
+    struct frame_latency *latency;
     AVCodecContext *codec_ctx;
     AVCodec           *codec;
     AVCodecParserContext *parser;
+    // only used from the stream thread
+    struct packet_pool packet_pool;
+    struct stream_reader reader;
     // successive packets may need to be concatenated, until a non-config
     // packet is available
     bool has_pending;
     AVPacket pending;
+
+    // the recording may be started and stopped at any time, so the last
+    // config packet and the current GOP are kept to start a new recording
+    // with a decodable frame immediately
+    struct stream_record_params record_params;
+    unsigned next_record_number;
+    SDL_mutex *mutex;
+    // NULL if not recording, written with both mutexes locked, so that it
+    // may be read with either one
+    struct stream_recording *recording;
+    // the stopped recordings, until their finisher thread is joined
+    struct stream_recording_queue finishing; // protected by the mutex
+    struct packet_window gop; // protected by the mutex
+    // the events are pushed from the input threads, which must not wait for
+    // the stream thread, possibly blocked by the recorder while it holds the
+    // mutex
+    SDL_mutex *event_mutex;
+    // the latest device pts and the client time at which it was received, to
+    // timestamp the events written in the recording
+    int64_t last_pts; // protected by the event_mutex
+    int64_t last_pts_time; // protected by the event_mutex
 };
 
-void
+bool
 stream_init(struct stream *stream, socket_t socket,
-            struct decoder *decoder, struct recorder *recorder);
+            struct decoder *decoder, struct replay_buffer *replay,
+            struct session_capture *capture, struct frame_latency *latency,
+            const struct stream_record_params *record_params);
+
+void
+stream_destroy(struct stream *stream);
 
 bool
 stream_start(struct stream *stream);
@@ -40,4 +108,30 @@ stream_stop(struct stream *stream);
 void
 stream_join(struct stream *stream);
 
+// start a new recording, starting with the current GOP
+// if filename is NULL, it is generated from the record path template
+// may be called before the stream is started or after it is joined
+// the current GOP is pushed to the recorder by the stream thread, along with
+// the next packet
+bool
+stream_start_recording(struct stream *stream, const char *filename,
+                       enum recorder_format format);
+
+// stop the current recording, if any
+// the remaining packets are written and the file is finished asynchronously
+void
+stream_stop_recording(struct stream *stream);
+
+// wait until all the stopped recordings are finished
+void
+stream_join_recordings(struct stream *stream);
+
+bool
+stream_is_recording(struct stream *stream);
+
+// write the event (the JSON description of a control message) in the event
+// track of the current recording, if any, at the estimated current device pts
+void
+stream_push_event(struct stream *stream, const char *text);
+
 #endif
@@ -0,0 +1,208 @@
+#include "stream_reader.h"
+
+#include <assert.h>
+#include <inttypes.h>
+#include <string.h>
+
+#include "config.h"
+#include "util/buffer_util.h"
+#include "util/log.h"
+
+#define HEADER_SIZE 12
+#define NO_PTS UINT64_C(-1)
+
+bool
+stream_reader_init(struct stream_reader *reader, socket_t socket,
+                   struct packet_pool *packet_pool,
+                   struct session_capture *capture) {
+    // the padding is readable (as required by FFmpeg for packets located at
+    // the end of a chunk) but not zeroed, which is fine for H.264: the decoder
+    // unescapes the NAL units into its own zero-padded buffers
+    reader->chunk_pool = av_buffer_pool_init(STREAM_READER_CHUNK_SIZE
+                                             + AV_INPUT_BUFFER_PADDING_SIZE,
+                                             av_buffer_alloc);
+    if (!reader->chunk_pool) {
+        LOGC("Could not create chunk pool");
+        return false;
+    }
+
+    reader->chunk = av_buffer_pool_get(reader->chunk_pool);
+    if (!reader->chunk) {
+        LOGC("Could not allocate chunk");
+        av_buffer_pool_uninit(&reader->chunk_pool);
+        return false;
+    }
+
+    reader->socket = socket;
+    reader->packet_pool = packet_pool;
+    reader->capture = capture;
+    reader->head = 0;
+    reader->tail = 0;
+    memset(&reader->stats, 0, sizeof(reader->stats));
+    return true;
+}
+
+void
+stream_reader_destroy(struct stream_reader *reader) {
+    av_buffer_unref(&reader->chunk);
+    // the chunks still referenced by packets are released with their last
+    // reference
+    av_buffer_pool_uninit(&reader->chunk_pool);
+}
+
+// make sure that the current chunk can store len bytes from reader->head
+static bool
+prepare_chunk(struct stream_reader *reader, size_t len) {
+    assert(len <= STREAM_READER_CHUNK_SIZE);
+    if (reader->head + len <= STREAM_READER_CHUNK_SIZE) {
+        return true;
+    }
+
+    // move the unread data (a partial packet) to the beginning of a chunk
+    size_t pending = reader->tail - reader->head;
+    if (av_buffer_is_writable(reader->chunk)) {
+        // no packet references the current chunk anymore, reuse it
+        memmove(reader->chunk->data, reader->chunk->data + reader->head,
+                pending);
+    } else {
+        AVBufferRef *chunk = av_buffer_pool_get(reader->chunk_pool);
+        if (!chunk) {
+            LOGC("Could not allocate chunk");
+            return false;
+        }
+        memcpy(chunk->data, reader->chunk->data + reader->head, pending);
+        av_buffer_unref(&reader->chunk);
+        reader->chunk = chunk;
+    }
+
+    reader->stats.copied_bytes += pending;
+    reader->head = 0;
+    reader->tail = pending;
+    return true;
+}
+
+// receive until at least len unread bytes are available in the current chunk
+static bool
+fill(struct stream_reader *reader, size_t len) {
+    if (!prepare_chunk(reader, len)) {
+        return false;
+    }
+
+    while (reader->tail - reader->head < len) {
+        // read as much as possible, the remaining data will be used by the
+        // next packets
+        ssize_t r = net_recv(reader->socket,
+                             reader->chunk->data + reader->tail,
+                             STREAM_READER_CHUNK_SIZE - reader->tail);
+        ++reader->stats.recv_calls;
+        if (r <= 0) {
+            return false;
+        }
+        if (reader->capture) {
+            session_capture_push(reader->capture,
+                                 reader->chunk->data + reader->tail, r);
+        }
+        reader->tail += r;
+        reader->stats.bytes += r;
+    }
+
+    return true;
+}
+
+static bool
+read_large_payload(struct stream_reader *reader, AVPacket *packet,
+                   uint32_t len) {
+    if (!packet_pool_get(reader->packet_pool, packet, len)) {
+        LOGE("Could not allocate packet");
+        return false;
+    }
+
+    // the beginning of the payload may already be in the chunk
+    size_t available = reader->tail - reader->head;
+    size_t copied = available < len ? available : len;
+    memcpy(packet->data, reader->chunk->data + reader->head, copied);
+    reader->head += copied;
+    reader->stats.copied_bytes += copied;
+
+    if (copied < len) {
+        size_t remaining = len - copied;
+        ssize_t r = net_recv_all(reader->socket, packet->data + copied,
+                                 remaining);
+        ++reader->stats.recv_calls;
+        if (r < 0 || (size_t) r < remaining) {
+            av_packet_unref(packet);
+            return false;
+        }
+        if (reader->capture) {
+            session_capture_push(reader->capture, packet->data + copied, r);
+        }
+        reader->stats.bytes += r;
+    }
+
+    return true;
+}
+
+bool
+stream_reader_read_packet(struct stream_reader *reader, AVPacket *packet) {
+    // The video stream contains raw packets, without time information. When we
+    // record, we retrieve the timestamps separately, from a "meta" header
+    // added by the server before each raw packet.
+    //
+    // The "meta" header length is 12 bytes:
+    // [. . . . . . . .|. . . .]. . . . . . . . . . . . . . . ...
+    //  <-------------> <-----> <-----------------------------...
+    //        PTS        packet        raw packet
+    //                    size
+    //
+    // It is followed by <packet_size> bytes containing the packet/frame.
+
+    if (!fill(reader, HEADER_SIZE)) {
+        return false;
+    }
+
+    const uint8_t *header = reader->chunk->data + reader->head;
+    uint64_t pts = buffer_read64be(header);
+    uint32_t len = buffer_read32be(&header[8]);
+    assert(pts == NO_PTS || (pts & 0x8000000000000000) == 0);
+    assert(len);
+    reader->head += HEADER_SIZE;
+
+    if (len <= STREAM_READER_MAX_INLINE_PAYLOAD) {
+        if (!fill(reader, len)) {
+            return false;
+        }
+
+        // reference the payload in the chunk
+        AVBufferRef *buf = av_buffer_ref(reader->chunk);
+        if (!buf) {
+            LOGE("Could not reference chunk");
+            return false;
+        }
+
+        av_init_packet(packet);
+        packet->buf = buf;
+        packet->data = buf->data + reader->head;
+        packet->size = len;
+        reader->head += len;
+    } else if (!read_large_payload(reader, packet, len)) {
+        return false;
+    }
+
+    packet->pts = pts != NO_PTS ? (int64_t) pts : AV_NOPTS_VALUE;
+    ++reader->stats.packets;
+
+    return true;
+}
+
+void
+stream_reader_log_stats(const struct stream_reader *reader) {
+    const struct stream_reader_stats *stats = &reader->stats;
+    if (!stats->packets) {
+        return;
+    }
+    LOGD("Stream reader: %" PRIu64 " packets, %" PRIu64 " recv calls "
+         "(%.2f per packet), %" PRIu64 " bytes (%" PRIu64 " copied)",
+         stats->packets, stats->recv_calls,
+         (double) stats->recv_calls / stats->packets, stats->bytes,
+         stats->copied_bytes);
+}
@@ -0,0 +1,60 @@
+#ifndef STREAM_READER_H
+#define STREAM_READER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <libavcodec/avcodec.h>
+
+#include "config.h"
+#include "packet_pool.h"
+#include "session_capture.h"
+#include "util/net.h"
+
+// size of the buffers receiving the socket data
+#define STREAM_READER_CHUNK_SIZE (256 * 1024)
+// larger payloads are received directly into a packet from the packet pool
+#define STREAM_READER_MAX_INLINE_PAYLOAD (STREAM_READER_CHUNK_SIZE / 4)
+
+struct stream_reader_stats {
+    uint64_t recv_calls;
+    uint64_t packets;
+    uint64_t bytes; // received from the socket
+    uint64_t copied_bytes; // payload bytes copied out of the chunks
+};
+
+// read the video stream framing ([pts|len|payload], see stream_reader.c)
+// from the socket using large recv() calls
+//
+// the data are received into reference-counted chunks: the payloads fully
+// contained in a chunk are returned as packets referencing the chunk, without
+// copy; a chunk returns to the chunk pool once all its packets are released
+struct stream_reader {
+    socket_t socket;
+    struct packet_pool *packet_pool;
+    // if not NULL, receive a copy of all the bytes read from the socket
+    struct session_capture *capture;
+    AVBufferPool *chunk_pool;
+    AVBufferRef *chunk;
+    size_t head; // start of the unread data in the chunk
+    size_t tail; // end of the received data in the chunk
+    struct stream_reader_stats stats;
+};
+
+bool
+stream_reader_init(struct stream_reader *reader, socket_t socket,
+                   struct packet_pool *packet_pool,
+                   struct session_capture *capture);
+
+void
+stream_reader_destroy(struct stream_reader *reader);
+
+// read the next packet (its pts is AV_NOPTS_VALUE for config packets)
+// return false on end of stream or error
+bool
+stream_reader_read_packet(struct stream_reader *reader, AVPacket *packet);
+
+void
+stream_reader_log_stats(const struct stream_reader *reader);
+
+#endif
@@ -0,0 +1,198 @@
+#include "texture_frame.h"
+
+#include <assert.h>
+#include <string.h>
+
+#include "config.h"
+#include "compat.h"
+#include "util/lock.h"
+#include "util/log.h"
+
+// the minimal line alignment, for the SIMD code of the decoder and of the
+// renderer
+#define MIN_ALIGN 32
+
+#define ALIGN_UP(VALUE, ALIGN) (((VALUE) + (ALIGN) - 1) / (ALIGN) * (ALIGN))
+
+bool
+texture_frame_allocator_init(struct texture_frame_allocator *allocator) {
+    allocator->mutex = SDL_CreateMutex();
+    if (!allocator->mutex) {
+        LOGC("Could not create texture frame allocator mutex");
+        return false;
+    }
+    allocator->pool = NULL;
+    allocator->buffer_size = 0;
+    return true;
+}
+
+void
+texture_frame_allocator_destroy(struct texture_frame_allocator *allocator) {
+    // the buffers still referenced are released when their last reference is
+    // dropped
+    av_buffer_pool_uninit(&allocator->pool);
+    SDL_DestroyMutex(allocator->mutex);
+}
+
+static int
+get_buffer(AVCodecContext *codec_ctx, AVFrame *frame, int flags) {
+    if (frame->format != AV_PIX_FMT_YUV420P) {
+        return avcodec_default_get_buffer2(codec_ctx, frame, flags);
+    }
+
+    // the decoder may write past the visible size
+    int width = frame->width;
+    int height = frame->height;
+    int linesize_align[AV_NUM_DATA_POINTERS];
+    avcodec_align_dimensions2(codec_ctx, &width, &height, linesize_align);
+    int align = MIN_ALIGN;
+    for (int i = 0; i < 3; ++i) {
+        if (linesize_align[i] > align) {
+            align = linesize_align[i];
+        }
+    }
+
+    struct texture_frame_allocator *allocator = codec_ctx->opaque;
+    if (!texture_frame_allocator_get(allocator, frame, width, height, align)) {
+        return AVERROR(ENOMEM);
+    }
+    return 0;
+}
+
+void
+texture_frame_allocator_install(struct texture_frame_allocator *allocator,
+                                AVCodecContext *codec_ctx) {
+    codec_ctx->opaque = allocator;
+    codec_ctx->get_buffer2 = get_buffer;
+#ifdef SCRCPY_LAVC_HAS_THREAD_SAFE_CALLBACKS
+    // get_buffer() may be called from any decoding thread
+    codec_ctx->thread_safe_callbacks = 1;
+#endif
+}
+
+static size_t
+get_planes_size(int pitch, int height) {
+    return (size_t) pitch * height + 2 * (size_t) (pitch / 2) * (height / 2);
+}
+
+bool
+texture_frame_allocator_get(struct texture_frame_allocator *allocator,
+                            AVFrame *frame, int padded_width,
+                            int padded_height, int align) {
+    assert(frame->format == AV_PIX_FMT_YUV420P);
+    assert(padded_width >= frame->width && padded_height >= frame->height);
+
+    // the chroma lines (half the pitch) must also be aligned
+    int pitch = ALIGN_UP(padded_width, 2 * align);
+    int height = ALIGN_UP(padded_height, 2);
+    size_t size = get_planes_size(pitch, height) + TEXTURE_FRAME_PADDING;
+    if (pitch > UINT16_MAX || height > UINT16_MAX || size > INT32_MAX) {
+        LOGE("Frame too large for a texture: %dx%d", pitch, height);
+        return false;
+    }
+
+    mutex_lock(allocator->mutex);
+    if (!allocator->pool || (int) size != allocator->buffer_size) {
+        // the frame size has changed
+        av_buffer_pool_uninit(&allocator->pool);
+        allocator->pool = av_buffer_pool_init((int) size, NULL);
+        if (!allocator->pool) {
+            mutex_unlock(allocator->mutex);
+            LOGC("Could not create texture frame pool");
+            return false;
+        }
+        allocator->buffer_size = (int) size;
+    }
+    frame->buf[0] = av_buffer_pool_get(allocator->pool);
+    mutex_unlock(allocator->mutex);
+
+    if (!frame->buf[0]) {
+        LOGC("Could not allocate texture frame");
+        return false;
+    }
+
+    // YV12: the V plane is stored before the U plane
+    uint8_t *data = frame->buf[0]->data;
+    frame->data[0] = data;
+    frame->data[2] = data + (size_t) pitch * height;
+    frame->data[1] = frame->data[2] + (size_t) (pitch / 2) * (height / 2);
+    frame->linesize[0] = pitch;
+    frame->linesize[1] = pitch / 2;
+    frame->linesize[2] = pitch / 2;
+    frame->extended_data = frame->data;
+    return true;
+}
+
+bool
+texture_frame_get_texture_size(const AVFrame *frame, struct size *size) {
+    // the frames allocated by FFmpeg use one buffer per plane
+    if (frame->format != AV_PIX_FMT_YUV420P || !frame->buf[0]
+            || frame->buf[1]) {
+        return false;
+    }
+
+    int pitch = frame->linesize[0];
+    if (pitch <= 0 || pitch % 2 || frame->linesize[1] != pitch / 2
+            || frame->linesize[2] != pitch / 2
+            || frame->data[2] <= frame->data[0]
+            || (frame->data[2] - frame->data[0]) % pitch) {
+        return false;
+    }
+
+    int height = (int) ((frame->data[2] - frame->data[0]) / pitch);
+    if (height % 2 || height < frame->height
+            || frame->data[1] != frame->data[2]
+                               + (size_t) (pitch / 2) * (height / 2)
+            || frame->data[0] != frame->buf[0]->data
+            || get_planes_size(pitch, height) > (size_t) frame->buf[0]->size) {
+        return false;
+    }
+
+    size->width = pitch;
+    size->height = height;
+    return true;
+}
+
+static void
+copy_plane(uint8_t *dst, int dst_pitch, const uint8_t *src, int src_pitch,
+           int height) {
+    int len = dst_pitch < src_pitch ? dst_pitch : src_pitch;
+    for (int i = 0; i < height; ++i) {
+        memcpy(dst + (size_t) i * dst_pitch, src + (size_t) i * src_pitch,
+               len);
+    }
+}
+
+bool
+texture_frame_upload(SDL_Texture *texture, const AVFrame *frame) {
+    struct size size;
+    bool ok = texture_frame_get_texture_size(frame, &size);
+    assert(ok);
+    (void) ok;
+
+    void *pixels;
+    int pitch;
+    if (SDL_LockTexture(texture, NULL, &pixels, &pitch)) {
+        LOGE("Could not lock texture: %s", SDL_GetError());
+        return false;
+    }
+
+    if (pitch == frame->linesize[0]) {
+        // same layout, copy all the planes at once
+        memcpy(pixels, frame->data[0], get_planes_size(pitch, size.height));
+    } else {
+        // the renderer uses another pitch, copy line by line
+        uint8_t *y = pixels;
+        uint8_t *v = y + (size_t) pitch * size.height;
+        int chroma_pitch = (pitch + 1) / 2;
+        uint8_t *u = v + (size_t) chroma_pitch * ((size.height + 1) / 2);
+        copy_plane(y, pitch, frame->data[0], frame->linesize[0], size.height);
+        copy_plane(v, chroma_pitch, frame->data[2], frame->linesize[2],
+                   size.height / 2);
+        copy_plane(u, chroma_pitch, frame->data[1], frame->linesize[1],
+                   size.height / 2);
+    }
+
+    SDL_UnlockTexture(texture);
+    return true;
+}
@@ -0,0 +1,64 @@
+#ifndef TEXTURE_FRAME_H
+#define TEXTURE_FRAME_H
+
+#include <stdbool.h>
+#include <libavcodec/avcodec.h>
+#include <SDL2/SDL_mutex.h>
+#include <SDL2/SDL_render.h>
+
+#include "config.h"
+#include "common.h"
+
+// padding after the planes, for the decoder SIMD code reading past the end
+#define TEXTURE_FRAME_PADDING 64
+
+// allocate the decoded YUV420P frames in the memory layout of a locked YV12
+// streaming texture: a single buffer with the Y, V and U planes contiguous,
+// and the same pitch as the texture
+//
+// the texture is created with the padded size of the frames (only the
+// visible part is rendered), so that uploading a frame is a single memcpy()
+// into the locked texture, instead of a copy of each line of each plane
+//
+// the buffers are reference-counted and recycled: the frames may be
+// referenced and released from any thread, even after the allocator is
+// destroyed
+struct texture_frame_allocator {
+    // the decoder may request buffers from several threads
+    SDL_mutex *mutex;
+    AVBufferPool *pool;
+    int buffer_size;
+};
+
+bool
+texture_frame_allocator_init(struct texture_frame_allocator *allocator);
+
+void
+texture_frame_allocator_destroy(struct texture_frame_allocator *allocator);
+
+// make the (not opened yet) codec context allocate its frames from allocator
+// (other pixel formats are allocated by the default FFmpeg allocator)
+void
+texture_frame_allocator_install(struct texture_frame_allocator *allocator,
+                                AVCodecContext *codec_ctx);
+
+// allocate the planes of frame (its format must be YUV420P, and its size
+// must be set), padded to padded_width x padded_height, with lines aligned
+// on align bytes
+bool
+texture_frame_allocator_get(struct texture_frame_allocator *allocator,
+                            AVFrame *frame, int padded_width,
+                            int padded_height, int align);
+
+// get the size of the texture matching the frame layout
+// return false if the frame has not been allocated by a
+// texture_frame_allocator
+bool
+texture_frame_get_texture_size(const AVFrame *frame, struct size *size);
+
+// write the frame into the texture (having the size returned by
+// texture_frame_get_texture_size())
+bool
+texture_frame_upload(SDL_Texture *texture, const AVFrame *frame);
+
+#endif
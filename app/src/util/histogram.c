@@ -0,0 +1,73 @@
+#include "histogram.h"
+
+#include <assert.h>
+#include <string.h>
+
+#include "config.h"
+
+void
+histogram_init(struct histogram *histogram) {
+    memset(histogram, 0, sizeof(*histogram));
+}
+
+static unsigned
+bucket_index(uint32_t value) {
+    if (value < HISTOGRAM_SUB_BUCKETS) {
+        return value;
+    }
+    // position of the most significant bit, at least SUB_BUCKET_BITS
+    unsigned msb = 31 - __builtin_clz(value);
+    unsigned shift = msb - HISTOGRAM_SUB_BUCKET_BITS;
+    unsigned sub = (value >> shift) & (HISTOGRAM_SUB_BUCKETS - 1);
+    return (shift + 1) * HISTOGRAM_SUB_BUCKETS + sub;
+}
+
+// return the largest value stored in the bucket
+static uint32_t
+bucket_upper_bound(unsigned index) {
+    if (index < HISTOGRAM_SUB_BUCKETS) {
+        return index;
+    }
+    unsigned shift = index / HISTOGRAM_SUB_BUCKETS - 1;
+    unsigned sub = index % HISTOGRAM_SUB_BUCKETS;
+    uint64_t lower = (uint64_t) (HISTOGRAM_SUB_BUCKETS + sub) << shift;
+    return lower + (UINT64_C(1) << shift) - 1;
+}
+
+void
+histogram_record(struct histogram *histogram, uint32_t value) {
+    unsigned index = bucket_index(value);
+    assert(index < HISTOGRAM_BUCKET_COUNT);
+    ++histogram->buckets[index];
+    ++histogram->count;
+    if (value > histogram->max) {
+        histogram->max = value;
+    }
+}
+
+uint32_t
+histogram_percentile(const struct histogram *histogram, unsigned percent) {
+    assert(percent <= 100);
+    if (!histogram->count) {
+        return 0;
+    }
+
+    // rank of the requested value, in [1, count]
+    uint64_t rank = (histogram->count * percent + 99) / 100;
+    if (!rank) {
+        rank = 1;
+    }
+
+    uint64_t cumulated = 0;
+    for (unsigned i = 0; i < HISTOGRAM_BUCKET_COUNT; ++i) {
+        cumulated += histogram->buckets[i];
+        if (cumulated >= rank) {
+            uint32_t value = bucket_upper_bound(i);
+            return value < histogram->max ? value : histogram->max;
+        }
+    }
+
+    // unreachable
+    assert(0);
+    return histogram->max;
+}
@@ -0,0 +1,38 @@
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <stdint.h>
+
+#include "config.h"
+
+// log-linear histogram of uint32_t values (typically durations in
+// microseconds), with a constant memory footprint
+//
+// each power of two is split into HISTOGRAM_SUB_BUCKETS buckets, so the
+// relative error of the reported percentiles is at most
+// 1/HISTOGRAM_SUB_BUCKETS (values below HISTOGRAM_SUB_BUCKETS are exact)
+#define HISTOGRAM_SUB_BUCKET_BITS 3
+#define HISTOGRAM_SUB_BUCKETS (1 << HISTOGRAM_SUB_BUCKET_BITS)
+#define HISTOGRAM_BUCKET_COUNT \
+    ((32 - HISTOGRAM_SUB_BUCKET_BITS + 1) * HISTOGRAM_SUB_BUCKETS)
+
+struct histogram {
+    uint32_t buckets[HISTOGRAM_BUCKET_COUNT];
+    uint64_t count;
+    uint32_t max;
+};
+
+// also used to reset the histogram
+void
+histogram_init(struct histogram *histogram);
+
+void
+histogram_record(struct histogram *histogram, uint32_t value);
+
+// return the value below which percent % of the recorded values fall (rounded
+// up to the upper bound of its bucket, but never above the max), or 0 if the
+// histogram is empty
+uint32_t
+histogram_percentile(const struct histogram *histogram, unsigned percent);
+
+#endif
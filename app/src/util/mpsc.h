@@ -0,0 +1,156 @@
+// generic bounded lock-free queue, from multiple producers to a single
+// consumer
+#ifndef MPSC_H
+#define MPSC_H
+
+#include <stdbool.h>
+#include <SDL2/SDL_atomic.h>
+#include <SDL2/SDL_mutex.h>
+
+#include "config.h"
+
+// To define a queue type of 64 ints (CAP must be a power of 2):
+//     struct mpsc_int MPSC(int, 64);
+//
+// Each slot stores the position for which it is ready to be pushed
+// (== position) or taken (== position + 1), as in Dmitry Vyukov's bounded
+// queue. The producers reserve a position by a CAS on the tail, so a push
+// never takes a lock; the consumer owns the head.
+//
+// The positions are stored as int into SDL_atomic_t, but always compared as
+// unsigned values, so that they can wrap around.
+#define MPSC(TYPE, CAP) { \
+    struct { \
+        SDL_atomic_t sequence; \
+        TYPE item; \
+    } slots[CAP]; \
+    SDL_atomic_t tail; /* next position to push */ \
+    unsigned head; /* next position to take, only accessed by the consumer */ \
+}
+
+#define mpsc_capacity_(PQ) \
+    (sizeof((PQ)->slots) / sizeof(*(PQ)->slots))
+
+#define mpsc_slot_(PQ, POS) \
+    (&(PQ)->slots[(POS) & (mpsc_capacity_(PQ) - 1)])
+
+#define mpsc_init(PQ) \
+    (void) ({ \
+        _Static_assert(!(mpsc_capacity_(PQ) & (mpsc_capacity_(PQ) - 1)), \
+                       "MPSC capacity must be a power of 2"); \
+        for (unsigned i_ = 0; i_ < mpsc_capacity_(PQ); ++i_) { \
+            SDL_AtomicSet(&(PQ)->slots[i_].sequence, (int) i_); \
+        } \
+        SDL_AtomicSet(&(PQ)->tail, 0); \
+        (PQ)->head = 0; \
+    })
+
+// may be called from any thread
+// return false if the queue is full
+#define mpsc_push(PQ, ITEM) \
+    ({ \
+        bool ok_; \
+        unsigned pos_ = (unsigned) SDL_AtomicGet(&(PQ)->tail); \
+        for (;;) { \
+            __typeof__(mpsc_slot_(PQ, 0)) slot_ = mpsc_slot_(PQ, pos_); \
+            unsigned seq_ = (unsigned) SDL_AtomicGet(&slot_->sequence); \
+            int diff_ = (int) (seq_ - pos_); \
+            if (!diff_ && SDL_AtomicCAS(&(PQ)->tail, (int) pos_, \
+                                        (int) (pos_ + 1))) { \
+                slot_->item = (ITEM); \
+                /* publish the item to the consumer */ \
+                SDL_AtomicSet(&slot_->sequence, (int) (pos_ + 1)); \
+                ok_ = true; \
+                break; \
+            } \
+            if (diff_ < 0) { \
+                /* the slot still contains the item pushed one lap before */ \
+                ok_ = false; \
+                break; \
+            } \
+            /* another producer reserved this position in the meantime */ \
+            pos_ = (unsigned) SDL_AtomicGet(&(PQ)->tail); \
+        } \
+        ok_; \
+    })
+
+// must be called from the consumer
+// false negatives are possible while a producer is publishing its item
+#define mpsc_is_empty(PQ) \
+    ((unsigned) SDL_AtomicGet(&mpsc_slot_(PQ, (PQ)->head)->sequence) \
+        != (PQ)->head + 1)
+
+// must be called from the consumer
+#define mpsc_take(PQ, PITEM) \
+    ({ \
+        __typeof__(mpsc_slot_(PQ, 0)) slot_ = mpsc_slot_(PQ, (PQ)->head); \
+        bool ok_ = (unsigned) SDL_AtomicGet(&slot_->sequence) \
+                == (PQ)->head + 1; \
+        if (ok_) { \
+            *(PITEM) = slot_->item; \
+            /* make the slot available for the push one lap later */ \
+            SDL_AtomicSet(&slot_->sequence, \
+                          (int) ((PQ)->head + mpsc_capacity_(PQ))); \
+            ++(PQ)->head; \
+        } \
+        ok_; \
+    })
+
+// wake up the consumer of an MPSC queue, without any syscall on the push
+// path unless the consumer is (about to be) sleeping, like an eventfd or a
+// futex
+struct mpsc_waiter {
+    // set by the consumer before it sleeps, reset by the producer which
+    // posts the semaphore
+    SDL_atomic_t waiting;
+    SDL_sem *sem;
+};
+
+static inline bool
+mpsc_waiter_init(struct mpsc_waiter *waiter) {
+    waiter->sem = SDL_CreateSemaphore(0);
+    if (!waiter->sem) {
+        return false;
+    }
+    SDL_AtomicSet(&waiter->waiting, 0);
+    return true;
+}
+
+static inline void
+mpsc_waiter_destroy(struct mpsc_waiter *waiter) {
+    SDL_DestroySemaphore(waiter->sem);
+}
+
+// to be called after a push (or any state change the consumer waits for)
+static inline void
+mpsc_waiter_notify(struct mpsc_waiter *waiter) {
+    if (SDL_AtomicGet(&waiter->waiting)
+            && SDL_AtomicCAS(&waiter->waiting, 1, 0)) {
+        SDL_SemPost(waiter->sem);
+    }
+}
+
+// to be called by the consumer before checking the state one last time
+static inline void
+mpsc_waiter_prepare(struct mpsc_waiter *waiter) {
+    SDL_AtomicSet(&waiter->waiting, 1);
+}
+
+// to be called by the consumer after mpsc_waiter_prepare(), if the state
+// changed in the meantime: return immediately
+static inline void
+mpsc_waiter_cancel(struct mpsc_waiter *waiter) {
+    if (!SDL_AtomicCAS(&waiter->waiting, 1, 0)) {
+        // a producer has already reset the flag, consume its post
+        SDL_SemWait(waiter->sem);
+    }
+}
+
+// to be called by the consumer after mpsc_waiter_prepare(), if the state did
+// not change: sleep until the next notification
+static inline void
+mpsc_waiter_wait(struct mpsc_waiter *waiter) {
+    SDL_SemWait(waiter->sem);
+}
+
+#endif
@@ -11,6 +11,7 @@
 # include <sys/types.h>
 # include <sys/socket.h>
 # include <netinet/in.h>
+# include <netinet/tcp.h>
 # include <arpa/inet.h>
 # include <unistd.h>
 # define SOCKET_ERROR -1
@@ -19,14 +20,30 @@
   typedef struct in_addr IN_ADDR;
 #endif
 
+static bool
+set_option(socket_t socket, int level, int name, int value,
+           const char *option) {
+    if (setsockopt(socket, level, name, (const void *) &value,
+                   sizeof(value)) == SOCKET_ERROR) {
+        LOGW("Could not set socket option %s", option);
+        return false;
+    }
+    return true;
+}
+
 socket_t
-net_connect(uint32_t addr, uint16_t port) {
+net_connect(uint32_t addr, uint16_t port, int rcvbuf) {
     socket_t sock = socket(AF_INET, SOCK_STREAM, 0);
     if (sock == INVALID_SOCKET) {
         perror("socket");
         return INVALID_SOCKET;
     }
 
+    if (rcvbuf) {
+        // ignore failure, the system default is used
+        set_option(sock, SOL_SOCKET, SO_RCVBUF, rcvbuf, "SO_RCVBUF");
+    }
+
     SOCKADDR_IN sin;
     sin.sin_family = AF_INET;
     sin.sin_addr.s_addr = htonl(addr);
@@ -42,7 +59,7 @@ net_connect(uint32_t addr, uint16_t port) {
 }
 
 socket_t
-net_listen(uint32_t addr, uint16_t port, int backlog) {
+net_listen(uint32_t addr, uint16_t port, int backlog, int rcvbuf) {
     socket_t sock = socket(AF_INET, SOCK_STREAM, 0);
     if (sock == INVALID_SOCKET) {
         perror("socket");
@@ -55,6 +72,11 @@ net_listen(uint32_t addr, uint16_t port, int backlog) {
         perror("setsockopt(SO_REUSEADDR)");
     }
 
+    if (rcvbuf) {
+        // ignore failure, the system default is used
+        set_option(sock, SOL_SOCKET, SO_RCVBUF, rcvbuf, "SO_RCVBUF");
+    }
+
     SOCKADDR_IN sin;
     sin.sin_family = AF_INET;
     sin.sin_addr.s_addr = htonl(addr); // htonl() harmless on INADDR_ANY
@@ -99,19 +121,45 @@ net_send(socket_t socket, const void *buf, size_t len) {
 
 ssize_t
 net_send_all(socket_t socket, const void *buf, size_t len) {
-    ssize_t w = 0;
+    size_t total = len;
     while (len > 0) {
-        w = send(socket, buf, len, 0);
+        ssize_t w = send(socket, buf, len, 0);
         if (w == -1) {
             return -1;
         }
         len -= w;
         buf = (char *) buf + w;
     }
-    return w;
+    return total;
 }
 
 bool
 net_shutdown(socket_t socket, int how) {
     return !shutdown(socket, how);
 }
+
+bool
+net_set_options(socket_t socket, const struct net_socket_options *options) {
+    bool ok = true;
+    if (options->nodelay) {
+        ok &= set_option(socket, IPPROTO_TCP, TCP_NODELAY, 1, "TCP_NODELAY");
+    }
+    if (options->quickack) {
+#ifdef TCP_QUICKACK
+        // the kernel may leave the quickack mode later, this only avoids the
+        // delayed ACKs on the first exchanges
+        ok &= set_option(socket, IPPROTO_TCP, TCP_QUICKACK, 1,
+                         "TCP_QUICKACK");
+#else
+        LOGD("TCP_QUICKACK not supported on this platform");
+#endif
+    }
+    if (options->keepalive) {
+        ok &= set_option(socket, SOL_SOCKET, SO_KEEPALIVE, 1, "SO_KEEPALIVE");
+    }
+    if (options->sndbuf) {
+        ok &= set_option(socket, SOL_SOCKET, SO_SNDBUF, options->sndbuf,
+                         "SO_SNDBUF");
+    }
+    return ok;
+}
@@ -19,17 +19,34 @@
 
 #include "config.h"
 
+struct net_socket_options {
+    // disable Nagle's algorithm, so that small messages are sent immediately
+    bool nodelay;
+    // disable the delayed ACKs (only supported on Linux, ignored elsewhere)
+    bool quickack;
+    // detect a dead peer on an idle connection
+    bool keepalive;
+    // in bytes, 0 to keep the system default
+    int sndbuf;
+};
+
 bool
 net_init(void);
 
 void
 net_cleanup(void);
 
+// rcvbuf is the receive buffer size (SO_RCVBUF) in bytes, or 0 to keep the
+// system default (autotuned on most systems)
+//
+// it is set before the connection, so that the TCP window scale negotiated
+// during the handshake allows to use it entirely (the accepted sockets inherit
+// it from the listening socket)
 socket_t
-net_connect(uint32_t addr, uint16_t port);
+net_connect(uint32_t addr, uint16_t port, int rcvbuf);
 
 socket_t
-net_listen(uint32_t addr, uint16_t port, int backlog);
+net_listen(uint32_t addr, uint16_t port, int backlog, int rcvbuf);
 
 socket_t
 net_accept(socket_t server_socket);
@@ -54,4 +71,9 @@ net_shutdown(socket_t socket, int how);
 bool
 net_close(socket_t socket);
 
+// apply the options to a connected socket
+// return false if any option could not be set (the others are still applied)
+bool
+net_set_options(socket_t socket, const struct net_socket_options *options);
+
 #endif
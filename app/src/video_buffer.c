@@ -9,105 +9,244 @@
 #include "util/lock.h"
 #include "util/log.h"
 
+// positions are stored as int into SDL_atomic_t, but always compared as
+// unsigned values, so that they can wrap around
+static inline unsigned
+atomic_get_position(SDL_atomic_t *atomic) {
+    return (unsigned) SDL_AtomicGet(atomic);
+}
+
+static inline void
+atomic_set_position(SDL_atomic_t *atomic, unsigned position) {
+    SDL_AtomicSet(atomic, (int) position);
+}
+
+static inline struct video_buffer_slot *
+get_slot(struct video_buffer *vb, unsigned position) {
+    return &vb->slots[position & (vb->slot_count - 1)];
+}
+
 bool
 video_buffer_init(struct video_buffer *vb, struct fps_counter *fps_counter,
-                  bool render_expired_frames) {
+                  bool render_expired_frames, unsigned capacity) {
+    assert(capacity);
     vb->fps_counter = fps_counter;
 
-    if (!(vb->decoding_frame = av_frame_alloc())) {
+    // besides the pending frames, one slot is decoded into and one may be
+    // uploaded by the consumer (power of 2 so that positions may wrap around)
+    unsigned slot_count = 4;
+    while (slot_count < capacity + 2) {
+        slot_count <<= 1;
+    }
+
+    vb->slots = SDL_calloc(slot_count, sizeof(*vb->slots));
+    if (!vb->slots) {
+        LOGC("Could not allocate video buffer");
         goto error_0;
     }
 
-    if (!(vb->rendering_frame = av_frame_alloc())) {
-        goto error_1;
+    unsigned i;
+    for (i = 0; i < slot_count; ++i) {
+        if (!(vb->slots[i].frame = av_frame_alloc())) {
+            goto error_1;
+        }
+        atomic_set_position(&vb->slots[i].sequence, i);
     }
 
     if (!(vb->mutex = SDL_CreateMutex())) {
-        goto error_2;
+        goto error_1;
     }
 
-    vb->render_expired_frames = render_expired_frames;
-    if (render_expired_frames) {
-        if (!(vb->rendering_frame_consumed_cond = SDL_CreateCond())) {
-            SDL_DestroyMutex(vb->mutex);
-            goto error_2;
-        }
-        // interrupted is not used if expired frames are not rendered
-        // since offering a frame will never block
-        vb->interrupted = false;
+    if (!(vb->frame_consumed_sem = SDL_CreateSemaphore(0))) {
+        goto error_2;
     }
 
-    // there is initially no rendering frame, so consider it has already been
-    // consumed
-    vb->rendering_frame_consumed = true;
+    vb->slot_count = slot_count;
+    vb->capacity = capacity;
+    vb->render_expired_frames = render_expired_frames;
+    atomic_set_position(&vb->head, 0);
+    atomic_set_position(&vb->tail, 0);
+    SDL_AtomicSet(&vb->interrupted, 0);
+    SDL_AtomicSet(&vb->producer_waiting, 0);
+    vb->has_latest = false;
+    vb->latest_position = 0;
+    vb->decoding_frame = vb->slots[0].frame;
 
     return true;
 
 error_2:
-    av_frame_free(&vb->rendering_frame);
+    SDL_DestroyMutex(vb->mutex);
 error_1:
-    av_frame_free(&vb->decoding_frame);
+    while (i--) {
+        av_frame_free(&vb->slots[i].frame);
+    }
+    SDL_free(vb->slots);
 error_0:
     return false;
 }
 
 void
 video_buffer_destroy(struct video_buffer *vb) {
-    if (vb->render_expired_frames) {
-        SDL_DestroyCond(vb->rendering_frame_consumed_cond);
-    }
+    SDL_DestroySemaphore(vb->frame_consumed_sem);
     SDL_DestroyMutex(vb->mutex);
-    av_frame_free(&vb->rendering_frame);
-    av_frame_free(&vb->decoding_frame);
+    for (unsigned i = 0; i < vb->slot_count; ++i) {
+        av_frame_free(&vb->slots[i].frame);
+    }
+    SDL_free(vb->slots);
+}
+
+// take the oldest pending frame (by the consumer to render it, or by the
+// producer to skip it)
+// return false if there is none
+static bool
+take_frame(struct video_buffer *vb, unsigned *position) {
+    unsigned head = atomic_get_position(&vb->head);
+    for (;;) {
+        struct video_buffer_slot *slot = get_slot(vb, head);
+        unsigned sequence = atomic_get_position(&slot->sequence);
+        int diff = (int) (sequence - (head + 1));
+        if (diff < 0) {
+            // empty
+            return false;
+        }
+        if (!diff && SDL_AtomicCAS(&vb->head, (int) head, (int) (head + 1))) {
+            *position = head;
+            return true;
+        }
+        // the other side took the frame in the meantime
+        head = atomic_get_position(&vb->head);
+    }
+}
+
+// make the slot available for decoding one lap later
+static void
+release_frame(struct video_buffer *vb, unsigned position) {
+    atomic_set_position(&get_slot(vb, position)->sequence,
+                        position + vb->slot_count);
+}
+
+// must be called from the producer
+static bool
+is_full(struct video_buffer *vb) {
+    unsigned tail = atomic_get_position(&vb->tail);
+    return tail - atomic_get_position(&vb->head) >= vb->capacity;
+}
+
+// must be called from the producer
+static bool
+is_not_full(struct video_buffer *vb) {
+    return !is_full(vb);
+}
+
+// must be called from the producer
+static bool
+is_decoding_slot_free(struct video_buffer *vb) {
+    unsigned tail = atomic_get_position(&vb->tail);
+    return atomic_get_position(&get_slot(vb, tail)->sequence) == tail;
+}
+
+// wait until ready() or interrupted, the consumer posts the semaphore when
+// it takes or releases a frame
+static void
+wait_for_consumer(struct video_buffer *vb,
+                  bool (*ready)(struct video_buffer *),
+                  bool interruptible) {
+    SDL_AtomicSet(&vb->producer_waiting, 1);
+    // check again, the consumer may have changed the state before it could
+    // see the flag
+    if (ready(vb) || (interruptible && SDL_AtomicGet(&vb->interrupted))) {
+        if (!SDL_AtomicCAS(&vb->producer_waiting, 1, 0)) {
+            // the consumer has already reset the flag, consume its post
+            SDL_SemWait(vb->frame_consumed_sem);
+        }
+        return;
+    }
+    SDL_SemWait(vb->frame_consumed_sem);
 }
 
 static void
-video_buffer_swap_frames(struct video_buffer *vb) {
-    AVFrame *tmp = vb->decoding_frame;
-    vb->decoding_frame = vb->rendering_frame;
-    vb->rendering_frame = tmp;
+notify_producer(struct video_buffer *vb) {
+    if (SDL_AtomicCAS(&vb->producer_waiting, 1, 0)) {
+        SDL_SemPost(vb->frame_consumed_sem);
+    }
 }
 
 void
 video_buffer_offer_decoded_frame(struct video_buffer *vb,
                                  bool *previous_frame_skipped) {
-    mutex_lock(vb->mutex);
+    *previous_frame_skipped = false;
+
     if (vb->render_expired_frames) {
-        // wait for the current (expired) frame to be consumed
-        while (!vb->rendering_frame_consumed && !vb->interrupted) {
-            cond_wait(vb->rendering_frame_consumed_cond, vb->mutex);
+        // wait for a pending (expired) frame to be consumed
+        while (is_full(vb) && !SDL_AtomicGet(&vb->interrupted)) {
+            wait_for_consumer(vb, is_not_full, true);
         }
-    } else if (!vb->rendering_frame_consumed) {
-        fps_counter_add_skipped_frame(vb->fps_counter);
     }
 
-    video_buffer_swap_frames(vb);
+    // once interrupted, expired frames are skipped to never block
+    if (is_full(vb)) {
+        unsigned oldest;
+        if (take_frame(vb, &oldest)) {
+            release_frame(vb, oldest);
+            fps_counter_add_skipped_frame(vb->fps_counter);
+            *previous_frame_skipped = true;
+        }
+        // else the consumer took it in the meantime
+    }
 
-    *previous_frame_skipped = !vb->rendering_frame_consumed;
-    vb->rendering_frame_consumed = false;
+    unsigned tail = atomic_get_position(&vb->tail);
+    // publish the frame to the consumer
+    atomic_set_position(&get_slot(vb, tail)->sequence, tail + 1);
 
+    mutex_lock(vb->mutex);
+    vb->has_latest = true;
+    vb->latest_position = tail;
     mutex_unlock(vb->mutex);
+
+    ++tail;
+    atomic_set_position(&vb->tail, tail);
+
+    // the next slot may still be uploaded by the consumer if it has been
+    // stalled while the producer skipped all the frames decoded since
+    while (!is_decoding_slot_free(vb)) {
+        wait_for_consumer(vb, is_decoding_slot_free, false);
+    }
+    vb->decoding_frame = get_slot(vb, tail)->frame;
 }
 
 const AVFrame *
-video_buffer_consume_rendered_frame(struct video_buffer *vb) {
-    assert(!vb->rendering_frame_consumed);
-    vb->rendering_frame_consumed = true;
-    fps_counter_add_rendered_frame(vb->fps_counter);
-    if (vb->render_expired_frames) {
-        // unblock video_buffer_offer_decoded_frame()
-        cond_signal(vb->rendering_frame_consumed_cond);
+video_buffer_take_rendering_frame(struct video_buffer *vb) {
+    unsigned position;
+    if (!take_frame(vb, &position)) {
+        return NULL;
     }
-    return vb->rendering_frame;
+    vb->rendering_position = position;
+    fps_counter_add_rendered_frame(vb->fps_counter);
+    // unblock video_buffer_offer_decoded_frame()
+    notify_producer(vb);
+    return get_slot(vb, position)->frame;
+}
+
+void
+video_buffer_release_rendered_frame(struct video_buffer *vb) {
+    release_frame(vb, vb->rendering_position);
+    notify_producer(vb);
+}
+
+bool
+video_buffer_ref_latest_frame(struct video_buffer *vb, AVFrame *dst) {
+    mutex_lock(vb->mutex);
+    // the latest frame may have been rendered or skipped, but its slot is not
+    // decoded into before another frame becomes the latest one
+    bool ok = vb->has_latest
+           && !av_frame_ref(dst, get_slot(vb, vb->latest_position)->frame);
+    mutex_unlock(vb->mutex);
+    return ok;
 }
 
 void
 video_buffer_interrupt(struct video_buffer *vb) {
-    if (vb->render_expired_frames) {
-        mutex_lock(vb->mutex);
-        vb->interrupted = true;
-        mutex_unlock(vb->mutex);
-        // wake up blocking wait
-        cond_signal(vb->rendering_frame_consumed_cond);
-    }
+    SDL_AtomicSet(&vb->interrupted, 1);
+    // wake up blocking wait
+    notify_producer(vb);
 }
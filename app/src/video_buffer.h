@@ -2,6 +2,7 @@
 #define VIDEO_BUFFER_H
 
 #include <stdbool.h>
+#include <SDL2/SDL_atomic.h>
 #include <SDL2/SDL_mutex.h>
 
 #include "config.h"
@@ -10,37 +11,90 @@
 // forward declarations
 typedef struct AVFrame AVFrame;
 
+struct video_buffer_slot {
+    AVFrame *frame;
+    // position for which the slot is ready to be decoded into (== position)
+    // or rendered (== position + 1)
+    SDL_atomic_t sequence;
+};
+
+// ring of decoded frames waiting to be rendered, from the decoder thread (the
+// producer) to the main thread (the consumer)
+//
+// the frames are decoded directly into the ring slots, and rendered in
+// order, so that a brief rendering stall (e.g. while the window is dragged)
+// delays the frames instead of dropping them. Once the ring is full, the
+// oldest pending frame is skipped (or the decoder waits if expired frames
+// must be rendered).
+//
+// the slots are exchanged without locking: the positions are atomic, and the
+// producer may take the oldest pending frame (to skip it) concurrently with
+// the consumer, so both take a frame using a CAS on the head
 struct video_buffer {
+    // only accessed by the producer
     AVFrame *decoding_frame;
-    AVFrame *rendering_frame;
-    SDL_mutex *mutex;
+    // only accessed by the consumer
+    unsigned rendering_position;
+
+    struct video_buffer_slot *slots;
+    unsigned slot_count;
+    unsigned capacity; // maximum number of pending frames
+
+    SDL_atomic_t head; // position of the next frame to render
+    // only written by the producer
+    SDL_atomic_t tail; // position of the decoding frame
+
     bool render_expired_frames;
-    bool interrupted;
-    SDL_cond *rendering_frame_consumed_cond;
-    bool rendering_frame_consumed;
+    SDL_atomic_t interrupted;
+    // set by the producer when it waits for a pending frame to be rendered
+    SDL_atomic_t producer_waiting;
+    SDL_sem *frame_consumed_sem;
+
+    // only protects latest_position, so that the latest frame may be
+    // referenced from any thread (snapshot)
+    SDL_mutex *mutex;
+    bool has_latest;
+    unsigned latest_position;
+
     struct fps_counter *fps_counter;
 };
 
+// capacity is the number of decoded frames which may wait to be rendered (at
+// least 1)
 bool
 video_buffer_init(struct video_buffer *vb, struct fps_counter *fps_counter,
-                  bool render_expired_frames);
+                  bool render_expired_frames, unsigned capacity);
 
 void
 video_buffer_destroy(struct video_buffer *vb);
 
-// set the decoded frame as ready for rendering
-// this function locks frames->mutex during its execution
-// the output flag is set to report whether the previous frame has been skipped
+// publish the decoded frame (vb->decoding_frame) for rendering, and make
+// vb->decoding_frame point to the next frame to decode into
+// the output flag is set to report whether a previous frame has been skipped
+// (in that case, the number of pending frames is unchanged)
+// must be called from the producer thread
 void
 video_buffer_offer_decoded_frame(struct video_buffer *vb,
                                  bool *previous_frame_skipped);
 
-// mark the rendering frame as consumed and return it
-// MUST be called with frames->mutex locked!!!
-// the caller is expected to render the returned frame to some texture before
-// unlocking frames->mutex
+// take the oldest pending frame for rendering, or return NULL if there is
+// none
+// the frame remains valid until video_buffer_release_rendered_frame() is
+// called
+// must be called from the consumer thread
 const AVFrame *
-video_buffer_consume_rendered_frame(struct video_buffer *vb);
+video_buffer_take_rendering_frame(struct video_buffer *vb);
+
+// release the frame returned by video_buffer_take_rendering_frame()
+void
+video_buffer_release_rendered_frame(struct video_buffer *vb);
+
+// reference the latest decoded frame into dst (which must be unreferenced)
+// this function locks vb->mutex only for the time needed to reference the
+// frame, the frame data is not copied
+// return false if no frame has been decoded yet
+bool
+video_buffer_ref_latest_frame(struct video_buffer *vb, AVFrame *dst);
 
 // wake up and avoid any blocking call
 void
@@ -0,0 +1,243 @@
+#include "yuv_convert.h"
+
+#include <assert.h>
+#include <SDL2/SDL_cpuinfo.h>
+#include <SDL2/SDL_stdinc.h>
+#include <SDL2/SDL_version.h>
+
+#include "config.h"
+#include "yuv_kernels.h"
+#include "util/log.h"
+
+static inline int
+mulhi(int a, int coef) {
+    // arithmetic shift, like the SIMD instructions
+    return (a * coef) >> 16;
+}
+
+static inline uint8_t
+clip(int value) {
+    return value < 0 ? 0 : value > 255 ? 255 : value;
+}
+
+static int
+convert_row_scalar(const uint8_t *y, const uint8_t *u, const uint8_t *v,
+                   uint8_t *dst, int start, int width,
+                   enum yuv_convert_format format, bool chroma_subsampled) {
+    int bpp = yuv_convert_bytes_per_pixel(format);
+    for (int x = start; x < width; ++x) {
+        int c = chroma_subsampled ? x / 2 : x;
+        // multiplied rather than shifted, the values may be negative
+        int yt = mulhi((y[x] - 16) * 64 + YUV_ROUND_Y, YUV_COEF_Y);
+        int d6 = (u[c] - 128) * 64;
+        int e6 = (v[c] - 128) * 64;
+        uint8_t r = clip(yt + mulhi(e6, YUV_COEF_RV));
+        uint8_t g = clip(yt - mulhi(d6, YUV_COEF_GU) - mulhi(e6, YUV_COEF_GV));
+        uint8_t b = clip(yt + mulhi(d6, YUV_COEF_BU));
+
+        uint8_t *p = &dst[x * bpp];
+        switch (format) {
+            case YUV_CONVERT_FORMAT_RGB24:
+                p[0] = r;
+                p[1] = g;
+                p[2] = b;
+                break;
+            case YUV_CONVERT_FORMAT_BGR24:
+                p[0] = b;
+                p[1] = g;
+                p[2] = r;
+                break;
+            case YUV_CONVERT_FORMAT_RGBA:
+                p[0] = r;
+                p[1] = g;
+                p[2] = b;
+                p[3] = 255;
+                break;
+            case YUV_CONVERT_FORMAT_GRAY8:
+                p[0] = clip(yt);
+                break;
+        }
+    }
+    return width;
+}
+
+static int
+half_row_scalar(const uint8_t *row0, const uint8_t *row1, uint8_t *dst,
+                int start, int out_width) {
+    for (int x = start; x < out_width; ++x) {
+        // rounded up at each step, like the SIMD averaging instructions
+        int left = (row0[2 * x] + row1[2 * x] + 1) >> 1;
+        int right = (row0[2 * x + 1] + row1[2 * x + 1] + 1) >> 1;
+        dst[x] = (left + right + 1) >> 1;
+    }
+    return out_width;
+}
+
+static const struct yuv_kernels *
+get_kernels(enum yuv_convert_impl impl) {
+    switch (impl) {
+#ifdef YUV_KERNELS_X86
+        case YUV_CONVERT_IMPL_SSE2:
+            return &yuv_kernels_sse2;
+        case YUV_CONVERT_IMPL_AVX2:
+            return &yuv_kernels_avx2;
+#endif
+#ifdef YUV_KERNELS_NEON
+        case YUV_CONVERT_IMPL_NEON:
+            return &yuv_kernels_neon;
+#endif
+        default:
+            // scalar
+            return NULL;
+    }
+}
+
+bool
+yuv_convert_impl_available(enum yuv_convert_impl impl) {
+    switch (impl) {
+        case YUV_CONVERT_IMPL_SCALAR:
+            return true;
+#ifdef YUV_KERNELS_X86
+        case YUV_CONVERT_IMPL_SSE2:
+            return SDL_HasSSE2();
+# if SDL_VERSION_ATLEAST(2, 0, 4)
+        case YUV_CONVERT_IMPL_AVX2:
+            return SDL_HasAVX2();
+# endif
+#endif
+#ifdef YUV_KERNELS_NEON
+        case YUV_CONVERT_IMPL_NEON:
+# if defined(__aarch64__)
+            return true;
+# elif SDL_VERSION_ATLEAST(2, 0, 6)
+            return SDL_HasNEON();
+# endif
+#endif
+        default:
+            return false;
+    }
+}
+
+enum yuv_convert_impl
+yuv_convert_best_impl(void) {
+    for (int impl = YUV_CONVERT_IMPL_COUNT - 1; impl > 0; --impl) {
+        if (yuv_convert_impl_available(impl)) {
+            return impl;
+        }
+    }
+    return YUV_CONVERT_IMPL_SCALAR;
+}
+
+const char *
+yuv_convert_impl_name(enum yuv_convert_impl impl) {
+    static const char *const names[] = {
+        [YUV_CONVERT_IMPL_SCALAR] = "scalar",
+        [YUV_CONVERT_IMPL_SSE2] = "sse2",
+        [YUV_CONVERT_IMPL_AVX2] = "avx2",
+        [YUV_CONVERT_IMPL_NEON] = "neon",
+    };
+    assert(impl < YUV_CONVERT_IMPL_COUNT);
+    return names[impl];
+}
+
+int
+yuv_convert_bytes_per_pixel(enum yuv_convert_format format) {
+    switch (format) {
+        case YUV_CONVERT_FORMAT_RGBA:
+            return 4;
+        case YUV_CONVERT_FORMAT_GRAY8:
+            return 1;
+        default:
+            return 3;
+    }
+}
+
+static void
+convert_row(const struct yuv_kernels *kernels, const uint8_t *y,
+            const uint8_t *u, const uint8_t *v, uint8_t *dst, int width,
+            enum yuv_convert_format format, bool chroma_subsampled) {
+    int done = kernels ? kernels->convert_row(y, u, v, dst, width, format,
+                                              chroma_subsampled)
+                       : 0;
+    convert_row_scalar(y, u, v, dst, done, width, format, chroma_subsampled);
+}
+
+static void
+half_row(const struct yuv_kernels *kernels, const uint8_t *row0,
+         const uint8_t *row1, uint8_t *dst, int out_width) {
+    int done = kernels ? kernels->half_row(row0, row1, dst, out_width) : 0;
+    half_row_scalar(row0, row1, dst, done, out_width);
+}
+
+bool
+yuv_convert_with_impl(enum yuv_convert_impl impl, const AVFrame *src,
+                      enum yuv_convert_format format, int factor,
+                      uint8_t *dst, int dst_linesize) {
+    assert(src->format == AV_PIX_FMT_YUV420P);
+    assert(factor == 1 || factor == 2 || factor == 4);
+    assert(yuv_convert_impl_available(impl));
+
+    const struct yuv_kernels *kernels = get_kernels(impl);
+    const uint8_t *const *data = (const uint8_t *const *) src->data;
+    const int *linesize = src->linesize;
+    int width = src->width / factor;
+    int height = src->height / factor;
+
+    if (factor == 1) {
+        for (int j = 0; j < height; ++j) {
+            convert_row(kernels, data[0] + j * linesize[0],
+                        data[1] + j / 2 * linesize[1],
+                        data[2] + j / 2 * linesize[2],
+                        dst + j * dst_linesize, width, format, true);
+        }
+        return true;
+    }
+
+    // the downscaled luma (and chroma, for 4x) rows, so that there is one
+    // chroma sample per output pixel
+    uint8_t *tmp = SDL_malloc(5 * (size_t) src->width);
+    if (!tmp) {
+        LOGC("Could not allocate conversion buffer");
+        return false;
+    }
+
+    if (factor == 2) {
+        uint8_t *y = tmp;
+        for (int j = 0; j < height; ++j) {
+            half_row(kernels, data[0] + 2 * j * linesize[0],
+                     data[0] + (2 * j + 1) * linesize[0], y, width);
+            convert_row(kernels, y, data[1] + j * linesize[1],
+                        data[2] + j * linesize[2],
+                        dst + j * dst_linesize, width, format, false);
+        }
+    } else {
+        uint8_t *y0 = tmp;
+        uint8_t *y1 = y0 + src->width;
+        uint8_t *y = y1 + src->width;
+        uint8_t *u = y + src->width;
+        uint8_t *v = u + src->width;
+        for (int j = 0; j < height; ++j) {
+            half_row(kernels, data[0] + 4 * j * linesize[0],
+                     data[0] + (4 * j + 1) * linesize[0], y0, 2 * width);
+            half_row(kernels, data[0] + (4 * j + 2) * linesize[0],
+                     data[0] + (4 * j + 3) * linesize[0], y1, 2 * width);
+            half_row(kernels, y0, y1, y, width);
+            half_row(kernels, data[1] + 2 * j * linesize[1],
+                     data[1] + (2 * j + 1) * linesize[1], u, width);
+            half_row(kernels, data[2] + 2 * j * linesize[2],
+                     data[2] + (2 * j + 1) * linesize[2], v, width);
+            convert_row(kernels, y, u, v, dst + j * dst_linesize, width,
+                        format, false);
+        }
+    }
+
+    SDL_free(tmp);
+    return true;
+}
+
+bool
+yuv_convert(const AVFrame *src, enum yuv_convert_format format, int factor,
+            uint8_t *dst, int dst_linesize) {
+    return yuv_convert_with_impl(yuv_convert_best_impl(), src, format, factor,
+                                 dst, dst_linesize);
+}
@@ -0,0 +1,59 @@
+#ifndef YUV_CONVERT_H
+#define YUV_CONVERT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <libavutil/frame.h>
+
+#include "config.h"
+
+// YUV420P (BT.601, limited range, as decoded from the device stream) to RGB
+// or gray conversion, optionally downscaled by 2 or 4 in the same pass
+//
+// it is much faster than swscale for these specific conversions, which are
+// needed for every frame by the analysis consumers
+
+enum yuv_convert_format {
+    YUV_CONVERT_FORMAT_RGB24,
+    YUV_CONVERT_FORMAT_BGR24,
+    YUV_CONVERT_FORMAT_RGBA, // alpha is 255
+    YUV_CONVERT_FORMAT_GRAY8, // full range
+};
+
+enum yuv_convert_impl {
+    YUV_CONVERT_IMPL_SCALAR,
+    YUV_CONVERT_IMPL_SSE2,
+    YUV_CONVERT_IMPL_AVX2,
+    YUV_CONVERT_IMPL_NEON,
+    YUV_CONVERT_IMPL_COUNT,
+};
+
+// whether the implementation is compiled in and supported by the CPU
+bool
+yuv_convert_impl_available(enum yuv_convert_impl impl);
+
+// the fastest available implementation
+enum yuv_convert_impl
+yuv_convert_best_impl(void);
+
+const char *
+yuv_convert_impl_name(enum yuv_convert_impl impl);
+
+int
+yuv_convert_bytes_per_pixel(enum yuv_convert_format format);
+
+// convert the YUV420P (limited range) frame src, downscaled by factor (1, 2
+// or 4), to dst
+// the destination size is (src->width / factor) x (src->height / factor)
+// all implementations produce exactly the same output
+bool
+yuv_convert_with_impl(enum yuv_convert_impl impl, const AVFrame *src,
+                      enum yuv_convert_format format, int factor,
+                      uint8_t *dst, int dst_linesize);
+
+// convert using the fastest available implementation
+bool
+yuv_convert(const AVFrame *src, enum yuv_convert_format format, int factor,
+            uint8_t *dst, int dst_linesize);
+
+#endif
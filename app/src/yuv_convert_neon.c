@@ -0,0 +1,118 @@
+#include "yuv_kernels.h"
+
+#ifdef YUV_KERNELS_NEON
+
+#include <arm_neon.h>
+
+// (a * coef) >> 16, rounded down like the scalar and x86 kernels
+static inline int16x8_t
+mulhi(int16x8_t a, int16_t coef) {
+    int32x4_t lo = vmull_n_s16(vget_low_s16(a), coef);
+    int32x4_t hi = vmull_n_s16(vget_high_s16(a), coef);
+    return vcombine_s16(vshrn_n_s32(lo, 16), vshrn_n_s32(hi, 16));
+}
+
+static inline int16x8_t
+widen(uint8x8_t value) {
+    return vreinterpretq_s16_u16(vmovl_u8(value));
+}
+
+// compute 8 pixels of R, G, B and luma, saturated to 8 bits
+static inline void
+yuv_to_rgb(int16x8_t y, int16x8_t u, int16x8_t v, uint8x8_t *r,
+           uint8x8_t *g, uint8x8_t *b, uint8x8_t *gray) {
+    int16x8_t c6 = vaddq_s16(vshlq_n_s16(vsubq_s16(y, vdupq_n_s16(16)), 6),
+                             vdupq_n_s16(YUV_ROUND_Y));
+    int16x8_t d6 = vshlq_n_s16(vsubq_s16(u, vdupq_n_s16(128)), 6);
+    int16x8_t e6 = vshlq_n_s16(vsubq_s16(v, vdupq_n_s16(128)), 6);
+    int16x8_t yt = mulhi(c6, YUV_COEF_Y);
+    *r = vqmovun_s16(vaddq_s16(yt, mulhi(e6, YUV_COEF_RV)));
+    *g = vqmovun_s16(vsubq_s16(vsubq_s16(yt, mulhi(d6, YUV_COEF_GU)),
+                               mulhi(e6, YUV_COEF_GV)));
+    *b = vqmovun_s16(vaddq_s16(yt, mulhi(d6, YUV_COEF_BU)));
+    *gray = vqmovun_s16(yt);
+}
+
+static int
+convert_row_neon(const uint8_t *y, const uint8_t *u, const uint8_t *v,
+                 uint8_t *dst, int width, enum yuv_convert_format format,
+                 bool chroma_subsampled) {
+    int bpp = yuv_convert_bytes_per_pixel(format);
+
+    int x = 0;
+    for (; x + 16 <= width; x += 16) {
+        uint8x16_t y8 = vld1q_u8(y + x);
+        uint8x8_t u_lo, u_hi, v_lo, v_hi;
+        if (chroma_subsampled) {
+            // each chroma sample is used for 2 pixels
+            uint8x8x2_t uu = vzip_u8(vld1_u8(u + x / 2), vld1_u8(u + x / 2));
+            uint8x8x2_t vv = vzip_u8(vld1_u8(v + x / 2), vld1_u8(v + x / 2));
+            u_lo = uu.val[0];
+            u_hi = uu.val[1];
+            v_lo = vv.val[0];
+            v_hi = vv.val[1];
+        } else {
+            uint8x16_t u8 = vld1q_u8(u + x);
+            uint8x16_t v8 = vld1q_u8(v + x);
+            u_lo = vget_low_u8(u8);
+            u_hi = vget_high_u8(u8);
+            v_lo = vget_low_u8(v8);
+            v_hi = vget_high_u8(v8);
+        }
+
+        uint8x8_t r_lo, g_lo, b_lo, y_lo;
+        uint8x8_t r_hi, g_hi, b_hi, y_hi;
+        yuv_to_rgb(widen(vget_low_u8(y8)), widen(u_lo), widen(v_lo),
+                   &r_lo, &g_lo, &b_lo, &y_lo);
+        yuv_to_rgb(widen(vget_high_u8(y8)), widen(u_hi), widen(v_hi),
+                   &r_hi, &g_hi, &b_hi, &y_hi);
+        uint8x16_t r = vcombine_u8(r_lo, r_hi);
+        uint8x16_t g = vcombine_u8(g_lo, g_hi);
+        uint8x16_t b = vcombine_u8(b_lo, b_hi);
+
+        uint8_t *p = dst + x * bpp;
+        switch (format) {
+            case YUV_CONVERT_FORMAT_RGB24: {
+                uint8x16x3_t rgb = {{r, g, b}};
+                vst3q_u8(p, rgb);
+                break;
+            }
+            case YUV_CONVERT_FORMAT_BGR24: {
+                uint8x16x3_t bgr = {{b, g, r}};
+                vst3q_u8(p, bgr);
+                break;
+            }
+            case YUV_CONVERT_FORMAT_RGBA: {
+                uint8x16x4_t rgba = {{r, g, b, vdupq_n_u8(255)}};
+                vst4q_u8(p, rgba);
+                break;
+            }
+            case YUV_CONVERT_FORMAT_GRAY8:
+                vst1q_u8(p, vcombine_u8(y_lo, y_hi));
+                break;
+        }
+    }
+    return x;
+}
+
+static int
+half_row_neon(const uint8_t *row0, const uint8_t *row1, uint8_t *dst,
+              int out_width) {
+    int x = 0;
+    for (; x + 16 <= out_width; x += 16) {
+        // deinterleave the even and odd columns
+        uint8x16x2_t a = vld2q_u8(row0 + 2 * x);
+        uint8x16x2_t b = vld2q_u8(row1 + 2 * x);
+        uint8x16_t left = vrhaddq_u8(a.val[0], b.val[0]);
+        uint8x16_t right = vrhaddq_u8(a.val[1], b.val[1]);
+        vst1q_u8(dst + x, vrhaddq_u8(left, right));
+    }
+    return x;
+}
+
+const struct yuv_kernels yuv_kernels_neon = {
+    .convert_row = convert_row_neon,
+    .half_row = half_row_neon,
+};
+
+#endif
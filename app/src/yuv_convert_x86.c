@@ -0,0 +1,254 @@
+#include "yuv_kernels.h"
+
+#ifdef YUV_KERNELS_X86
+
+#include <immintrin.h>
+
+// the kernels are compiled for their instruction set with target attributes,
+// and only called if the CPU supports it
+#define TARGET_SSE2 __attribute__((target("sse2")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+
+// store 16 pixels from the 8-bit R, G, B (and luma for gray) vectors
+static inline TARGET_SSE2 void
+store_pixels(uint8_t *dst, __m128i r, __m128i g, __m128i b, __m128i y,
+             enum yuv_convert_format format) {
+    if (format == YUV_CONVERT_FORMAT_GRAY8) {
+        _mm_storeu_si128((__m128i *) dst, y);
+        return;
+    }
+
+    if (format == YUV_CONVERT_FORMAT_BGR24) {
+        __m128i tmp = r;
+        r = b;
+        b = tmp;
+    }
+
+    __m128i a = _mm_set1_epi8((char) 0xff);
+    __m128i rg_lo = _mm_unpacklo_epi8(r, g);
+    __m128i rg_hi = _mm_unpackhi_epi8(r, g);
+    __m128i ba_lo = _mm_unpacklo_epi8(b, a);
+    __m128i ba_hi = _mm_unpackhi_epi8(b, a);
+    // 4 RGBA pixels per vector
+    __m128i p[4] = {
+        _mm_unpacklo_epi16(rg_lo, ba_lo),
+        _mm_unpackhi_epi16(rg_lo, ba_lo),
+        _mm_unpacklo_epi16(rg_hi, ba_hi),
+        _mm_unpackhi_epi16(rg_hi, ba_hi),
+    };
+
+    if (format == YUV_CONVERT_FORMAT_RGBA) {
+        for (int i = 0; i < 4; ++i) {
+            _mm_storeu_si128((__m128i *) (dst + 16 * i), p[i]);
+        }
+        return;
+    }
+
+    // RGB24/BGR24: remove the alpha bytes, each pair of pixels in a 64-bit
+    // half becomes 6 contiguous bytes
+    __m128i mask_lo = _mm_set1_epi64x(0x0000000000ffffffLL);
+    __m128i mask_hi = _mm_set1_epi64x(0x0000ffffff000000LL);
+    for (int i = 0; i < 4; ++i) {
+        __m128i t = _mm_or_si128(_mm_and_si128(p[i], mask_lo),
+                                 _mm_and_si128(_mm_srli_epi64(p[i], 8),
+                                               mask_hi));
+        // each store writes 2 extra bytes, overwritten by the next one (the
+        // last one writes 2 bytes past the 16 pixels)
+        _mm_storel_epi64((__m128i *) (dst + 12 * i), t);
+        _mm_storel_epi64((__m128i *) (dst + 12 * i + 6),
+                         _mm_unpackhi_epi64(t, t));
+    }
+}
+
+// number of pixels which must follow the 16 pixels of an iteration
+static inline int
+get_slack(enum yuv_convert_format format) {
+    // RGB24/BGR24 stores write 2 bytes past the 16 pixels
+    return format == YUV_CONVERT_FORMAT_RGB24
+        || format == YUV_CONVERT_FORMAT_BGR24;
+}
+
+// compute 8 pixels of R, G, B and luma (16-bit lanes)
+static inline TARGET_SSE2 void
+yuv_to_rgb_sse2(__m128i y, __m128i u, __m128i v, __m128i *r, __m128i *g,
+                __m128i *b, __m128i *yt) {
+    __m128i c6 = _mm_add_epi16(
+            _mm_slli_epi16(_mm_sub_epi16(y, _mm_set1_epi16(16)), 6),
+            _mm_set1_epi16(YUV_ROUND_Y));
+    __m128i d6 = _mm_slli_epi16(_mm_sub_epi16(u, _mm_set1_epi16(128)), 6);
+    __m128i e6 = _mm_slli_epi16(_mm_sub_epi16(v, _mm_set1_epi16(128)), 6);
+    *yt = _mm_mulhi_epi16(c6, _mm_set1_epi16(YUV_COEF_Y));
+    *r = _mm_add_epi16(*yt, _mm_mulhi_epi16(e6, _mm_set1_epi16(YUV_COEF_RV)));
+    *g = _mm_sub_epi16(_mm_sub_epi16(*yt, _mm_mulhi_epi16(d6,
+                                            _mm_set1_epi16(YUV_COEF_GU))),
+                       _mm_mulhi_epi16(e6, _mm_set1_epi16(YUV_COEF_GV)));
+    *b = _mm_add_epi16(*yt, _mm_mulhi_epi16(d6, _mm_set1_epi16(YUV_COEF_BU)));
+}
+
+static TARGET_SSE2 int
+convert_row_sse2(const uint8_t *y, const uint8_t *u, const uint8_t *v,
+                 uint8_t *dst, int width, enum yuv_convert_format format,
+                 bool chroma_subsampled) {
+    int bpp = yuv_convert_bytes_per_pixel(format);
+    int slack = get_slack(format);
+    __m128i zero = _mm_setzero_si128();
+
+    int x = 0;
+    for (; x + 16 + slack <= width; x += 16) {
+        __m128i y8 = _mm_loadu_si128((const __m128i *) (y + x));
+        __m128i u_lo, u_hi, v_lo, v_hi;
+        if (chroma_subsampled) {
+            __m128i u8 = _mm_loadl_epi64((const __m128i *) (u + x / 2));
+            __m128i v8 = _mm_loadl_epi64((const __m128i *) (v + x / 2));
+            __m128i u16 = _mm_unpacklo_epi8(u8, zero);
+            __m128i v16 = _mm_unpacklo_epi8(v8, zero);
+            // each chroma sample is used for 2 pixels
+            u_lo = _mm_unpacklo_epi16(u16, u16);
+            u_hi = _mm_unpackhi_epi16(u16, u16);
+            v_lo = _mm_unpacklo_epi16(v16, v16);
+            v_hi = _mm_unpackhi_epi16(v16, v16);
+        } else {
+            __m128i u8 = _mm_loadu_si128((const __m128i *) (u + x));
+            __m128i v8 = _mm_loadu_si128((const __m128i *) (v + x));
+            u_lo = _mm_unpacklo_epi8(u8, zero);
+            u_hi = _mm_unpackhi_epi8(u8, zero);
+            v_lo = _mm_unpacklo_epi8(v8, zero);
+            v_hi = _mm_unpackhi_epi8(v8, zero);
+        }
+
+        __m128i r_lo, g_lo, b_lo, y_lo;
+        __m128i r_hi, g_hi, b_hi, y_hi;
+        yuv_to_rgb_sse2(_mm_unpacklo_epi8(y8, zero), u_lo, v_lo,
+                        &r_lo, &g_lo, &b_lo, &y_lo);
+        yuv_to_rgb_sse2(_mm_unpackhi_epi8(y8, zero), u_hi, v_hi,
+                        &r_hi, &g_hi, &b_hi, &y_hi);
+
+        store_pixels(dst + x * bpp,
+                     _mm_packus_epi16(r_lo, r_hi),
+                     _mm_packus_epi16(g_lo, g_hi),
+                     _mm_packus_epi16(b_lo, b_hi),
+                     _mm_packus_epi16(y_lo, y_hi), format);
+    }
+    return x;
+}
+
+// average the 2x2 blocks of 32 bytes of two rows
+static inline TARGET_SSE2 __m128i
+half_sse2(const uint8_t *row0, const uint8_t *row1) {
+    __m128i mask = _mm_set1_epi16(0x00ff);
+    __m128i h[2];
+    for (int i = 0; i < 2; ++i) {
+        __m128i a = _mm_loadu_si128((const __m128i *) (row0 + 16 * i));
+        __m128i b = _mm_loadu_si128((const __m128i *) (row1 + 16 * i));
+        __m128i vertical = _mm_avg_epu8(a, b);
+        h[i] = _mm_avg_epu16(_mm_and_si128(vertical, mask),
+                             _mm_srli_epi16(vertical, 8));
+    }
+    return _mm_packus_epi16(h[0], h[1]);
+}
+
+static TARGET_SSE2 int
+half_row_sse2(const uint8_t *row0, const uint8_t *row1, uint8_t *dst,
+              int out_width) {
+    int x = 0;
+    for (; x + 16 <= out_width; x += 16) {
+        _mm_storeu_si128((__m128i *) (dst + x),
+                         half_sse2(row0 + 2 * x, row1 + 2 * x));
+    }
+    return x;
+}
+
+const struct yuv_kernels yuv_kernels_sse2 = {
+    .convert_row = convert_row_sse2,
+    .half_row = half_row_sse2,
+};
+
+// the 16 pixels are computed at once in 16-bit lanes
+static TARGET_AVX2 int
+convert_row_avx2(const uint8_t *y, const uint8_t *u, const uint8_t *v,
+                 uint8_t *dst, int width, enum yuv_convert_format format,
+                 bool chroma_subsampled) {
+    int bpp = yuv_convert_bytes_per_pixel(format);
+    int slack = get_slack(format);
+
+    int x = 0;
+    for (; x + 16 + slack <= width; x += 16) {
+        __m256i y16 = _mm256_cvtepu8_epi16(
+                _mm_loadu_si128((const __m128i *) (y + x)));
+        __m128i u8, v8;
+        if (chroma_subsampled) {
+            u8 = _mm_loadl_epi64((const __m128i *) (u + x / 2));
+            v8 = _mm_loadl_epi64((const __m128i *) (v + x / 2));
+            // each chroma sample is used for 2 pixels
+            u8 = _mm_unpacklo_epi8(u8, u8);
+            v8 = _mm_unpacklo_epi8(v8, v8);
+        } else {
+            u8 = _mm_loadu_si128((const __m128i *) (u + x));
+            v8 = _mm_loadu_si128((const __m128i *) (v + x));
+        }
+        __m256i u16 = _mm256_cvtepu8_epi16(u8);
+        __m256i v16 = _mm256_cvtepu8_epi16(v8);
+
+        __m256i c6 = _mm256_add_epi16(_mm256_slli_epi16(
+                _mm256_sub_epi16(y16, _mm256_set1_epi16(16)), 6),
+                _mm256_set1_epi16(YUV_ROUND_Y));
+        __m256i d6 = _mm256_slli_epi16(
+                _mm256_sub_epi16(u16, _mm256_set1_epi16(128)), 6);
+        __m256i e6 = _mm256_slli_epi16(
+                _mm256_sub_epi16(v16, _mm256_set1_epi16(128)), 6);
+        __m256i yt = _mm256_mulhi_epi16(c6, _mm256_set1_epi16(YUV_COEF_Y));
+        __m256i r = _mm256_add_epi16(yt,
+                _mm256_mulhi_epi16(e6, _mm256_set1_epi16(YUV_COEF_RV)));
+        __m256i g = _mm256_sub_epi16(_mm256_sub_epi16(yt,
+                _mm256_mulhi_epi16(d6, _mm256_set1_epi16(YUV_COEF_GU))),
+                _mm256_mulhi_epi16(e6, _mm256_set1_epi16(YUV_COEF_GV)));
+        __m256i b = _mm256_add_epi16(yt,
+                _mm256_mulhi_epi16(d6, _mm256_set1_epi16(YUV_COEF_BU)));
+
+        // the packing works per 128-bit lane, reorder the 64-bit quarters so
+        // that each 128-bit half contains the 16 values of one vector
+        __m256i rg = _mm256_permute4x64_epi64(_mm256_packus_epi16(r, g),
+                                              0xd8);
+        __m256i by = _mm256_permute4x64_epi64(_mm256_packus_epi16(b, yt),
+                                              0xd8);
+
+        store_pixels(dst + x * bpp,
+                     _mm256_castsi256_si128(rg),
+                     _mm256_extracti128_si256(rg, 1),
+                     _mm256_castsi256_si128(by),
+                     _mm256_extracti128_si256(by, 1), format);
+    }
+    return x;
+}
+
+static TARGET_AVX2 int
+half_row_avx2(const uint8_t *row0, const uint8_t *row1, uint8_t *dst,
+              int out_width) {
+    __m256i mask = _mm256_set1_epi16(0x00ff);
+    int x = 0;
+    for (; x + 32 <= out_width; x += 32) {
+        __m256i h[2];
+        for (int i = 0; i < 2; ++i) {
+            const uint8_t *p0 = row0 + 2 * x + 32 * i;
+            const uint8_t *p1 = row1 + 2 * x + 32 * i;
+            __m256i a = _mm256_loadu_si256((const __m256i *) p0);
+            __m256i b = _mm256_loadu_si256((const __m256i *) p1);
+            __m256i vertical = _mm256_avg_epu8(a, b);
+            h[i] = _mm256_avg_epu16(_mm256_and_si256(vertical, mask),
+                                    _mm256_srli_epi16(vertical, 8));
+        }
+        __m256i packed = _mm256_permute4x64_epi64(
+                _mm256_packus_epi16(h[0], h[1]), 0xd8);
+        _mm256_storeu_si256((__m256i *) (dst + x), packed);
+    }
+    // the remaining blocks of 16 pixels
+    return x + half_row_sse2(row0 + 2 * x, row1 + 2 * x, dst + x,
+                             out_width - x);
+}
+
+const struct yuv_kernels yuv_kernels_avx2 = {
+    .convert_row = convert_row_avx2,
+    .half_row = half_row_avx2,
+};
+
+#endif
@@ -0,0 +1,57 @@
+#ifndef YUV_KERNELS_H
+#define YUV_KERNELS_H
+
+// internal to yuv_convert
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "config.h"
+#include "yuv_convert.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+# define YUV_KERNELS_X86
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+# define YUV_KERNELS_NEON
+#endif
+
+// BT.601 limited range to full range RGB, in fixed point, computed exactly as
+// the SIMD kernels do with 16-bit lanes:
+//   mulhi(x << 6, coef) == (x * coef / 4) >> 8 (rounded down)
+// so that all implementations produce the same output
+#define YUV_COEF_Y 1192 // 1.164 * 1024
+#define YUV_COEF_RV 1636 // 1.596 * 1024
+#define YUV_COEF_GU 400 // 0.391 * 1024
+#define YUV_COEF_GV 832 // 0.813 * 1024
+#define YUV_COEF_BU 2064 // 2.018 * 1024
+// added to the luma (shifted by 6) so that it is rounded to nearest (255 for
+// white) instead of down
+#define YUV_ROUND_Y 32
+
+struct yuv_kernels {
+    // convert a row of width pixels (the chroma samples are shared by 2
+    // pixels if chroma_subsampled, or there is one per pixel otherwise)
+    // return the number of pixels converted, the remaining ones are converted
+    // by the caller
+    int (*convert_row)(const uint8_t *y, const uint8_t *u, const uint8_t *v,
+                       uint8_t *dst, int width, enum yuv_convert_format format,
+                       bool chroma_subsampled);
+    // average the 2x2 blocks of two rows into out_width pixels
+    // return the number of pixels computed, the remaining ones are computed
+    // by the caller
+    int (*half_row)(const uint8_t *row0, const uint8_t *row1, uint8_t *dst,
+                    int out_width);
+};
+
+#ifdef YUV_KERNELS_X86
+extern const struct yuv_kernels yuv_kernels_sse2;
+extern const struct yuv_kernels yuv_kernels_avx2;
+#endif
+
+#ifdef YUV_KERNELS_NEON
+extern const struct yuv_kernels yuv_kernels_neon;
+#endif
+
+#endif
@@ -107,6 +107,34 @@ static void test_options2(void) {
         "--no-control",
         "--no-display",
         "--record", "file.mp4", // cannot enable --no-display without recording
+        "--record-raw", "session.raw",
+        "--record-queue-bytes", "16M",
+        "--record-queue-packets", "256",
+        "--record-queue-policy", "drop-gop",
+        "--record-segment-duration", "600",
+        "--record-segment-size", "500M",
+        "--record-fragmented",
+        "--record-write-size", "4M",
+        "--record-sync-interval", "1000",
+        "--record-direct-io",
+        "--record-path", "rec-%n.mp4",
+        "--replay-buffer", "30",
+        "--replay-path", "replay-%n.mkv",
+        "--decoder-queue-depth", "4",
+        "--decoder-queue-policy", "drop-until-keyframe",
+        "--decoder-profile", "throughput",
+        "--decoder-threads", "4",
+        "--frame-buffer", "3",
+        "--texture-frames",
+        "--dedup-frames",
+        "--screenshot-path", "shot-%n.jpg",
+        "--screenshot-quality", "75",
+        "--screenshot-compression", "1",
+        "--no-tcp-nodelay",
+        "--tcp-quickack",
+        "--tcp-keepalive",
+        "--socket-buffer-size", "2M",
+        "--external-server", // not compatible with "--show-touches"
     };
 
     bool ok = scrcpy_parse_args(&args, ARRAY_LEN(argv), argv);
@@ -117,6 +145,104 @@ static void test_options2(void) {
     assert(!opts->display);
     assert(!strcmp(opts->record_filename, "file.mp4"));
     assert(opts->record_format == RECORDER_FORMAT_MP4);
+    assert(!strcmp(opts->record_raw_filename, "session.raw"));
+    assert(opts->record_queue_bytes == 16000000);
+    assert(opts->record_queue_packets == 256);
+    assert(opts->record_queue_policy == RECORDER_QUEUE_POLICY_DROP_GOP);
+    assert(opts->record_segment_duration == 600);
+    assert(opts->record_segment_size == 500000000);
+    assert(opts->record_fragmented);
+    assert(opts->record_write_size == 4000000);
+    assert(opts->record_sync_interval == 1000);
+    assert(opts->record_direct_io);
+    assert(!strcmp(opts->record_path, "rec-%n.mp4"));
+    assert(opts->record_path_format == RECORDER_FORMAT_MP4);
+    assert(opts->replay_duration == 30);
+    assert(!strcmp(opts->replay_path, "replay-%n.mkv"));
+    assert(opts->replay_format == RECORDER_FORMAT_MKV);
+    assert(opts->decoder_queue_depth == 4);
+    assert(opts->decoder_queue_policy
+            == PACKET_QUEUE_POLICY_DROP_UNTIL_KEYFRAME);
+    assert(opts->decoder_profile == DECODER_PROFILE_THROUGHPUT);
+    assert(opts->decoder_threads == 4);
+    assert(opts->frame_buffer == 3);
+    assert(opts->texture_frames);
+    assert(opts->dedup_frames);
+    assert(!strcmp(opts->screenshot_path, "shot-%n.jpg"));
+    assert(opts->screenshot_format == SNAPSHOT_FORMAT_JPEG);
+    assert(opts->screenshot_quality == 75);
+    assert(opts->screenshot_compression == 1);
+    assert(!opts->tcp_nodelay);
+    assert(opts->tcp_quickack);
+    assert(opts->tcp_keepalive);
+    assert(opts->socket_buffer_size == 2000000);
+    assert(opts->external_server);
+}
+
+static void test_headless(void) {
+    struct scrcpy_cli_args args = {
+        .opts = SCRCPY_OPTIONS_DEFAULT,
+        .help = false,
+        .version = false,
+    };
+
+    char *argv[] = {
+        "scrcpy",
+        "--headless",
+        "--frame-log", "frames.csv",
+        "--external-server",
+    };
+
+    bool ok = scrcpy_parse_args(&args, ARRAY_LEN(argv), argv);
+    assert(ok);
+
+    const struct scrcpy_options *opts = &args.opts;
+    assert(opts->headless);
+    assert(!strcmp(opts->frame_log_filename, "frames.csv"));
+
+    // nothing to render without display
+    char *argv2[] = {
+        "scrcpy",
+        "--headless",
+        "--no-display",
+        "--record", "file.mp4",
+    };
+
+    args.opts = (struct scrcpy_options) SCRCPY_OPTIONS_DEFAULT;
+    ok = scrcpy_parse_args(&args, ARRAY_LEN(argv2), argv2);
+    assert(!ok);
+}
+
+static void test_record_events(void) {
+    struct scrcpy_cli_args args = {
+        .opts = SCRCPY_OPTIONS_DEFAULT,
+        .help = false,
+        .version = false,
+    };
+
+    // the default --record-path (mp4) does not prevent recording the events
+    // in the --record file
+    char *argv[] = {
+        "scrcpy",
+        "--record", "file.mkv",
+        "--record-events",
+    };
+
+    bool ok = scrcpy_parse_args(&args, ARRAY_LEN(argv), argv);
+    assert(ok);
+    assert(args.opts.record_events);
+    assert(args.opts.record_path_format == RECORDER_FORMAT_MP4);
+
+    // the event track is only supported in mkv
+    char *argv2[] = {
+        "scrcpy",
+        "--record", "file.mp4",
+        "--record-events",
+    };
+
+    args.opts = (struct scrcpy_options) SCRCPY_OPTIONS_DEFAULT;
+    ok = scrcpy_parse_args(&args, ARRAY_LEN(argv2), argv2);
+    assert(!ok);
 }
 
 int main(void) {
@@ -124,5 +250,7 @@ int main(void) {
     test_flag_help();
     test_options();
     test_options2();
+    test_headless();
+    test_record_events();
     return 0;
 };
@@ -0,0 +1,179 @@
+#include <assert.h>
+#include <string.h>
+#include <libavutil/frame.h>
+
+#include "frame_converter.h"
+
+// create a YUV420P frame filled with a single color
+static AVFrame *create_frame(int width, int height, uint8_t y, uint8_t u,
+                             uint8_t v) {
+    AVFrame *frame = av_frame_alloc();
+    assert(frame);
+    frame->format = AV_PIX_FMT_YUV420P;
+    frame->width = width;
+    frame->height = height;
+    int r = av_frame_get_buffer(frame, 32);
+    assert(!r);
+    (void) r;
+
+    for (int i = 0; i < height; ++i) {
+        memset(frame->data[0] + i * frame->linesize[0], y, width);
+    }
+    for (int i = 0; i < height / 2; ++i) {
+        memset(frame->data[1] + i * frame->linesize[1], u, width / 2);
+        memset(frame->data[2] + i * frame->linesize[2], v, width / 2);
+    }
+    return frame;
+}
+
+static void test_convert_formats(void) {
+    struct frame_converter fc;
+    frame_converter_init(&fc);
+
+    // red (BT.601 limited range)
+    AVFrame *src = create_frame(64, 48, 81, 90, 240);
+    src->pts = 42;
+
+    AVFrame *dst = av_frame_alloc();
+    assert(dst);
+
+    bool ok = frame_converter_convert(&fc, src, AV_PIX_FMT_RGB24, 0, 0, dst);
+    assert(ok);
+    assert(dst->width == 64);
+    assert(dst->height == 48);
+    assert(dst->format == AV_PIX_FMT_RGB24);
+    assert(dst->pts == 42);
+    assert(dst->linesize[0] % FRAME_CONVERTER_ALIGN == 0);
+    const uint8_t *pixel = dst->data[0] + 47 * dst->linesize[0] + 63 * 3;
+    assert(pixel[0] > 240 && pixel[1] < 16 && pixel[2] < 16);
+    av_frame_unref(dst);
+
+    ok = frame_converter_convert(&fc, src, AV_PIX_FMT_BGR24, 0, 0, dst);
+    assert(ok);
+    pixel = dst->data[0];
+    assert(pixel[0] < 16 && pixel[1] < 16 && pixel[2] > 240);
+    av_frame_unref(dst);
+
+    av_frame_free(&src);
+
+    // white
+    src = create_frame(64, 48, 235, 128, 128);
+    ok = frame_converter_convert(&fc, src, AV_PIX_FMT_GRAY8, 0, 0, dst);
+    assert(ok);
+    // the luma range may be preserved
+    assert(dst->data[0][0] >= 235);
+    av_frame_unref(dst);
+
+    assert(fc.stats.conversions == 3);
+    assert(fc.stats.cache_misses == 3);
+
+    av_frame_free(&dst);
+    av_frame_free(&src);
+    frame_converter_destroy(&fc);
+}
+
+static void test_convert_downscale(void) {
+    struct frame_converter fc;
+    frame_converter_init(&fc);
+
+    AVFrame *src = create_frame(640, 480, 235, 128, 128);
+    AVFrame *dst = av_frame_alloc();
+    assert(dst);
+
+    bool ok = frame_converter_convert(&fc, src, AV_PIX_FMT_RGB24, 160, 120,
+                                      dst);
+    assert(ok);
+    assert(dst->width == 160);
+    assert(dst->height == 120);
+    const uint8_t *pixel = dst->data[0] + 119 * dst->linesize[0] + 159 * 3;
+    assert(pixel[0] > 250 && pixel[1] > 250 && pixel[2] > 250);
+    av_frame_unref(dst);
+
+    av_frame_free(&dst);
+    av_frame_free(&src);
+    frame_converter_destroy(&fc);
+}
+
+static void test_convert_cache(void) {
+    struct frame_converter fc;
+    frame_converter_init(&fc);
+
+    AVFrame *src = create_frame(64, 48, 128, 128, 128);
+    AVFrame *dst = av_frame_alloc();
+    assert(dst);
+
+    // the same conversion reuses the context
+    for (int i = 0; i < 10; ++i) {
+        bool ok = frame_converter_convert(&fc, src, AV_PIX_FMT_RGB24, 0, 0,
+                                          dst);
+        assert(ok);
+        (void) ok;
+        av_frame_unref(dst);
+    }
+    assert(fc.stats.conversions == 10);
+    assert(fc.stats.cache_misses == 1);
+
+    // alternating conversions fitting in the cache
+    for (int i = 0; i < 10; ++i) {
+        enum AVPixelFormat format = i % 2 ? AV_PIX_FMT_BGR24
+                                          : AV_PIX_FMT_GRAY8;
+        bool ok = frame_converter_convert(&fc, src, format, 0, 0, dst);
+        assert(ok);
+        (void) ok;
+        av_frame_unref(dst);
+    }
+    assert(fc.stats.cache_misses == 3);
+
+    // evict the least recently used conversion (RGB24)
+    for (int i = 1; i <= FRAME_CONVERTER_CACHE_SIZE - 2; ++i) {
+        bool ok = frame_converter_convert(&fc, src, AV_PIX_FMT_GRAY8,
+                                          16 * i, 12 * i, dst);
+        assert(ok);
+        (void) ok;
+        av_frame_unref(dst);
+    }
+    assert(fc.stats.cache_misses == 1 + FRAME_CONVERTER_CACHE_SIZE);
+    bool ok = frame_converter_convert(&fc, src, AV_PIX_FMT_BGR24, 0, 0, dst);
+    assert(ok);
+    av_frame_unref(dst);
+    assert(fc.stats.cache_misses == 1 + FRAME_CONVERTER_CACHE_SIZE);
+    ok = frame_converter_convert(&fc, src, AV_PIX_FMT_RGB24, 0, 0, dst);
+    assert(ok);
+    assert(fc.stats.cache_misses == 2 + FRAME_CONVERTER_CACHE_SIZE);
+
+    // the output frame remains valid after the converter is destroyed
+    frame_converter_destroy(&fc);
+    assert(dst->data[0][0] == dst->data[0][1]);
+    av_frame_unref(dst);
+
+    av_frame_free(&dst);
+    av_frame_free(&src);
+}
+
+static void test_fit_size(void) {
+    int width;
+    int height;
+
+    frame_converter_fit_size(1080, 2400, 0, &width, &height);
+    assert(width == 1080 && height == 2400);
+
+    frame_converter_fit_size(1080, 2400, 3000, &width, &height);
+    assert(width == 1080 && height == 2400);
+
+    frame_converter_fit_size(1080, 2400, 800, &width, &height);
+    assert(width == 360 && height == 800);
+
+    frame_converter_fit_size(2400, 1080, 801, &width, &height);
+    assert(width == 800 && height == 360);
+
+    frame_converter_fit_size(1000, 3, 10, &width, &height);
+    assert(width == 10 && height == 1);
+}
+
+int main(void) {
+    test_convert_formats();
+    test_convert_downscale();
+    test_convert_cache();
+    test_fit_size();
+    return 0;
+}
@@ -0,0 +1,114 @@
+#include <assert.h>
+#include <string.h>
+
+#include "frame_dedup.h"
+
+static AVFrame *create_frame(int width, int height) {
+    AVFrame *frame = av_frame_alloc();
+    assert(frame);
+    frame->format = AV_PIX_FMT_YUV420P;
+    frame->width = width;
+    frame->height = height;
+    int r = av_frame_get_buffer(frame, 32);
+    assert(!r);
+    (void) r;
+
+    int chroma_height = (height + 1) / 2;
+    memset(frame->data[0], 16, frame->linesize[0] * height);
+    memset(frame->data[1], 128, frame->linesize[1] * chroma_height);
+    memset(frame->data[2], 128, frame->linesize[2] * chroma_height);
+    return frame;
+}
+
+static void test_duplicate(void) {
+    struct frame_dedup dedup;
+    frame_dedup_init(&dedup);
+
+    AVFrame *frame = create_frame(100, 50);
+    assert(!frame_dedup_check(&dedup, frame)); // no previous frame
+    assert(frame_dedup_check(&dedup, frame));
+    assert(frame_dedup_check(&dedup, frame));
+    assert(dedup.deduplicated == 2);
+
+    frame_dedup_reset(&dedup);
+    assert(!frame_dedup_check(&dedup, frame));
+    assert(dedup.deduplicated == 2);
+
+    av_frame_free(&frame);
+}
+
+static void test_changes(void) {
+    struct frame_dedup dedup;
+    frame_dedup_init(&dedup);
+
+    AVFrame *frame = create_frame(100, 50);
+    assert(!frame_dedup_check(&dedup, frame));
+
+    // luma change on a sampled row, at the end of the row (not a full word)
+    frame->data[0][2 * frame->linesize[0] + 99] = 17;
+    assert(!frame_dedup_check(&dedup, frame));
+    assert(frame_dedup_check(&dedup, frame));
+
+    // chroma changes (all the chroma rows are sampled)
+    frame->data[1][3 * frame->linesize[1]] = 0;
+    assert(!frame_dedup_check(&dedup, frame));
+    frame->data[2][24 * frame->linesize[2] + 49] = 0;
+    assert(!frame_dedup_check(&dedup, frame));
+    assert(frame_dedup_check(&dedup, frame));
+
+    assert(dedup.deduplicated == 2);
+    av_frame_free(&frame);
+}
+
+static void test_padding_ignored(void) {
+    struct frame_dedup dedup;
+    frame_dedup_init(&dedup);
+
+    AVFrame *frame = create_frame(100, 50);
+    assert(frame->linesize[0] > 100);
+    assert(!frame_dedup_check(&dedup, frame));
+
+    // the bytes after the visible width are not part of the frame
+    frame->data[0][frame->linesize[0] - 1] = 42;
+    assert(frame_dedup_check(&dedup, frame));
+
+    av_frame_free(&frame);
+}
+
+static void test_size_change(void) {
+    struct frame_dedup dedup;
+    frame_dedup_init(&dedup);
+
+    // same content (only black pixels), but rotated
+    AVFrame *portrait = create_frame(48, 64);
+    AVFrame *landscape = create_frame(64, 48);
+    assert(!frame_dedup_check(&dedup, portrait));
+    assert(!frame_dedup_check(&dedup, landscape));
+    assert(!frame_dedup_check(&dedup, portrait));
+    assert(dedup.deduplicated == 0);
+
+    av_frame_free(&portrait);
+    av_frame_free(&landscape);
+}
+
+static void test_full_hash(void) {
+    AVFrame *frame = create_frame(100, 50);
+    uint64_t sampled = frame_dedup_hash(frame);
+    uint64_t full = frame_dedup_hash_full(frame);
+
+    // luma change on a row not sampled for deduplication
+    frame->data[0][3 * frame->linesize[0]] = 17;
+    assert(frame_dedup_hash(frame) == sampled);
+    assert(frame_dedup_hash_full(frame) != full);
+
+    av_frame_free(&frame);
+}
+
+int main(void) {
+    test_duplicate();
+    test_changes();
+    test_padding_ignored();
+    test_size_change();
+    test_full_hash();
+    return 0;
+}
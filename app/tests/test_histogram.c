@@ -0,0 +1,77 @@
+#include <assert.h>
+
+#include "util/histogram.h"
+
+static void test_histogram_empty(void) {
+    struct histogram histogram;
+    histogram_init(&histogram);
+
+    assert(histogram.count == 0);
+    assert(histogram_percentile(&histogram, 50) == 0);
+    assert(histogram_percentile(&histogram, 100) == 0);
+}
+
+static void test_histogram_small_values(void) {
+    struct histogram histogram;
+    histogram_init(&histogram);
+
+    // values below HISTOGRAM_SUB_BUCKETS are exact
+    for (uint32_t i = 1; i <= 4; ++i) {
+        histogram_record(&histogram, i);
+    }
+
+    assert(histogram.count == 4);
+    assert(histogram.max == 4);
+    assert(histogram_percentile(&histogram, 0) == 1);
+    assert(histogram_percentile(&histogram, 25) == 1);
+    assert(histogram_percentile(&histogram, 50) == 2);
+    assert(histogram_percentile(&histogram, 75) == 3);
+    assert(histogram_percentile(&histogram, 100) == 4);
+}
+
+static void test_histogram_precision(void) {
+    struct histogram histogram;
+    histogram_init(&histogram);
+
+    for (uint32_t i = 1; i <= 100000; ++i) {
+        histogram_record(&histogram, i);
+    }
+
+    assert(histogram.count == 100000);
+    assert(histogram.max == 100000);
+
+    unsigned percents[] = {1, 50, 95, 99};
+    for (unsigned i = 0; i < sizeof(percents) / sizeof(percents[0]); ++i) {
+        uint32_t expected = percents[i] * 1000;
+        uint32_t value = histogram_percentile(&histogram, percents[i]);
+        // never below the exact value, and within the bucket precision
+        assert(value >= expected);
+        assert(value - expected <= expected / HISTOGRAM_SUB_BUCKETS);
+    }
+
+    assert(histogram_percentile(&histogram, 100) == 100000);
+}
+
+static void test_histogram_large_values(void) {
+    struct histogram histogram;
+    histogram_init(&histogram);
+
+    histogram_record(&histogram, 0);
+    histogram_record(&histogram, UINT32_MAX);
+
+    assert(histogram_percentile(&histogram, 50) == 0);
+    assert(histogram_percentile(&histogram, 100) == UINT32_MAX);
+
+    // reset
+    histogram_init(&histogram);
+    assert(histogram.count == 0);
+    assert(histogram.max == 0);
+}
+
+int main(void) {
+    test_histogram_empty();
+    test_histogram_small_values();
+    test_histogram_precision();
+    test_histogram_large_values();
+    return 0;
+}
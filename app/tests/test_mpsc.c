@@ -0,0 +1,150 @@
+#include <assert.h>
+#include <SDL2/SDL_thread.h>
+#include <SDL2/SDL_timer.h>
+
+#include "util/mpsc.h"
+
+struct int_queue MPSC(int, 8);
+
+static void test_mpsc_fifo(void) {
+    struct int_queue queue;
+    mpsc_init(&queue);
+
+    assert(mpsc_is_empty(&queue));
+
+    int item;
+    bool ok = mpsc_take(&queue, &item);
+    assert(!ok); // the queue is empty
+
+    // several laps, so that the positions wrap around the slots
+    for (int i = 0; i < 20; ++i) {
+        ok = mpsc_push(&queue, 2 * i);
+        assert(ok);
+        ok = mpsc_push(&queue, 2 * i + 1);
+        assert(ok);
+        assert(!mpsc_is_empty(&queue));
+
+        ok = mpsc_take(&queue, &item);
+        assert(ok);
+        assert(item == 2 * i);
+        ok = mpsc_take(&queue, &item);
+        assert(ok);
+        assert(item == 2 * i + 1);
+        assert(mpsc_is_empty(&queue));
+    }
+    (void) ok;
+}
+
+static void test_mpsc_full(void) {
+    struct int_queue queue;
+    mpsc_init(&queue);
+
+    for (int i = 0; i < 8; ++i) {
+        bool ok = mpsc_push(&queue, i);
+        assert(ok);
+        (void) ok;
+    }
+
+    bool ok = mpsc_push(&queue, 42);
+    assert(!ok); // the queue is full
+
+    int item;
+    ok = mpsc_take(&queue, &item);
+    assert(ok);
+    assert(item == 0);
+
+    // one slot is available again
+    ok = mpsc_push(&queue, 42);
+    assert(ok);
+    ok = mpsc_push(&queue, 43);
+    assert(!ok);
+
+    for (int i = 1; i < 8; ++i) {
+        ok = mpsc_take(&queue, &item);
+        assert(ok);
+        assert(item == i);
+    }
+    ok = mpsc_take(&queue, &item);
+    assert(ok);
+    assert(item == 42);
+    assert(mpsc_is_empty(&queue));
+    (void) ok;
+}
+
+#define PRODUCERS 4
+#define ITEMS_PER_PRODUCER 100000
+
+struct shared {
+    struct int_queue queue;
+    struct mpsc_waiter waiter;
+};
+
+struct producer {
+    struct shared *shared;
+    int id;
+};
+
+static int run_producer(void *data) {
+    struct producer *producer = data;
+    struct shared *shared = producer->shared;
+    for (int i = 0; i < ITEMS_PER_PRODUCER; ++i) {
+        // the producer id in the high bits, the sequence in the low bits
+        int item = producer->id << 24 | i;
+        while (!mpsc_push(&shared->queue, item)) {
+            // full, let the consumer run
+            SDL_Delay(0);
+        }
+        mpsc_waiter_notify(&shared->waiter);
+    }
+    return 0;
+}
+
+static void test_mpsc_concurrent(void) {
+    struct shared shared;
+    mpsc_init(&shared.queue);
+    bool ok = mpsc_waiter_init(&shared.waiter);
+    assert(ok);
+    (void) ok;
+
+    struct producer producers[PRODUCERS];
+    SDL_Thread *threads[PRODUCERS];
+    for (int i = 0; i < PRODUCERS; ++i) {
+        producers[i].shared = &shared;
+        producers[i].id = i;
+        threads[i] = SDL_CreateThread(run_producer, "producer", &producers[i]);
+        assert(threads[i]);
+    }
+
+    // the items of each producer are received in order, none is lost
+    int next[PRODUCERS] = {0};
+    for (int count = 0; count < PRODUCERS * ITEMS_PER_PRODUCER; ++count) {
+        int item;
+        while (!mpsc_take(&shared.queue, &item)) {
+            mpsc_waiter_prepare(&shared.waiter);
+            if (!mpsc_is_empty(&shared.queue)) {
+                mpsc_waiter_cancel(&shared.waiter);
+            } else {
+                mpsc_waiter_wait(&shared.waiter);
+            }
+        }
+        int id = item >> 24;
+        assert(id >= 0 && id < PRODUCERS);
+        assert((item & 0xFFFFFF) == next[id]);
+        ++next[id];
+    }
+
+    for (int i = 0; i < PRODUCERS; ++i) {
+        SDL_WaitThread(threads[i], NULL);
+        assert(next[i] == ITEMS_PER_PRODUCER);
+    }
+    assert(mpsc_is_empty(&shared.queue));
+
+    mpsc_waiter_destroy(&shared.waiter);
+}
+
+int main(void) {
+    test_mpsc_fifo();
+    test_mpsc_full();
+    test_mpsc_concurrent();
+    return 0;
+}
@@ -0,0 +1,113 @@
+#include <assert.h>
+#include <string.h>
+
+#include "packet_pool.h"
+
+static void test_packet_pool_reuse(void) {
+    struct packet_pool pool;
+    bool ok = packet_pool_init(&pool);
+    assert(ok);
+
+    AVPacket packet;
+    ok = packet_pool_get(&pool, &packet, 1000);
+    assert(ok);
+    assert(packet.size == 1000);
+    assert(packet.buf);
+    uint8_t *data = packet.data;
+    memset(packet.data, 42, packet.size);
+    av_packet_unref(&packet);
+
+    assert(pool.stats.requests == 1);
+    assert(pool.stats.hits == 0);
+    assert(pool.stats.misses == 1);
+    assert(pool.stats.buffers == 1);
+
+    // same size class, the buffer must be reused
+    ok = packet_pool_get(&pool, &packet, 4000);
+    assert(ok);
+    assert(packet.size == 4000);
+    assert(packet.data == data);
+    assert(pool.stats.requests == 2);
+    assert(pool.stats.hits == 1);
+    assert(pool.stats.misses == 1);
+
+    // the first buffer is still referenced, a new one must be allocated
+    AVPacket other;
+    ok = packet_pool_get(&pool, &other, 10);
+    assert(ok);
+    assert(other.data != data);
+    assert(pool.stats.misses == 2);
+    assert(pool.stats.buffers == 2);
+
+    av_packet_unref(&other);
+    av_packet_unref(&packet);
+
+    packet_pool_destroy(&pool);
+}
+
+static void test_packet_pool_padding(void) {
+    struct packet_pool pool;
+    bool ok = packet_pool_init(&pool);
+    assert(ok);
+
+    AVPacket packet;
+    ok = packet_pool_get(&pool, &packet, 100);
+    assert(ok);
+    // write into the area which will be padding on the next request
+    memset(packet.data, 0xff, 100);
+    av_packet_unref(&packet);
+
+    ok = packet_pool_get(&pool, &packet, 50);
+    assert(ok);
+    for (int i = 0; i < AV_INPUT_BUFFER_PADDING_SIZE; ++i) {
+        assert(packet.data[50 + i] == 0);
+    }
+    av_packet_unref(&packet);
+
+    packet_pool_destroy(&pool);
+}
+
+static void test_packet_pool_oversized(void) {
+    struct packet_pool pool;
+    bool ok = packet_pool_init(&pool);
+    assert(ok);
+
+    size_t max_size = (size_t) 1 << (PACKET_POOL_MIN_SIZE_SHIFT
+                                      + PACKET_POOL_CLASS_COUNT - 1);
+
+    AVPacket packet;
+    ok = packet_pool_get(&pool, &packet, max_size + 1);
+    assert(ok);
+    assert((size_t) packet.size == max_size + 1);
+    assert(pool.stats.oversized == 1);
+    assert(pool.stats.misses == 1);
+    // not allocated from the pool
+    assert(pool.stats.buffers == 0);
+    av_packet_unref(&packet);
+
+    packet_pool_destroy(&pool);
+}
+
+static void test_packet_pool_outlives_pool(void) {
+    struct packet_pool pool;
+    bool ok = packet_pool_init(&pool);
+    assert(ok);
+
+    AVPacket packet;
+    ok = packet_pool_get(&pool, &packet, 100);
+    assert(ok);
+
+    packet_pool_destroy(&pool);
+
+    // the buffer must still be valid
+    memset(packet.data, 0, packet.size);
+    av_packet_unref(&packet);
+}
+
+int main(void) {
+    test_packet_pool_reuse();
+    test_packet_pool_padding();
+    test_packet_pool_oversized();
+    test_packet_pool_outlives_pool();
+    return 0;
+}
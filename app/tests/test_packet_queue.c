@@ -0,0 +1,297 @@
+#include <assert.h>
+#include <SDL2/SDL_thread.h>
+
+#include "packet_queue.h"
+
+static void make_packet(AVPacket *packet, uint8_t value, bool keyframe) {
+    int r = av_new_packet(packet, 16);
+    assert(!r);
+    (void) r;
+    packet->data[0] = value;
+    packet->pts = value;
+    packet->flags = keyframe ? AV_PKT_FLAG_KEY : 0;
+}
+
+// push a new packet (the queue references it)
+static bool push(struct packet_queue *queue, uint8_t value, bool keyframe) {
+    AVPacket packet;
+    make_packet(&packet, value, keyframe);
+    bool ok = packet_queue_push(queue, &packet);
+    av_packet_unref(&packet);
+    return ok;
+}
+
+// push a new config packet (without pts)
+static bool push_config(struct packet_queue *queue, uint8_t value) {
+    AVPacket packet;
+    make_packet(&packet, value, false);
+    packet.pts = AV_NOPTS_VALUE;
+    bool ok = packet_queue_push(queue, &packet);
+    av_packet_unref(&packet);
+    return ok;
+}
+
+static uint8_t take(struct packet_queue *queue) {
+    AVPacket packet;
+    bool ok = packet_queue_take(queue, &packet);
+    assert(ok);
+    (void) ok;
+    uint8_t value = packet.data[0];
+    av_packet_unref(&packet);
+    return value;
+}
+
+static void test_packet_queue_fifo(void) {
+    struct packet_queue queue;
+    bool ok = packet_queue_init(&queue, 3, PACKET_QUEUE_POLICY_BLOCK);
+    assert(ok);
+    // rounded up to a power of 2
+    assert(queue.capacity == 4);
+
+    for (uint8_t i = 0; i < 10; ++i) {
+        ok = push(&queue, 2 * i, i == 0);
+        assert(ok);
+        ok = push(&queue, 2 * i + 1, false);
+        assert(ok);
+        assert(packet_queue_depth(&queue) == 2);
+        assert(take(&queue) == 2 * i);
+        assert(take(&queue) == 2 * i + 1);
+        assert(packet_queue_depth(&queue) == 0);
+    }
+
+    assert(queue.stats.pushed == 20);
+    assert(queue.stats.dropped == 0);
+    assert(queue.stats.max_depth == 2);
+
+    packet_queue_destroy(&queue);
+}
+
+static void test_packet_queue_drop_until_keyframe(void) {
+    struct packet_queue queue;
+    bool ok = packet_queue_init(&queue, 2,
+                                PACKET_QUEUE_POLICY_DROP_UNTIL_KEYFRAME);
+    assert(ok);
+
+    ok = push(&queue, 0, true);
+    assert(ok);
+    ok = push(&queue, 1, false);
+    assert(ok);
+    // full, dropped
+    ok = push(&queue, 2, false);
+    assert(ok);
+    assert(queue.stats.dropped == 1);
+
+    assert(take(&queue) == 0);
+
+    // not full anymore, but still dropped until the next keyframe
+    ok = push(&queue, 3, false);
+    assert(ok);
+    assert(queue.stats.dropped == 2);
+
+    ok = push(&queue, 4, true);
+    assert(ok);
+    ok = push(&queue, 5, false);
+    assert(ok);
+    assert(queue.stats.dropped == 3);
+
+    assert(take(&queue) == 1);
+    assert(take(&queue) == 4);
+
+    // dropping since 5
+    ok = push(&queue, 6, false);
+    assert(ok);
+    assert(queue.stats.dropped == 4);
+
+    ok = push(&queue, 7, true);
+    assert(ok);
+    assert(take(&queue) == 7);
+
+    packet_queue_destroy(&queue);
+}
+
+static void test_packet_queue_drop_oldest(void) {
+    struct packet_queue queue;
+    bool ok = packet_queue_init(&queue, 4, PACKET_QUEUE_POLICY_DROP_OLDEST);
+    assert(ok);
+
+    ok = push(&queue, 0, true);
+    assert(ok);
+    ok = push(&queue, 1, false);
+    assert(ok);
+    ok = push(&queue, 2, false);
+    assert(ok);
+    ok = push(&queue, 3, true);
+    assert(ok);
+
+    // full, the packets preceding the queued keyframe are dropped
+    ok = push(&queue, 4, false);
+    assert(ok);
+    assert(queue.stats.dropped == 3);
+    assert(packet_queue_depth(&queue) == 2);
+
+    assert(take(&queue) == 3);
+    assert(take(&queue) == 4);
+
+    // the remaining packets are unreferenced on destroy
+    ok = push(&queue, 5, false);
+    assert(ok);
+    packet_queue_destroy(&queue);
+}
+
+static void test_packet_queue_drop_oldest_no_keyframe(void) {
+    struct packet_queue queue;
+    bool ok = packet_queue_init(&queue, 2, PACKET_QUEUE_POLICY_DROP_OLDEST);
+    assert(ok);
+
+    ok = push(&queue, 0, true);
+    assert(ok);
+    ok = push(&queue, 1, false);
+    assert(ok);
+
+    // no queued keyframe to resume from, the new packets are dropped until
+    // the next keyframe
+    ok = push(&queue, 2, false);
+    assert(ok);
+    assert(queue.stats.dropped == 1);
+
+    assert(take(&queue) == 0);
+
+    ok = push(&queue, 3, false);
+    assert(ok);
+    assert(queue.stats.dropped == 2);
+
+    ok = push(&queue, 4, true);
+    assert(ok);
+    assert(take(&queue) == 1);
+    assert(take(&queue) == 4);
+
+    packet_queue_destroy(&queue);
+}
+
+static void test_packet_queue_drop_oldest_config(void) {
+    struct packet_queue queue;
+    bool ok = packet_queue_init(&queue, 4, PACKET_QUEUE_POLICY_DROP_OLDEST);
+    assert(ok);
+
+    for (uint8_t i = 0; i < 4; ++i) {
+        ok = push(&queue, i, i == 0);
+        assert(ok);
+    }
+
+    // full, the decoder will resume from the config packet and the IDR
+    ok = push_config(&queue, 4);
+    assert(ok);
+    assert(queue.stats.dropped == 4);
+    ok = push(&queue, 5, true);
+    assert(ok);
+
+    assert(take(&queue) == 4);
+    assert(take(&queue) == 5);
+
+    ok = push_config(&queue, 6);
+    assert(ok);
+    ok = push(&queue, 7, true);
+    assert(ok);
+    ok = push(&queue, 8, false);
+    assert(ok);
+    ok = push(&queue, 9, false);
+    assert(ok);
+
+    // a config packet at the head is never dropped, the new packets are
+    ok = push(&queue, 10, false);
+    assert(ok);
+    assert(queue.stats.dropped == 5);
+
+    assert(take(&queue) == 6);
+
+    // not full anymore, but dropped until the next keyframe
+    ok = push(&queue, 11, false);
+    assert(ok);
+    assert(queue.stats.dropped == 6);
+
+    // a config packet is kept, but does not end the dropping
+    ok = push_config(&queue, 12);
+    assert(ok);
+    ok = push(&queue, 13, false);
+    assert(ok);
+    assert(queue.stats.dropped == 7);
+
+    // full, the packets preceding the queued config packet are dropped
+    ok = push(&queue, 14, true);
+    assert(ok);
+    assert(queue.stats.dropped == 10);
+
+    assert(take(&queue) == 12);
+    assert(take(&queue) == 14);
+
+    packet_queue_destroy(&queue);
+}
+
+static void test_packet_queue_stop(void) {
+    struct packet_queue queue;
+    bool ok = packet_queue_init(&queue, 1, PACKET_QUEUE_POLICY_BLOCK);
+    assert(ok);
+    assert(queue.capacity == 2);
+
+    ok = push(&queue, 0, true);
+    assert(ok);
+    ok = push(&queue, 1, false);
+    assert(ok);
+
+    packet_queue_stop(&queue);
+
+    // must not block
+    ok = push(&queue, 1, false);
+    assert(!ok);
+
+    AVPacket packet;
+    ok = packet_queue_take(&queue, &packet);
+    assert(!ok);
+
+    packet_queue_destroy(&queue);
+}
+
+#define THREADED_COUNT 100000
+
+static int run_consumer(void *data) {
+    struct packet_queue *queue = data;
+    for (unsigned i = 0; i < THREADED_COUNT; ++i) {
+        uint8_t value = take(queue);
+        assert(value == (uint8_t) i);
+        (void) value;
+    }
+    return 0;
+}
+
+static void test_packet_queue_threaded(void) {
+    struct packet_queue queue;
+    bool ok = packet_queue_init(&queue, 4, PACKET_QUEUE_POLICY_BLOCK);
+    assert(ok);
+
+    SDL_Thread *thread = SDL_CreateThread(run_consumer, "consumer", &queue);
+    assert(thread);
+
+    for (unsigned i = 0; i < THREADED_COUNT; ++i) {
+        ok = push(&queue, (uint8_t) i, false);
+        assert(ok);
+    }
+
+    SDL_WaitThread(thread, NULL);
+
+    assert(queue.stats.pushed == THREADED_COUNT);
+    assert(queue.stats.dropped == 0);
+    assert(queue.stats.max_depth <= 4);
+
+    packet_queue_destroy(&queue);
+}
+
+int main(void) {
+    test_packet_queue_fifo();
+    test_packet_queue_drop_until_keyframe();
+    test_packet_queue_drop_oldest();
+    test_packet_queue_drop_oldest_no_keyframe();
+    test_packet_queue_drop_oldest_config();
+    test_packet_queue_stop();
+    test_packet_queue_threaded();
+    return 0;
+}
@@ -0,0 +1,102 @@
+#include <assert.h>
+
+#include "packet_window.h"
+
+static void push(struct packet_window *window, int64_t pts, int size,
+                 bool keyframe) {
+    AVPacket packet;
+    int r = av_new_packet(&packet, size);
+    assert(!r);
+    (void) r;
+    packet.pts = pts;
+    packet.flags = keyframe ? AV_PKT_FLAG_KEY : 0;
+    bool ok = packet_window_push(window, &packet);
+    assert(ok);
+    (void) ok;
+    av_packet_unref(&packet);
+}
+
+static void test_starts_with_keyframe(void) {
+    struct packet_window window;
+    packet_window_init(&window, 2000000);
+    assert(packet_window_is_empty(&window));
+
+    push(&window, AV_NOPTS_VALUE, 30, false); // config packet
+    assert(window.has_config_packet);
+
+    // not decodable without the previous keyframe
+    push(&window, 0, 100, false);
+    assert(window.count == 0);
+    assert(packet_window_is_empty(&window));
+
+    push(&window, 16000, 1000, true);
+    push(&window, 32000, 100, false);
+    assert(window.count == 2);
+    assert(window.bytes == 1100);
+    assert(window.queue.first->packet.pts == 16000);
+
+    packet_window_destroy(&window);
+}
+
+// push 4 GOPs of 3 packets per second
+static void push_gops(struct packet_window *window) {
+    push(window, AV_NOPTS_VALUE, 30, false);
+    for (int i = 0; i < 4; ++i) {
+        int64_t pts = i * 1000000;
+        push(window, pts, 100, true);
+        push(window, pts + 300000, 10, false);
+        push(window, pts + 600000, 10, false);
+    }
+}
+
+static void test_trim_gops(void) {
+    struct packet_window window;
+    packet_window_init(&window, 2000000);
+
+    push_gops(&window);
+
+    // the GOP starting at 1s is the latest one still covering 2 seconds
+    assert(window.queue.first->packet.pts == 1000000);
+    assert(window.count == 9);
+    assert(window.bytes == 360);
+
+    // a new config packet invalidates the whole window
+    push(&window, AV_NOPTS_VALUE, 30, false);
+    assert(window.count == 0);
+    assert(window.bytes == 0);
+    assert(packet_window_is_empty(&window));
+
+    packet_window_destroy(&window);
+}
+
+static void test_current_gop(void) {
+    struct packet_window window;
+    packet_window_init(&window, 0);
+
+    push_gops(&window);
+
+    assert(window.queue.first->packet.pts == 3000000);
+    assert(window.count == 3);
+
+    AVPacket *packets;
+    unsigned count;
+    bool ok = packet_window_ref_packets(&window, &packets, &count);
+    assert(ok);
+    (void) ok;
+    assert(count == 4);
+    assert(packets[0].pts == AV_NOPTS_VALUE);
+    assert(packets[0].size == 30);
+    assert(packets[1].pts == 3000000);
+    assert(packets[1].flags & AV_PKT_FLAG_KEY);
+    assert(packets[3].pts == 3600000);
+    packet_window_release_packets(packets, count);
+
+    packet_window_destroy(&window);
+}
+
+int main(void) {
+    test_starts_with_keyframe();
+    test_trim_gops();
+    test_current_gop();
+    return 0;
+}
@@ -0,0 +1,85 @@
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "record_io.h"
+
+#define FILENAME "test_record_io.bin"
+
+static void write_bytes(struct record_io *io, uint8_t value, size_t len) {
+    uint8_t buf[1000];
+    memset(buf, value, sizeof(buf));
+    while (len) {
+        size_t n = len < sizeof(buf) ? len : sizeof(buf);
+        bool ok = record_io_write(io, buf, n);
+        assert(ok);
+        (void) ok;
+        len -= n;
+    }
+}
+
+static size_t read_file(uint8_t *data, size_t len) {
+    FILE *file = fopen(FILENAME, "rb");
+    assert(file);
+    size_t r = fread(data, 1, len, file);
+    fclose(file);
+    return r;
+}
+
+static void test_write_and_seek(bool direct, uint32_t sync_interval) {
+    struct record_io_params params = {
+        // rounded up to 8192
+        .buffer_size = 5000,
+        .sync_interval = sync_interval,
+        .direct = direct,
+    };
+    struct record_io_stats stats;
+    record_io_stats_init(&stats);
+
+    struct record_io io;
+    bool ok = record_io_open(&io, FILENAME, &params, &stats);
+    assert(ok);
+
+    // more than all the blocks, so that the muxer must wait for the writer
+    write_bytes(&io, 'a', 100000);
+    assert(record_io_seek(&io, 0, AVSEEK_SIZE) == 100000);
+
+    // rewrite a header, like the mp4 muxer does on close
+    assert(record_io_seek(&io, 10, SEEK_SET) == 10);
+    write_bytes(&io, 'b', 4);
+    assert(record_io_seek(&io, 0, SEEK_END) == 100000);
+    write_bytes(&io, 'c', 10);
+    assert(record_io_seek(&io, 0, SEEK_CUR) == 100010);
+
+    ok = record_io_close(&io);
+    assert(ok);
+    (void) ok;
+
+    assert(stats.bytes == 100014);
+    assert(stats.writes == stats.write_latency.count);
+    assert(stats.writes >= 100000 / 8192 + 3);
+    if (sync_interval) {
+        // at least on close
+        assert(stats.syncs >= 1);
+    } else {
+        assert(!stats.syncs);
+    }
+
+    static uint8_t data[100100];
+    size_t len = read_file(data, sizeof(data));
+    assert(len == 100010);
+    for (size_t i = 0; i < len; ++i) {
+        uint8_t expected = i >= 100000 ? 'c' : i >= 10 && i < 14 ? 'b' : 'a';
+        assert(data[i] == expected);
+        (void) expected;
+    }
+
+    remove(FILENAME);
+}
+
+int main(void) {
+    test_write_and_seek(false, 0);
+    test_write_and_seek(false, 1);
+    test_write_and_seek(true, 0);
+    return 0;
+}
@@ -0,0 +1,209 @@
+#include <assert.h>
+#include <string.h>
+
+#include "recorder.h"
+
+// the recorder thread is not started, so the packets stay in the queue
+
+static bool push(struct recorder *recorder, int64_t pts, int size,
+                 bool keyframe) {
+    AVPacket packet;
+    int r = av_new_packet(&packet, size);
+    assert(!r);
+    (void) r;
+    packet.pts = pts;
+    packet.flags = keyframe ? AV_PKT_FLAG_KEY : 0;
+    bool ok = recorder_push(recorder, &packet);
+    av_packet_unref(&packet);
+    return ok;
+}
+
+static void init_recorder(struct recorder *recorder, unsigned max_packets,
+                          size_t max_bytes,
+                          enum recorder_queue_policy policy) {
+    struct recorder_queue_params params = {
+        .max_packets = max_packets,
+        .max_bytes = max_bytes,
+        .policy = policy,
+    };
+    struct recorder_output_params output_params = {0};
+    struct size frame_size = {1920, 1080};
+    bool ok = recorder_init(recorder, "test.mp4", RECORDER_FORMAT_MP4,
+                            frame_size, &params, &output_params);
+    assert(ok);
+    (void) ok;
+}
+
+static void test_stats(void) {
+    struct recorder recorder;
+    init_recorder(&recorder, 8, 1000, RECORDER_QUEUE_POLICY_BLOCK);
+
+    assert(push(&recorder, AV_NOPTS_VALUE, 30, false)); // config packet
+    assert(push(&recorder, 0, 400, true));
+    assert(push(&recorder, 16000, 100, false));
+
+    struct recorder_stats stats;
+    recorder_get_stats(&recorder, &stats);
+    assert(stats.pushed == 3);
+    assert(stats.dropped == 0);
+    assert(stats.blocked == 0);
+    assert(stats.depth == 3);
+    assert(stats.max_depth == 3);
+    assert(stats.bytes == 530);
+    assert(stats.max_bytes == 530);
+
+    recorder_destroy(&recorder);
+}
+
+static void test_drop_gop_by_packets(void) {
+    struct recorder recorder;
+    init_recorder(&recorder, 3, 1000000, RECORDER_QUEUE_POLICY_DROP_GOP);
+
+    assert(push(&recorder, 0, 100, true));
+    assert(push(&recorder, 1, 100, false));
+    assert(push(&recorder, 2, 100, false));
+    // full, the remaining packets of the GOP are dropped
+    assert(push(&recorder, 3, 100, false));
+    assert(push(&recorder, 4, 100, false));
+    // the queue is still full, this GOP is also dropped
+    assert(push(&recorder, 5, 100, true));
+    assert(push(&recorder, 6, 100, false));
+
+    struct recorder_stats stats;
+    recorder_get_stats(&recorder, &stats);
+    assert(stats.pushed == 3);
+    assert(stats.dropped == 4);
+    assert(stats.depth == 3);
+
+    recorder_destroy(&recorder);
+}
+
+static void test_drop_gop_by_bytes(void) {
+    struct recorder recorder;
+    init_recorder(&recorder, 100, 1000, RECORDER_QUEUE_POLICY_DROP_GOP);
+
+    // a packet larger than max_bytes is accepted in an empty queue
+    assert(push(&recorder, 0, 1500, true));
+    assert(push(&recorder, 1, 10, false));
+
+    struct recorder_stats stats;
+    recorder_get_stats(&recorder, &stats);
+    assert(stats.pushed == 1);
+    assert(stats.dropped == 1);
+    assert(stats.bytes == 1500);
+
+    recorder_destroy(&recorder);
+}
+
+static void test_events(void) {
+    struct recorder_queue_params params = {
+        .max_packets = 2,
+        .max_bytes = 1000000,
+        .policy = RECORDER_QUEUE_POLICY_BLOCK,
+    };
+    struct recorder_output_params output_params = {
+        .events = true,
+    };
+    struct size frame_size = {1920, 1080};
+
+    struct recorder recorder;
+    bool ok = recorder_init(&recorder, "test.mkv", RECORDER_FORMAT_MKV,
+                            frame_size, &params, &output_params);
+    assert(ok);
+
+    assert(push(&recorder, 0, 100, true));
+    assert(recorder_push_event(&recorder, 1000, "{}"));
+    // the queue is full, the event is dropped without blocking
+    assert(recorder_push_event(&recorder, 2000, "{}"));
+
+    struct recorder_stats stats;
+    recorder_get_stats(&recorder, &stats);
+    assert(stats.pushed == 2);
+    assert(stats.dropped == 1);
+    assert(stats.bytes == 102);
+
+    recorder_destroy(&recorder);
+
+    // no event track in mp4
+    ok = recorder_init(&recorder, "test.mp4", RECORDER_FORMAT_MP4,
+                       frame_size, &params, &output_params);
+    assert(ok);
+    (void) ok;
+
+    assert(recorder_push_event(&recorder, 1000, "{}"));
+    recorder_get_stats(&recorder, &stats);
+    assert(stats.pushed == 0);
+
+    recorder_destroy(&recorder);
+}
+
+static void test_events_decreasing_pts(void) {
+    struct recorder_queue_params params = {
+        .max_packets = 8,
+        .max_bytes = 1000000,
+        .policy = RECORDER_QUEUE_POLICY_BLOCK,
+    };
+    struct recorder_output_params output_params = {
+        .events = true,
+    };
+    struct size frame_size = {1920, 1080};
+
+    struct recorder recorder;
+    bool ok = recorder_init(&recorder, "test.mkv", RECORDER_FORMAT_MKV,
+                            frame_size, &params, &output_params);
+    assert(ok);
+
+    assert(push(&recorder, 0, 100, true));
+    assert(recorder_push_event(&recorder, 150000, "{}"));
+    // estimated before a delayed video packet, the next event gets a lower pts
+    assert(push(&recorder, 16000, 100, false));
+    assert(recorder_push_event(&recorder, 20000, "{}"));
+    assert(!recorder.failed);
+
+    struct recorder_stats stats;
+    recorder_get_stats(&recorder, &stats);
+    assert(stats.pushed == 4);
+    assert(stats.dropped == 0);
+
+    // the events pts never decrease, so that the muxer accepts them
+    int64_t last_event_pts = AV_NOPTS_VALUE;
+    for (struct record_packet *rec = recorder.queue.first; rec;
+            rec = rec->next) {
+        if (rec->packet.stream_index == RECORDER_EVENT_STREAM_INDEX) {
+            assert(last_event_pts == AV_NOPTS_VALUE
+                    || rec->packet.pts >= last_event_pts);
+            assert(rec->packet.dts == rec->packet.pts);
+            last_event_pts = rec->packet.pts;
+        }
+    }
+    assert(last_event_pts == 150000);
+
+    recorder_destroy(&recorder);
+}
+
+static void check_segment_filename(const char *filename, unsigned index,
+                                   const char *expected) {
+    char *s = recorder_get_segment_filename(filename, index);
+    assert(s);
+    assert(!strcmp(s, expected));
+    SDL_free(s);
+}
+
+static void test_segment_filename(void) {
+    check_segment_filename("file.mp4", 0, "file-000.mp4");
+    check_segment_filename("dir/file.mkv", 12, "dir/file-012.mkv");
+    check_segment_filename("file", 3, "file-003");
+    check_segment_filename("dir.d/file", 1, "dir.d/file-001");
+    check_segment_filename(".mp4", 2, ".mp4-002");
+    check_segment_filename("file.mp4", 1234, "file-1234.mp4");
+}
+
+int main(void) {
+    test_stats();
+    test_drop_gop_by_packets();
+    test_drop_gop_by_bytes();
+    test_events();
+    test_events_decreasing_pts();
+    test_segment_filename();
+    return 0;
+}
@@ -0,0 +1,55 @@
+#include <assert.h>
+#include <string.h>
+#include <time.h>
+
+#include "snapshot.h"
+
+static time_t get_time(void) {
+    struct tm tm = {
+        .tm_year = 2020 - 1900,
+        .tm_mon = 2, // March
+        .tm_mday = 14,
+        .tm_hour = 15,
+        .tm_min = 9,
+        .tm_sec = 26,
+        .tm_isdst = -1,
+    };
+    time_t t = mktime(&tm);
+    assert(t != (time_t) -1);
+    return t;
+}
+
+static void test_format_path(void) {
+    char path[64];
+    bool ok = snapshot_format_path("shot-%t-%n.png", 7, get_time(), path,
+                                   sizeof(path));
+    assert(ok);
+    assert(!strcmp(path, "shot-20200314-150926-007.png"));
+}
+
+static void test_format_path_escape(void) {
+    char path[64];
+    bool ok = snapshot_format_path("%%n%n%x.jpg", 1234, 0, path,
+                                   sizeof(path));
+    assert(ok);
+    // unknown sequences are kept as is
+    assert(!strcmp(path, "%n1234%x.jpg"));
+}
+
+static void test_format_path_too_long(void) {
+    char path[9];
+    bool ok = snapshot_format_path("abc%n.png", 1, 0, path, sizeof(path));
+    assert(!ok);
+
+    // exactly fits, including the null byte
+    ok = snapshot_format_path("a%n.png", 1, 0, path, sizeof(path));
+    assert(ok);
+    assert(!strcmp(path, "a001.png"));
+}
+
+int main(void) {
+    test_format_path();
+    test_format_path_escape();
+    test_format_path_too_long();
+    return 0;
+}
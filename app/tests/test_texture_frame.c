@@ -0,0 +1,126 @@
+#include <assert.h>
+#include <string.h>
+
+#include "texture_frame.h"
+
+static AVFrame *create_frame(int width, int height) {
+    AVFrame *frame = av_frame_alloc();
+    assert(frame);
+    frame->format = AV_PIX_FMT_YUV420P;
+    frame->width = width;
+    frame->height = height;
+    return frame;
+}
+
+static void test_layout(void) {
+    struct texture_frame_allocator allocator;
+    bool ok = texture_frame_allocator_init(&allocator);
+    assert(ok);
+
+    AVFrame *frame = create_frame(100, 50);
+    ok = texture_frame_allocator_get(&allocator, frame, 112, 64, 32);
+    assert(ok);
+
+    // the chroma pitch (half the pitch) must be aligned too
+    assert(frame->linesize[0] == 128);
+    assert(frame->linesize[1] == 64);
+    assert(frame->linesize[2] == 64);
+
+    // Y, V and U planes, contiguous
+    assert(frame->data[0] == frame->buf[0]->data);
+    assert(frame->data[2] == frame->data[0] + 128 * 64);
+    assert(frame->data[1] == frame->data[2] + 64 * 32);
+    assert(frame->extended_data == frame->data);
+
+    struct size size;
+    ok = texture_frame_get_texture_size(frame, &size);
+    assert(ok);
+    assert(size.width == 128);
+    assert(size.height == 64);
+
+    av_frame_free(&frame);
+    texture_frame_allocator_destroy(&allocator);
+    (void) ok;
+}
+
+static void test_odd_padded_height(void) {
+    struct texture_frame_allocator allocator;
+    bool ok = texture_frame_allocator_init(&allocator);
+    assert(ok);
+
+    AVFrame *frame = create_frame(64, 33);
+    ok = texture_frame_allocator_get(&allocator, frame, 64, 33, 16);
+    assert(ok);
+
+    struct size size;
+    ok = texture_frame_get_texture_size(frame, &size);
+    assert(ok);
+    assert(size.width == 64);
+    assert(size.height == 34); // rounded up to even
+
+    av_frame_free(&frame);
+    texture_frame_allocator_destroy(&allocator);
+    (void) ok;
+}
+
+static void test_not_texture_frame(void) {
+    AVFrame *frame = av_frame_alloc();
+    assert(frame);
+    frame->format = AV_PIX_FMT_YUV420P;
+    frame->width = 64;
+    frame->height = 32;
+    int r = av_frame_get_buffer(frame, 32);
+    assert(!r);
+    (void) r;
+
+    // one buffer per plane
+    struct size size;
+    bool ok = texture_frame_get_texture_size(frame, &size);
+    assert(!ok);
+    (void) ok;
+
+    av_frame_free(&frame);
+}
+
+static void test_reuse(void) {
+    struct texture_frame_allocator allocator;
+    bool ok = texture_frame_allocator_init(&allocator);
+    assert(ok);
+
+    AVFrame *frame = create_frame(64, 32);
+    ok = texture_frame_allocator_get(&allocator, frame, 64, 32, 32);
+    assert(ok);
+    uint8_t *data = frame->data[0];
+    av_frame_free(&frame);
+
+    // same size, the buffer must be recycled
+    frame = create_frame(64, 32);
+    ok = texture_frame_allocator_get(&allocator, frame, 64, 32, 32);
+    assert(ok);
+    assert(frame->data[0] == data);
+
+    // new size (for example on device rotation), the previous frame must
+    // remain valid
+    AVFrame *rotated = create_frame(32, 64);
+    ok = texture_frame_allocator_get(&allocator, rotated, 32, 64, 32);
+    assert(ok);
+    struct size size;
+    ok = texture_frame_get_texture_size(rotated, &size);
+    assert(ok);
+    assert(size.width == 64);
+    assert(size.height == 64);
+    memset(frame->data[0], 0, 64 * 32);
+
+    av_frame_free(&frame);
+    av_frame_free(&rotated);
+    texture_frame_allocator_destroy(&allocator);
+    (void) ok;
+}
+
+int main(void) {
+    test_layout();
+    test_odd_padded_height();
+    test_not_texture_frame();
+    test_reuse();
+    return 0;
+}
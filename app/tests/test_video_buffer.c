@@ -0,0 +1,182 @@
+#include <assert.h>
+#include <libavutil/frame.h>
+#include <SDL2/SDL_thread.h>
+
+#include "fps_counter.h"
+#include "video_buffer.h"
+
+// what the decoder does
+static bool offer(struct video_buffer *vb, int64_t pts) {
+    vb->decoding_frame->pts = pts;
+    bool skipped;
+    video_buffer_offer_decoded_frame(vb, &skipped);
+    return skipped;
+}
+
+// what screen_update_frame() does, return -1 if there is no frame
+static int64_t render(struct video_buffer *vb) {
+    const AVFrame *frame = video_buffer_take_rendering_frame(vb);
+    if (!frame) {
+        return -1;
+    }
+    int64_t pts = frame->pts;
+    video_buffer_release_rendered_frame(vb);
+    return pts;
+}
+
+static void assert_frame_counts(struct fps_counter *counter,
+                                unsigned rendered, unsigned skipped) {
+    SDL_LockMutex(counter->mutex);
+    assert(counter->nr_rendered == rendered);
+    assert(counter->nr_skipped == skipped);
+    SDL_UnlockMutex(counter->mutex);
+    (void) rendered;
+    (void) skipped;
+}
+
+static void test_video_buffer_latest(void) {
+    struct fps_counter counter;
+    bool ok = fps_counter_init(&counter, NULL);
+    assert(ok);
+    ok = fps_counter_start(&counter);
+    assert(ok);
+
+    struct video_buffer vb;
+    ok = video_buffer_init(&vb, &counter, false, 1);
+    assert(ok);
+
+    assert(render(&vb) == -1);
+
+    assert(!offer(&vb, 0));
+    assert(render(&vb) == 0);
+    assert(render(&vb) == -1);
+
+    // only the latest frame is rendered
+    assert(!offer(&vb, 1));
+    assert(offer(&vb, 2));
+    assert(offer(&vb, 3));
+    assert(render(&vb) == 3);
+    assert(render(&vb) == -1);
+
+    assert_frame_counts(&counter, 2, 2);
+
+    video_buffer_destroy(&vb);
+    fps_counter_stop(&counter);
+    fps_counter_interrupt(&counter);
+    fps_counter_join(&counter);
+    fps_counter_destroy(&counter);
+}
+
+static void test_video_buffer_ring(void) {
+    struct fps_counter counter;
+    bool ok = fps_counter_init(&counter, NULL);
+    assert(ok);
+    ok = fps_counter_start(&counter);
+    assert(ok);
+
+    struct video_buffer vb;
+    ok = video_buffer_init(&vb, &counter, false, 3);
+    assert(ok);
+
+    // a stall shorter than the ring is absorbed
+    assert(!offer(&vb, 0));
+    assert(!offer(&vb, 1));
+    assert(!offer(&vb, 2));
+    assert(render(&vb) == 0);
+    assert(render(&vb) == 1);
+    assert(render(&vb) == 2);
+    assert(render(&vb) == -1);
+
+    // a longer stall skips the oldest frames
+    for (int64_t pts = 3; pts < 8; ++pts) {
+        assert(offer(&vb, pts) == (pts >= 6));
+    }
+    assert(render(&vb) == 5);
+    assert(render(&vb) == 6);
+    assert(render(&vb) == 7);
+    assert(render(&vb) == -1);
+
+    assert_frame_counts(&counter, 6, 2);
+
+    video_buffer_destroy(&vb);
+    fps_counter_stop(&counter);
+    fps_counter_interrupt(&counter);
+    fps_counter_join(&counter);
+    fps_counter_destroy(&counter);
+}
+
+static void test_video_buffer_rendering_frame_kept(void) {
+    struct fps_counter counter;
+    bool ok = fps_counter_init(&counter, NULL);
+    assert(ok);
+
+    struct video_buffer vb;
+    ok = video_buffer_init(&vb, &counter, false, 1);
+    assert(ok);
+
+    assert(!offer(&vb, 0));
+    const AVFrame *frame = video_buffer_take_rendering_frame(&vb);
+    assert(frame && frame->pts == 0);
+
+    // the frame being rendered is never decoded into while the other slots
+    // are reused (once they are all used, the decoder would wait for the
+    // release)
+    for (int64_t pts = 1; pts < (int64_t) vb.slot_count - 1; ++pts) {
+        offer(&vb, pts);
+        assert(vb.decoding_frame != frame);
+    }
+    assert(frame->pts == 0);
+    video_buffer_release_rendered_frame(&vb);
+
+    video_buffer_destroy(&vb);
+    fps_counter_destroy(&counter);
+}
+
+#define THREADED_COUNT 100000
+
+static int run_producer(void *data) {
+    struct video_buffer *vb = data;
+    for (int64_t pts = 0; pts < THREADED_COUNT; ++pts) {
+        offer(vb, pts);
+    }
+    return 0;
+}
+
+static void test_video_buffer_threaded(bool render_expired_frames) {
+    struct fps_counter counter;
+    bool ok = fps_counter_init(&counter, NULL);
+    assert(ok);
+
+    struct video_buffer vb;
+    ok = video_buffer_init(&vb, &counter, render_expired_frames, 4);
+    assert(ok);
+
+    SDL_Thread *thread = SDL_CreateThread(run_producer, "producer", &vb);
+    assert(thread);
+
+    // the frames are rendered in order, and none is skipped if expired
+    // frames must be rendered
+    int64_t last = -1;
+    while (last != THREADED_COUNT - 1) {
+        int64_t pts = render(&vb);
+        if (pts != -1) {
+            assert(pts > last);
+            assert(!render_expired_frames || pts == last + 1);
+            last = pts;
+        }
+    }
+
+    SDL_WaitThread(thread, NULL);
+
+    video_buffer_destroy(&vb);
+    fps_counter_destroy(&counter);
+}
+
+int main(void) {
+    test_video_buffer_latest();
+    test_video_buffer_ring();
+    test_video_buffer_rendering_frame_kept();
+    test_video_buffer_threaded(false);
+    test_video_buffer_threaded(true);
+    return 0;
+}
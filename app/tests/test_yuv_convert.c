@@ -0,0 +1,177 @@
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <libavutil/frame.h>
+
+#include "yuv_convert.h"
+
+static AVFrame *create_frame(int width, int height) {
+    AVFrame *frame = av_frame_alloc();
+    assert(frame);
+    frame->format = AV_PIX_FMT_YUV420P;
+    frame->width = width;
+    frame->height = height;
+    int r = av_frame_get_buffer(frame, 32);
+    assert(!r);
+    (void) r;
+    return frame;
+}
+
+static void fill_plane(uint8_t *data, int linesize, int width, int height,
+                       uint8_t value) {
+    for (int y = 0; y < height; ++y) {
+        memset(data + y * linesize, value, width);
+    }
+}
+
+static void fill_frame(AVFrame *frame, uint8_t y, uint8_t u, uint8_t v) {
+    int cw = (frame->width + 1) / 2;
+    int ch = (frame->height + 1) / 2;
+    fill_plane(frame->data[0], frame->linesize[0], frame->width,
+               frame->height, y);
+    fill_plane(frame->data[1], frame->linesize[1], cw, ch, u);
+    fill_plane(frame->data[2], frame->linesize[2], cw, ch, v);
+}
+
+static void fill_random(AVFrame *frame) {
+    int cw = (frame->width + 1) / 2;
+    int ch = (frame->height + 1) / 2;
+    for (int y = 0; y < frame->height; ++y) {
+        for (int x = 0; x < frame->width; ++x) {
+            frame->data[0][y * frame->linesize[0] + x] = rand();
+        }
+    }
+    for (int p = 1; p < 3; ++p) {
+        for (int y = 0; y < ch; ++y) {
+            for (int x = 0; x < cw; ++x) {
+                frame->data[p][y * frame->linesize[p] + x] = rand();
+            }
+        }
+    }
+}
+
+static void test_colors(void) {
+    AVFrame *frame = create_frame(8, 2);
+    uint8_t out[8 * 2 * 4];
+
+    // black
+    fill_frame(frame, 16, 128, 128);
+    bool ok = yuv_convert_with_impl(YUV_CONVERT_IMPL_SCALAR, frame,
+                                    YUV_CONVERT_FORMAT_RGBA, 2, out, 16);
+    assert(ok);
+    assert(out[0] == 0 && out[1] == 0 && out[2] == 0 && out[3] == 255);
+
+    // white
+    fill_frame(frame, 235, 128, 128);
+    ok = yuv_convert_with_impl(YUV_CONVERT_IMPL_SCALAR, frame,
+                               YUV_CONVERT_FORMAT_GRAY8, 1, out, 8);
+    assert(ok);
+    assert(out[0] == 255);
+
+    // red
+    fill_frame(frame, 81, 90, 240);
+    ok = yuv_convert_with_impl(YUV_CONVERT_IMPL_SCALAR, frame,
+                               YUV_CONVERT_FORMAT_RGB24, 1, out, 24);
+    assert(ok);
+    assert(out[0] >= 253 && out[1] <= 2 && out[2] <= 2);
+    ok = yuv_convert_with_impl(YUV_CONVERT_IMPL_SCALAR, frame,
+                               YUV_CONVERT_FORMAT_BGR24, 1, out, 24);
+    assert(ok);
+    assert(out[0] <= 2 && out[1] <= 2 && out[2] >= 253);
+    (void) ok;
+
+    av_frame_free(&frame);
+}
+
+static void test_downscale_average(void) {
+    AVFrame *frame = create_frame(4, 4);
+    fill_frame(frame, 16, 128, 128);
+    // a white 2x2 block in a black 4x4 block
+    frame->data[0][0] = 235;
+    frame->data[0][1] = 235;
+    frame->data[0][frame->linesize[0]] = 235;
+    frame->data[0][frame->linesize[0] + 1] = 235;
+
+    uint8_t out[4];
+    bool ok = yuv_convert_with_impl(YUV_CONVERT_IMPL_SCALAR, frame,
+                                    YUV_CONVERT_FORMAT_GRAY8, 2, out, 2);
+    assert(ok);
+    assert(out[0] == 255 && out[1] == 0 && out[2] == 0 && out[3] == 0);
+
+    ok = yuv_convert_with_impl(YUV_CONVERT_IMPL_SCALAR, frame,
+                               YUV_CONVERT_FORMAT_GRAY8, 4, out, 1);
+    assert(ok);
+    (void) ok;
+    // luma 71 (the average of 235, 16, 16 and 16 rounded up at each step)
+    assert(out[0] == 64);
+
+    av_frame_free(&frame);
+}
+
+// every implementation must produce exactly the scalar output
+static void test_impls_match_scalar(void) {
+    static const int sizes[][2] = {
+        {64, 32},
+        {100, 36},
+        {37, 21}, // odd dimensions
+        {1280, 8},
+        {18, 4}, // just above one SIMD iteration
+    };
+    static const enum yuv_convert_format formats[] = {
+        YUV_CONVERT_FORMAT_RGB24,
+        YUV_CONVERT_FORMAT_BGR24,
+        YUV_CONVERT_FORMAT_RGBA,
+        YUV_CONVERT_FORMAT_GRAY8,
+    };
+
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s) {
+        AVFrame *frame = create_frame(sizes[s][0], sizes[s][1]);
+        fill_random(frame);
+
+        for (size_t f = 0; f < sizeof(formats) / sizeof(formats[0]); ++f) {
+            for (int factor = 1; factor <= 4; factor *= 2) {
+                int width = frame->width / factor;
+                int height = frame->height / factor;
+                int linesize = width * 4 + 7; // padded
+                // canary after the last line
+                size_t size = (size_t) linesize * height + 16;
+                uint8_t *expected = malloc(size);
+                uint8_t *actual = malloc(size);
+                assert(expected && actual);
+                memset(expected, 0xa5, size);
+
+                bool ok = yuv_convert_with_impl(YUV_CONVERT_IMPL_SCALAR,
+                                                frame, formats[f], factor,
+                                                expected, linesize);
+                assert(ok);
+
+                for (int impl = YUV_CONVERT_IMPL_SCALAR + 1;
+                        impl < YUV_CONVERT_IMPL_COUNT; ++impl) {
+                    if (!yuv_convert_impl_available(impl)) {
+                        continue;
+                    }
+                    memset(actual, 0xa5, size);
+                    ok = yuv_convert_with_impl(impl, frame, formats[f],
+                                               factor, actual, linesize);
+                    assert(ok);
+                    // including the padding and the canary (nothing is
+                    // written past the last pixel of each line)
+                    assert(!memcmp(expected, actual, size));
+                }
+                (void) ok;
+
+                free(expected);
+                free(actual);
+            }
+        }
+
+        av_frame_free(&frame);
+    }
+}
+
+int main(void) {
+    test_colors();
+    test_downscale_average();
+    test_impls_match_scalar();
+    return 0;
+}
@@ -0,0 +1,592 @@
+// Fake device server, streaming a recorded H.264 (Annex B) file to a scrcpy
+// client over loopback, exactly as the Java server does:
+//  - connect the video socket then the control socket to the client port
+//    (like "adb reverse");
+//  - send the device name and the frame size (see DesktopConnection.send());
+//  - send each packet prefixed by the 12-byte meta header (pts and length),
+//    the SPS/PPS being sent as a config packet (without pts).
+//
+// It allows to run the client without any device, adb or Java server:
+//
+//     scrcpy --external-server &
+//     replay_server --fps 60 capture.h264
+//
+// The client exits once the whole file has been streamed.
+//
+// With --raw, the file is a session captured by "scrcpy --record-raw": it
+// already contains the device info and the meta headers, so it is replayed
+// verbatim, with its original timestamps.
+
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <SDL2/SDL.h>
+
+#include "config.h"
+#include "common.h"
+#include "util/buffer_util.h"
+#include "util/log.h"
+#include "util/net.h"
+#include "util/str_util.h"
+
+#define IPV4_LOCALHOST 0x7F000001
+#define DEVICE_NAME_FIELD_LENGTH 64
+#define DEVICE_INFO_SIZE (DEVICE_NAME_FIELD_LENGTH + 4)
+#define HEADER_SIZE 12
+#define NO_PTS UINT64_C(-1)
+// timestamps used when streaming as fast as possible
+#define DEFAULT_PTS_FPS 60
+
+struct replay_options {
+    const char *filename;
+    const char *device_name;
+    uint16_t port;
+    struct size size;
+    unsigned fps; // 0 means as fast as possible
+    unsigned loop; // 0 means infinite
+    bool raw;
+};
+
+struct replay_packet {
+    size_t offset;
+    size_t len;
+    bool config;
+    uint64_t pts; // only for raw captures
+};
+
+struct replay {
+    uint8_t *data;
+    size_t len;
+    struct replay_packet *packets;
+    size_t packet_count;
+    size_t frame_count; // non-config packets
+    const uint8_t *device_info; // only for raw captures
+};
+
+static void
+print_usage(const char *arg0) {
+    fprintf(stderr,
+            "Usage: %s [options] file.h264\n"
+            "       %s --raw [options] file.raw\n"
+            "\n"
+            "Options:\n"
+            "\n"
+            "    --fps value\n"
+            "        Stream at the given frame rate, or as fast as possible if\n"
+            "        0 (timestamps are then generated for %d fps).\n"
+            "        Default is 60.\n"
+            "\n"
+            "    --loop count\n"
+            "        Stream the file count times (0 for infinite).\n"
+            "        Default is 1.\n"
+            "\n"
+            "    --name text\n"
+            "        Set the device name sent to the client.\n"
+            "        Default is \"replay\".\n"
+            "\n"
+            "    -p, --port port\n"
+            "        Set the TCP port the client listens on.\n"
+            "        Default is %d.\n"
+            "\n"
+            "    --raw\n"
+            "        Read a session captured by \"scrcpy --record-raw\" instead\n"
+            "        of an H.264 stream. The captured device info and\n"
+            "        timestamps are sent unchanged (--name and --size are\n"
+            "        ignored), and the packets are streamed at their original\n"
+            "        rate (or as fast as possible if --fps is 0, any other\n"
+            "        value is ignored).\n"
+            "\n"
+            "    --size widthxheight\n"
+            "        Set the frame size sent to the client (the actual size is\n"
+            "        read from the stream by the decoder).\n"
+            "        Default is 1920x1080.\n",
+            arg0, arg0, DEFAULT_PTS_FPS, DEFAULT_LOCAL_PORT);
+}
+
+static bool
+parse_uint(const char *s, unsigned *out, unsigned max, const char *name) {
+    long value;
+    if (!parse_integer(s, &value) || value < 0 || (unsigned long) value > max) {
+        LOGE("Could not parse %s: %s", name, s);
+        return false;
+    }
+    *out = value;
+    return true;
+}
+
+static bool
+parse_size(const char *s, struct size *size) {
+    unsigned width;
+    unsigned height;
+    if (sscanf(s, "%ux%u", &width, &height) != 2 || !width || !height
+            || width > 0xFFFF || height > 0xFFFF) {
+        LOGE("Could not parse size: %s", s);
+        return false;
+    }
+    size->width = width;
+    size->height = height;
+    return true;
+}
+
+#define OPT_FPS  1000
+#define OPT_LOOP 1001
+#define OPT_NAME 1002
+#define OPT_SIZE 1003
+#define OPT_RAW  1004
+
+static bool
+parse_args(struct replay_options *opts, int argc, char *argv[]) {
+    static const struct option long_options[] = {
+        {"fps",  required_argument, NULL, OPT_FPS},
+        {"help", no_argument,       NULL, 'h'},
+        {"loop", required_argument, NULL, OPT_LOOP},
+        {"name", required_argument, NULL, OPT_NAME},
+        {"port", required_argument, NULL, 'p'},
+        {"raw",  no_argument,       NULL, OPT_RAW},
+        {"size", required_argument, NULL, OPT_SIZE},
+        {NULL,   0,                 NULL, 0},
+    };
+
+    int c;
+    unsigned value;
+    while ((c = getopt_long(argc, argv, "hp:", long_options, NULL)) != -1) {
+        switch (c) {
+            case OPT_FPS:
+                if (!parse_uint(optarg, &opts->fps, 1000, "fps")) {
+                    return false;
+                }
+                break;
+            case 'h':
+                print_usage(argv[0]);
+                exit(0);
+            case OPT_LOOP:
+                if (!parse_uint(optarg, &opts->loop, 0x7FFFFFFF, "loop")) {
+                    return false;
+                }
+                break;
+            case OPT_NAME:
+                opts->device_name = optarg;
+                break;
+            case 'p':
+                if (!parse_uint(optarg, &value, 0xFFFF, "port")) {
+                    return false;
+                }
+                opts->port = value;
+                break;
+            case OPT_RAW:
+                opts->raw = true;
+                break;
+            case OPT_SIZE:
+                if (!parse_size(optarg, &opts->size)) {
+                    return false;
+                }
+                break;
+            default:
+                return false;
+        }
+    }
+
+    if (optind != argc - 1) {
+        print_usage(argv[0]);
+        return false;
+    }
+    opts->filename = argv[optind];
+    return true;
+}
+
+static bool
+read_file(const char *filename, uint8_t **data, size_t *len) {
+    FILE *file = fopen(filename, "rb");
+    if (!file) {
+        LOGE("Could not open %s", filename);
+        return false;
+    }
+
+    size_t capacity = 1 << 20;
+    size_t size = 0;
+    uint8_t *buf = malloc(capacity);
+    while (buf) {
+        size += fread(buf + size, 1, capacity - size, file);
+        if (size < capacity) {
+            break;
+        }
+        capacity *= 2;
+        uint8_t *tmp = realloc(buf, capacity);
+        if (!tmp) {
+            free(buf);
+        }
+        buf = tmp;
+    }
+
+    bool ok = buf && !ferror(file);
+    fclose(file);
+    if (!ok) {
+        LOGE("Could not read %s", filename);
+        free(buf);
+        return false;
+    }
+
+    *data = buf;
+    *len = size;
+    return true;
+}
+
+// return the position of the next start code (00 00 01) at or after pos, or
+// len if there is none
+static size_t
+find_start_code(const uint8_t *data, size_t len, size_t pos) {
+    for (size_t i = pos; i + 3 <= len; ++i) {
+        if (!data[i] && !data[i + 1] && data[i + 2] == 1) {
+            return i;
+        }
+    }
+    return len;
+}
+
+static bool
+add_packet(struct replay *replay, size_t *capacity, size_t offset, size_t end,
+           bool config, uint64_t pts) {
+    if (replay->packet_count == *capacity) {
+        *capacity = *capacity ? *capacity * 2 : 1024;
+        struct replay_packet *packets =
+            realloc(replay->packets, *capacity * sizeof(*packets));
+        if (!packets) {
+            LOGC("Could not allocate packets");
+            return false;
+        }
+        replay->packets = packets;
+    }
+
+    struct replay_packet *packet = &replay->packets[replay->packet_count++];
+    packet->offset = offset;
+    packet->len = end - offset;
+    packet->config = config;
+    packet->pts = pts;
+    if (!config) {
+        ++replay->frame_count;
+    }
+    return true;
+}
+
+// split the Annex B stream into packets as produced by MediaCodec: the
+// SPS/PPS in a config packet, then one packet per access unit
+static bool
+split_packets(struct replay *replay) {
+    const uint8_t *data = replay->data;
+    size_t len = replay->len;
+    size_t capacity = 0;
+
+    size_t start = find_start_code(data, len, 0);
+    if (start == len) {
+        LOGE("No H.264 start code found");
+        return false;
+    }
+
+    bool has_current = false;
+    bool current_config = false;
+    bool current_has_slice = false;
+    size_t current_offset = 0;
+
+    size_t nal = start;
+    while (nal < len) {
+        // include the leading zero byte of 4-byte start codes in the previous
+        // NAL unit, it does not matter for the decoder
+        size_t payload = nal + 3;
+        size_t next = find_start_code(data, len, payload);
+        if (payload == len) {
+            break;
+        }
+
+        uint8_t type = data[payload] & 0x1f;
+        bool config = type == 7 || type == 8; // SPS or PPS
+        bool slice = type == 1 || type == 5;
+        // first_mb_in_slice is the first field of the slice header, encoded
+        // as ue(v): its value is 0 if the first bit is 1
+        bool first_slice = slice && payload + 1 < len
+                        && (data[payload + 1] & 0x80);
+        // SEI and access unit delimiter start a new access unit
+        bool new_access_unit = config != current_config
+                            || (current_has_slice
+                                && (first_slice || type == 6 || type == 9));
+
+        if (has_current && new_access_unit) {
+            if (!add_packet(replay, &capacity, current_offset, nal,
+                            current_config, NO_PTS)) {
+                return false;
+            }
+            has_current = false;
+        }
+
+        if (!has_current) {
+            has_current = true;
+            current_config = config;
+            current_has_slice = false;
+            current_offset = nal;
+        }
+        current_has_slice |= slice;
+
+        nal = next;
+    }
+
+    if (has_current && !add_packet(replay, &capacity, current_offset, len,
+                                   current_config, NO_PTS)) {
+        return false;
+    }
+
+    if (!replay->frame_count) {
+        LOGE("No frame found");
+        return false;
+    }
+
+    return true;
+}
+
+// parse a raw session capture: the device info followed by the packets, each
+// prefixed by its meta header
+static bool
+parse_raw_packets(struct replay *replay) {
+    const uint8_t *data = replay->data;
+    size_t len = replay->len;
+    size_t capacity = 0;
+
+    if (len < DEVICE_INFO_SIZE) {
+        LOGE("Raw capture too short");
+        return false;
+    }
+    replay->device_info = data;
+
+    size_t pos = DEVICE_INFO_SIZE;
+    while (len - pos >= HEADER_SIZE) {
+        uint64_t pts = buffer_read64be(&data[pos]);
+        uint32_t packet_len = buffer_read32be(&data[pos + 8]);
+        pos += HEADER_SIZE;
+        if (packet_len > len - pos) {
+            // the capture was interrupted in the middle of a packet
+            LOGW("Ignoring truncated packet at the end of the capture");
+            pos -= HEADER_SIZE;
+            break;
+        }
+        if (!add_packet(replay, &capacity, pos, pos + packet_len,
+                        pts == NO_PTS, pts)) {
+            return false;
+        }
+        pos += packet_len;
+    }
+
+    if (pos != len) {
+        LOGW("Ignoring %" PRIu64 " trailing bytes", (uint64_t) (len - pos));
+    }
+
+    if (!replay->frame_count) {
+        LOGE("No frame found");
+        return false;
+    }
+
+    return true;
+}
+
+// return the duration of one iteration of a raw capture (in microseconds),
+// used to offset the timestamps when looping
+static uint64_t
+raw_duration(const struct replay *replay) {
+    uint64_t first = NO_PTS;
+    uint64_t last = 0;
+    for (size_t i = 0; i < replay->packet_count; ++i) {
+        uint64_t pts = replay->packets[i].pts;
+        if (pts != NO_PTS) {
+            if (first == NO_PTS) {
+                first = pts;
+            }
+            last = pts;
+        }
+    }
+    // add one frame interval (estimated) so that two iterations do not
+    // overlap
+    uint64_t interval = replay->frame_count > 1
+                      ? (last - first) / (replay->frame_count - 1)
+                      : 1000000 / DEFAULT_PTS_FPS;
+    return last - first + interval;
+}
+
+static bool
+send_device_info(socket_t socket, const char *device_name, struct size size) {
+    uint8_t buf[DEVICE_INFO_SIZE] = {0};
+    strncpy((char *) buf, device_name, DEVICE_NAME_FIELD_LENGTH - 1);
+    buffer_write16be(&buf[DEVICE_NAME_FIELD_LENGTH], size.width);
+    buffer_write16be(&buf[DEVICE_NAME_FIELD_LENGTH + 2], size.height);
+    return net_send_all(socket, buf, sizeof(buf)) >= 0;
+}
+
+static bool
+send_packet(socket_t socket, const uint8_t *data, size_t len, uint64_t pts) {
+    uint8_t header[HEADER_SIZE];
+    buffer_write64be(header, pts);
+    buffer_write32be(&header[8], len);
+    return net_send_all(socket, header, HEADER_SIZE) >= 0
+        && net_send_all(socket, data, len) >= 0;
+}
+
+// the client sends control messages, read them so that it never blocks
+static int
+run_control_drain(void *data) {
+    socket_t socket = *(socket_t *) data;
+    char buf[4096];
+    while (net_recv(socket, buf, sizeof(buf)) > 0) {
+        // discard
+    }
+    return 0;
+}
+
+static void
+wait_until(uint64_t deadline) {
+    uint64_t freq = SDL_GetPerformanceFrequency();
+    for (;;) {
+        uint64_t now = SDL_GetPerformanceCounter();
+        if (now >= deadline) {
+            return;
+        }
+        uint32_t ms = (deadline - now) * 1000 / freq;
+        if (ms) {
+            SDL_Delay(ms);
+        }
+    }
+}
+
+static bool
+stream(const struct replay *replay, const struct replay_options *opts,
+       socket_t socket) {
+    unsigned pts_fps = opts->fps ? opts->fps : DEFAULT_PTS_FPS;
+    uint64_t freq = SDL_GetPerformanceFrequency();
+    uint64_t start = SDL_GetPerformanceCounter();
+
+    // for raw captures, the original timestamps are used both for pacing and
+    // as is (offset on each loop)
+    uint64_t raw_first_pts = NO_PTS;
+    uint64_t raw_loop_duration = 0;
+    if (opts->raw) {
+        for (size_t j = 0; j < replay->packet_count; ++j) {
+            if (!replay->packets[j].config) {
+                raw_first_pts = replay->packets[j].pts;
+                break;
+            }
+        }
+        raw_loop_duration = raw_duration(replay);
+    }
+
+    uint64_t frames = 0;
+    uint64_t bytes = 0;
+    for (unsigned i = 0; !opts->loop || i < opts->loop; ++i) {
+        for (size_t j = 0; j < replay->packet_count; ++j) {
+            const struct replay_packet *packet = &replay->packets[j];
+            uint64_t pts = NO_PTS;
+            if (!packet->config) {
+                if (opts->raw) {
+                    pts = packet->pts + i * raw_loop_duration;
+                    if (opts->fps) {
+                        wait_until(start + (pts - raw_first_pts) * freq
+                                           / 1000000);
+                    }
+                } else {
+                    if (opts->fps) {
+                        wait_until(start + frames * freq / opts->fps);
+                    }
+                    pts = frames * 1000000 / pts_fps;
+                }
+                ++frames;
+            }
+            if (!send_packet(socket, replay->data + packet->offset,
+                             packet->len, pts)) {
+                LOGE("Could not send packet (client disconnected?)");
+                return false;
+            }
+            bytes += HEADER_SIZE + packet->len;
+        }
+    }
+
+    double sec = (double) (SDL_GetPerformanceCounter() - start) / freq;
+    LOGI("Streamed %" PRIu64 " frames (%" PRIu64 " bytes) in %.3f s "
+         "(%.1f fps)", frames, bytes, sec, frames / sec);
+    return true;
+}
+
+int
+main(int argc, char *argv[]) {
+    struct replay_options opts = {
+        .device_name = "replay",
+        .port = DEFAULT_LOCAL_PORT,
+        .size = {1920, 1080},
+        .fps = 60,
+        .loop = 1,
+    };
+    if (!parse_args(&opts, argc, argv)) {
+        return 1;
+    }
+
+    SDL_SetMainReady();
+    SDL_LogSetAllPriority(SDL_LOG_PRIORITY_INFO);
+
+    struct replay replay = {0};
+    if (!read_file(opts.filename, &replay.data, &replay.len)) {
+        return 1;
+    }
+
+    int ret = 1;
+    if (opts.raw ? !parse_raw_packets(&replay) : !split_packets(&replay)) {
+        goto end;
+    }
+    LOGI("%s: %" PRIu64 " frames, %" PRIu64 " config packets", opts.filename,
+         (uint64_t) replay.frame_count,
+         (uint64_t) (replay.packet_count - replay.frame_count));
+
+    if (!net_init()) {
+        goto end;
+    }
+
+    socket_t video_socket = net_connect(IPV4_LOCALHOST, opts.port, 0);
+    if (video_socket == INVALID_SOCKET) {
+        LOGE("Could not connect to the client on port %" PRIu16, opts.port);
+        goto end_net;
+    }
+
+    socket_t control_socket = net_connect(IPV4_LOCALHOST, opts.port, 0);
+    if (control_socket == INVALID_SOCKET) {
+        LOGE("Could not connect the control socket");
+        goto end_video_socket;
+    }
+
+    SDL_Thread *drain = SDL_CreateThread(run_control_drain, "control",
+                                         &control_socket);
+    if (!drain) {
+        LOGC("Could not start control thread");
+        goto end_control_socket;
+    }
+
+    bool info_sent = replay.device_info
+                   ? net_send_all(video_socket, replay.device_info,
+                                  DEVICE_INFO_SIZE) >= 0
+                   : send_device_info(video_socket, opts.device_name,
+                                      opts.size);
+    if (!info_sent) {
+        LOGE("Could not send device info");
+    } else if (stream(&replay, &opts, video_socket)) {
+        ret = 0;
+    }
+
+    // the client stops on end of stream, which closes the control socket
+    net_shutdown(video_socket, SHUT_RDWR);
+    SDL_WaitThread(drain, NULL);
+
+end_control_socket:
+    net_close(control_socket);
+end_video_socket:
+    net_close(video_socket);
+end_net:
+    net_cleanup();
+end:
+    free(replay.packets);
+    free(replay.data);
+    return ret;
+}